@@ -9,23 +9,44 @@
 #include <math.h>
 #include "deviceConfig.h"
 #include "bufferOutput.h"
-
+#include "discoveryTemplate.h"
+#include "eventStream.h"
+#include "jsonWriter.h"
+
+// Home Assistant discovery for a blind, as a cover
+// The state and position come from separate topics, or from one JSON topic if that is turned on.
+static constexpr DiscoveryTemplate blindDiscovery(
+    "{ \"~\": \"pico_somfy/blinds/" DISCOVERY_ID "\", \"name\": null"
+    ", \"avty_t\": \"pico_somfy/status\", \"pl_avail\": \"online\", \"pl_not_avail\": \"offline\", "
+    "\"stat_t\": \"~/state\", \"cmd_t\": \"~/cmd\", \"pl_open\": \"open\", \"pl_cls\": \"close\", \"pl_stop\": \"stop\", "
+    "\"pos_t\": \"~/position\", \"set_pos_t\": \"~/pos\", \"uniq_id\": \"ps_cover_" DISCOVERY_ID "\", "
+    "\"device\": { \"name\": \"" DISCOVERY_NAME "\", \"mdl\": \"Pico-Somfy controlled cover\", \"mf\": \"Bagpuss\", \"ids\": [\"psb_" DISCOVERY_ID "\"] } }");
+static constexpr DiscoveryTemplate blindJsonDiscovery(
+    "{ \"~\": \"pico_somfy/blinds/" DISCOVERY_ID "\", \"name\": null"
+    ", \"avty_t\": \"pico_somfy/status\", \"pl_avail\": \"online\", \"pl_not_avail\": \"offline\", "
+    "\"stat_t\": \"~/json\", \"val_tpl\": \"{{ value_json.state }}\", \"cmd_t\": \"~/cmd\", \"pl_open\": \"open\", \"pl_cls\": \"close\", \"pl_stop\": \"stop\", "
+    "\"pos_t\": \"~/json\", \"pos_tpl\": \"{{ value_json.position }}\", \"set_pos_t\": \"~/pos\", \"uniq_id\": \"ps_cover_" DISCOVERY_ID "\", "
+    "\"device\": { \"name\": \"" DISCOVERY_NAME "\", \"mdl\": \"Pico-Somfy controlled cover\", \"mf\": \"Bagpuss\", \"ids\": [\"psb_" DISCOVERY_ID "\"] } }");
 
 
 Blind::Blind(
     uint16_t blindId,
     std::string name,
+    std::string group,
     int currentPosition,
     int favouritePosition,
     int openTime,
     int closeTime,
     std::shared_ptr<SomfyRemote> remote,
     std::shared_ptr<MqttClient> mqttClient,
-    std::shared_ptr<DeviceConfig> config)
+    std::shared_ptr<DeviceConfig> config,
+    std::shared_ptr<EventStream> events)
 :   _blindId(blindId),
     _isDirty(false),
     _needsPublish(false),
+    _forcePublish(false),
     _name(std::move(name)),
+    _group(std::move(group)),
     _targetPosition(currentPosition),
     _intermediatePosition(currentPosition),
     _openTime(openTime),
@@ -34,9 +55,19 @@ Blind::Blind(
     _mqttClient(mqttClient),
     _favouritePosition(favouritePosition),
     _config(config),
+    _events(std::move(events)),
     _motionDirection(0),
-    _cmdSubscription(mqttClient, string_format("pico_somfy/blinds/%08x/cmd", blindId),[this](const uint8_t *payload, uint32_t length) { OnCommand(payload, length); }),
-    _posSubscription(mqttClient, string_format("pico_somfy/blinds/%08x/pos", blindId),[this](const uint8_t *payload, uint32_t length) { OnSetPosition(payload, length); }),
+    _commandSource(CommandSource::None),
+    _lastSource(CommandSource::None),
+    _lastRssi(0),
+    _publishedPosition(-1),
+    _publishedDirection(0),
+    _stateChanged(true),
+    _eventPosition(-1),
+    _eventTarget(-1),
+    _eventDirection(0),
+    _cmdSubscription(mqttClient, MqttTopicKind::Blind, blindId, MqttTopicVerb::Command, [this](const uint8_t *payload, uint32_t length) { OnCommand(payload, length, CommandSource::Mqtt); }),
+    _posSubscription(mqttClient, MqttTopicKind::Blind, blindId, MqttTopicVerb::Position, [this](const uint8_t *payload, uint32_t length) { OnSetPosition(payload, length, CommandSource::Mqtt); }),
     _refreshTimer([this]() { return UpdatePosition(); }, 0),
     _discoveryWorker([this]() { PublishDiscovery(); })
 {
@@ -46,7 +77,12 @@ Blind::Blind(
     if(_favouritePosition > 100 || _favouritePosition < 0)
         _favouritePosition = 50;
 
+    // Read once, rather than finding the config record every time the position is published
+    auto mqttConfig = _config->GetMqttConfig();
+    _jsonState = mqttConfig && mqttConfig->jsonState;
+
     _lastTick = get_absolute_time();
+    _lastPublish = _lastTick;
 
     TriggerPublishDiscovery();
 }
@@ -55,9 +91,10 @@ Blind::~Blind()
 {
 }
 
-void Blind::UpdateConfig(std::string name, int openTime, int closeTime)
+void Blind::UpdateConfig(std::string name, int openTime, int closeTime, std::string group)
 {
     _name = std::move(name);
+    _group = std::move(group);
     _openTime = openTime;
     _closeTime = closeTime;
     _isDirty = true;
@@ -76,39 +113,48 @@ void Blind::GoToPosition(int position)
         position = 100;
     else if(position < 0)
         position = 0;
+    auto sent = true;
     if(_intermediatePosition > position || position == 0)
-        _remote->PressButtons(SomfyButton::Down, ShortPress);
+        sent = _remote->PressButtons(SomfyButton::Down, ShortPress, _commandSource);
     if(_intermediatePosition < position || position == 100)
-        _remote->PressButtons(SomfyButton::Up, ShortPress);
+        sent = _remote->PressButtons(SomfyButton::Up, ShortPress, _commandSource);
 
-    _targetPosition = position;
+    if(sent)
+        _targetPosition = position;
 }
 
 void Blind::GoUp()
 {
-    _remote->PressButtons(SomfyButton::Up, ShortPress);
+    _remote->PressButtons(SomfyButton::Up, ShortPress, _commandSource);
 }
 
 void Blind::GoDown()
 {
-    _remote->PressButtons(SomfyButton::Down, ShortPress);
+    _remote->PressButtons(SomfyButton::Down, ShortPress, _commandSource);
 }
 
 void Blind::Stop()
 {
     if(_motionDirection)
-        _remote->PressButtons(SomfyButton::My, ShortPress);
+        _remote->PressButtons(SomfyButton::My, ShortPress, _commandSource);
 }
 
 void Blind::GoToMyPosition()
 {
     if(_motionDirection)
         return;
-    _remote->PressButtons(SomfyButton::My, ShortPress);
+    _remote->PressButtons(SomfyButton::My, ShortPress, _commandSource);
 }
 
-void Blind::ButtonsPressed(SomfyButton button, bool longPress)
+void Blind::ButtonsPressed(SomfyButton button, bool longPress, CommandSource source, int rssi)
 {
+    // Stopping at the target finishes the last command, so it keeps its source
+    if(source != CommandSource::Schedule)
+        _lastSource = source;
+    if(source == CommandSource::Remote)
+        _lastRssi = rssi;
+    _stateChanged = true;
+
     if(button == SomfyButton::Up)
     {
         _targetPosition = 100;
@@ -144,13 +190,14 @@ void Blind::ButtonsPressed(SomfyButton button, bool longPress)
     _lastTick = get_absolute_time();
     _refreshTimer.ResetTimer(500);
     _isDirty = true;
+    PublishEvent();
 }
 
 void Blind::SaveMyPosition()
 {
     if(!_motionDirection)
     {
-        _remote->PressButtons(SomfyButton::My, LongPress);
+        _remote->PressButtons(SomfyButton::My, LongPress, _commandSource);
     }
 }
 
@@ -162,7 +209,9 @@ void Blind::SaveConfig(bool force)
     }
 
     BlindConfig config;
+    memset(&config, 0, sizeof(config));
     strcpy(config.blindName, _name.c_str());
+    strlcpy(config.groupName, _group.c_str(), sizeof(config.groupName));
     config.closeTime = _closeTime;
     config.openTime = _openTime;
     config.remoteId = _remote->GetRemoteId();
@@ -200,7 +249,10 @@ uint32_t Blind::UpdatePosition()
         {
             _intermediatePosition = _targetPosition;
             if(_targetPosition < 100 && _targetPosition > 0)
+            {
+                _commandSource = CommandSource::Schedule;
                 Stop();
+            }
             _motionDirection = 0;
         }
     }
@@ -209,14 +261,15 @@ uint32_t Blind::UpdatePosition()
 
     // Tell the MQTT subscribers where we are at
     auto needsPublish = PublishPosition();
+    PublishEvent();
 
-    // Tick again if we're in motion, or we need to try publishing again later
-    return _motionDirection ? 1000 :
-        needsPublish ? 30000 : 0;
+    // Tick again if we're in motion, or the publish queue was full and we need to try again soon
+    return _motionDirection || needsPublish ? 1000 : 0;
 }
 
-void Blind::OnCommand(const uint8_t *payload, uint32_t length)
+void Blind::OnCommand(const uint8_t *payload, uint32_t length, CommandSource source)
 {
+    _commandSource = source;
     if(length == 4 && !memcmp(payload, "open", 4))
         GoUp();
     else if(length == 5 && !memcmp(payload, "close", 5))
@@ -225,8 +278,9 @@ void Blind::OnCommand(const uint8_t *payload, uint32_t length)
         Stop();
 }
 
-void Blind::OnSetPosition(const uint8_t *payload, uint32_t length)
+void Blind::OnSetPosition(const uint8_t *payload, uint32_t length, CommandSource source)
 {
+    _commandSource = source;
     if(length > 31)
         return;
     char payloadstr[32];
@@ -239,45 +293,166 @@ void Blind::OnSetPosition(const uint8_t *payload, uint32_t length)
     GoToPosition(pos);
 }
 
+void Blind::SetPosition(int position, CommandSource source)
+{
+    _commandSource = source;
+    GoToPosition(position);
+}
+
 
 bool Blind::PublishPosition()
 {
+    // Returns true if we need to try again
     if(!_mqttClient->IsEnabled())
+        return false;
+
+    // Only publish when something has changed, and the position only once the rounded value moves
+    auto position = (int)roundf(_intermediatePosition);
+    if(position == _publishedPosition && _motionDirection == _publishedDirection && !_stateChanged)
+        return false;
+
+    // Starting and stopping go straight out, but position updates are limited while the blind moves
+    auto now = get_absolute_time();
+    if(_motionDirection == _publishedDirection && !_stateChanged &&
+        absolute_time_diff_us(_lastPublish, now) < BLIND_PUBLISH_INTERVAL * 1000)
         return true;
 
+    auto published = _jsonState ? PublishJsonState(position) : PublishTopics(position);
+    if(published)
+    {
+        _lastPublish = now;
+        _stateChanged = false;
+    }
+    return !published;
+}
+
+bool Blind::PublishTopics(int position)
+{
     char topic[42];
-    sprintf(topic, "pico_somfy/blinds/%08x/position", _blindId);
+    auto published = true;
+    if(position != _publishedPosition)
+    {
+        sprintf(topic, "pico_somfy/blinds/%08x/position", _blindId);
+
+        char buff[16];
+        BufferOutput payload(buff, sizeof(buff));
+        payload.Append(position);
+        // State is QoS 1, so the broker is sure to get the latest
+        if(_mqttClient->Publish(topic, (uint8_t *)buff, payload.BytesWritten(), true, 1))
+            _publishedPosition = position;
+        else
+            published = false;
+    }
 
-    char buff[16];
-    BufferOutput payload(buff, sizeof(buff));
-    payload.Append((int)_intermediatePosition);
-    if(!_mqttClient->Publish(topic, (uint8_t *)buff, payload.BytesWritten()))
+    if(_motionDirection != _publishedDirection || _stateChanged)
     {
-        return false;
+        sprintf(topic, "pico_somfy/blinds/%08x/state", _blindId);
+        if(_mqttClient->Publish(
+            topic,
+            (uint8_t *)(_motionDirection > 0 ? "opening" :
+                        _motionDirection < 0 ? "closing" :
+                                               "stopped"),
+            7, // All payloads are 7 bytes...
+            true,
+            1))
+            _publishedDirection = _motionDirection;
+        else
+            published = false;
     }
+    return published;
+}
+
+bool Blind::PublishJsonState(int position)
+{
+    char topic[42];
+    sprintf(topic, "pico_somfy/blinds/%08x/json", _blindId);
 
-    sprintf(topic, "pico_somfy/blinds/%08x/state", _blindId);
-    return !_mqttClient->Publish(
-        topic,
-        (uint8_t *)(_motionDirection > 0 ? "opening" :
-                    _motionDirection < 0 ? "closing" :
-                                           "stopped"),
-        7); // All payloads are 7 bytes...
+    char buff[128];
+    BufferOutput payload(buff, sizeof(buff));
+    payload.Append("{\"position\":");
+    payload.Append(position);
+    payload.Append(",\"target\":");
+    payload.Append(_targetPosition);
+    payload.Append(",\"direction\":");
+    payload.Append(_motionDirection);
+    payload.Append(",\"state\":\"");
+    payload.Append(
+        _motionDirection > 0 ? "opening" :
+        _motionDirection < 0 ? "closing" :
+                               "stopped");
+    payload.Append("\",\"source\":\"");
+    payload.Append(
+        _lastSource == CommandSource::Mqtt ? "mqtt" :
+        _lastSource == CommandSource::Web ? "web" :
+        _lastSource == CommandSource::Remote ? "remote" :
+                                               "none");
+    payload.Append("\",\"rssi\":");
+    if(_lastRssi)
+        payload.Append(_lastRssi);
+    else
+        payload.Append("null");
+    payload.Append('}');
+
+    // One QoS 1 message in place of the two topics
+    if(!_mqttClient->Publish(topic, (uint8_t *)buff, payload.BytesWritten(), true, 1))
+        return false;
+
+    _publishedPosition = position;
+    _publishedDirection = _motionDirection;
+    return true;
+}
+
+void Blind::PublishEvent()
+{
+    auto position = (int)roundf(_intermediatePosition);
+    if(!_events->HasClients() ||
+        position == _eventPosition && _targetPosition == _eventTarget && _motionDirection == _eventDirection)
+        return;
+
+    char buff[96];
+    JsonWriter event(buff, sizeof(buff));
+    event.BeginObject();
+    event.Key("id");
+    event.UInt(_blindId);
+    event.Key("position");
+    event.Int(position);
+    event.Key("target");
+    event.Int(_targetPosition);
+    event.Key("state");
+    event.String(
+        _motionDirection > 0 ? "opening" :
+        _motionDirection < 0 ? "closing" :
+                               "stopped");
+    event.EndObject();
+    _events->Publish("blind", buff, event.BytesWritten());
+
+    _eventPosition = position;
+    _eventTarget = _targetPosition;
+    _eventDirection = _motionDirection;
 }
 
-void Blind::TriggerPublishDiscovery()
+void Blind::RepublishState()
+{
+    _publishedPosition = -1;
+    _stateChanged = true;
+    if(!_motionDirection)
+        _refreshTimer.ResetTimer(1);
+}
+
+void Blind::TriggerPublishDiscovery(bool force)
 {
     if(_mqttClient->IsEnabled())
     {
         _needsPublish = true;
+        _forcePublish |= force;
         _discoveryWorker.ScheduleWork();
     }
 }
 
-void Blind::PublishDiscovery()
+bool Blind::PublishDiscovery()
 {
     if(!_mqttClient->IsConnected())
-        return;
+        return false;
 
     DBG_PRINT("Discovery publish for blind %d (%s)\n", _blindId, _name.c_str()); 
     auto mqttConfig = _config->GetMqttConfig();
@@ -285,35 +460,38 @@ void Blind::PublishDiscovery()
     {
         DBG_PUT("Discovery topic not configured");
         _needsPublish = false;
-        return;
+        return true;
     }
 
-    DBG_PRINT("Discovery topic: %s\n", mqttConfig->topic); 
+    // The message is retained, so don't send it again if the broker already has it
+    auto name = _name.c_str();
+    auto &discovery = _jsonState ? blindJsonDiscovery : blindDiscovery;
+    auto hash = discovery.Hash(DISCOVERY_HASH_SEED, mqttConfig->topic, _blindId, name);
+    if(!_forcePublish && hash == _config->GetBlindDiscoveryHash(_blindId))
+    {
+        _needsPublish = false;
+        return true;
+    }
 
-    char payload[512];
-    BufferOutput payloadWriter(payload, sizeof(payload));
-    
-    payloadWriter.Append("{ \"~\": \"pico_somfy/blinds/");
-    payloadWriter.AppendHex(_blindId);
-    payloadWriter.Append("\", \"name\": null");
-    //payloadWriter.AppendEscaped(this->_name.c_str());
-    payloadWriter.Append(
-        ", \"avty_t\": \"pico_somfy/status\", \"pl_avail\": \"online\", \"pl_not_avail\": \"offline\", "
-        "\"stat_t\": \"~/state\", \"cmd_t\": \"~/cmd\", \"pl_open\": \"open\", \"pl_cls\": \"close\", \"pl_stop\": \"stop\", "
-        "\"pos_t\": \"~/position\", \"set_pos_t\": \"~/pos\", \"uniq_id\": \"ps_cover_");
-    payloadWriter.AppendHex(_blindId);
-    payloadWriter.Append("\", \"device\": { \"name\": \"");
-    payloadWriter.AppendEscaped(this->_name.c_str());
-    payloadWriter.Append("\", \"mdl\": \"Pico-Somfy controlled cover\", \"mf\": \"Bagpuss\", \"ids\": [\"psb_");
-    payloadWriter.AppendHex(_blindId);
-    payloadWriter.Append("\"] } }");
+    DBG_PRINT("Discovery topic: %s\n", mqttConfig->topic); 
 
     char topic[64];
     snprintf(topic, sizeof(topic), "%s/cover/pico_somfy/%08x/config", mqttConfig->topic, _blindId);
     topic[63] = 0;
-    DBG_PRINT("Publishing %d bytes to %s\n", payloadWriter.BytesWritten(), topic);
-    if(_mqttClient->Publish(topic, (uint8_t *)payload, payloadWriter.BytesWritten()))
-        _needsPublish = false;
 
-}
+    auto length = discovery.Length(name);
+    DBG_PRINT("Publishing %d bytes to %s\n", length, topic);
+    // QoS 1, so it is sent again after a reconnect until the broker has it. Only then is the hash saved.
+    if(!_mqttClient->Publish(topic, length, [this, name, &discovery](uint8_t *payload) { discovery.Write(payload, _blindId, name); }, true, 1,
+        [config = _config, blindId = _blindId, hash]()
+        {
+            // Unless the blind was deleted while we waited
+            if(config->GetBlindConfig(blindId))
+                config->SaveBlindDiscoveryHash(blindId, hash);
+        }))
+        return false;
 
+    _needsPublish = false;
+    _forcePublish = false;
+    return true;
+}
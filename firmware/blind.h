@@ -9,28 +9,38 @@
 #include <scheduler.h>
 
 class SomfyRemote;
+class EventStream;
 enum SomfyButton : int;
+enum class CommandSource : uint8_t;
 struct BlindConfig;
 
+// Least time between state publishes while a blind moves, in ms. Twice the 1s tick, so a moving blind publishes its
+// position on every other tick. Starting and stopping aren't held back.
+#define BLIND_PUBLISH_INTERVAL 2000
+
 class Blind
 {
     public:
         Blind(
             uint16_t blindId,
             std::string name,
+            std::string group,
             int currentPosition,
             int favouritePosition,
             int openTime,
             int closeTime,
             std::shared_ptr<SomfyRemote> remote,
             std::shared_ptr<MqttClient> mqttClient,
-            std::shared_ptr<DeviceConfig> config);
+            std::shared_ptr<DeviceConfig> config,
+            std::shared_ptr<EventStream> events);
 
         ~Blind();
 
         // Config API
         const std::string &GetName() { return _name; }
-        void UpdateConfig(std::string name, int openTime, int closeTime);
+        void UpdateConfig(std::string name, int openTime, int closeTime, std::string group);
+        /// @brief Name of the group the blind belongs to, or empty
+        const std::string &GetGroup() { return _group; }
         int GetOpenTime() { return _openTime; }
         int GetCloseTime() { return _closeTime; }
         uint32_t GetRemoteId();
@@ -45,7 +55,8 @@ class Blind
         void GoToMyPosition();
 
         /// @brief Called if buttons on a remote linked to this blind are pressed
-        void ButtonsPressed(SomfyButton button, bool longPress);
+        /// @param rssi Signal strength of a physical remote, in dBm
+        void ButtonsPressed(SomfyButton button, bool longPress, CommandSource source, int rssi = 0);
 
         /// @brief Saves the current position as the My position
         void SaveMyPosition();
@@ -56,32 +67,63 @@ class Blind
         /// @brief 1 for up, -1 for down (if we think the blind is moving)
         bool GetMotionDirection() { return _motionDirection; }
 
-        void OnCommand(const uint8_t *payload, uint32_t length);
-        void OnSetPosition(const uint8_t *payload, uint32_t length);
+        void OnCommand(const uint8_t *payload, uint32_t length, CommandSource source);
+        void OnSetPosition(const uint8_t *payload, uint32_t length, CommandSource source);
+        void SetPosition(int position, CommandSource source);
 
         bool NeedsPublish() { return _needsPublish; }
-        void TriggerPublishDiscovery();
+        /// @brief Publish discovery info soon, if it has changed since it was last published
+        /// @param force Publish it even if it hasn't changed
+        void TriggerPublishDiscovery(bool force = false);
+
+        /// @brief Publish the Home Assistant discovery message
+        /// @return False if it couldn't be sent, and needs trying again
+        bool PublishDiscovery();
 
         void SaveConfig(bool force = false);
 
+        /// @brief Publish the position and state again soon, even if they haven't changed
+        void RepublishState();
+
     private:
         Blind(const Blind&) = delete;
 
         /// @brief Called periodically for blinds in motion to update their guess of their actual position.
         uint32_t UpdatePosition();
         bool PublishPosition();
-        void PublishDiscovery();
+        bool PublishTopics(int position);
+        bool PublishJsonState(int position);
+        /// @brief Tell the web interface about any change in position or motion
+        void PublishEvent();
 
         uint16_t _blindId;
         bool _isDirty;  // True if save is needed
         bool _needsPublish;
+        bool _forcePublish;     // Publish discovery even if it hasn't changed
+        bool _jsonState;        // Publish state as one JSON message. Saving the MQTT config restarts the service, so it can't change under us.
         std::string _name;
+        std::string _group;
         int _openTime;
         int _closeTime;
 
         absolute_time_t _lastTick;
         int _motionDirection;
 
+        CommandSource _commandSource;   // Where the command being carried out came from
+        CommandSource _lastSource;      // Where the last button press seen came from
+        int _lastRssi;                  // Of the last physical remote press, or 0
+
+        // What was last published, so only changes are sent
+        int _publishedPosition;
+        int _publishedDirection;
+        bool _stateChanged;
+        absolute_time_t _lastPublish;
+
+        // What the web interface was last sent
+        int _eventPosition;
+        int _eventTarget;
+        int _eventDirection;
+
         float _intermediatePosition;
         int _targetPosition;      // Position of the blind, 100 for open, 0 for closed.
         int _favouritePosition;
@@ -89,6 +131,7 @@ class Blind
         std::shared_ptr<MqttClient> _mqttClient;
         std::shared_ptr<SomfyRemote> _remote;
         std::shared_ptr<DeviceConfig> _config;
+        std::shared_ptr<EventStream> _events;
         MqttSubscription _cmdSubscription;
         MqttSubscription _posSubscription;
         ScheduledTimer _refreshTimer;
@@ -7,15 +7,22 @@
 #include "blinds.h"
 #include "deviceConfig.h"
 #include "remotes.h"
-#include "bufferOutput.h"
+#include "commandQueue.h"
+#include <set>
+#include <algorithm>
 
 Blinds::Blinds(
     std::shared_ptr<DeviceConfig> config,
     std::shared_ptr<MqttClient> mqttClient,
-    std::shared_ptr<WebServer> webServer)
+    std::shared_ptr<WebServer> webServer,
+    std::shared_ptr<RadioCommandQueue> commandQueue,
+    std::shared_ptr<EventStream> events)
 :   _config(std::move(config)),
     _mqttClient(std::move(mqttClient)),
     _webServer(webServer),
+    _commandQueue(std::move(commandQueue)),
+    _events(std::move(events)),
+    _listCursor(_blinds),
     _nextId(1),
     _saveTimer([this]() { SaveBlindState(false); return SAVE_DELAY; }, SAVE_DELAY)
 {
@@ -25,31 +32,30 @@ void Blinds::Initialize(std::shared_ptr<SomfyRemotes> remotes)
 {
     _remotes = remotes;
 
-    uint32_t count;
-    const uint16_t *blindids = _config->GetBlindIds(&count);
+    auto blindIds = _config->GetBlindIds();
 
-    DBG_PRINT("There are %d blinds registered\n", count);
+    DBG_PRINT("There are %d blinds registered\n", blindIds.size());
 
     auto errors = false;
-    for(auto a = 0; a < count; a++)
+    for(auto blindId : blindIds)
     {
-        if(blindids[a] >= _nextId)
-            _nextId = blindids[a] + 1;
-        auto cfg = _config->GetBlindConfig(blindids[a]);
-        auto remote = _remotes->GetRemote(cfg->remoteId);
+        if(blindId >= _nextId)
+            _nextId = blindId + 1;
+        auto cfg = _config->GetBlindConfig(blindId);
+        auto remote = cfg ? _remotes->GetRemote(cfg->remoteId) : nullptr;
         if(remote)
         {
-            auto blind = std::make_unique<Blind>(blindids[a], cfg->blindName, cfg->currentPosition, cfg->myPosition, cfg->openTime, cfg->closeTime, remote, _mqttClient, _config);
+            auto blind = std::make_unique<Blind>(blindId, cfg->blindName, cfg->groupName, cfg->currentPosition, cfg->myPosition, cfg->openTime, cfg->closeTime, remote, _mqttClient, _config, _events);
             _blinds.insert(
                 {
-                    blindids[a],
+                    blindId,
                     std::move(blind)
                 });
         }
         else
         {
-            DBG_PRINT("Deleting blind id %d with missing remote %08x\n", blindids[a], cfg->remoteId );
-            _config->DeleteBlindConfig(blindids[a]);
+            DBG_PRINT("Deleting blind id %d with missing config or remote\n", blindId);
+            _config->DeleteBlindConfig(blindId);
             errors = true;
         }
     }
@@ -59,10 +65,14 @@ void Blinds::Initialize(std::shared_ptr<SomfyRemotes> remotes)
         SaveBlindList();
     }
 
-    _webApi.push_back(CgiSubscription(_webServer, "/api/blinds/add.json", [this](const CgiParams &params) { return DoAddBlind(params); }));
-    _webApi.push_back(CgiSubscription(_webServer, "/api/blinds/update.json", [this](const CgiParams &params) { return DoUpdateBlind(params); }));
-    _webApi.push_back(CgiSubscription(_webServer, "/api/blinds/delete.json", [this](const CgiParams &params) { return DoDeleteBlind(params); }));
-    _webApi.push_back(CgiSubscription(_webServer, "/api/blinds/command.json", [this](const CgiParams &params) { return DoBlindCommand(params); }));
+    UpdateGroups();
+
+    // GET with a query string still works, for existing scripts
+    _webApi.push_back(RouteSubscription(_webServer, "/api/blinds/add.json", HttpGet | HttpPost, [this](const WebRequest &request, WebResponse &response) { DoAddBlind(request, response); }));
+    _webApi.push_back(RouteSubscription(_webServer, "/api/blinds/update.json", HttpGet | HttpPost, [this](const WebRequest &request, WebResponse &response) { DoUpdateBlind(request, response); }));
+    _webApi.push_back(RouteSubscription(_webServer, "/api/blinds/delete.json", HttpGet | HttpPost, [this](const WebRequest &request, WebResponse &response) { DoDeleteBlind(request, response); }));
+    _webApi.push_back(RouteSubscription(_webServer, "/api/blinds/command.json", HttpGet | HttpPost, [this](const WebRequest &request, WebResponse &response) { DoBlindCommand(request, response); }));
+    _webApi.push_back(RouteSubscription(_webServer, "/api/blinds/batch.json", HttpPost, [this](const WebRequest &request, WebResponse &response) { DoBatchCommand(request, response); }));
 
     _webData.push_back(SsiSubscription(_webServer, "blinds", [this](char *buffer, int len, uint16_t tagPart, uint16_t *nextPart) { return GetBlindsResponse(buffer, len, tagPart, nextPart); }));
 }
@@ -71,16 +81,85 @@ bool Blinds::TryRepublish()
 {
     for(auto iter = _blinds.begin(); iter != _blinds.end(); iter++)
     {
-        if(iter->second->NeedsPublish())
-        {
-            iter->second->TriggerPublishDiscovery();
+        // Publish as many as the MQTT queue will take
+        if(iter->second->NeedsPublish() && !iter->second->PublishDiscovery())
             return true;
-        }
     }
 
     return false;
 }
 
+void Blinds::Rediscover()
+{
+    for(auto iter = _blinds.begin(); iter != _blinds.end(); iter++)
+    {
+        iter->second->TriggerPublishDiscovery(true);
+        iter->second->RepublishState();
+    }
+}
+
+void Blinds::UpdateGroups()
+{
+    std::set<std::string> groups;
+    for(auto iter = _blinds.begin(); iter != _blinds.end(); iter++)
+    {
+        if(!iter->second->GetGroup().empty())
+            groups.insert(iter->second->GetGroup());
+    }
+
+    // Groups only exist while they have blinds in them, so just start again
+    _groupSubscriptions.clear();
+    for(auto iter = groups.begin(); iter != groups.end(); iter++)
+    {
+        auto id = MqttClient::GroupId(iter->c_str(), iter->length());
+        auto group = *iter;
+        _groupSubscriptions.push_back(MqttSubscription(_mqttClient, MqttTopicKind::Group, id, MqttTopicVerb::Command,
+            [this, group](const uint8_t *payload, uint32_t length) { OnGroupCommand(&group, MqttTopicVerb::Command, payload, length); }));
+        _groupSubscriptions.push_back(MqttSubscription(_mqttClient, MqttTopicKind::Group, id, MqttTopicVerb::Position,
+            [this, group](const uint8_t *payload, uint32_t length) { OnGroupCommand(&group, MqttTopicVerb::Position, payload, length); }));
+    }
+
+    _groupSubscriptions.push_back(MqttSubscription(_mqttClient, MqttTopicKind::All, 0, MqttTopicVerb::Command,
+        [this](const uint8_t *payload, uint32_t length) { OnGroupCommand(nullptr, MqttTopicVerb::Command, payload, length); }));
+    _groupSubscriptions.push_back(MqttSubscription(_mqttClient, MqttTopicKind::All, 0, MqttTopicVerb::Position,
+        [this](const uint8_t *payload, uint32_t length) { OnGroupCommand(nullptr, MqttTopicVerb::Position, payload, length); }));
+}
+
+void Blinds::OnGroupCommand(const std::string *group, MqttTopicVerb verb, const uint8_t *payload, uint32_t length)
+{
+    // One radio batch for the whole group, so the blinds start moving together. Each blind presses at most one
+    // button. Blinds beyond a full batch are skipped, and left where they are, as the MQTT rate limit would turn
+    // them away anyway. Otherwise they'd think they were moving when no command was sent.
+    uint32_t count = 0;
+    for(auto iter = _blinds.begin(); iter != _blinds.end(); iter++)
+    {
+        if(!group || iter->second->GetGroup() == *group)
+            count++;
+    }
+    if(!_commandQueue->BeginBatch(std::min<uint32_t>(count, MAX_COMMAND_BATCH)))
+    {
+        DBG_PUT("Group command dropped, the radio queue is full");
+        return;
+    }
+    uint32_t sent = 0;
+    for(auto iter = _blinds.begin(); iter != _blinds.end(); iter++)
+    {
+        if(group && iter->second->GetGroup() != *group)
+            continue;
+        if(sent == MAX_COMMAND_BATCH)
+        {
+            DBG_PRINT("Group command skipped blind %d, as a batch only takes %d\n", iter->first, MAX_COMMAND_BATCH);
+            continue;
+        }
+        sent++;
+        if(verb == MqttTopicVerb::Command)
+            iter->second->OnCommand(payload, length, CommandSource::Mqtt);
+        else
+            iter->second->OnSetPosition(payload, length, CommandSource::Mqtt);
+    }
+    _commandQueue->CommitBatch();
+}
+
 void Blinds::SaveBlindState(bool force)
 {
     for(auto iter = _blinds.begin(); iter != _blinds.end(); iter++)
@@ -92,107 +171,108 @@ void Blinds::SaveBlindState(bool force)
 void Blinds::SaveBlindList()
 {
     DBG_PRINT("Saving blind list with %d blind ids.\n", _blinds.size());
-    uint16_t ids[128];
-    uint16_t *idoff = ids;
+    std::vector<uint16_t> ids;
+    ids.reserve(_blinds.size());
     for(auto iter = _blinds.begin(); iter != _blinds.end(); iter++)
     {
-        *idoff++ = iter->first & 0xFFFF;
+        ids.push_back(iter->first & 0xFFFF);
     }
-    _config->SaveBlindIds(ids, _blinds.size());
+    _config->SaveBlindIds(ids.data(), ids.size());
 }
 
-bool Blinds::DoAddBlind(const CgiParams &params)
+static std::string GroupName(const std::string &param)
 {
-    auto nameParam = params.find("name");
-    auto openTimeParam = params.find("openTime");
-    auto closeTimeParam = params.find("closeTime");
-
-    if(nameParam == params.end() ||
-       openTimeParam == params.end() ||
-       closeTimeParam == params.end())
+    // The name goes into a topic, so leave out anything MQTT treats specially
+    std::string name;
+    for(auto c : param)
     {
-        DBG_PUT("Missing arguments to AddBlind");
-        return false;
+        if(c != '/' && c != '+' && c != '#' && name.length() < sizeof(BlindConfig::groupName) - 1)
+            name += c;
     }
+    return name;
+}
 
-    int openTime, closeTime;
-    if( !sscanf(openTimeParam->second.c_str(), "%d", &openTime) ||
-        !sscanf(closeTimeParam->second.c_str(), "%d", &closeTime))
+void Blinds::DoAddBlind(const WebRequest &request, WebResponse &response)
+{
+    char name[sizeof(BlindConfig::blindName)];
+    int32_t openTime, closeTime;
+    if(!request.GetString("name", name, sizeof(name)) ||
+       !request.GetInt("openTime", openTime) ||
+       !request.GetInt("closeTime", closeTime))
     {
-        DBG_PUT("Bad open or close time parameters");
-        return false;
+        response.Error(400, "Needs name, openTime and closeTime");
+        return;
     }
 
+    char groupParam[64];
+    auto group = request.GetString("group", groupParam, sizeof(groupParam)) ? GroupName(groupParam) : std::string();
+
     // Create a new blind, and a new remote for the blind
-    auto newRemote = _remotes->CreateRemote(nameParam->second);
+    auto newRemote = _remotes->CreateRemote(name);
     auto newId = _nextId++;
 
-    auto newBlind = std::make_unique<Blind>(newId, nameParam->second, 90, 50, openTime, closeTime, newRemote, _mqttClient, _config);
+    auto newBlind = std::make_unique<Blind>(newId, name, group, 90, 50, openTime, closeTime, newRemote, _mqttClient, _config, _events);
     newBlind->SaveConfig(true);
 
     auto created = _blinds.insert({newId, std::move(newBlind)});
+    _listCursor.Reset();
     newRemote->AssociateBlind(newId);
 
     SaveBlindList();
+    UpdateGroups();
 
-    return true;
+    response.SetStatus(201);
+    response.Json().BeginObject();
+    response.Json().Key("id");
+    response.Json().UInt(newId);
+    response.Json().EndObject();
 }
 
-bool Blinds::DoUpdateBlind(const CgiParams &params)
+void Blinds::DoUpdateBlind(const WebRequest &request, WebResponse &response)
 {
-    auto idParam = params.find("id");
-    auto nameParam = params.find("name");
-    auto openTimeParam = params.find("openTime");
-    auto closeTimeParam = params.find("closeTime");
-
-    if(idParam == params.end() ||
-       nameParam == params.end() ||
-       openTimeParam == params.end() ||
-       closeTimeParam == params.end())
-    {
-        DBG_PUT("Missing arguments to AddBlind");
-        return false;
-    }
-
-    uint16_t id;
-    int openTime, closeTime;
-    if( !sscanf(idParam->second.c_str(), "%hu", &id) ||
-        !sscanf(openTimeParam->second.c_str(), "%d", &openTime) ||
-        !sscanf(closeTimeParam->second.c_str(), "%d", &closeTime))
+    int32_t id, openTime, closeTime;
+    char name[sizeof(BlindConfig::blindName)];
+    if(!request.GetInt("id", id) ||
+       !request.GetString("name", name, sizeof(name)) ||
+       !request.GetInt("openTime", openTime) ||
+       !request.GetInt("closeTime", closeTime))
     {
-        DBG_PUT("Bad open or close time parameters");
-        return false;
+        response.Error(400, "Needs id, name, openTime and closeTime");
+        return;
     }
 
     auto pos = _blinds.find(id);
     if(pos == _blinds.end())
     {
-        DBG_PRINT("No blind with id %d found\n", id);
-        return false;
+        response.Error(404, "No such blind");
+        return;
     }
 
+    // Leave the group alone if it isn't given
+    char groupParam[64];
+    auto group = request.GetString("group", groupParam, sizeof(groupParam)) ? GroupName(groupParam) : pos->second->GetGroup();
+
     DBG_PUT("Updating blind....");
-    pos->second->UpdateConfig(nameParam->second, openTime, closeTime);
-    return true;
+    pos->second->UpdateConfig(name, openTime, closeTime, group);
+    UpdateGroups();
 }
 
-
-
-bool Blinds::DoDeleteBlind(const CgiParams &params)
+void Blinds::DoDeleteBlind(const WebRequest &request, WebResponse &response)
 {
-    auto idParam = params.find("id");
-    uint32_t id;
-    if(!sscanf(idParam->second.c_str(), "%d", &id))
+    int32_t id;
+    if(!request.GetInt("id", id))
     {
-        DBG_PRINT("Can't read ID %s\n", idParam->second.c_str());
-        return false;
+        response.Error(400, "Needs id");
+        return;
     }
-    
+
     // Unregister the remote from the blind
+    _listCursor.Reset();
     auto removed = _blinds.extract(id);
     if(removed.empty())
     {
-        return false;
+        response.Error(404, "No such blind");
+        return;
     }
 
     auto remoteId = removed.mapped()->GetRemoteId();
@@ -200,86 +280,172 @@ bool Blinds::DoDeleteBlind(const CgiParams &params)
 
     _config->DeleteBlindConfig(id);
     SaveBlindList();
-    return true;
+    UpdateGroups();
 }
 
-bool Blinds::DoBlindCommand(const CgiParams &params)
+void Blinds::DoBlindCommand(const WebRequest &request, WebResponse &response)
 {
-    auto idParam = params.find("id");
-    auto commandParam = params.find("command");
-    auto payloadParam = params.find("payload");
+    int32_t id;
+    char command[8];
+    char payload[16];
+    if(!request.GetInt("id", id) ||
+       !request.GetString("command", command, sizeof(command)) ||
+       !request.GetString("payload", payload, sizeof(payload)))
+    {
+        response.Error(400, "Needs id, command and payload");
+        return;
+    }
 
-    if(idParam == params.end() || commandParam == params.end() || payloadParam == params.end())
+    auto blindEntry = _blinds.find(id);
+    if(blindEntry == _blinds.end())
     {
-        DBG_PUT("Bad command received - missing arguments\n");
-        return false;
+        response.Error(404, "No such blind");
+        return;
     }
 
-    uint32_t id;
-    if(!sscanf(idParam->second.c_str(), "%d", &id))
+    auto isPosition = !strcmp(command, "pos");
+    if(!isPosition && strcmp(command, "cmd"))
     {
-        DBG_PRINT("Can't read ID %s\n", idParam->second.c_str());
-        return false;
+        response.Error(400, "Command must be cmd or pos");
+        return;
     }
 
-    auto blindEntry = _blinds.find(id);
-    if(blindEntry == _blinds.end())
+    uint32_t retryAfterMs;
+    if(!_commandQueue->CanQueue(CommandSource::Web, 1, &retryAfterMs))
     {
-        DBG_PRINT("No blind found with ID %d\n", id);
-        return false;
+        response.Busy(retryAfterMs);
+        return;
     }
 
-    if(commandParam->second == "cmd")
-        blindEntry->second->OnCommand((const uint8_t *)payloadParam->second.c_str(), payloadParam->second.length());
-    else if(commandParam->second == "pos")
-        blindEntry->second->OnSetPosition((const uint8_t *)payloadParam->second.c_str(), payloadParam->second.length());
+    if(isPosition)
+        blindEntry->second->OnSetPosition((const uint8_t *)payload, strlen(payload), CommandSource::Web);
     else
-        DBG_PRINT("Unexpected command: %s", commandParam->second.c_str());
-    return true;
+        blindEntry->second->OnCommand((const uint8_t *)payload, strlen(payload), CommandSource::Web);
 }
 
-uint16_t Blinds::GetBlindsResponse(char *pcInsert, int iInsertLen, uint16_t tagPart, uint16_t *nextPart)
+void Blinds::DoBatchCommand(const WebRequest &request, WebResponse &response)
 {
-    // This data structure is a poor choice for this API
-    auto pos = _blinds.begin();
-    for(auto a = 0; a < tagPart; a++)
+    // Each item presses at most one button, so the whole request fits in one radio batch
+    struct BatchItem
     {
-        pos++;
+        Blind *blind;
+        int32_t position;       // Or -1 for a command
+        char command[8];
+        const char *result;
+    };
+    BatchItem items[MAX_COMMAND_BATCH];
+
+    auto &body = request.GetBody();
+    auto count = body.Count();
+    if(!body.IsArray() || count == 0 || count > MAX_COMMAND_BATCH)
+    {
+        char message[48];
+        snprintf(message, sizeof(message), "Needs an array of 1 to %d commands", MAX_COMMAND_BATCH);
+        response.Error(400, message);
+        return;
     }
 
-    if(pos == _blinds.end())
-        return 0;
-
-    BufferOutput outputter(pcInsert, iInsertLen);
-    outputter.Append("{ \"id\": ");
-    outputter.Append((int)pos->first);
-    outputter.Append(", \"name\": \"");
-    outputter.AppendEscaped(pos->second->GetName().c_str());
-    outputter.Append("\", \"position\": ");
-    outputter.Append(pos->second->GetIntermediatePosition());
-    outputter.Append(", \"openTime\": ");
-    outputter.Append(pos->second->GetOpenTime());
-    outputter.Append(", \"closeTime\": "); 
-    outputter.Append(pos->second->GetCloseTime());
-    outputter.Append(", \"remoteId\": ");
-    outputter.Append((int)pos->second->GetRemoteId());
-    outputter.Append(", \"state\": \"");
-    auto md = pos->second->GetMotionDirection();
-    outputter.Append(
-        md > 0 ? "opening" :
-        md < 0 ? "closing" :
-        "stopped");
-
-    pos++;
-    if(pos != _blinds.end())
+    // Check everything before sending anything
+    auto valid = true;
+    auto item = items;
+    body.ForEach([this, &item, &valid](const JsonValue &value)
     {
-        outputter.Append("\" },");
-        *nextPart = tagPart + 1;
+        uint16_t id;
+        item->blind = nullptr;
+        item->position = -1;
+        item->result = "ok";
+        if(!value["id"].GetUInt(id, UINT16_MAX) || !_blinds.count(id))
+            item->result = "no such blind";
+        else if(value["position"].IsValid())
+        {
+            if(!value["position"].GetInt(item->position) || item->position < 0 || item->position > 100)
+                item->result = "bad position";
+        }
+        else if(!value["command"].GetString(item->command, sizeof(item->command)) ||
+            strcmp(item->command, "open") && strcmp(item->command, "close") && strcmp(item->command, "stop"))
+            item->result = "bad command";
+
+        if(strcmp(item->result, "ok"))
+            valid = false;
+        else
+            item->blind = _blinds[id].get();
+        item++;
+    });
+
+    uint32_t retryAfterMs;
+    if(valid && !_commandQueue->CanQueue(CommandSource::Web, count, &retryAfterMs))
+    {
+        response.Busy(retryAfterMs);
+        return;
+    }
+
+    if(valid)
+    {
+        // Checked before any blind is told to move, so nothing changes if the batch can't be sent
+        if(!_commandQueue->BeginBatch(count))
+        {
+            response.Error(503, "The radio queue is full");
+            return;
+        }
+        for(auto a = 0; a < count; a++)
+        {
+            if(items[a].position >= 0)
+                items[a].blind->SetPosition(items[a].position, CommandSource::Web);
+            else
+                items[a].blind->OnCommand((const uint8_t *)items[a].command, strlen(items[a].command), CommandSource::Web);
+        }
+        _commandQueue->CommitBatch();
     }
     else
-        outputter.Append("\" }");
-    
-    return outputter.BytesWritten();
+    {
+        // None of it is sent
+        response.SetStatus(400);
+        for(auto a = 0; a < count; a++)
+        {
+            if(!strcmp(items[a].result, "ok"))
+                items[a].result = "not sent";
+        }
+    }
+
+    // A result for each command, in order
+    auto &json = response.Json();
+    json.BeginObject();
+    json.Key("results");
+    json.BeginArray();
+    for(auto a = 0; a < count; a++)
+        json.String(items[a].result);
+    json.EndArray();
+    json.EndObject();
+}
+
+uint16_t Blinds::GetBlindsResponse(char *pcInsert, int iInsertLen, uint16_t tagPart, uint16_t *nextPart)
+{
+    // Carry on from the last part, rather than walking the map again
+    return _listCursor.Write(pcInsert, iInsertLen, tagPart, nextPart, [](JsonWriter &writer, decltype(_blinds)::iterator pos)
+    {
+        writer.BeginObject();
+        writer.Key("id");
+        writer.UInt(pos->first);
+        writer.Key("name");
+        writer.String(pos->second->GetName());
+        writer.Key("group");
+        writer.String(pos->second->GetGroup());
+        writer.Key("position");
+        writer.Int(pos->second->GetIntermediatePosition());
+        writer.Key("openTime");
+        writer.Int(pos->second->GetOpenTime());
+        writer.Key("closeTime");
+        writer.Int(pos->second->GetCloseTime());
+        writer.Key("remoteId");
+        writer.UInt(pos->second->GetRemoteId());
+        writer.Key("state");
+        auto md = pos->second->GetMotionDirection();
+        writer.String(
+            md > 0 ? "opening" :
+            md < 0 ? "closing" :
+            "stopped");
+        writer.EndObject();
+    });
 }
 
 bool Blinds::IsAPrimaryRemote(uint32_t remoteId)
@@ -8,9 +8,12 @@
 #include <memory>
 #include "webServer.h"
 #include "scheduler.h"
+#include "listCursor.h"
 
 class MqttClient;
 class SomfyRemotes;
+class RadioCommandQueue;
+class EventStream;
 
 
 class Blinds
@@ -19,7 +22,9 @@ class Blinds
         Blinds(
             std::shared_ptr<DeviceConfig> config,
             std::shared_ptr<MqttClient> mqttClient,
-            std::shared_ptr<WebServer> webServer);
+            std::shared_ptr<WebServer> webServer,
+            std::shared_ptr<RadioCommandQueue> commandQueue,
+            std::shared_ptr<EventStream> events);
 
         void Initialize(std::shared_ptr<SomfyRemotes> remotes);
 
@@ -38,29 +43,43 @@ class Blinds
         /// @brief Publish discovery info for any devices that need to, now that Mqtt is connected
         /// @return True if there is more work to be done
         bool TryRepublish();
+
+        /// @brief Publish discovery info and state for every device, whether or not it has changed
+        void Rediscover();
         void SaveBlindState(bool force = false);
 
     private:
 
         void SaveBlindList();
 
-        bool DoAddBlind(const CgiParams &params);
-        bool DoUpdateBlind(const CgiParams &params);
-        bool DoDeleteBlind(const CgiParams &params);
-        bool DoBlindCommand(const CgiParams &params);
+        /// @brief Subscribe to the topics for every group in use, plus the all blinds topics
+        void UpdateGroups();
+        /// @brief Send a command to every blind in a group, or every blind if the group is null, as one radio batch
+        void OnGroupCommand(const std::string *group, MqttTopicVerb verb, const uint8_t *payload, uint32_t length);
+
+        void DoAddBlind(const WebRequest &request, WebResponse &response);
+        void DoUpdateBlind(const WebRequest &request, WebResponse &response);
+        void DoDeleteBlind(const WebRequest &request, WebResponse &response);
+        void DoBlindCommand(const WebRequest &request, WebResponse &response);
+        /// @brief Commands for several blinds, checked and then sent as one radio batch
+        void DoBatchCommand(const WebRequest &request, WebResponse &response);
 
         uint16_t GetBlindsResponse(char *pcInsert, int iInsertLen, uint16_t tagPart, uint16_t *nextPart);
 
         uint32_t _nextId;
         std::map<uint32_t, std::unique_ptr<Blind>> _blinds;
+        ListCursor<std::map<uint32_t, std::unique_ptr<Blind>>> _listCursor;     // For GetBlindsResponse. Shared by every connection.
 
         std::shared_ptr<DeviceConfig> _config;
         std::shared_ptr<SomfyRemotes> _remotes;
         std::shared_ptr<MqttClient> _mqttClient;
         std::shared_ptr<WebServer> _webServer;
+        std::shared_ptr<RadioCommandQueue> _commandQueue;
+        std::shared_ptr<EventStream> _events;
 
-        std::list<CgiSubscription> _webApi;
+        std::list<RouteSubscription> _webApi;
         std::list<SsiSubscription> _webData;
+        std::list<MqttSubscription> _groupSubscriptions;
         ScheduledTimer _saveTimer;
 };
 
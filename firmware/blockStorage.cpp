@@ -5,133 +5,485 @@
 #include "picoSomfy.h"
 #include "pico/flash.h"
 #include <string.h>
+#include <algorithm>
+#include <map>
 #include "blockStorage.h"
+#include "flashScheduler.h"
 
 #define BLOCK_FREE 0xFFFFFFFF
 #define BLOCK_EMPTY 0
+// Offset of a record that isn't there, or that there is no room for
+#define NO_RECORD 0xFFFFFFFF
+
+// Storage format versions:
+//  1 - Fixed size blocks of whole pages, with no sector header
+//  2 - Sector headers, followed by variable length records
+//  3 - Records carry a sequence number, so the latest copy of a block can be told apart after a power cut
+#define STORAGE_MAGIC 0x53464d42
+#define STORAGE_VERSION 3
+
+// Records are aligned so block data can be safely cast to structs
+#define RECORD_ALIGN 8
+
+// Background maintenance keeps this many sectors erased and ready, including the one kept in reserve
+#define PRE_ERASED_SECTORS 3
+// ...but only compacts sectors that are at least half deleted records to do it
+#define COMPACT_THRESHOLD (FLASH_SECTOR_SIZE / 2)
+// Move unchanging records out of sectors that have been erased this many times fewer than the most worn
+#ifndef WEAR_LEVEL_SPREAD
+#define WEAR_LEVEL_SPREAD 100
+#endif
+
+struct SectorHeader
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t headerSize;
+    uint32_t eraseCount;
+    uint32_t reserved;
+};
+
+struct RecordHeader
+{
+    uint32_t blockId;       // BLOCK_FREE until the record is completely written, BLOCK_EMPTY once deleted
+    uint16_t length;        // Length of the block data following the header
+    uint16_t lengthCheck;   // ~length. Distinguishes a record from unwritten flash
+    uint32_t sequence;      // Counts up with each block saved. Moving a record keeps its sequence number
+    uint32_t reserved;
+};
+
+struct ProgramParams
+{
+    uint32_t offset;        // Flash offset to start programming. Doesn't need to be page aligned
+    const uint8_t *header;  // Bytes to program first...
+    size_t headerSize;
+    const uint8_t *data;    // ...followed immediately by these
+    size_t size;
+};
+
+static uint32_t RecordSize(size_t length)
+{
+    return (sizeof(RecordHeader) + length + RECORD_ALIGN - 1) & ~(RECORD_ALIGN - 1);
+}
 
-BlockStorage::BlockStorage(uint32_t base, size_t size, size_t blockSize)
-:   _base(base)
+static bool IsUnwritten(const RecordHeader *record)
+{
+    return record->blockId == BLOCK_FREE && record->length == 0xFFFF && record->lengthCheck == 0xFFFF;
+}
+
+static bool IsValid(const RecordHeader *record, uint32_t sectorOffset)
+{
+    return (uint16_t)~record->length == record->lengthCheck &&
+        sectorOffset + RecordSize(record->length) <= FLASH_SECTOR_SIZE;
+}
+
+/// @brief Programs an arbitrary range of bytes. Must be called via the FlashScheduler
+/// @remarks The rest of each page is programmed with 0xFF, which leaves the existing flash contents unchanged.
+static void ProgramBytes(ProgramParams *params)
+{
+    uint8_t page[FLASH_PAGE_SIZE];
+    auto offset = params->offset;
+    while(params->headerSize || params->size)
+    {
+        auto pageStart = offset & ~(FLASH_PAGE_SIZE - 1);
+        auto off = offset - pageStart;
+        ::memset(page, 0xFF, sizeof(page));
+        while(off < FLASH_PAGE_SIZE && (params->headerSize || params->size))
+        {
+            auto &src = params->headerSize ? params->header : params->data;
+            auto &remaining = params->headerSize ? params->headerSize : params->size;
+            auto bytes = remaining > FLASH_PAGE_SIZE - off ? FLASH_PAGE_SIZE - off : remaining;
+            ::memcpy(page + off, src, bytes);
+            src += bytes;
+            remaining -= bytes;
+            off += bytes;
+        }
+        flash_range_program(pageStart, page, sizeof(page));
+        offset = pageStart + FLASH_PAGE_SIZE;
+    }
+}
+
+BlockStorage::BlockStorage(std::shared_ptr<FlashScheduler> flash, uint32_t base, size_t size, size_t legacyBlockSize)
+:   _flash(std::move(flash)),
+    _base(base),
+    _sequence(0),
+    _erases(0),
+    _programs(0),
+    _lookups(0),
+    _lookupRecords(0),
+    _longestSave(0)
 {
     _base = (base / FLASH_SECTOR_SIZE) * FLASH_SECTOR_SIZE;
     _sectors = (size + FLASH_SECTOR_SIZE - 1) / FLASH_SECTOR_SIZE;
-    _blockPages = (blockSize + 4 + FLASH_PAGE_SIZE - 1) / FLASH_PAGE_SIZE;
+
+    auto start = get_absolute_time();
+    Mount(legacyBlockSize);
+    _mountTime = (uint32_t)absolute_time_diff_us(start, get_absolute_time());
+    _mountedAt = get_absolute_time();
 
     PrintStorageStats();
 
+    _flash->SetIdleWork([this]() { return DoMaintenance(); });
 }
 
-const uint8_t *BlockStorage::GetBlock(uint32_t blockId) const
+uint32_t BlockStorage::MaxBlockSize()
 {
-    auto block = FindBlock(blockId);
-    if( block == -1)
-        return nullptr;
+    return FLASH_SECTOR_SIZE - sizeof(SectorHeader) - sizeof(RecordHeader);
+}
 
-    // Don't return the header
-    return (uint8_t *)(block + XIP_BASE + sizeof(uint32_t));
+void BlockStorage::Mount(size_t legacyBlockSize)
+{
+    _sectorInfo.resize(_sectors);
+
+    // Anything in a sector without our header must be data in the old format
+    auto needsMigration = false;
+    for(uint32_t sector = 0; sector < _sectors; sector++)
+    {
+        ScanSector(sector);
+        if(_sectorInfo[sector].formatted)
+            continue;
+
+        auto words = (const uint32_t *)(XIP_BASE + _base + sector * FLASH_SECTOR_SIZE);
+        for(uint32_t a = 0; a < FLASH_SECTOR_SIZE / sizeof(uint32_t); a++)
+        {
+            if(words[a] != 0xFFFFFFFF)
+            {
+                needsMigration = true;
+                break;
+            }
+        }
+    }
+
+    if(needsMigration)
+    {
+        MigrateLegacySectors(legacyBlockSize);
+    }
+    else
+    {
+        // Brand new (erased) sectors just need formatting
+        for(uint32_t sector = 0; sector < _sectors; sector++)
+        {
+            if(!_sectorInfo[sector].formatted)
+                FormatSectors(sector, 1);
+        }
+    }
+
+    RemoveStaleCopies();
 }
 
-uint32_t BlockStorage::FindBlock(uint32_t blockId) const
+void BlockStorage::RemoveStaleCopies()
+{
+    // A save writes the new copy of a block before deleting the old one, so a reset in between
+    // leaves both. Keep whichever was saved last.
+    std::map<uint32_t, uint32_t> latest;    // Block ID to the offset of its latest copy
+    for(uint32_t sector = 0; sector < _sectors; sector++)
+    {
+        auto &info = _sectorInfo[sector];
+        if(!info.formatted)
+            continue;
+
+        auto sectorStart = _base + sector * FLASH_SECTOR_SIZE;
+        uint32_t offset = sizeof(SectorHeader);
+        while(offset < info.writeOffset)
+        {
+            auto record = (const RecordHeader *)(XIP_BASE + sectorStart + offset);
+            if(!IsValid(record, offset))
+                break;
+            if(record->blockId != BLOCK_FREE && record->blockId != BLOCK_EMPTY)
+            {
+                auto found = latest.emplace(record->blockId, sectorStart + offset);
+                if(!found.second)
+                {
+                    auto other = (const RecordHeader *)(XIP_BASE + found.first->second);
+                    DBG_PRINT("Block %08x is stored twice (sequence %u and %u)\n", record->blockId, other->sequence, record->sequence);
+                    if(other->sequence > record->sequence)
+                    {
+                        DeleteRecord(sectorStart + offset);
+                    }
+                    else
+                    {
+                        DeleteRecord(found.first->second);
+                        found.first->second = sectorStart + offset;
+                    }
+                }
+            }
+            offset += RecordSize(record->length);
+        }
+    }
+}
+
+void BlockStorage::ScanSector(uint32_t sector)
 {
-    // Search through the pages until we find the block we are looking for...
-    auto offset = _base;
-    auto end = offset + _sectors * FLASH_SECTOR_SIZE - _blockPages * FLASH_PAGE_SIZE + 1;
+    auto sectorBase = XIP_BASE + _base + sector * FLASH_SECTOR_SIZE;
+    auto header = (const SectorHeader *)sectorBase;
+    auto &info = _sectorInfo[sector];
+
+    info.formatted = header->magic == STORAGE_MAGIC && header->version == STORAGE_VERSION;
+    info.writeOffset = sizeof(SectorHeader);
+    info.deadBytes = 0;
+    if(!info.formatted)
+        return;
 
-    while(offset < end)
+    while(info.writeOffset + sizeof(RecordHeader) <= FLASH_SECTOR_SIZE)
     {
-        auto id = (uint32_t *)(XIP_BASE + offset);
-        if(*id == blockId)
-            return offset;
-        offset += _blockPages * FLASH_PAGE_SIZE;
+        auto record = (const RecordHeader *)(sectorBase + info.writeOffset);
+        if(IsUnwritten(record))
+            break;
+
+        if(!IsValid(record, info.writeOffset))
+        {
+            // Nothing after this point can be trusted, so it can't be used until the sector is reclaimed
+            DBG_PRINT("Corrupt record found at 0x%08x\n", _base + sector * FLASH_SECTOR_SIZE + info.writeOffset);
+            info.deadBytes += FLASH_SECTOR_SIZE - info.writeOffset;
+            info.writeOffset = FLASH_SECTOR_SIZE;
+            break;
+        }
+
+        auto recordSize = RecordSize(record->length);
+        if(record->blockId == BLOCK_FREE || record->blockId == BLOCK_EMPTY)
+            info.deadBytes += recordSize;
+        if(record->sequence != 0xFFFFFFFF && record->sequence >= _sequence)
+            _sequence = record->sequence + 1;
+        info.writeOffset += recordSize;
     }
+}
 
-    // We didn't find the block with that ID
-    return -1;
+void BlockStorage::MigrateLegacySectors(size_t legacyBlockSize)
+{
+    // Blocks in format version 1 were stored in fixed slots of whole pages, with a 4 byte ID header
+    auto slotSize = ((legacyBlockSize + sizeof(uint32_t) + FLASH_PAGE_SIZE - 1) / FLASH_PAGE_SIZE) * FLASH_PAGE_SIZE;
+
+    DBG_PRINT("Migrating block storage to format version %d\n", STORAGE_VERSION);
+
+    // Sectors with nothing live in them can be formatted straight away, giving somewhere to copy the rest to
+    std::vector<LegacyBlock> blocks;
+    for(uint32_t sector = 0; sector < _sectors; sector++)
+    {
+        if(_sectorInfo[sector].formatted)
+            continue;
+        blocks.clear();
+        CollectLegacyBlocks(sector, slotSize, blocks);
+        if(blocks.empty() && !IsLegacySlotSpanned(sector, slotSize))
+            FormatSectors(sector, 1);
+    }
+
+    // Copy the live blocks out of each remaining sector before erasing it. If we're interrupted, the
+    // next boot finds the copies already made and carries on with the sectors which haven't been formatted yet.
+    for(uint32_t sector = 0; sector < _sectors; sector++)
+    {
+        if(_sectorInfo[sector].formatted)
+            continue;
+
+        blocks.clear();
+        CollectLegacyBlocks(sector, slotSize, blocks);
+
+        // Blocks that don't fit anywhere else have to be held in RAM while their sector is erased.
+        // That only happens when the storage is too full to have a single empty sector.
+        std::vector<std::pair<uint32_t, std::vector<uint8_t>>> held;
+        for(auto &block : blocks)
+        {
+            if(FindBlock(block.blockId) != NO_RECORD)
+                continue;
+            auto offset = AllocateRecord(block.size);
+            if(offset == NO_RECORD || !WriteRecord(offset, block.blockId, block.data, block.size, _sequence++))
+                held.emplace_back(block.blockId, std::vector<uint8_t>(block.data, block.data + block.size));
+        }
+
+        FormatSectors(sector, 1);
+
+        auto &info = _sectorInfo[sector];
+        for(auto &block : held)
+        {
+            auto offset = _base + sector * FLASH_SECTOR_SIZE + info.writeOffset;
+            if(info.writeOffset + RecordSize(block.second.size()) > FLASH_SECTOR_SIZE ||
+                !WriteRecord(offset, block.first, block.second.data(), block.second.size(), _sequence++))
+                DBG_PRINT("ERROR: Block %08x was lost during migration\n", block.first);
+        }
+    }
+
+    DBG_PUT("Migration complete");
 }
 
+void BlockStorage::CollectLegacyBlocks(uint32_t sector, size_t slotSize, std::vector<LegacyBlock> &blocks) const
+{
+    // Collect the live blocks that start in this sector. Any block that runs on into
+    // the next sector is still intact, because that sector hasn't been erased yet.
+    auto dataSize = slotSize - sizeof(uint32_t);
+    auto end = _sectors * FLASH_SECTOR_SIZE;
+    auto sectorStart = sector * FLASH_SECTOR_SIZE;
+    auto offset = ((sectorStart + slotSize - 1) / slotSize) * slotSize;
+    for(; offset < sectorStart + FLASH_SECTOR_SIZE && offset + slotSize <= end; offset += slotSize)
+    {
+        auto slot = (const uint8_t *)(XIP_BASE + _base + offset);
+        auto blockId = *(const uint32_t *)slot;
+        if(blockId == BLOCK_FREE || blockId == BLOCK_EMPTY)
+            continue;
+
+        // The old format had no lengths. Blocks were zero padded to the end of their last page, and any pages
+        // after that were left unwritten. The config readers treat a short block as zero filled, so only keep
+        // the part with data in it (to a whole word).
+        auto data = slot + sizeof(uint32_t);
+        auto size = dataSize;
+        while(size > FLASH_PAGE_SIZE - sizeof(uint32_t))
+        {
+            auto pageStart = ((size + sizeof(uint32_t) - 1) / FLASH_PAGE_SIZE) * FLASH_PAGE_SIZE - sizeof(uint32_t);
+            if(std::any_of(data + pageStart, data + size, [](uint8_t b) { return b != 0xFF; }))
+                break;
+            size = pageStart;
+        }
+        while(size && data[size - 1] == 0)
+            size--;
+        size = std::min((size + sizeof(uint32_t) - 1) & ~(sizeof(uint32_t) - 1), dataSize);
+
+        blocks.push_back({ blockId, data, size });
+    }
+}
+
+bool BlockStorage::IsLegacySlotSpanned(uint32_t sector, size_t slotSize) const
+{
+    // A live block starting in the sector before may run on into this one
+    auto sectorStart = sector * FLASH_SECTOR_SIZE;
+    auto slotStart = (sectorStart / slotSize) * slotSize;
+    auto slotSector = slotStart / FLASH_SECTOR_SIZE;
+    if(slotStart == sectorStart || _sectorInfo[slotSector].formatted)
+        return false;
+    auto blockId = *(const uint32_t *)(XIP_BASE + _base + slotStart);
+    return blockId != BLOCK_FREE && blockId != BLOCK_EMPTY;
+}
 
-void BlockStorage::SaveBlock(uint32_t blockId, const uint8_t *data, size_t size)
+const uint8_t *BlockStorage::GetBlock(uint32_t blockId, size_t *size) const
 {
-    // Find a free block to store our data
-    auto freeBlock = FindBlock(BLOCK_FREE);
-    if(freeBlock == -1)
+    auto block = FindBlock(blockId);
+    if(block == NO_RECORD)
+        return nullptr;
+
+    auto record = (const RecordHeader *)(block + XIP_BASE);
+    if(size)
+        *size = record->length;
+
+    // Don't return the header
+    return (uint8_t *)(record + 1);
+}
+
+const uint8_t *BlockStorage::NextBlock(uint32_t *cursor, uint32_t *blockId, size_t *size) const
+{
+    // The cursor is an offset into the storage. Walk each sector from the start, as the
+    // records may have moved since the last call, so the cursor may not be on a record boundary.
+    for(auto sector = *cursor / FLASH_SECTOR_SIZE; sector < _sectors; sector++)
     {
-        DBG_PUT("No free blocks found");
+        auto &info = _sectorInfo[sector];
+        if(!info.formatted)
+            continue;
 
-        // If there are no free blocks, try to reformat all contiguous empty sectors.
-        FormatEmptySectors();
-        freeBlock = FindBlock(BLOCK_FREE);
-        if(freeBlock == -1)
+        auto sectorStart = _base + sector * FLASH_SECTOR_SIZE;
+        uint32_t offset = sizeof(SectorHeader);
+        while(offset < info.writeOffset)
         {
-            DBG_PUT("ERROR: Still no free blocks found");
-            return;
+            auto record = (const RecordHeader *)(XIP_BASE + sectorStart + offset);
+            if(!IsValid(record, offset))
+                break;
+            auto position = sector * FLASH_SECTOR_SIZE + offset;
+            offset += RecordSize(record->length);
+            if(position < *cursor || record->blockId == BLOCK_FREE || record->blockId == BLOCK_EMPTY)
+                continue;
+
+            *cursor = sector * FLASH_SECTOR_SIZE + offset;
+            *blockId = record->blockId;
+            *size = record->length;
+            return (const uint8_t *)(record + 1);
         }
     }
 
-    DBG_PRINT("Free block found at 0x%08x\n", freeBlock);
+    *cursor = _sectors * FLASH_SECTOR_SIZE;
+    return nullptr;
+}
 
-    // First find any existing block and "delete" it by nulling out it's first page
-    auto existing = FindBlock(blockId);
-    if(existing != -1)
+uint32_t BlockStorage::FindBlock(uint32_t blockId) const
+{
+    if(blockId == BLOCK_FREE || blockId == BLOCK_EMPTY)
+        return NO_RECORD;
+
+    _lookups++;
+
+    // Search through the records in each sector until we find the block we are looking for...
+    for(uint32_t sector = 0; sector < _sectors; sector++)
     {
-        DBG_PRINT("Deleting existing record at 0x%08x\n", existing);
-        DeletePage(existing);
+        auto &info = _sectorInfo[sector];
+        if(!info.formatted)
+            continue;
+
+        auto sectorStart = _base + sector * FLASH_SECTOR_SIZE;
+        uint32_t offset = sizeof(SectorHeader);
+        while(offset < info.writeOffset)
+        {
+            auto record = (const RecordHeader *)(XIP_BASE + sectorStart + offset);
+            if(!IsValid(record, offset))
+                break;
+            _lookupRecords++;
+            if(record->blockId == blockId)
+                return sectorStart + offset;
+            offset += RecordSize(record->length);
+        }
     }
 
-    // Finally, save the block in the free location
-    struct PgmData
+    // We didn't find the block with that ID
+    return NO_RECORD;
+}
+
+bool BlockStorage::SaveBlock(uint32_t blockId, const uint8_t *data, size_t size)
+{
+    if(size > MaxBlockSize())
     {
-        uint32_t blockId;
-        uint32_t offset;
-        const uint8_t *data;
-        size_t size;
-    };
-    PgmData d = {blockId, freeBlock, data, size};
+        DBG_PRINT("Block %08x is too large to store (%zu bytes)\n", blockId, size);
+        return false;
+    }
 
-    DBG_PRINT("Flashing new record at... 0x%08x (0x%08x)\n", d.offset, d.size);
-    auto result = flash_safe_execute([](void *p) {
-        // Copy the first pages directly
-        auto params = (PgmData *)p;
+    auto start = get_absolute_time();
 
-        uint8_t tmpPage[FLASH_PAGE_SIZE];
+    // Find space to store our data
+    auto offset = AllocateRecord(size);
+    if(offset == NO_RECORD)
+    {
+        DBG_PUT("No free space found");
 
-        // The first page includes the ID
-        *(uint32_t *)tmpPage = params->blockId;
-        uint8_t off = sizeof(uint32_t); // Offset into the page buffer
-        uint32_t space = FLASH_PAGE_SIZE - off;
-        while(params->size)
+        // If there is no space, try to reclaim space used by deleted records
+        while(offset == NO_RECORD && ReclaimSpace())
+            offset = AllocateRecord(size);
+        if(offset == NO_RECORD)
         {
-            auto bytes = params->size > space ? space : params->size;
-            ::memcpy(tmpPage + off, params->data, bytes);
-            params->size -= bytes;
-            params->data += bytes;
-            space -= bytes;
-            off += bytes;
-            if(space > 0)
-                ::memset(tmpPage + off, 0, space);
-            DBG_PRINT("Flashing one page at 0x%08x\n", params->offset);
-
-            flash_range_program(params->offset, tmpPage, sizeof(tmpPage));
-            params->offset += sizeof(d);
-            off = 0; // Next page has no header
-            space = sizeof(d);
+            DBG_PUT("ERROR: Still no free space found");
+            return false;
         }
+    }
 
-    }, &d, 1000);
-    if(result != PICO_OK)
+    // Find any existing block before writing the new one, but only delete it once
+    // the new one is safely stored
+    auto existing = FindBlock(blockId);
+
+    DBG_PRINT("Flashing new record at... 0x%08x (0x%08zx)\n", offset, size);
+    if(!WriteRecord(offset, blockId, data, size, _sequence++))
+        return false;
+
+    if(existing != NO_RECORD)
     {
-        DBG_PRINT("Write failed (%d)\n", result);
+        DBG_PRINT("Deleting existing record at 0x%08x\n", existing);
+        DeleteRecord(existing);
     }
 
+    // Includes any time spent waiting to erase or compact sectors
+    auto elapsed = (uint32_t)absolute_time_diff_us(start, get_absolute_time());
+    if(elapsed > _longestSave)
+        _longestSave = elapsed;
+    return true;
 }
 
 void BlockStorage::ClearBlock(uint32_t blockId)
 {
     auto existing = FindBlock(blockId);
-    if(existing != -1)
+    if(existing != NO_RECORD)
     {
         DBG_PRINT("Deleting existing record at 0x%08x\n", existing);
-        DeletePage(existing);
+        DeleteRecord(existing);
     }
     else
     {
@@ -142,118 +494,331 @@ void BlockStorage::ClearBlock(uint32_t blockId)
 void BlockStorage::Format()
 {
     DBG_PRINT("Formatting entire block storage: 0x%08x - 0x%08x\n", _base, _sectors * FLASH_SECTOR_SIZE);
-    auto result = flash_safe_execute([](void *p) {
-        auto pthis = (BlockStorage *)p;
-        flash_range_erase(pthis->_base, pthis->_sectors * FLASH_SECTOR_SIZE);
-    }, this, 1000);
-
-    if(result == PICO_OK)
-        DBG_PUT("Formatting complete");
-    else
-        DBG_PRINT("Format failed (%d)\n", result);
+    FormatSectors(0, _sectors);
+    DBG_PUT("Formatting complete");
 }
 
 void BlockStorage::PrintStorageStats()
 {
     // Print statistics about the block storage...
-    auto offset = _base;
-    auto end = offset + _sectors * FLASH_SECTOR_SIZE - _blockPages * FLASH_PAGE_SIZE + 1;
-
     auto usedCount = 0;
-    auto freeCount = 0;
     auto clearedCount = 0;
-    auto clearedSectors = 0;    // Number of sectors cleared and ready for reformat
-
-    uint32_t emptyStart = offset;
-
-    while(offset < end)
+    auto usedBytes = 0;
+    auto freeBytes = 0;
+    auto clearedBytes = 0;
+    auto emptySectors = 0;
+    auto legacySectors = 0;
+    uint32_t minWear = -1;
+    uint32_t maxWear = 0;
+
+    for(uint32_t sector = 0; sector < _sectors; sector++)
     {
-        auto id = (uint32_t *)(XIP_BASE + offset);
-        if(*id == 0)
+        auto &info = _sectorInfo[sector];
+        if(!info.formatted)
         {
-            // A previously cleared block
-            clearedCount++;
+            legacySectors++;
+            continue;
         }
-        else
-        {
-            auto emptySectorStart = (emptyStart - _base + FLASH_SECTOR_SIZE - 1) / FLASH_SECTOR_SIZE;
-            auto emptySectorEnd = (offset - _base) / FLASH_SECTOR_SIZE;
-            if(emptySectorStart < emptySectorEnd)
-                clearedSectors += (emptySectorEnd - emptySectorStart);
 
-            emptyStart = offset + _blockPages * FLASH_PAGE_SIZE;
-            if(*id == 0xFFFFFFFF)
+        auto header = (const SectorHeader *)(XIP_BASE + _base + sector * FLASH_SECTOR_SIZE);
+        if(header->eraseCount < minWear)
+            minWear = header->eraseCount;
+        if(header->eraseCount > maxWear)
+            maxWear = header->eraseCount;
+
+        if(info.writeOffset == sizeof(SectorHeader))
+            emptySectors++;
+        freeBytes += FLASH_SECTOR_SIZE - info.writeOffset;
+        clearedBytes += info.deadBytes;
+
+        auto sectorStart = XIP_BASE + _base + sector * FLASH_SECTOR_SIZE;
+        uint32_t offset = sizeof(SectorHeader);
+        while(offset < info.writeOffset)
+        {
+            auto record = (const RecordHeader *)(sectorStart + offset);
+            if(!IsValid(record, offset))
+                break;
+            auto recordSize = RecordSize(record->length);
+            if(record->blockId == BLOCK_FREE || record->blockId == BLOCK_EMPTY)
             {
-                // A clean formatted block
-                freeCount++;
+                clearedCount++;
             }
             else
             {
-                // A block with data
                 usedCount++;
+                usedBytes += recordSize;
             }
+            offset += recordSize;
         }
-        offset += _blockPages * FLASH_PAGE_SIZE;
     }
 
-    printf("Storage statistics:\n    Sectors:  %d\n    Blocks:   %d\n    Used:     %d\n    Free:     %d\n    Del:      %d\n    Del Sect: %d\n\n", _sectors, (_sectors * FLASH_SECTOR_SIZE) / (_blockPages * FLASH_PAGE_SIZE), usedCount, freeCount, clearedCount, clearedSectors);
+    if(minWear > maxWear)
+        minWear = 0;
+
+    // Project the erase rate since mounting to a daily figure, to get an idea of flash life
+    auto uptime = absolute_time_diff_us(_mountedAt, get_absolute_time());
+    auto erasesPerDay = uptime > 0 ? (uint32_t)(_erases * 86400000000ll / uptime) : 0;
+    auto lookupCost = _lookups ? _lookupRecords / _lookups : 0;
+
+    printf("Storage statistics (v%d):\n    Sectors:  %d\n    Used:     %d (%d bytes)\n    Free:     %d bytes\n    Del:      %d (%d bytes)\n    Empty:    %d sectors\n    Legacy:   %d sectors\n    Wear:     %d-%d erases\n\n", STORAGE_VERSION, _sectors, usedCount, usedBytes, freeBytes, clearedCount, clearedBytes, emptySectors, legacySectors, minWear, maxWear);
+    printf("Storage performance:\n    Mount:    %dus\n    Erases:   %d (%d/day)\n    Programs: %d\n    Lookups:  %d (%d records each)\n    Slowest save: %dus\n\n", _mountTime, _erases, erasesPerDay, _programs, _lookups, lookupCost, _longestSave);
 }
 
-void BlockStorage::DeletePage(uint32_t pageOffset)
+uint32_t BlockStorage::AllocateRecord(size_t size, int compactingSector, bool preferWorn)
 {
-    flash_safe_execute( [](void *pg) {
+    auto recordSize = RecordSize(size);
 
-        auto offset = (uint32_t)pg;
-        uint8_t zeros[FLASH_PAGE_SIZE];
-        ::memset(zeros, 0, FLASH_PAGE_SIZE);
-        flash_range_program(offset, zeros, sizeof(zeros));
-    }, (void *)pageOffset, 1000);
+    // Always keep one empty sector back, so there is somewhere to move live records to
+    // when compacting a sector. Sectors still to be migrated will be empty once formatted.
+    auto emptySectors = 0;
+    for(auto &info : _sectorInfo)
+    {
+        if(!info.formatted || info.writeOffset == sizeof(SectorHeader))
+            emptySectors++;
+    }
+    if(compactingSector != -1)
+        emptySectors++;
+
+    // Best fit, so small records fill up the ends of partially used sectors.
+    // When starting on an empty sector, pick the least worn one.
+    // Records moved to level the wear go in the most worn sector with room instead, as they won't change.
+    auto best = -1;
+    uint32_t bestFree = FLASH_SECTOR_SIZE + 1;
+    uint32_t bestWear = -1;
+    for(uint32_t sector = 0; sector < _sectors; sector++)
+    {
+        auto &info = _sectorInfo[sector];
+        if(!info.formatted || (int)sector == compactingSector)
+            continue;
+
+        uint32_t free = FLASH_SECTOR_SIZE - info.writeOffset;
+        if(free < recordSize ||
+            (info.writeOffset == sizeof(SectorHeader) && emptySectors < 2))
+            continue;
+
+        auto wear = ((const SectorHeader *)(XIP_BASE + _base + sector * FLASH_SECTOR_SIZE))->eraseCount;
+        auto better = preferWorn ?
+            best == -1 || wear > bestWear || (wear == bestWear && free < bestFree) :
+            free < bestFree || (free == bestFree && wear < bestWear);
+        if(better)
+        {
+            best = sector;
+            bestFree = free;
+            bestWear = wear;
+        }
+    }
+
+    if(best == -1)
+        return NO_RECORD;
+
+    return _base + best * FLASH_SECTOR_SIZE + _sectorInfo[best].writeOffset;
 }
 
-void BlockStorage::FormatEmptySectors()
+bool BlockStorage::WriteRecord(uint32_t offset, uint32_t blockId, const uint8_t *data, size_t size, uint32_t sequence)
 {
+    auto &info = _sectorInfo[(offset - _base) / FLASH_SECTOR_SIZE];
+    info.writeOffset += RecordSize(size);
 
-    // Iterate through the blocks, keeping track of fully empty pages
-    auto offset = 0;
-    auto end = _sectors * FLASH_SECTOR_SIZE;
+    // Write the record with a free block ID first, and only fill in the ID once the
+    // data is complete. A partially written record is then seen as deleted.
+    struct PgmData
+    {
+        RecordHeader header;
+        ProgramParams record;
+        ProgramParams id;
+    };
+    PgmData d;
+    d.header = { BLOCK_FREE, (uint16_t)size, (uint16_t)~size, sequence, 0xFFFFFFFF };
+    d.record = { offset, (const uint8_t *)&d.header, sizeof(d.header), data, size };
+    d.id = { offset, (const uint8_t *)&blockId, sizeof(blockId), nullptr, 0 };
+
+    auto result = _flash->Program([](void *p) {
+        auto params = (PgmData *)p;
+        ProgramBytes(&params->record);
+        ProgramBytes(&params->id);
+    }, &d);
+    _programs++;
+    if(result != PICO_OK)
+    {
+        DBG_PRINT("Write failed (%d)\n", result);
+        info.deadBytes += RecordSize(size);
+        return false;
+    }
+    return true;
+}
 
-    // Assume the first sector is empty
-    auto emptySectorStart = 0;
+void BlockStorage::DeleteRecord(uint32_t offset)
+{
+    auto record = (const RecordHeader *)(XIP_BASE + offset);
+    _sectorInfo[(offset - _base) / FLASH_SECTOR_SIZE].deadBytes += RecordSize(record->length);
+
+    // Zeroing the ID marks the record as deleted, while leaving the length intact
+    uint32_t empty = BLOCK_EMPTY;
+    ProgramParams params = { offset, (const uint8_t *)&empty, sizeof(empty), nullptr, 0 };
+    _flash->Program( [](void *p) {
+        ProgramBytes((ProgramParams *)p);
+    }, &params);
+    _programs++;
+}
 
-    while(offset < end)
+bool BlockStorage::DoMaintenance()
+{
+    // Erase sectors of deleted records ahead of time, and keep a few empty sectors ready,
+    // so saving rarely has to wait for an erase
+    if(EraseDeletedSector())
+        return true;
+
+    auto emptySectors = 0;
+    for(auto &info : _sectorInfo)
     {
-        if(*(uint32_t *)(XIP_BASE + _base + offset) != BLOCK_EMPTY)
+        if(info.formatted && info.writeOffset == sizeof(SectorHeader))
+            emptySectors++;
+    }
+    if(emptySectors < PRE_ERASED_SECTORS && CompactSector(COMPACT_THRESHOLD))
+        return true;
+
+    return LevelWear();
+}
+
+bool BlockStorage::ReclaimSpace()
+{
+    return EraseDeletedSector() || CompactSector(1);
+}
+
+bool BlockStorage::EraseDeletedSector()
+{
+    // Reformat a sector that contains nothing but deleted records
+    for(uint32_t sector = 0; sector < _sectors; sector++)
+    {
+        auto &info = _sectorInfo[sector];
+        if(info.formatted &&
+            info.writeOffset > sizeof(SectorHeader) &&
+            info.writeOffset - sizeof(SectorHeader) == info.deadBytes)
         {
-            // We know the current sector is not empty
-            auto emptySectorEnd = offset / FLASH_SECTOR_SIZE;
+            FormatSectors(sector, 1);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool BlockStorage::CompactSector(uint32_t minDeadBytes)
+{
+    // Compact the sector with the most deleted data by moving its live records elsewhere.
+    // The empty sector we keep in reserve guarantees there is room for them.
+    auto victim = -1;
+    auto hasSpare = false;
+    for(uint32_t sector = 0; sector < _sectors; sector++)
+    {
+        auto &info = _sectorInfo[sector];
+        if(!info.formatted)
+            continue;
+        if(info.writeOffset == sizeof(SectorHeader))
+            hasSpare = true;
+        else if(info.deadBytes >= minDeadBytes && (victim == -1 || info.deadBytes > _sectorInfo[victim].deadBytes))
+            victim = sector;
+    }
+
+    if(victim == -1 || !hasSpare)
+        return false;
 
-            // If there were empty sectors up to this sector, format them
-            if(emptySectorEnd > emptySectorStart)
-                FormatSectors(emptySectorStart, emptySectorEnd - emptySectorStart);
+    return MoveRecords(victim);
+}
 
-            // Assume the next sector _after_ the end of this block is empty until we know otherwise
-            emptySectorStart = emptySectorEnd + 1;
+bool BlockStorage::LevelWear()
+{
+    // Records that never change pin their sectors, so the rest wear out faster.
+    // Once the difference gets large, move them into the most worn sectors to free up the unworn one.
+    auto victim = -1;
+    uint32_t minWear = -1;
+    uint32_t maxWear = 0;
+    auto hasSpare = false;
+    for(uint32_t sector = 0; sector < _sectors; sector++)
+    {
+        auto &info = _sectorInfo[sector];
+        if(!info.formatted)
+            continue;
+
+        auto wear = ((const SectorHeader *)(XIP_BASE + _base + sector * FLASH_SECTOR_SIZE))->eraseCount;
+        if(wear > maxWear)
+            maxWear = wear;
+        if(info.writeOffset == sizeof(SectorHeader))
+            hasSpare = true;
+        else if(wear < minWear)
+        {
+            victim = sector;
+            minWear = wear;
         }
-        offset += _blockPages * FLASH_PAGE_SIZE;
     }
 
-    // Format the remaining empty blocks at the end of the storage
-    if(_sectors > emptySectorStart)
-        FormatSectors(emptySectorStart, _sectors - emptySectorStart);
+    if(victim == -1 || !hasSpare || maxWear - minWear < WEAR_LEVEL_SPREAD)
+        return false;
+
+    DBG_PRINT("Levelling wear: sector %d has %d erases, vs %d\n", victim, minWear, maxWear);
+    return MoveRecords(victim, true);
 }
 
+bool BlockStorage::MoveRecords(uint32_t victim, bool preferWorn)
+{
+    DBG_PRINT("Compacting sector %d\n", victim);
+    auto sectorStart = _base + victim * FLASH_SECTOR_SIZE;
+    uint32_t offset = sizeof(SectorHeader);
+    while(offset < _sectorInfo[victim].writeOffset)
+    {
+        auto record = (const RecordHeader *)(XIP_BASE + sectorStart + offset);
+        if(!IsValid(record, offset))
+            break;
+        if(record->blockId != BLOCK_FREE && record->blockId != BLOCK_EMPTY)
+        {
+            auto target = AllocateRecord(record->length, victim, preferWorn);
+            if(target == NO_RECORD ||
+                !WriteRecord(target, record->blockId, (const uint8_t *)(record + 1), record->length, record->sequence))
+            {
+                DBG_PUT("ERROR: Unable to move record while compacting");
+                return false;
+            }
+        }
+        offset += RecordSize(record->length);
+    }
 
-void BlockStorage::FormatSectors(int sector, int count)
+    FormatSectors(victim, 1);
+    return true;
+}
+
+void BlockStorage::FormatSectors(uint32_t sector, uint32_t count)
 {
     DBG_PRINT("Formatting sectors %d to %d\n", sector, sector + count - 1);
+
+    // Carry the erase counts over, so we can see how the wear is spread
+    std::vector<uint32_t> eraseCounts(count);
+    for(uint32_t a = 0; a < count; a++)
+    {
+        auto header = (const SectorHeader *)(XIP_BASE + _base + (sector + a) * FLASH_SECTOR_SIZE);
+        eraseCounts[a] = (header->magic == STORAGE_MAGIC ? header->eraseCount : 0) + 1;
+    }
+
     struct FmtParams
     {
         uint32_t base;
-        uint32_t size;
+        uint32_t count;
+        const uint32_t *eraseCounts;
     };
-    FmtParams params = { _base + sector * FLASH_SECTOR_SIZE,  count * FLASH_SECTOR_SIZE };
-    flash_safe_execute( [] (void *p) {
+    FmtParams params = { _base + sector * FLASH_SECTOR_SIZE, count, eraseCounts.data() };
+    auto result = _flash->Erase( [] (void *p) {
         auto params = (FmtParams *)p;
-        flash_range_erase(params->base, params->size);
-    }, &params, 1000);
-}
\ No newline at end of file
+        flash_range_erase(params->base, params->count * FLASH_SECTOR_SIZE);
+        for(uint32_t a = 0; a < params->count; a++)
+        {
+            SectorHeader header = { STORAGE_MAGIC, STORAGE_VERSION, sizeof(SectorHeader), params->eraseCounts[a], 0xFFFFFFFF };
+            ProgramParams pgm = { params->base + a * FLASH_SECTOR_SIZE, (const uint8_t *)&header, sizeof(header), nullptr, 0 };
+            ProgramBytes(&pgm);
+        }
+    }, &params);
+    _erases += count;
+
+    if(result != PICO_OK)
+        DBG_PRINT("Format failed (%d)\n", result);
+
+    for(uint32_t a = sector; a < sector + count; a++)
+        ScanSector(a);
+}
@@ -3,27 +3,45 @@
 
 #pragma once
 
+#include <vector>
+#include <memory>
 
-/// @brief Trivial and extremely limited flash block storage with rudimentary wear leveling
+class FlashScheduler;
+
+/// @brief Simple log-structured flash storage for variable length blocks, with rudimentary wear leveling
+/// @remarks Each sector starts with a versioned header, followed by records appended one after another.
+/// Each record has a small header holding the block ID and its length, so small blocks pack densely
+/// and large blocks can span several pages (but never more than one sector). It also holds a sequence
+/// number, so if a power cut leaves two copies of a block, mounting keeps the one saved last.
 class BlockStorage
 {
 public:
-    /// @brief Initialize the block storage
+    /// @brief Initialize the block storage, migrating from an older format if needed
+    /// @param flash Scheduler to run flash operations through
     /// @param base Base address in flash for block storage - must be multiple of FLASH_SECTOR_SIZE (4096)
     /// @param size size of the block storage - must be multiple of FLASH_SECTOR_SIZE (4096)
-    /// @param blockSize max size of each block (will be rounded up to multiples of FLASH_PAGE_SIZE - 4)
-    BlockStorage(uint32_t base, size_t size, size_t blockSize);
+    /// @param legacyBlockSize block size used by the original fixed-block storage format. Only needed to migrate old data.
+    BlockStorage(std::shared_ptr<FlashScheduler> flash, uint32_t base, size_t size, size_t legacyBlockSize);
 
     /// @brief Returns a pointer to the block
     /// @param blockId Id of the previously stored block
+    /// @param size [out] Optional. Receives the size of the stored block
     /// @return the stored block data (a pointer directly into flash memory). It can't be modified!
-    const uint8_t *GetBlock(uint32_t blockId) const;
+    const uint8_t *GetBlock(uint32_t blockId, size_t *size = nullptr) const;
+
+    /// @brief Enumerates the stored blocks, in storage order
+    /// @param cursor [in/out] 0 to start with the first block. Updated to continue from the next block
+    /// @param blockId [out] Receives the ID of the block
+    /// @param size [out] Receives the size of the block
+    /// @return the block data, or nullptr if there are no more blocks
+    const uint8_t *NextBlock(uint32_t *cursor, uint32_t *blockId, size_t *size) const;
 
     /// @brief Stores a block in flash, overwriting any previous block with that ID
     /// @param blockId Id of the block to store
     /// @param data Data to store in the block
-    /// @param size Size of the data to store in the block (must be <= blockSize)
-    void SaveBlock(uint32_t blockId, const uint8_t *data, size_t size);
+    /// @param size Size of the data to store in the block (must be <= MaxBlockSize())
+    /// @return false if the block could not be stored
+    bool SaveBlock(uint32_t blockId, const uint8_t *data, size_t size);
 
     /// @brief Clears a block in flash
     /// @param blockId Id of the block to clear
@@ -32,18 +50,70 @@ public:
     /// @brief Formats (clears) the entire block storage. DANGER!
     void Format();
 
-    uint32_t BlockSize() { return _blockPages * 256 - 4; }
+    /// @brief The largest block that can be stored
+    static uint32_t MaxBlockSize();
+
+    /// @brief Does one step of background maintenance, erasing space ahead of time
+    /// @return True if there is more to do
+    bool DoMaintenance();
+
+    /// @brief Sector erases since mounting
+    uint32_t GetEraseCount() const { return _erases; }
+
+    /// @brief The longest time taken to save a block, in microseconds
+    uint32_t GetLongestSave() const { return _longestSave; }
 
+    /// @brief Prints usage, wear and performance statistics
     void PrintStorageStats();
 
 private:
+    /// @brief What we know about each sector, so we don't need to rescan flash to find free space
+    struct SectorInfo
+    {
+        bool formatted;         // False for sectors still in an older format (or not yet formatted)
+        uint16_t writeOffset;   // Offset of the free space at the end of the sector
+        uint16_t deadBytes;     // Bytes used by deleted or incomplete records
+    };
+
+    /// @brief A live block found in a sector still in an older format
+    struct LegacyBlock
+    {
+        uint32_t blockId;
+        const uint8_t *data;    // Directly in flash, so only valid until its sector is erased
+        size_t size;
+    };
+
+    void Mount(size_t legacyBlockSize);
+    void ScanSector(uint32_t sector);
+    void RemoveStaleCopies();
+    void MigrateLegacySectors(size_t legacyBlockSize);
+    void CollectLegacyBlocks(uint32_t sector, size_t slotSize, std::vector<LegacyBlock> &blocks) const;
+    bool IsLegacySlotSpanned(uint32_t sector, size_t slotSize) const;
+
     uint32_t FindBlock(uint32_t blockId) const;
-    void DeletePage(uint32_t pageOffset);
+    uint32_t AllocateRecord(size_t size, int compactingSector = -1, bool preferWorn = false);
+    bool WriteRecord(uint32_t offset, uint32_t blockId, const uint8_t *data, size_t size, uint32_t sequence);
+    void DeleteRecord(uint32_t offset);
 
-    void FormatEmptySectors();
-    void FormatSectors(int sectorNumber, int count);
+    bool ReclaimSpace();
+    bool EraseDeletedSector();
+    bool CompactSector(uint32_t minDeadBytes);
+    bool LevelWear();
+    bool MoveRecords(uint32_t sector, bool preferWorn = false);
+    void FormatSectors(uint32_t sectorNumber, uint32_t count);
 
+    std::shared_ptr<FlashScheduler> _flash;
     uint32_t _base;         // Base address of storage
     uint32_t _sectors;      // Number of sectors allocated to storage
-    uint32_t _blockPages;   // Number of pages in each block
+    std::vector<SectorInfo> _sectorInfo;
+    uint32_t _sequence;     // Sequence number for the next block saved
+
+    // Performance counters, to see how the storage behaves over time
+    absolute_time_t _mountedAt;
+    uint32_t _mountTime;            // Microseconds to mount (and migrate) the storage
+    uint32_t _erases;               // Sectors erased since mounting
+    uint32_t _programs;             // Program operations since mounting
+    mutable uint32_t _lookups;      // Blocks looked up
+    mutable uint32_t _lookupRecords;// Records scanned by those lookups
+    uint32_t _longestSave;          // Slowest save, in microseconds
 };
@@ -3,6 +3,10 @@
 
 #pragma once
 
+#include <stdio.h>
+#include <string.h>
+#include <string>
+
 /// @brief Helper class for witing SSI tag buffers
 class BufferOutput
 {
@@ -17,7 +21,7 @@ class BufferOutput
         void Append(const char *str)
         {
             auto len = strlen(str);
-            if(len > _length)
+            if(len > (size_t)_length)
                 return;
             memcpy(_buffer, str, len);
             _buffer += len;
@@ -49,7 +53,7 @@ class BufferOutput
         void Append(const std::string &str)
         {
             auto len = str.length();
-            if(len > _length)
+            if(len > (size_t)_length)
                 return;
             memcpy(_buffer, str.data(), str.length());
             _buffer += len;
@@ -78,6 +82,20 @@ class BufferOutput
             _written += 8;
         }        
 
+        void AppendHex(const uint8_t *data, size_t size)
+        {
+            static const char digits[] = "0123456789abcdef";
+            if((int)(size * 2) > _length)
+                return;
+            for(size_t a = 0; a < size; a++)
+            {
+                *_buffer++ = digits[data[a] >> 4];
+                *_buffer++ = digits[data[a] & 0xF];
+            }
+            _length -= size * 2;
+            _written += size * 2;
+        }
+
         void Append(char c)
         {
             if(!_length)
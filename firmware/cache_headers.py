@@ -0,0 +1,79 @@
+#!/usr/bin/env python3
+# Copyright (c) 2023 Mark Godwin.
+# SPDX-License-Identifier: MIT
+"""Add caching headers to the static files in a makefsdata generated fsdata.c.
+
+Every static file gets a strong ETag from a hash of its contents, so the web server can answer conditional
+requests with 304 Not Modified. Files with a content hash in their name (the React build's /static/ bundles)
+never change, so are marked immutable. Everything else, like index.html, must be checked each time.
+The SSI api files are generated on the fly, so are left alone.
+
+usage: cache_headers.py fsdata.c
+"""
+
+import hashlib
+import re
+import sys
+
+IMMUTABLE = b"Cache-Control: public, max-age=31536000, immutable\r\n"
+REVALIDATE = b"Cache-Control: no-cache\r\n"
+HASHED_NAME = re.compile(rb"^/static/.*\.[0-9a-f]{8,}\.[a-z]+$")
+
+BLOCK = re.compile(
+    r"(static const unsigned char FSDATA_ALIGN_PRE data_(\w+)\[\] FSDATA_ALIGN_POST = \{\n)(.*?)(\};\n)", re.S)
+
+
+def hex_lines(data):
+    return "\n".join("".join("0x%02x," % c for c in data[i:i + 16]) for i in range(0, len(data), 16))
+
+
+def parse_bytes(text):
+    # Drop the comments, which can contain anything, before picking out the bytes
+    text = re.sub(r"/\*.*?\*/", "", text, flags=re.S)
+    return bytes(int(b, 16) for b in re.findall(r"0x([0-9a-fA-F]{2})", text))
+
+
+def rewrite(match):
+    data = parse_bytes(match.group(3))
+    name_end = data.index(b"\0")
+    name_length = (name_end + 4) & ~3
+    name = data[:name_end]
+    header_end = data.find(b"\r\n\r\n", name_length) + 4
+    headers = data[name_length:header_end].split(b"\r\n")[:-2]
+    body = data[header_end:]
+
+    # SSI files are filled in as they are sent, so can't be cached
+    if name.startswith(b"/api/") or any(h.startswith(b"ETag:") for h in headers):
+        return match.group(0)
+
+    # A strong validator for exactly these bytes. The web server makes it weak when it decompresses the file.
+    etag = b'ETag: "%s"\r\n' % hashlib.sha1(body).hexdigest()[:16].encode()
+    cache = IMMUTABLE if HASHED_NAME.match(name) else REVALIDATE
+    lines = [h + b"\r\n" for h in headers]
+    extra = [etag, cache]
+    if any(h.startswith(b"Content-Encoding:") for h in headers):
+        extra.append(b"Vary: Accept-Encoding\r\n")
+    # Before Content-Type, which makefsdata always puts last
+    lines[-1:-1] = extra
+    lines[-1] += b"\r\n"
+
+    out = "/* %s (%d chars) */\n%s\n\n/* HTTP header */\n" % (name.decode(), name_end + 1, hex_lines(data[:name_length]))
+    for line in lines:
+        # makefsdata counts the length header without its number
+        length = "18+" if line.startswith(b"Content-Length:") else str(len(line))
+        out += '/* "%s" (%s bytes) */\n%s\n' % (line.decode().replace("\r\n", "\n"), length, hex_lines(line))
+    out += "/* raw file data (%d bytes) */\n%s" % (len(body), hex_lines(body))
+    return match.group(1) + out + match.group(4)
+
+
+def main():
+    path = sys.argv[1]
+    with open(path, newline="") as f:
+        text = f.read().replace("\r\n", "\n")
+    text = BLOCK.sub(rewrite, text)
+    with open(path, "w", newline="\r\n") as f:
+        f.write(text)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,160 @@
+// Copyright (c) 2023 Mark Godwin.
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+/// @brief Converts a hex digit to its value, or -1 if it isn't one
+inline char hexToInt(char x)
+{
+    if(x >= '0' && x <= '9')
+        return x - '0';
+    if(x >= 'a' && x <= 'f')
+        return x + 10 - 'a';
+    if(x >= 'A' && x <= 'F')
+        return x + 10 - 'A';
+    return -1;
+}
+
+/// @brief Read only view of the query string parameters httpd split out of a request.
+/// @remarks Nothing is copied: names and values point into httpd's request buffer, so the view is only valid for
+/// the call it is passed to. There are at most LWIP_HTTPD_MAX_CGI_PARAMETERS of them, so lookups just scan.
+class CgiParams
+{
+    public:
+        CgiParams(int count, char **names, char **values)
+        :   _count(count),
+            _names(names),
+            _values(values)
+        {
+        }
+
+        int Count() const { return _count; }
+        const char *Name(int index) const { return _names[index]; }
+        const char *Value(int index) const { return _values[index]; }
+
+        bool Has(const char *name) const { return Get(name) != nullptr; }
+
+        /// @brief Value of a parameter
+        /// @return The value, or null if there is no such parameter
+        const char *Get(const char *name) const
+        {
+            for(auto a = 0; a < _count; a++)
+            {
+                if(!strcmp(_names[a], name))
+                    return _values[a];
+            }
+            return nullptr;
+        }
+
+        /// @brief True if the parameter is there and has this value
+        bool Equals(const char *name, const char *value) const
+        {
+            auto param = Get(name);
+            return param && !strcmp(param, value);
+        }
+
+        /// @brief Copy a parameter into a buffer
+        /// @return False if it is missing, or doesn't fit with its terminator
+        bool GetString(const char *name, char *buffer, uint32_t size) const
+        {
+            auto param = Get(name);
+            return param && strlcpy(buffer, param, size) < size;
+        }
+
+        /// @brief Read a whole decimal number
+        /// @return False if it is missing, isn't a number, or doesn't fit
+        bool GetInt(const char *name, int32_t &value) const
+        {
+            auto param = Get(name);
+            if(!param)
+                return false;
+            auto negative = *param == '-';
+            uint32_t magnitude;
+            if(!ParseUInt(negative ? param + 1 : param, param + strlen(param), magnitude) ||
+                magnitude > (negative ? (uint32_t)INT32_MAX + 1 : (uint32_t)INT32_MAX))
+                return false;
+            value = negative ? (int32_t)(0 - magnitude) : (int32_t)magnitude;
+            return true;
+        }
+
+        bool GetUInt(const char *name, uint32_t &value) const
+        {
+            auto param = Get(name);
+            return param && ParseUInt(param, param + strlen(param), value);
+        }
+
+        /// @brief Read a number that must fit in a smaller type, like a port or blind id
+        template<typename T>
+        bool GetUInt(const char *name, T &value, uint32_t max) const
+        {
+            uint32_t result;
+            if(!GetUInt(name, result) || result > max)
+                return false;
+            value = result;
+            return true;
+        }
+
+        /// @brief Read true/false or 1/0
+        /// @return False if it is missing or neither
+        bool GetBool(const char *name, bool &value) const
+        {
+            auto param = Get(name);
+            if(!param)
+                return false;
+            if(!strcmp(param, "true") || !strcmp(param, "1"))
+                value = true;
+            else if(!strcmp(param, "false") || !strcmp(param, "0"))
+                value = false;
+            else
+                return false;
+            return true;
+        }
+
+        /// @brief Read the digits between begin and end, with nothing else
+        /// @return False if there are no digits, something else is there, or it doesn't fit
+        static bool ParseUInt(const char *begin, const char *end, uint32_t &value)
+        {
+            if(begin == end)
+                return false;
+            uint64_t result = 0;
+            for(auto p = begin; p < end; p++)
+            {
+                if(*p < '0' || *p > '9')
+                    return false;
+                result = result * 10 + (*p - '0');
+                if(result > UINT32_MAX)
+                    return false;
+            }
+            value = result;
+            return true;
+        }
+
+        /// @brief Decode a query string value where it is, as it can only get shorter
+        /// @remarks '+' becomes a space and %xx the byte it encodes. A '%' not followed by two hex digits is kept.
+        /// So is %00, as a NUL would cut the value short without anyone noticing.
+        static void UrlDecode(char *value)
+        {
+            auto out = value;
+            while(auto chr = *value++)
+            {
+                if(chr == '+')
+                    chr = ' ';
+                else if(chr == '%' && hexToInt(value[0]) != (char)-1 && hexToInt(value[1]) != (char)-1 &&
+                    (hexToInt(value[0]) | hexToInt(value[1])))
+                {
+                    chr = (hexToInt(value[0]) << 4) | hexToInt(value[1]);
+                    value += 2;
+                }
+                *out++ = chr;
+            }
+            *out = 0;
+        }
+
+    private:
+        int _count;
+        char **_names;
+        char **_values;
+};
@@ -6,6 +6,7 @@
 #include "pico/multicore.h"
 #include "pico/flash.h"
 #include <string.h>
+#include <algorithm>
 #include "commandQueue.h"
 #include "radio.h"
 #include "statusLed.h"
@@ -18,6 +19,23 @@ struct CommandEntry
     uint16_t rollingCode;
     uint16_t repeat;
     SomfyButton button;
+    uint16_t batchRemaining;    // Commands still to come in the same batch
+    CommandSource source;
+};
+
+// Limits for each source, in CommandSource order. A source can send a burst of commands at once, then carries on at
+// its rate. It can only have a burst waiting at once, which is less than the queue holds, so the others still get in.
+static const struct
+{
+    uint8_t burst;
+    uint8_t perSecond;
+} sourceLimits[COMMAND_SOURCE_COUNT] =
+{
+    { 16, 8 },      // None
+    { 24, 4 },      // Mqtt: automations move whole rooms at once
+    { 24, 2 },      // Web: enough for a full batch, but not a script in a loop
+    { 0, 0 },       // Remote: received, never sent
+    { 16, 8 },      // Schedule: stopping blinds where they were sent, which mustn't be missed
 };
 
 class SpinLock
@@ -40,26 +58,150 @@ private:
 RadioCommandQueue::RadioCommandQueue(std::shared_ptr<RFM69Radio> radio, StatusLed *led)
 :   _radio(std::move(radio)),
     _led(led),
+    _transmitting(false),
+    _batching(false),
+    _batchCount(0),
+    _batchReserved(0),
     _recvWrite(0),
     _recvRead(0),
     _recvCount(0)
 {
-    queue_init(&_queue, sizeof(CommandEntry), 16);
+    memset(_sources, 0, sizeof(_sources));
+    for(auto a = 0; a < COMMAND_SOURCE_COUNT; a++)
+    {
+        _sources[a].tokens = sourceLimits[a].burst * 1000;
+        _sources[a].lastRefill = get_absolute_time();
+    }
+
+    queue_init(&_queue, sizeof(CommandEntry), COMMAND_QUEUE_SIZE);
+    mutex_init(&_transmitLock);
     _lockNum = spin_lock_claim_unused(true);
     _recvLock = spin_lock_init(_lockNum);
 }
 
-bool RadioCommandQueue::QueueCommand(SomfyCommand command)
+void RadioCommandQueue::RefillTokens(SourceState &state, CommandSource source)
+{
+    auto now = get_absolute_time();
+    auto elapsedMs = absolute_time_diff_us(state.lastRefill, now) / 1000;
+    if(elapsedMs <= 0)
+        return;
+    // Keep the part of a ms that hasn't been counted yet
+    state.lastRefill = delayed_by_ms(state.lastRefill, elapsedMs);
+    // Thousandths of a command per ms is commands per second
+    auto &limits = sourceLimits[(int)source];
+    state.tokens = std::min<uint64_t>(state.tokens + elapsedMs * limits.perSecond, limits.burst * 1000);
+}
+
+bool RadioCommandQueue::CanQueue(CommandSource source, uint32_t count, uint32_t *retryAfterMs)
+{
+    auto &limits = sourceLimits[(int)source];
+    auto &state = _sources[(int)source];
+    if(!limits.perSecond)
+    {
+        // Received remote presses are never sent
+        *retryAfterMs = UINT32_MAX;
+        return false;
+    }
+    RefillTokens(state, source);
+
+    auto waiting = state.queued - state.taken;
+    if(waiting + count > limits.burst)
+    {
+        // Until the radio has worked through enough of them
+        *retryAfterMs = (waiting + count - limits.burst) * COMMAND_SEND_TIME_MS;
+        return false;
+    }
+    if(state.tokens < count * 1000)
+    {
+        *retryAfterMs = (count * 1000 - state.tokens) / limits.perSecond;
+        return false;
+    }
+    return true;
+}
+
+bool RadioCommandQueue::QueueCommand(SomfyCommand command, CommandSource source)
 {
+    auto &state = _sources[(int)source];
+    if(_batching && _batchCount == _batchReserved)
+    {
+        DBG_PRINT("Command from source %d doesn't fit in the batch\n", (int)source);
+        state.stats.dropped++;
+        return false;
+    }
+
+    uint32_t retryAfterMs;
+    if(!CanQueue(source, 1, &retryAfterMs))
+    {
+        DBG_PRINT("Command from source %d is over its limit, try again in %dms\n", (int)source, retryAfterMs);
+        state.stats.limited++;
+        return false;
+    }
+    state.tokens -= 1000;
+
+    if(_batching)
+    {
+        // Counted as waiting from now, so the batch can't go over the limit
+        state.queued++;
+        _batchSources[_batchCount] = source;
+        _batch[_batchCount++] = command;
+        return true;
+    }
+
     CommandEntry entry = { 
         commandType: 1,
         remoteId: command.remoteId,
         rollingCode: command.rollingCode,
         repeat: command.repeat,
-        button: command.button
+        button: command.button,
+        batchRemaining: 0,
+        source: source
     };
 
-    return queue_try_add(&_queue, &entry);
+    if(!queue_try_add(&_queue, &entry))
+    {
+        state.stats.dropped++;
+        return false;
+    }
+    state.queued++;
+    state.stats.sent++;
+    return true;
+}
+
+bool RadioCommandQueue::BeginBatch(uint32_t count)
+{
+    // The worker holds the radio until the whole batch is sent, so it must all go in. Only this core adds
+    // commands, so the room can't be taken while the batch is collected. Leave a little more for received
+    // packets arriving at the same time.
+    if(count > MAX_COMMAND_BATCH || COMMAND_QUEUE_SIZE - queue_get_level(&_queue) < count + 2)
+    {
+        DBG_PRINT("No room to send a batch of %d commands\n", count);
+        return false;
+    }
+    _batching = true;
+    _batchCount = 0;
+    _batchReserved = count;
+    return true;
+}
+
+void RadioCommandQueue::CommitBatch()
+{
+    _batching = false;
+    auto count = _batchCount;
+    _batchCount = 0;
+    for(uint32_t a = 0; a < count; a++)
+    {
+        CommandEntry entry = { 
+            commandType: 1,
+            remoteId: _batch[a].remoteId,
+            rollingCode: _batch[a].rollingCode,
+            repeat: _batch[a].repeat,
+            button: _batch[a].button,
+            batchRemaining: (uint16_t)(count - a - 1),
+            source: _batchSources[a]
+        };
+        queue_add_blocking(&_queue, &entry);
+        _sources[(int)_batchSources[a]].stats.sent++;
+    }
 }
 
 bool RadioCommandQueue::ReadCommand(SomfyCommand *command)
@@ -81,6 +223,7 @@ bool RadioCommandQueue::ReadCommand(SomfyCommand *command)
     command->rollingCode = _receivedCommands[_recvRead].command.rollingCode;
     command->repeat = _receivedCommands[_recvRead].command.repeat;
     command->button = _receivedCommands[_recvRead].command.button;
+    command->rssi = _receivedCommands[_recvRead].command.rssi;
     _recvCount--;
     _recvRead = (_recvRead + 1) % (MAX_RECV_QUEUE);
     if(_recvCount == 0)
@@ -103,6 +246,16 @@ void RadioCommandQueue::Shutdown()
     } 
 }
 
+bool RadioCommandQueue::HoldTransmissions(uint32_t timeoutMs)
+{
+    return mutex_enter_timeout_ms(&_transmitLock, timeoutMs);
+}
+
+void RadioCommandQueue::ReleaseTransmissions()
+{
+    mutex_exit(&_transmitLock);
+}
+
 /// @brief Called when there is a packet to be read from the radio
 void RadioCommandQueue::QueueReceive()
 {
@@ -182,7 +335,18 @@ void RadioCommandQueue::Worker()
             case 0:
                 return;
             case 1:
+                _sources[(int)entry.source].taken++;
+                // Wait for any long flash operation to finish, so it can't break up the frame timing.
+                // Keep hold of the radio until the end of a batch, so it all goes out together.
+                if(!_transmitting)
+                    mutex_enter_blocking(&_transmitLock);
+                _transmitting = true;
                 ExecuteCommand(entry.remoteId, entry.rollingCode, entry.button, entry.repeat);
+                if(entry.batchRemaining == 0)
+                {
+                    _transmitting = false;
+                    mutex_exit(&_transmitLock);
+                }
                 break;
             case 2:
                 ReceiveCommand();
@@ -254,6 +418,7 @@ void RadioCommandQueue::ReceiveCommand()
 {
     uint8_t msg[7];
     _radio->ReceivePacket(msg, sizeof(msg));
+    auto rssi = _radio->GetRssi();
 
     //printf("Packet recieved: %02x%02x%02x%02x%02x%02x%02x\n", msg[0], msg[1], msg[2], msg[3], msg[4], msg[5], msg[6]);
 
@@ -296,6 +461,9 @@ void RadioCommandQueue::ReceiveCommand()
             _receivedCommands[_recvWrite].command.button == button)
         {
             _receivedCommands[_recvWrite].command.repeat++;
+            // Keep the strongest of the repeats
+            if(rssi > _receivedCommands[_recvWrite].command.rssi)
+                _receivedCommands[_recvWrite].command.rssi = rssi;
             _receivedCommands[_recvWrite].lastMsgTime = now;
             save = false;
         }
@@ -315,6 +483,7 @@ void RadioCommandQueue::ReceiveCommand()
         _receivedCommands[_recvWrite].command.rollingCode = roll;
         _receivedCommands[_recvWrite].command.button = button;
         _receivedCommands[_recvWrite].command.repeat = 0;
+        _receivedCommands[_recvWrite].command.rssi = rssi;
         _receivedCommands[_recvWrite].lastMsgTime = now;
         _recvCount++;
     }
@@ -4,8 +4,10 @@
 #pragma once
 
 enum SomfyButton : int;
+enum class CommandSource : uint8_t;
 
 #include "pico/util/queue.h"
+#include "pico/mutex.h"
 #include <memory>
 
 class RFM69Radio;
@@ -17,6 +19,7 @@ struct SomfyCommand
     uint16_t rollingCode;
     uint16_t repeat;
     SomfyButton button;
+    int8_t rssi;        // Signal strength in dBm, for received commands
 };
 
 struct RecvCommand
@@ -27,6 +30,26 @@ struct RecvCommand
 
 #define MAX_RECV_QUEUE 8
 
+// Commands waiting for the radio
+#define COMMAND_QUEUE_SIZE 32
+
+// Most commands that can be sent together as one batch
+#define MAX_COMMAND_BATCH 24
+
+// One for each CommandSource
+#define COMMAND_SOURCE_COUNT 5
+
+// Roughly how long the radio takes to send a short press, for telling a source when the queue will have room
+#define COMMAND_SEND_TIME_MS 500
+
+/// @brief What happened to the commands from one source
+struct CommandSourceStats
+{
+    uint32_t sent;          // Added to the radio queue
+    uint32_t limited;       // Turned away because the source was over its rate, or had too many waiting
+    uint32_t dropped;       // Turned away because the radio queue was full
+};
+
 /// @brief Queue for executing radio commands
 /// @remarks Because radio commands take a while, and need to be executed with precise timing (and for fun/overkill) we'll run the commands from the pico's second thread
 class RadioCommandQueue
@@ -34,18 +57,63 @@ class RadioCommandQueue
 public:
     RadioCommandQueue(std::shared_ptr<RFM69Radio> radio, StatusLed *led);
 
-    bool QueueCommand(SomfyCommand command);
+    /// @brief Queue a command to send
+    /// @remarks Each source has a token bucket, and a limit on how many of its commands can be waiting at once,
+    /// so one busy source can't fill the queue and hold up the others.
+    /// @return false if the source is over its limits, or the queue is full
+    bool QueueCommand(SomfyCommand command, CommandSource source);
+
+    /// @brief Check a source could queue count commands now, without queuing anything
+    /// @param retryAfterMs Set to how long until it could, if it can't, or UINT32_MAX if the source never sends
+    bool CanQueue(CommandSource source, uint32_t count, uint32_t *retryAfterMs);
+
+    const CommandSourceStats &GetSourceStats(CommandSource source) { return _sources[(int)source].stats; }
+
+    /// @brief Commands from a source that are waiting for the radio
+    uint32_t GetWaitingCount(CommandSource source) { return _sources[(int)source].queued - _sources[(int)source].taken; }
+
+    /// @brief Collect the commands queued from here on, to be sent as one batch by CommitBatch.
+    /// The batch goes out back to back, in order, without a flash operation splitting it up.
+    /// @param count Most commands that will be queued, up to MAX_COMMAND_BATCH. Room is kept for them in the
+    /// radio queue, so any command QueueCommand accepts is sure to be sent. Any more are turned away.
+    /// @return false if the radio queue doesn't have room, in which case nothing is collected
+    bool BeginBatch(uint32_t count);
+
+    /// @brief Send the commands collected since BeginBatch
+    void CommitBatch();
 
     // Read commands from other remotes recieved over the airwaves
     bool ReadCommand(SomfyCommand *command);
 
     void Shutdown();
 
+    /// @brief True if a command is being transmitted right now
+    bool IsTransmitting() { return _transmitting; }
+
+    /// @brief True if nothing is being transmitted, or waiting to be
+    bool IsIdle() { return !_transmitting && queue_is_empty(&_queue); }
+
+    /// @brief Stop any new transmissions from starting, e.g. for a long flash operation
+    /// @param timeoutMs How long to wait for the current transmission to finish
+    /// @return false if the radio was still transmitting after the timeout
+    bool HoldTransmissions(uint32_t timeoutMs);
+    void ReleaseTransmissions();
+
     /// @brief Runs the queue processing until shut down
     void Start();
 
 
 private:
+    struct SourceState
+    {
+        uint32_t tokens;                // In thousandths of a command
+        absolute_time_t lastRefill;
+        uint32_t queued;                // Counted up as commands are queued, by this core
+        volatile uint32_t taken;        // Counted up as the worker takes them off the queue
+        CommandSourceStats stats;
+    };
+
+    void RefillTokens(SourceState &state, CommandSource source);
     void QueueReceive();
 
     void Worker();
@@ -55,6 +123,16 @@ private:
     std::shared_ptr<RFM69Radio> _radio;
     StatusLed *_led;
     queue_t _queue;
+    mutex_t _transmitLock;
+    volatile bool _transmitting;
+
+    bool _batching;
+    uint32_t _batchCount;
+    uint32_t _batchReserved;    // Room kept in the queue for the batch
+    SomfyCommand _batch[MAX_COMMAND_BATCH];
+    CommandSource _batchSources[MAX_COMMAND_BATCH];
+
+    SourceState _sources[COMMAND_SOURCE_COUNT];
 
     int _recvWrite;
     int _recvRead;
@@ -7,6 +7,7 @@
 #include "serviceControl.h"
 #include "deviceConfig.h"
 #include "wifiScanner.h"
+#include "bufferOutput.h"
 
 #define TAGINDEX_SSID 0
 #define TAGINDEX_SSIDLIST 1
@@ -14,6 +15,8 @@
 #define TAGINDEX_MQTTPORT 1
 #define TAGINDEX_MQTTUSER 2
 #define TAGINDEX_MQTTTOPIC 3
+#define TAGINDEX_MQTTJSON 4
+#define TAGINDEX_MQTTFAILOVER 5
 
 ConfigService::ConfigService(
     std::shared_ptr<DeviceConfig> config,
@@ -33,35 +36,36 @@ ConfigService::ConfigService(
     _ssiHandlers.push_back(SsiSubscription(webServer, "mqttPort", [this] (char *pcInsert, int iInsertLen, uint16_t tagPart, uint16_t *nextPart) { return HandleMqttConfigResponse(TAGINDEX_MQTTPORT, pcInsert, iInsertLen, tagPart, nextPart); }));
     _ssiHandlers.push_back(SsiSubscription(webServer, "mqttUser", [this] (char *pcInsert, int iInsertLen, uint16_t tagPart, uint16_t *nextPart) { return HandleMqttConfigResponse(TAGINDEX_MQTTUSER, pcInsert, iInsertLen, tagPart, nextPart); }));
     _ssiHandlers.push_back(SsiSubscription(webServer, "mqttTopi", [this] (char *pcInsert, int iInsertLen, uint16_t tagPart, uint16_t *nextPart) { return HandleMqttConfigResponse(TAGINDEX_MQTTTOPIC, pcInsert, iInsertLen, tagPart, nextPart); }));
+    _ssiHandlers.push_back(SsiSubscription(webServer, "mqttJson", [this] (char *pcInsert, int iInsertLen, uint16_t tagPart, uint16_t *nextPart) { return HandleMqttConfigResponse(TAGINDEX_MQTTJSON, pcInsert, iInsertLen, tagPart, nextPart); }));
+    _ssiHandlers.push_back(SsiSubscription(webServer, "mqttFail", [this] (char *pcInsert, int iInsertLen, uint16_t tagPart, uint16_t *nextPart) { return HandleMqttConfigResponse(TAGINDEX_MQTTFAILOVER, pcInsert, iInsertLen, tagPart, nextPart); }));
     _ssiHandlers.push_back(SsiSubscription(webServer, "mqttAddr", [this] (char *pcInsert, int iInsertLen, uint16_t tagPart, uint16_t *nextPart) { return HandleMqttConfigResponse(TAGINDEX_MQTTADDR, pcInsert, iInsertLen, tagPart, nextPart); }));
 
 }
 
 bool ConfigService::OnConfigure(const CgiParams &params)
 {
-    auto modeParam = params.find("mode");
-    if(modeParam == params.end())
+    auto mode = params.Get("mode");
+    if(!mode)
         return false;
-    auto &mode = modeParam->second;
 
-    if(mode == "wifi")
+    if(!strcmp(mode, "wifi"))
     {
-        if(!params.count("ssid") ||
-            !params.count("password"))
+        auto ssid = params.Get("ssid");
+        auto password = params.Get("password");
+        if(!ssid || !password)
             return false;
 
         WifiConfig cfg;
         memset(&cfg, 0, sizeof(cfg));
-        strlcpy(cfg.ssid, params.at("ssid").c_str(), sizeof(cfg.ssid));
-        auto &password = params.at("password");
-        if(password == "********")
+        strlcpy(cfg.ssid, ssid, sizeof(cfg.ssid));
+        if(!strcmp(password, "********"))
         {
             auto oldCConfig = _config->GetWifiConfig();
             strlcpy(cfg.password, oldCConfig->password, sizeof(cfg.password));
         }
         else
         {
-            strlcpy(cfg.password, password.c_str(), sizeof(cfg.password));
+            strlcpy(cfg.password, password, sizeof(cfg.password));
         }
 
         DBG_PUT("Saving config\n");
@@ -70,33 +74,59 @@ bool ConfigService::OnConfigure(const CgiParams &params)
         _serviceControl->StopService();
         return true;
     }
-    else if(mode == "mqtt")
+    else if(!strcmp(mode, "mqtt"))
     {
         DBG_PUT("Setting MQTT config\n");
-        if(!params.count("host") ||
-            !params.count("port") ||
-            !params.count("username") ||
-            !params.count("password") ||
-            !params.count("topic"))
+        MqttConfig cfg;
+        memset( &cfg, 0, sizeof(cfg));
+        auto password = params.Get("password");
+        if(!params.GetString("host", cfg.brokerAddress, sizeof(cfg.brokerAddress)) ||
+            !params.GetUInt("port", cfg.port, UINT16_MAX) ||
+            !params.GetString("username", cfg.username, sizeof(cfg.username)) ||
+            !password ||
+            !params.GetString("topic", cfg.topic, sizeof(cfg.topic)))
         {
-            DBG_PUT("Missing arguments\n");
+            DBG_PUT("Missing or bad arguments\n");
             return false;
         }
 
-        MqttConfig cfg;
-        memset( &cfg, 0, sizeof(cfg));
-        strlcpy(cfg.brokerAddress, params.at("host").c_str(), sizeof(cfg.brokerAddress));
-        sscanf(params.at("port").c_str(), "%hu", &cfg.port);
-        strlcpy(cfg.username, params.at("username").c_str(), sizeof(cfg.username));
-        auto &password = params.at("password");
-        if(password == "********")
+        if(!strcmp(password, "********"))
         {
             auto oldCConfig = _config->GetMqttConfig();
             strlcpy(cfg.password, oldCConfig->password, sizeof(cfg.password));
         }
         else
-            strlcpy(cfg.password, password.c_str(), sizeof(cfg.password));
-        strlcpy(cfg.topic, params.at("topic").c_str(), sizeof(cfg.topic));
+            strlcpy(cfg.password, password, sizeof(cfg.password));
+        // Optional, so older clients still work
+        params.GetBool("json", cfg.jsonState);
+
+        // Optional failover brokers, as a comma separated list of host[:port]
+        auto failover = params.Get("failover");
+        if(failover)
+        {
+            for(auto a = 0; a < MQTT_FAILOVER_BROKERS && *failover; a++)
+            {
+                auto end = failover + strcspn(failover, ",");
+                auto hostLength = strcspn(failover, ",:");
+                if(hostLength >= sizeof(cfg.failoverAddress[a]))
+                {
+                    DBG_PUT("Failover broker address is too long\n");
+                    return false;
+                }
+                memcpy(cfg.failoverAddress[a], failover, hostLength);
+                uint32_t port;
+                if(failover[hostLength] == ':')
+                {
+                    if(!CgiParams::ParseUInt(failover + hostLength + 1, end, port) || port > UINT16_MAX)
+                    {
+                        DBG_PUT("Bad failover broker port\n");
+                        return false;
+                    }
+                    cfg.failoverPort[a] = port;
+                }
+                failover = *end ? end + 1 : end;
+            }
+        }
 
 
         DBG_PUT("Saving config\n");
@@ -104,7 +134,7 @@ bool ConfigService::OnConfigure(const CgiParams &params)
         DBG_PUT("Restarting service\n");
         _serviceControl->StopService();
     }
-    else if(mode == "firmware")
+    else if(!strcmp(mode, "firmware"))
     {
         DBG_PUT("Requesting firmware reboot\n");
         _serviceControl->StopService(true);
@@ -188,6 +218,29 @@ int16_t ConfigService::HandleMqttConfigResponse(uint32_t tagIndex, char *pcInser
             memcpy(pcInsert, cfg->topic, len);
             return len;
         }
+        case TAGINDEX_MQTTFAILOVER:
+        {
+            BufferOutput output(pcInsert, iInsertLen);
+            for(auto a = 0; a < MQTT_FAILOVER_BROKERS && *cfg->failoverAddress[a]; a++)
+            {
+                if(a)
+                    output.Append(',');
+                output.AppendEscaped(cfg->failoverAddress[a]);
+                if(cfg->failoverPort[a])
+                {
+                    output.Append(':');
+                    output.Append((int)cfg->failoverPort[a]);
+                }
+            }
+            return output.BytesWritten();
+        }
+        case TAGINDEX_MQTTJSON:
+        {
+            auto value = cfg->jsonState ? "true" : "false";
+            auto len = strlen(value);
+            memcpy(pcInsert, value, len);
+            return len;
+        }
     }
 
     return 0;
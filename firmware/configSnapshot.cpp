@@ -0,0 +1,307 @@
+// Copyright (c) 2023 Mark Godwin.
+// SPDX-License-Identifier: MIT
+
+#include "picoSomfy.h"
+
+#include "configSnapshot.h"
+#include "deviceConfig.h"
+#include "serviceControl.h"
+#include "bufferOutput.h"
+
+#define SNAPSHOT_VERSION 1
+
+// Entry header is the record ID and data length, and the entry ends with a CRC
+#define ENTRY_HEADER_SIZE 6
+#define ENTRY_CRC_SIZE 4
+
+static const char exportHeaders[] =
+    "HTTP/1.0 200 OK\r\n"
+    "Content-Type: application/json\r\n"
+    "Cache-Control: no-store\r\n"
+    "\r\n";
+
+static uint32_t UpdateCrc(uint32_t crc, const uint8_t *data, size_t size)
+{
+    // CRC-32, as used by zip. Slow, but it doesn't need a table.
+    while(size--)
+    {
+        crc ^= *data++;
+        for(auto bit = 0; bit < 8; bit++)
+            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+    }
+    return crc;
+}
+
+static uint32_t Crc32(const uint8_t *data, size_t size)
+{
+    return ~UpdateCrc(0xFFFFFFFF, data, size);
+}
+
+/// @brief One client's export
+/// @remarks The records are copied as the request is opened, so saves and compaction while it is being sent can't
+/// move them under it, and clients exporting at the same time don't share anything.
+class ConfigSnapshot::Export : public WebStream
+{
+    public:
+        Export(DeviceConfig *config)
+        :   _secrets(false),
+            _started(false),
+            _finished(false),
+            _crc(0xFFFFFFFF),
+            _entry(0),
+            _offset(0),
+            _partLength(0),
+            _partSent(0)
+        {
+            uint32_t cursor = 0;
+            uint32_t recordId;
+            size_t size;
+            const uint8_t *data;
+            while((data = config->NextRecord(&cursor, &recordId, &size)) != nullptr)
+            {
+                auto start = _entries.size();
+                auto length = (uint16_t)size;
+                _starts.push_back(start);
+                _entries.resize(start + ENTRY_HEADER_SIZE + size + ENTRY_CRC_SIZE);
+                memcpy(&_entries[start], &recordId, sizeof(recordId));
+                memcpy(&_entries[start + 4], &length, sizeof(length));
+                memcpy(&_entries[start + ENTRY_HEADER_SIZE], data, size);
+            }
+            _starts.push_back(_entries.size());
+        }
+
+        virtual void SetParameters(int count, char **names, char **values)
+        {
+            for(auto a = 0; a < count; a++)
+            {
+                if(!strcmp(names[a], "secrets") && !strcmp(values[a], "1"))
+                    _secrets = true;
+            }
+        }
+
+        virtual int Read(char *buffer, int count)
+        {
+            auto read = 0;
+            while(read < count)
+            {
+                if(_partSent == _partLength && !NextPart())
+                    break;
+                auto chunk = std::min<int>(count - read, _partLength - _partSent);
+                memcpy(buffer + read, _part + _partSent, chunk);
+                read += chunk;
+                _partSent += chunk;
+            }
+            return read ? read : -1;
+        }
+
+    private:
+        /// @brief Blanks the passwords unless they were asked for, then fills in the CRCs
+        void Seal()
+        {
+            for(size_t a = 0; a + 1 < _starts.size(); a++)
+            {
+                auto entry = &_entries[_starts[a]];
+                auto size = _starts[a + 1] - _starts[a] - ENTRY_HEADER_SIZE - ENTRY_CRC_SIZE;
+                uint32_t recordId;
+                memcpy(&recordId, entry, sizeof(recordId));
+                if(!_secrets)
+                    DeviceConfig::RemoveSecrets(recordId, entry + ENTRY_HEADER_SIZE, size);
+                auto crc = Crc32(entry, ENTRY_HEADER_SIZE + size);
+                memcpy(entry + ENTRY_HEADER_SIZE + size, &crc, sizeof(crc));
+                _crc = UpdateCrc(_crc, entry, ENTRY_HEADER_SIZE + size + ENTRY_CRC_SIZE);
+            }
+        }
+
+        bool NextPart()
+        {
+            BufferOutput outputter(_part, sizeof(_part));
+            auto entries = _starts.size() - 1;
+            if(!_started)
+            {
+                _started = true;
+                Seal();
+                outputter.Append(exportHeaders);
+                outputter.Append("{\"version\": ");
+                outputter.Append(SNAPSHOT_VERSION);
+                outputter.Append(", \"records\": [");
+            }
+            else if(_entry < entries)
+            {
+                // Stream the current entry as hex, a bit at a time
+                auto start = _starts[_entry] + _offset;
+                if(_offset == 0)
+                    outputter.Append(_entry ? ", \"" : "\"");
+                auto chunk = std::min(_starts[_entry + 1] - start, (sizeof(_part) - 8) / 2);
+                outputter.AppendHex(&_entries[start], chunk);
+                _offset += chunk;
+                if(_starts[_entry] + _offset == _starts[_entry + 1])
+                {
+                    outputter.Append('\"');
+                    _entry++;
+                    _offset = 0;
+                }
+            }
+            else if(!_finished)
+            {
+                _finished = true;
+                outputter.Append("], \"count\": ");
+                outputter.Append((int)entries);
+                outputter.Append(", \"crc\": \"");
+                outputter.AppendHex(~_crc);
+                outputter.Append("\"}");
+            }
+            _partLength = outputter.BytesWritten();
+            _partSent = 0;
+            return _partLength > 0;
+        }
+
+        bool _secrets;
+        bool _started;
+        bool _finished;
+        uint32_t _crc;
+        std::vector<uint8_t> _entries;      // Every entry, back to back
+        std::vector<size_t> _starts;        // Where each entry starts, then the end of the last one
+        size_t _entry;
+        size_t _offset;
+        char _part[256];
+        int _partLength;
+        int _partSent;
+};
+
+ConfigSnapshot::ConfigSnapshot(
+    std::shared_ptr<DeviceConfig> config,
+    std::shared_ptr<WebServer> webServer,
+    std::shared_ptr<ServiceControl> serviceControl)
+:   _config(std::move(config)),
+    _serviceControl(std::move(serviceControl)),
+    _importController(webServer, "/api/snapshot/import.json", [this](const CgiParams &params) { return OnImport(params); }),
+    _exportStream(webServer, "/api/snapshot/export.json", [this]() { return new Export(_config.get()); }),
+    _importStarted(false),
+    _importOffset(0),
+    _importCount(0),
+    _importCrc(0)
+{
+}
+
+bool ConfigSnapshot::OnImport(const CgiParams &params)
+{
+    auto op = params.Get("op");
+    if(!op)
+        return false;
+
+    if(!strcmp(op, "begin"))
+    {
+        DBG_PUT("Starting config import");
+        _config->ClearImport();
+        _importStarted = true;
+        _importOffset = 0;
+        _importCount = 0;
+        _importCrc = 0xFFFFFFFF;
+        _importEntry.clear();
+        return true;
+    }
+
+    if(!_importStarted)
+        return false;
+
+    if(!strcmp(op, "data"))
+    {
+        uint32_t offset;
+        auto data = params.Get("data");
+        if(!params.GetUInt("offset", offset) || !data)
+            return false;
+
+        // Chunks must arrive in order
+        if(offset != _importOffset)
+        {
+            DBG_PRINT("Import chunk at %d is out of order. Expected %d\n", offset, _importOffset);
+            return false;
+        }
+
+        if(!ImportData(data, strlen(data)))
+        {
+            _importStarted = false;
+            _config->ClearImport();
+            return false;
+        }
+        return true;
+    }
+
+    if(!strcmp(op, "commit"))
+    {
+        uint32_t count;
+        auto crcParam = params.Get("crc");
+        if(!params.GetUInt("count", count) || !crcParam)
+            return false;
+
+        auto crc = strtoul(crcParam, nullptr, 16);
+        if(!_importEntry.empty() || count != _importCount || crc != ~_importCrc)
+        {
+            DBG_PRINT("Import is incomplete. Received %d records, with CRC %08x\n", _importCount, ~_importCrc);
+            return false;
+        }
+
+        _importStarted = false;
+        _config->CommitImport();
+
+        // Restart to load the new config
+        _serviceControl->StopService();
+        return true;
+    }
+
+    if(!strcmp(op, "abort"))
+    {
+        _importStarted = false;
+        _config->ClearImport();
+        return true;
+    }
+
+    return false;
+}
+
+bool ConfigSnapshot::ImportData(const char *hex, size_t length)
+{
+    if(length % 2)
+        return false;
+
+    for(size_t a = 0; a < length; a += 2)
+    {
+        auto n1 = (uint8_t)hexToInt(hex[a]);
+        auto n2 = (uint8_t)hexToInt(hex[a + 1]);
+        if(n1 > 15 || n2 > 15)
+            return false;
+        _importEntry.push_back((n1 << 4) | n2);
+        _importOffset++;
+
+        if(_importEntry.size() < ENTRY_HEADER_SIZE)
+            continue;
+
+        uint32_t recordId;
+        uint16_t size;
+        memcpy(&recordId, _importEntry.data(), sizeof(recordId));
+        memcpy(&size, _importEntry.data() + 4, sizeof(size));
+        if(size > BlockStorage::MaxBlockSize())
+        {
+            DBG_PRINT("Import record %08x is too large (%d bytes)\n", recordId, size);
+            return false;
+        }
+        if(_importEntry.size() < ENTRY_HEADER_SIZE + size + ENTRY_CRC_SIZE)
+            continue;
+
+        // We have the whole entry. Check it, and stage it in flash.
+        uint32_t crc;
+        memcpy(&crc, _importEntry.data() + ENTRY_HEADER_SIZE + size, sizeof(crc));
+        if(crc != Crc32(_importEntry.data(), ENTRY_HEADER_SIZE + size))
+        {
+            DBG_PRINT("Import record %08x has a bad CRC\n", recordId);
+            return false;
+        }
+        if(!_config->StageImport(recordId, _importEntry.data() + ENTRY_HEADER_SIZE, size))
+            return false;
+
+        _importCount++;
+        _importCrc = UpdateCrc(_importCrc, _importEntry.data(), _importEntry.size());
+        _importEntry.clear();
+    }
+    return true;
+}
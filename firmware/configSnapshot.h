@@ -0,0 +1,45 @@
+// Copyright (c) 2023 Mark Godwin.
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include "webServer.h"
+#include <memory>
+#include <vector>
+
+class DeviceConfig;
+class ServiceControl;
+
+/// @brief Exports and imports a snapshot of the whole config store via the web interface, to move it to another device
+/// @remarks The snapshot is a stream of binary entries, each being the record ID (4 bytes), the data length (2 bytes),
+/// the data, then a CRC32 of everything before it (4 bytes). All little-endian.
+/// Export streams the entries as hex strings, with the WiFi and MQTT passwords blanked unless the request asks for
+/// them with secrets=1. Import takes the hex stream back in chunks, staging each record in flash as it is completed,
+/// then applies them all at once when committed.
+class ConfigSnapshot
+{
+    public:
+        ConfigSnapshot(
+            std::shared_ptr<DeviceConfig> config,
+            std::shared_ptr<WebServer> webServer,
+            std::shared_ptr<ServiceControl> serviceControl);
+
+    private:
+        class Export;
+
+        bool OnImport(const CgiParams &params);
+        bool ImportData(const char *hex, size_t length);
+
+        std::shared_ptr<DeviceConfig> _config;
+        std::shared_ptr<ServiceControl> _serviceControl;
+
+        CgiSubscription _importController;
+        StreamSubscription _exportStream;
+
+        // Import state
+        bool _importStarted;
+        uint32_t _importOffset;
+        uint32_t _importCount;
+        uint32_t _importCrc;
+        std::vector<uint8_t> _importEntry;
+};
@@ -1,9 +1,12 @@
 // Copyright (c) 2023 Mark Godwin.
 // SPDX-License-Identifier: MIT
 
+#include <stddef.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <algorithm>
+#include <vector>
 #include "picoSomfy.h"
 #include "pico/flash.h"
 #include "pico/malloc.h"
@@ -11,39 +14,232 @@
 #include "deviceConfig.h"
 #include "blockStorage.h"
 
-static const uint32_t wifiConfigMagic = 0x19841984;
-static const uint32_t mqttConfigMagic = 0x19841985;
 static const uint32_t blindsConfigMagic = 0x19841986;
 static const uint32_t remotesConfigMagic = 0x19841987;
 static const uint32_t externalRemotesConfigMagic = 0x19841990;
-static const uint32_t blindConfigMagic = 0x19850000;
-static const uint32_t remoteConfigMagic = 0x19860000;
+static const uint32_t wifiConfigMagic = 0x19841991;
+static const uint32_t mqttConfigMagic = 0x19841992;
+static const uint32_t blindConfigMagic = 0x19870000;
+static const uint32_t remoteConfigMagic = 0x19880000;
+static const uint32_t importCommitMagic = 0x19841993;
+static const uint32_t blindDiscoveryMagic = 0x19890000;
+static const uint32_t remoteDiscoveryMagic = 0x198A0000;
+
+// Imported records are staged under their ID with the top bit set, until the import is committed
+static const uint32_t importStagingFlag = 0x80000000;
+
+// Config records from before they were versioned. They are upgraded as the storage is opened.
+static const uint32_t legacyWifiConfigMagic = 0x19841984;
+static const uint32_t legacyMqttConfigMagic = 0x19841985;
+static const uint32_t legacyBlindConfigMagic = 0x19850000;
+static const uint32_t legacyRemoteConfigMagic = 0x19860000;
+
+// Upgrade functions convert a stored record from an older layout into the current one.
+// The record is zeroed first, so version 0 (unversioned) just needs copying over.
+static void Upgrade(WifiConfig *cfg, uint16_t version, const uint8_t *data, size_t size)
+{
+    if(version < 1)
+        memcpy(cfg, data, std::min(size, sizeof(WifiConfig)));
+}
+
+static void Upgrade(MqttConfig *cfg, uint16_t version, const uint8_t *data, size_t size)
+{
+    if(version < 2)
+    {
+        // Versions 0 and 1 only had room for a dotted-quad broker address
+        struct
+        {
+            char brokerAddress[16];
+            uint16_t port;
+            char username[32];
+            char password[64];
+            char topic[128];
+        } old;
+        memset(&old, 0, sizeof(old));
+        memcpy(&old, data, std::min(size, sizeof(old)));
+        memcpy(cfg->brokerAddress, old.brokerAddress, sizeof(old.brokerAddress));
+        cfg->port = old.port;
+        memcpy(cfg->username, old.username, sizeof(old.username));
+        memcpy(cfg->password, old.password, sizeof(old.password));
+        memcpy(cfg->topic, old.topic, sizeof(old.topic));
+    }
+    else if(version < 3)
+    {
+        // Version 3 added the JSON state option on the end
+        memcpy(cfg, data, std::min(size, offsetof(MqttConfig, jsonState)));
+    }
+    else if(version < 4)
+    {
+        // Version 4 added the failover brokers
+        memcpy(cfg, data, std::min(size, offsetof(MqttConfig, failoverAddress)));
+    }
+}
+
+static void Upgrade(BlindConfig *cfg, uint16_t version, const uint8_t *data, size_t size)
+{
+    // Version 2 added the group name on the end
+    if(version < 2)
+        memcpy(cfg, data, std::min(size, offsetof(BlindConfig, groupName)));
+}
+
+static void Upgrade(RemoteConfig *cfg, uint16_t version, const uint8_t *data, size_t size)
+{
+    if(version < 1)
+        memcpy(cfg, data, std::min(size, sizeof(RemoteConfig)));
+}
+
+DeviceConfig::DeviceConfig(std::shared_ptr<FlashScheduler> flash, uint32_t storageSize, uint32_t legacyBlockSize)
+:   _storage(std::move(flash), PICO_FLASH_SIZE_BYTES - storageSize, storageSize, legacyBlockSize)
+{
+    // Finish off an import that was interrupted part way through
+    if(_storage.GetBlock(importCommitMagic))
+    {
+        DBG_PUT("Resuming config import");
+        CommitImport();
+    }
+    else
+        UpgradeRecords();
+}
 
-DeviceConfig::DeviceConfig(uint32_t storageSize, uint32_t blockSize)
-:   _storage(PICO_FLASH_SIZE_BYTES - storageSize, storageSize, blockSize)
+/// @brief Checks a record's header against the current layout
+static bool IsCurrent(const uint8_t *block, size_t size, uint16_t version, size_t recordSize)
 {
+    ConfigHeader header;
+    if(block == nullptr || size < sizeof(header) + recordSize)
+        return false;
+    memcpy(&header, block, sizeof(header));
+    return header.version == version && header.size == recordSize;
+}
+
+/// @brief Gets a config record. It never writes, so other config pointers stay good.
+/// @return The record, read directly from flash, or null if there is none in the current layout
+template<typename T>
+const T *DeviceConfig::GetRecord(uint32_t blockId, uint16_t version)
+{
+    size_t size;
+    auto block = _storage.GetBlock(blockId, &size);
+    if(!IsCurrent(block, size, version, sizeof(T)))
+        return nullptr;
+    return (const T *)(block + sizeof(ConfigHeader));
+}
+
+void DeviceConfig::UpgradeRecords()
+{
+    // Find everything that needs upgrading first, as saving the upgraded records moves others about
+    std::vector<uint32_t> outdated;
+    uint32_t cursor = 0;
+    uint32_t blockId;
+    size_t size;
+    const uint8_t *block;
+    while((block = _storage.NextBlock(&cursor, &blockId, &size)) != nullptr)
+    {
+        auto kind = blockId & 0xFFFF0000;
+        if(blockId == legacyWifiConfigMagic || blockId == legacyMqttConfigMagic ||
+            kind == legacyBlindConfigMagic || kind == legacyRemoteConfigMagic ||
+            (blockId == wifiConfigMagic && !IsCurrent(block, size, WIFI_CONFIG_VERSION, sizeof(WifiConfig))) ||
+            (blockId == mqttConfigMagic && !IsCurrent(block, size, MQTT_CONFIG_VERSION, sizeof(MqttConfig))) ||
+            (kind == blindConfigMagic && !IsCurrent(block, size, BLIND_CONFIG_VERSION, sizeof(BlindConfig))) ||
+            (kind == remoteConfigMagic && !IsCurrent(block, size, REMOTE_CONFIG_VERSION, sizeof(RemoteConfig))))
+        {
+            outdated.push_back(blockId);
+        }
+    }
+
+    for(auto blockId : outdated)
+    {
+        auto kind = blockId & 0xFFFF0000;
+        auto id = blockId & 0xFFFF;
+        if(blockId == wifiConfigMagic || blockId == legacyWifiConfigMagic)
+            UpgradeRecord<WifiConfig>(wifiConfigMagic, legacyWifiConfigMagic, WIFI_CONFIG_VERSION);
+        else if(blockId == mqttConfigMagic || blockId == legacyMqttConfigMagic)
+            UpgradeRecord<MqttConfig>(mqttConfigMagic, legacyMqttConfigMagic, MQTT_CONFIG_VERSION);
+        else if(kind == blindConfigMagic || kind == legacyBlindConfigMagic)
+            UpgradeRecord<BlindConfig>(blindConfigMagic | id, legacyBlindConfigMagic | id, BLIND_CONFIG_VERSION);
+        else
+            UpgradeRecord<RemoteConfig>(remoteConfigMagic | id, legacyRemoteConfigMagic | id, REMOTE_CONFIG_VERSION);
+    }
+}
+
+/// @brief Rewrites a config record in the current layout, if it was stored with an older one
+template<typename T>
+void DeviceConfig::UpgradeRecord(uint32_t blockId, uint32_t legacyBlockId, uint16_t version)
+{
+    size_t size;
+    auto block = _storage.GetBlock(blockId, &size);
+    auto header = (const ConfigHeader *)block;
+    if(IsCurrent(block, size, version, sizeof(T)))
+        // Already done, when its legacy record was seen first
+        return;
+
+    uint16_t oldVersion;
+    const uint8_t *oldData;
+    size_t oldSize;
+    if(block != nullptr && size >= sizeof(ConfigHeader))
+    {
+        oldVersion = header->version;
+        oldData = (const uint8_t *)(header + 1);
+        oldSize = std::min(size - sizeof(ConfigHeader), (size_t)header->size);
+    }
+    else
+    {
+        oldVersion = 0;
+        oldData = _storage.GetBlock(legacyBlockId, &oldSize);
+        if(oldData == nullptr)
+            return;
+    }
+
+    if(oldVersion > version)
+    {
+        DBG_PRINT("Config record %08x is from a newer version (%d). Ignoring it\n", blockId, oldVersion);
+        return;
+    }
+
+    DBG_PRINT("Upgrading config record %08x from version %d to %d\n", blockId, oldVersion, version);
+    T record;
+    memset(&record, 0, sizeof(record));
+    if(oldVersion == version)
+        memcpy(&record, oldData, std::min(oldSize, sizeof(T)));   // The size changed without a version change?!
+    else
+        Upgrade(&record, oldVersion, oldData, oldSize);
+    if(SaveRecord(blockId, version, &record) && oldVersion == 0)
+        _storage.ClearBlock(legacyBlockId);
+}
+
+template<typename T>
+bool DeviceConfig::SaveRecord(uint32_t blockId, uint16_t version, const T *record)
+{
+    uint8_t buf[sizeof(ConfigHeader) + sizeof(T)];
+    ConfigHeader header = { version, sizeof(T) };
+    memcpy(buf, &header, sizeof(header));
+    memcpy(buf + sizeof(header), record, sizeof(T));
+    return _storage.SaveBlock(blockId, buf, sizeof(buf));
+}
+
+void DeviceConfig::DeleteRecord(uint32_t blockId, uint32_t legacyBlockId)
+{
+    _storage.ClearBlock(blockId);
+    // It is left behind if it couldn't be upgraded
+    _storage.ClearBlock(legacyBlockId);
 }
 
 const WifiConfig * DeviceConfig::GetWifiConfig()
 {
-    auto creds = (const WifiConfig *)_storage.GetBlock(wifiConfigMagic);
-    return creds;
+    return GetRecord<WifiConfig>(wifiConfigMagic, WIFI_CONFIG_VERSION);
 }
 
 void DeviceConfig::SaveWifiConfig(const WifiConfig *config)
 {
-    _storage.SaveBlock(wifiConfigMagic, (const uint8_t *)config, sizeof(WifiConfig));
+    SaveRecord(wifiConfigMagic, WIFI_CONFIG_VERSION, config);
 }
 
 const MqttConfig *DeviceConfig::GetMqttConfig()
 {
-    auto creds = (const MqttConfig *)_storage.GetBlock(mqttConfigMagic);
-    return creds;
+    return GetRecord<MqttConfig>(mqttConfigMagic, MQTT_CONFIG_VERSION);
 }
 
 void DeviceConfig::SaveMqttConfig(const MqttConfig *mqttConfig)
 {
-    _storage.SaveBlock(mqttConfigMagic, (const uint8_t *)mqttConfig, sizeof(MqttConfig));
+    SaveRecord(mqttConfigMagic, MQTT_CONFIG_VERSION, mqttConfig);
 }
 
 void DeviceConfig::SaveBlindIds(const uint16_t *blindIds, uint32_t count)
@@ -51,9 +247,9 @@ void DeviceConfig::SaveBlindIds(const uint16_t *blindIds, uint32_t count)
     SaveIdList(blindsConfigMagic, blindIds, count);
 }
 
-const uint16_t *DeviceConfig::GetBlindIds(uint32_t *count)
+std::vector<uint16_t> DeviceConfig::GetBlindIds()
 {
-    return GetIdList(blindsConfigMagic, count);
+    return GetIdList(blindsConfigMagic);
 }
 
 void DeviceConfig::SaveRemoteIds(const uint16_t *remoteIds, uint32_t count)
@@ -68,7 +264,7 @@ void DeviceConfig::SaveExternalRemoteIds(const uint32_t *remoteIds, uint32_t cou
 
 const BlindConfig *DeviceConfig::GetBlindConfig(uint16_t blindId)
 {
-    return (BlindConfig *)_storage.GetBlock(blindConfigMagic | blindId);
+    return GetRecord<BlindConfig>(blindConfigMagic | blindId, BLIND_CONFIG_VERSION);
 }
 
 void DeviceConfig::SaveBlindConfig(uint16_t blindId, const BlindConfig *blindConfig)
@@ -80,19 +276,20 @@ void DeviceConfig::SaveBlindConfig(uint16_t blindId, const BlindConfig *blindCon
     {
         return;
     }
-    _storage.SaveBlock(blindConfigMagic | blindId, (const uint8_t *)blindConfig, sizeof(*blindConfig));
+    SaveRecord(blindConfigMagic | blindId, BLIND_CONFIG_VERSION, blindConfig);
 }
 
 void DeviceConfig::DeleteBlindConfig(uint16_t blindId)
 {
-    _storage.ClearBlock(blindConfigMagic | blindId);
+    DeleteRecord(blindConfigMagic | blindId, legacyBlindConfigMagic | blindId);
+    _storage.ClearBlock(blindDiscoveryMagic | blindId);
 }
 
 const RemoteConfig *DeviceConfig::GetRemoteConfig(uint32_t remoteId)
 {
     if(remoteId == 0xFFFFFFFF || !remoteId)
         return nullptr;
-    return (RemoteConfig *)_storage.GetBlock(remoteConfigMagic | (remoteId & 0xFFFF));
+    return GetRecord<RemoteConfig>(remoteConfigMagic | (remoteId & 0xFFFF), REMOTE_CONFIG_VERSION);
 }
 
 void DeviceConfig::SaveRemoteConfig(uint32_t remoteId, const RemoteConfig *remoteConfig)
@@ -104,22 +301,61 @@ void DeviceConfig::SaveRemoteConfig(uint32_t remoteId, const RemoteConfig *remot
     {
         return;
     }
-    _storage.SaveBlock(remoteConfigMagic | (remoteId & 0xFFFF), (const uint8_t *)remoteConfig, sizeof(*remoteConfig));
+    SaveRecord(remoteConfigMagic | (remoteId & 0xFFFF), REMOTE_CONFIG_VERSION, remoteConfig);
 }
 
 void DeviceConfig::DeleteRemoteConfig(uint32_t remoteId)
 {
-    _storage.ClearBlock(remoteConfigMagic | (remoteId & 0xFFFF));
+    DeleteRecord(remoteConfigMagic | (remoteId & 0xFFFF), legacyRemoteConfigMagic | (remoteId & 0xFFFF));
+    _storage.ClearBlock(remoteDiscoveryMagic | (remoteId & 0xFFFF));
+}
+
+uint32_t DeviceConfig::GetBlindDiscoveryHash(uint16_t blindId)
+{
+    return GetHash(blindDiscoveryMagic | blindId);
+}
+
+void DeviceConfig::SaveBlindDiscoveryHash(uint16_t blindId, uint32_t hash)
+{
+    SaveHash(blindDiscoveryMagic | blindId, hash);
+}
+
+uint32_t DeviceConfig::GetRemoteDiscoveryHash(uint32_t remoteId)
+{
+    return GetHash(remoteDiscoveryMagic | (remoteId & 0xFFFF));
 }
 
-const uint16_t *DeviceConfig::GetRemoteIds(uint32_t *count)
+void DeviceConfig::SaveRemoteDiscoveryHash(uint32_t remoteId, uint32_t hash)
 {
-    return GetIdList(remotesConfigMagic, count);
+    SaveHash(remoteDiscoveryMagic | (remoteId & 0xFFFF), hash);
 }
 
-const uint32_t *DeviceConfig::GetExternalRemoteIds(uint32_t *count)
+uint32_t DeviceConfig::GetHash(uint32_t blockId)
 {
-    return GetIdList32(externalRemotesConfigMagic, count);
+    size_t size;
+    auto block = _storage.GetBlock(blockId, &size);
+    if(block == nullptr || size != sizeof(uint32_t))
+        return 0;
+    uint32_t hash;
+    memcpy(&hash, block, sizeof(hash));
+    return hash;
+}
+
+void DeviceConfig::SaveHash(uint32_t blockId, uint32_t hash)
+{
+    // Don't wear the flash rewriting what's already there
+    if(GetHash(blockId) != hash)
+        _storage.SaveBlock(blockId, (const uint8_t *)&hash, sizeof(hash));
+}
+
+std::vector<uint16_t> DeviceConfig::GetRemoteIds()
+{
+    return GetIdList(remotesConfigMagic);
+}
+
+std::vector<uint32_t> DeviceConfig::GetExternalRemoteIds()
+{
+    return GetIdList32(externalRemotesConfigMagic);
 }
 
 void DeviceConfig::HardReset()
@@ -142,16 +378,125 @@ void DeviceConfig::HardReset()
 
 }
 
+const uint8_t *DeviceConfig::NextRecord(uint32_t *cursor, uint32_t *recordId, size_t *size)
+{
+    const uint8_t *data;
+    do
+    {
+        data = _storage.NextBlock(cursor, recordId, size);
+    }
+    while(data != nullptr && ((*recordId & importStagingFlag) || *recordId == importCommitMagic));
+    return data;
+}
+
+// Blanks a field of a record, if the record is long enough to have it
+static void ClearField(uint8_t *data, size_t size, size_t offset, size_t length)
+{
+    if(offset < size)
+        memset(data + offset, 0, std::min(length, size - offset));
+}
+
+void DeviceConfig::RemoveSecrets(uint32_t recordId, uint8_t *data, size_t size)
+{
+    // Unversioned records have no header
+    if(recordId == wifiConfigMagic || recordId == legacyWifiConfigMagic)
+    {
+        auto offset = recordId == wifiConfigMagic ? sizeof(ConfigHeader) : 0;
+        ClearField(data, size, offset + offsetof(WifiConfig, password), sizeof(WifiConfig::password));
+    }
+    else if(recordId == mqttConfigMagic || recordId == legacyMqttConfigMagic)
+    {
+        auto offset = recordId == mqttConfigMagic ? sizeof(ConfigHeader) : 0;
+        ClearField(data, size, offset + offsetof(MqttConfig, password), sizeof(MqttConfig::password));
+    }
+}
+
+bool DeviceConfig::StageImport(uint32_t recordId, const uint8_t *data, size_t size)
+{
+    if(recordId & importStagingFlag || recordId == importCommitMagic || recordId == 0)
+    {
+        DBG_PRINT("Not importing invalid record ID %08x\n", recordId);
+        return false;
+    }
+    return _storage.SaveBlock(recordId | importStagingFlag, data, size);
+}
+
+void DeviceConfig::ClearImport()
+{
+    uint32_t cursor = 0;
+    uint32_t blockId;
+    size_t size;
+    while(_storage.NextBlock(&cursor, &blockId, &size))
+    {
+        if(blockId & importStagingFlag)
+            _storage.ClearBlock(blockId);
+    }
+    _storage.ClearBlock(importCommitMagic);
+}
+
+uint32_t DeviceConfig::CommitImport()
+{
+    // Mark the import as committed first, so we can finish it after a power cut
+    uint8_t marker = 1;
+    if(!_storage.GetBlock(importCommitMagic) &&
+        !_storage.SaveBlock(importCommitMagic, &marker, sizeof(marker)))
+        return 0;
+
+    // Remove the current config...
+    uint32_t cursor = 0;
+    uint32_t blockId;
+    size_t size;
+    while(_storage.NextBlock(&cursor, &blockId, &size))
+    {
+        if(!(blockId & importStagingFlag) && blockId != importCommitMagic)
+            _storage.ClearBlock(blockId);
+    }
+
+    // ...and replace it with the staged records. Making space for them can move
+    // records around, so keep going until none are left.
+    uint32_t count = 0;
+    auto found = true;
+    while(found)
+    {
+        found = false;
+        cursor = 0;
+        const uint8_t *data;
+        while((data = _storage.NextBlock(&cursor, &blockId, &size)) != nullptr)
+        {
+            if(!(blockId & importStagingFlag))
+                continue;
+            found = true;
+
+            // Saving may need to reclaim the sector this is in, so take a copy first
+            std::vector<uint8_t> record(data, data + size);
+            if(_storage.SaveBlock(blockId & ~importStagingFlag, record.data(), record.size()))
+                count++;
+            else
+                DBG_PRINT("Failed to import record %08x\n", blockId & ~importStagingFlag);
+            _storage.ClearBlock(blockId);
+        }
+    }
+
+    _storage.ClearBlock(importCommitMagic);
+    DBG_PRINT("Imported %d config records\n", count);
+    // The snapshot may have come from older firmware
+    UpgradeRecords();
+    return count;
+}
+
 void DeviceConfig::SaveIdList(uint32_t header, const uint16_t *ids, uint32_t count)
 {
     size_t bytes = sizeof(count) + sizeof(uint16_t) * count;
-    if(bytes > _storage.BlockSize())
-        DBG_PUT("Too many ids to fit in the block. FAIL\n");
+    if(bytes > _storage.MaxBlockSize())
+    {
+        DBG_PRINT("Too many ids (%d) to fit in a block. FAIL\n", count);
+        return;
+    }
 
     auto buf = (uint8_t *)malloc(bytes);
     if(buf == nullptr)
     {
-        DBG_PRINT("Failed to allocate a buffer of %d bytes to save ID list\n", bytes);
+        DBG_PRINT("Failed to allocate a buffer of %zu bytes to save ID list\n", bytes);
         return;
     }
     memcpy(buf, &count, sizeof(count));
@@ -163,13 +508,16 @@ void DeviceConfig::SaveIdList(uint32_t header, const uint16_t *ids, uint32_t cou
 void DeviceConfig::SaveIdList32(uint32_t header, const uint32_t *ids, uint32_t count)
 {
     size_t bytes = sizeof(count) + sizeof(uint32_t) * count;
-    if(bytes > _storage.BlockSize())
-        DBG_PUT("Too many ids to fit in the block. FAIL\n");
+    if(bytes > _storage.MaxBlockSize())
+    {
+        DBG_PRINT("Too many ids (%d) to fit in a block. FAIL\n", count);
+        return;
+    }
 
     auto buf = (uint8_t *)malloc(bytes);
     if(buf == nullptr)
     {
-        DBG_PRINT("Failed to allocate a buffer of %d bytes to save ID list\n", bytes);
+        DBG_PRINT("Failed to allocate a buffer of %zu bytes to save ID list\n", bytes);
         return;
     }
     memcpy(buf, &count, sizeof(count));
@@ -178,28 +526,26 @@ void DeviceConfig::SaveIdList32(uint32_t header, const uint32_t *ids, uint32_t c
     free(buf);
 }
 
-const uint16_t *DeviceConfig::GetIdList(uint32_t header, uint32_t *count)
+std::vector<uint16_t> DeviceConfig::GetIdList(uint32_t header)
 {
-    auto block = (const uint32_t *)_storage.GetBlock(header);
-    if(block == nullptr)
-    {
-        *count = 0;
-        return nullptr;
-    }
-    *count = *block;
-    return (const uint16_t *)(block + 1);
+    size_t size;
+    auto block = (const uint32_t *)_storage.GetBlock(header, &size);
+    if(block == nullptr || size < sizeof(uint32_t))
+        return {};
+    auto count = std::min<size_t>(*block, (size - sizeof(uint32_t)) / sizeof(uint16_t));
+    auto ids = (const uint16_t *)(block + 1);
+    // Copied, as the callers save config while going through the list, and that can move the block
+    return std::vector<uint16_t>(ids, ids + count);
 }
 
-const uint32_t *DeviceConfig::GetIdList32(uint32_t header, uint32_t *count)
+std::vector<uint32_t> DeviceConfig::GetIdList32(uint32_t header)
 {
-    auto block = (const uint32_t *)_storage.GetBlock(header);
-    if(block == nullptr)
-    {
-        *count = 0;
-        return nullptr;
-    }
-    *count = *block;
-    return (block + 1);
+    size_t size;
+    auto block = (const uint32_t *)_storage.GetBlock(header, &size);
+    if(block == nullptr || size < sizeof(uint32_t))
+        return {};
+    auto count = std::min<size_t>(*block, (size - sizeof(uint32_t)) / sizeof(uint32_t));
+    return std::vector<uint32_t>(block + 1, block + 1 + count);
 }
 
 bool operator==(const RemoteConfig &left, const RemoteConfig &right)
@@ -218,5 +564,6 @@ bool operator==(const BlindConfig &left, const BlindConfig &right)
         left.myPosition == right.myPosition &&
         left.openTime == right.openTime &&
         left.closeTime == right.closeTime &&
-        left.remoteId == right.remoteId;
+        left.remoteId == right.remoteId &&
+        !strcmp(left.groupName, right.groupName);
 }
@@ -3,10 +3,25 @@
 
 #pragma once
 
+#include <vector>
 #include "blockStorage.h"
 
 #define SAVE_DELAY 120000
 
+// Config records are stored with a version, so their layout can change without losing data.
+// When changing one of the structs below, increment its version and add a step to its
+// Upgrade function in deviceConfig.cpp to convert from the previous layout.
+#define WIFI_CONFIG_VERSION 1
+#define MQTT_CONFIG_VERSION 4
+#define BLIND_CONFIG_VERSION 2
+#define REMOTE_CONFIG_VERSION 1
+
+/// @brief Stored in front of each config record
+struct ConfigHeader
+{
+    uint16_t version;
+    uint16_t size;
+};
 
 struct WifiConfig
 {
@@ -14,13 +29,20 @@ struct WifiConfig
     char password[64];
 };
 
+// Brokers tried in turn, when the main broker can't be reached
+#define MQTT_FAILOVER_BROKERS 2
+
 struct MqttConfig
 {
-    char brokerAddress[16];
+    char brokerAddress[64];     // Host name or IP address
     uint16_t port;
     char username[32];
     char password[64];
     char topic[128];
+    bool jsonState;             // Publish blind state as one JSON topic, instead of separate position and state topics
+    // Failover brokers, using the same credentials. Unused entries are empty.
+    char failoverAddress[MQTT_FAILOVER_BROKERS][64];
+    uint16_t failoverPort[MQTT_FAILOVER_BROKERS];
 };
 
 struct BlindConfig
@@ -32,6 +54,8 @@ struct BlindConfig
     int closeTime;
     // Primary remote for controlling this blind
     uint32_t remoteId;
+    // Group the blind is commanded with, on pico_somfy/groups/{name}. Empty for none.
+    char groupName[24];
 };
 
 struct RemoteConfig
@@ -48,10 +72,13 @@ bool operator==(const BlindConfig &left, const BlindConfig &right);
 
 bool operator==(const RemoteConfig &left, const RemoteConfig &right);
 
+/// @brief The device's settings, kept in the block storage.
+/// @remarks Records are moved about as the storage compacts itself, so a config pointer from one of the getters is only
+/// good until the next save or delete. Take a copy of anything needed across one. The ID lists are copied out for you.
 class DeviceConfig
 {
     public:
-        DeviceConfig(uint32_t storageSize, uint32_t blockSize);
+        DeviceConfig(std::shared_ptr<FlashScheduler> flash, uint32_t storageSize, uint32_t legacyBlockSize);
 
         const WifiConfig *GetWifiConfig();
         void SaveWifiConfig(const WifiConfig *wifiConfig);
@@ -59,16 +86,15 @@ class DeviceConfig
         const MqttConfig *GetMqttConfig();
         void SaveMqttConfig(const MqttConfig *mqttConfig);
 
-        const uint16_t *GetBlindIds(uint32_t *count);
+        std::vector<uint16_t> GetBlindIds();
         void SaveBlindIds(const uint16_t *blindIds, uint32_t count);
 
         /// @brief Get the IDs of all the registered remotes
-        /// @param count [out] number of remotes registered
         /// @return For reasons, only the lower 16 bits of the ID is returned. You need to use a fixed upper 8 bits
-        const uint16_t *GetRemoteIds(uint32_t *count);
+        std::vector<uint16_t> GetRemoteIds();
         void SaveRemoteIds(const uint16_t *blindIds, uint32_t count);
 
-        const uint32_t *GetExternalRemoteIds(uint32_t *count);
+        std::vector<uint32_t> GetExternalRemoteIds();
         void SaveExternalRemoteIds(const uint32_t *remoteIds, uint32_t count);
 
         const BlindConfig *GetBlindConfig(uint16_t blindId);
@@ -79,15 +105,58 @@ class DeviceConfig
         void SaveRemoteConfig(uint32_t remoteId, const RemoteConfig *remoteConfig);
         void DeleteRemoteConfig(uint32_t remoteId);
 
+        /// @brief Hash of the discovery message last published for a device, so it needn't be sent again
+        /// @return The hash, or 0 if nothing has been published
+        uint32_t GetBlindDiscoveryHash(uint16_t blindId);
+        void SaveBlindDiscoveryHash(uint16_t blindId, uint32_t hash);
+        uint32_t GetRemoteDiscoveryHash(uint32_t remoteId);
+        void SaveRemoteDiscoveryHash(uint32_t remoteId, uint32_t hash);
+
         void HardReset();
 
+        /// @brief Prints usage, wear and performance statistics of the underlying storage
+        void PrintStorageStats() { _storage.PrintStorageStats(); }
+
+        /// @brief Enumerates all the stored config records, e.g. to export them
+        /// @param cursor [in/out] 0 to start with the first record
+        /// @param recordId [out] Receives the ID of the record
+        /// @param size [out] Receives the size of the record
+        /// @return The record data, or nullptr if there are no more records
+        const uint8_t *NextRecord(uint32_t *cursor, uint32_t *recordId, size_t *size);
+
+        /// @brief Blanks the WiFi and MQTT passwords in a copy of a record, so it can be shared without them
+        static void RemoveSecrets(uint32_t recordId, uint8_t *data, size_t size);
+
+        /// @brief Stores a record to be imported by CommitImport. It has no effect on the current config until then.
+        bool StageImport(uint32_t recordId, const uint8_t *data, size_t size);
+
+        /// @brief Discards any staged records
+        void ClearImport();
+
+        /// @brief Replaces the entire config with the staged records
+        /// @return The number of records imported
+        uint32_t CommitImport();
+
     private:
         DeviceConfig(const DeviceConfig &) = delete;
 
+        template<typename T>
+        const T *GetRecord(uint32_t blockId, uint16_t version);
+        /// @brief Brings every config record up to the current layout. Done before anything reads them.
+        void UpgradeRecords();
+        template<typename T>
+        void UpgradeRecord(uint32_t blockId, uint32_t legacyBlockId, uint16_t version);
+        template<typename T>
+        bool SaveRecord(uint32_t blockId, uint16_t version, const T *record);
+        void DeleteRecord(uint32_t blockId, uint32_t legacyBlockId);
+
+        uint32_t GetHash(uint32_t blockId);
+        void SaveHash(uint32_t blockId, uint32_t hash);
+
         void SaveIdList(uint32_t header, const uint16_t *ids, uint32_t count);
-        const uint16_t *GetIdList(uint32_t header, uint32_t *count);
+        std::vector<uint16_t> GetIdList(uint32_t header);
         void SaveIdList32(uint32_t header, const uint32_t *ids, uint32_t count);
-        const uint32_t *GetIdList32(uint32_t header, uint32_t *count);
+        std::vector<uint32_t> GetIdList32(uint32_t header);
 
         BlockStorage _storage;        
 };
@@ -0,0 +1,108 @@
+// Copyright (c) 2023 Mark Godwin.
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <stdint.h>
+#include "jsonWriter.h"
+
+// Slots in a discovery template, filled in when it is published
+#define DISCOVERY_ID "\x01"     // Device ID, as 8 hex digits
+#define DISCOVERY_NAME "\x02"   // Device name, escaped for JSON
+
+// Starting value for DiscoveryTemplate::Hash
+#define DISCOVERY_HASH_SEED 2166136261u
+
+/// @brief Home Assistant discovery message, worked out at compile time with slots for the device details.
+/// The text stays in flash, and is filled in straight into the MQTT publish queue.
+class DiscoveryTemplate
+{
+    public:
+        constexpr DiscoveryTemplate(const char *text)
+        :   _text(text),
+            _fixedLength(CountFixed(text)),
+            _idSlots(CountSlots(text, *DISCOVERY_ID)),
+            _nameSlots(CountSlots(text, *DISCOVERY_NAME))
+        {
+        }
+
+        /// @brief Length of the message, once filled in
+        uint32_t Length(const char *name) const
+        {
+            return _fixedLength + _idSlots * 8 + _nameSlots * EscapedLength(name);
+        }
+
+        /// @brief Write the message, which must have room for Length() bytes
+        void Write(uint8_t *output, uint32_t id, const char *name) const
+        {
+            static const char digits[] = "0123456789abcdef";
+            for(auto text = _text; *text; text++)
+            {
+                if(*text == *DISCOVERY_ID)
+                {
+                    for(auto shift = 28; shift >= 0; shift -= 4)
+                        *output++ = digits[(id >> shift) & 0xF];
+                }
+                else if(*text == *DISCOVERY_NAME)
+                {
+                    for(auto c = name; *c; c++)
+                        output += JsonWriter::EscapeChar(*c, (char *)output);
+                }
+                else
+                {
+                    *output++ = *text;
+                }
+            }
+        }
+
+        /// @brief Fold everything that goes into a published message into a hash, to tell if it has changed.
+        /// Chain calls to cover several messages, starting from DISCOVERY_HASH_SEED.
+        uint32_t Hash(uint32_t hash, const char *baseTopic, uint32_t id, const char *name) const
+        {
+            hash = HashString(hash, baseTopic);
+            hash = HashString(hash, _text);
+            for(auto shift = 0; shift < 32; shift += 8)
+                hash = (hash ^ ((id >> shift) & 0xFF)) * 16777619u;
+            return HashString(hash, name);
+        }
+
+    private:
+        static uint32_t HashString(uint32_t hash, const char *str)
+        {
+            // FNV-1a, including the terminator so adjacent strings can't run together
+            do
+                hash = (hash ^ (uint8_t)*str) * 16777619u;
+            while(*str++);
+            return hash;
+        }
+
+        static constexpr uint32_t CountSlots(const char *text, char slot)
+        {
+            uint32_t count = 0;
+            for(; *text; text++)
+                count += *text == slot;
+            return count;
+        }
+
+        static constexpr uint32_t CountFixed(const char *text)
+        {
+            uint32_t count = 0;
+            for(; *text; text++)
+                count += *text != *DISCOVERY_ID && *text != *DISCOVERY_NAME;
+            return count;
+        }
+
+        static uint32_t EscapedLength(const char *name)
+        {
+            char escaped[JSON_ESCAPE_MAX];
+            uint32_t length = 0;
+            for(; *name; name++)
+                length += JsonWriter::EscapeChar(*name, escaped);
+            return length;
+        }
+
+        const char *_text;
+        uint32_t _fixedLength;
+        uint32_t _idSlots;
+        uint32_t _nameSlots;
+};
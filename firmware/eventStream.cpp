@@ -0,0 +1,157 @@
+// Copyright (c) 2023 Mark Godwin.
+// SPDX-License-Identifier: MIT
+
+#include "picoSomfy.h"
+#include "eventStream.h"
+#include <string.h>
+
+static const char eventHeaders[] =
+    "HTTP/1.0 200 OK\r\n"
+    "Content-Type: text/event-stream\r\n"
+    "Cache-Control: no-cache\r\n"
+    "\r\n"
+    "retry: 2000\n\n";
+static const char resyncEvent[] = "event: resync\ndata: {}\n\n";
+static const char keepAliveComment[] = ":\n\n";
+
+EventStream::EventStream(std::shared_ptr<WebServer> webServer)
+:   _resyncCount(0),
+    _subscription(webServer, "/api/events", [this]() { return OpenClient(); }),
+    _wakeWorker([this]() { for(auto client : _clients) client->WakeIfPending(); }),
+    _keepAliveTimer([this]() { return KeepAlive(); }, EVENT_STREAM_KEEPALIVE)
+{
+}
+
+EventStream::~EventStream()
+{
+    // Open connections outlive us, so finish them off
+    for(auto client : _clients)
+        client->Close();
+    _clients.clear();
+}
+
+WebStream *EventStream::OpenClient()
+{
+    if(_clients.size() >= EVENT_STREAM_MAX_CLIENTS)
+    {
+        DBG_PUT("Too many event stream clients");
+        return nullptr;
+    }
+
+    auto client = new Client(this);
+    _clients.push_back(client);
+    DBG_PRINT("Event stream client connected, %d now\n", _clients.size());
+    return client;
+}
+
+void EventStream::Publish(const char *event, const char *data, uint32_t length)
+{
+    if(_clients.empty())
+        return;
+
+    for(auto client : _clients)
+    {
+        if(!(client->Queue("event: ", 7) &&
+            client->Queue(event, strlen(event)) &&
+            client->Queue("\ndata: ", 7) &&
+            client->Queue(data, length) &&
+            client->Queue("\n\n", 2)))
+        {
+            DBG_PUT("Event stream client fell behind");
+            client->Resync();
+            _resyncCount++;
+        }
+    }
+    _wakeWorker.ScheduleWork();
+}
+
+uint32_t EventStream::KeepAlive()
+{
+    for(auto client : _clients)
+        client->Queue(keepAliveComment, sizeof(keepAliveComment) - 1);
+    if(!_clients.empty())
+        _wakeWorker.ScheduleWork();
+    return EVENT_STREAM_KEEPALIVE;
+}
+
+EventStream::Client::Client(EventStream *owner)
+:   _owner(owner),
+    _closed(false),
+    _started(false),
+    _newlines(2),
+    _head(0),
+    _used(0)
+{
+    Queue(eventHeaders, sizeof(eventHeaders) - 1);
+}
+
+EventStream::Client::~Client()
+{
+    if(_owner)
+    {
+        _owner->_clients.remove(this);
+        DBG_PRINT("Event stream client disconnected, %d left\n", _owner->_clients.size());
+    }
+}
+
+int EventStream::Client::Read(char *buffer, int count)
+{
+    if(!_used)
+        return _closed ? -1 : 0;
+
+    _started = true;
+    // Copy out up to the end of the queue, then from the start if it wrapped
+    int read = 0;
+    while(_used && read < count)
+    {
+        auto chunk = std::min<uint32_t>(std::min<uint32_t>(_used, EVENT_STREAM_QUEUE_SIZE - _head), count - read);
+        memcpy(buffer + read, _queue + _head, chunk);
+        read += chunk;
+        _head = (_head + chunk) % EVENT_STREAM_QUEUE_SIZE;
+        _used -= chunk;
+    }
+
+    for(auto p = buffer + std::max(0, read - 2); p < buffer + read; p++)
+        _newlines = *p == '\n' ? std::min(_newlines + 1, 2) : 0;
+    return read;
+}
+
+bool EventStream::Client::Queue(const char *data, uint32_t length)
+{
+    if(length > EVENT_STREAM_QUEUE_SIZE - _used)
+        return false;
+
+    auto tail = (_head + _used) % EVENT_STREAM_QUEUE_SIZE;
+    auto chunk = std::min<uint32_t>(length, EVENT_STREAM_QUEUE_SIZE - tail);
+    memcpy(_queue + tail, data, chunk);
+    memcpy(_queue, data + chunk, length - chunk);
+    _used += length;
+    return true;
+}
+
+void EventStream::Client::Resync()
+{
+    // Throw away everything not yet handed to httpd, and have the client fetch the full state instead.
+    // If httpd has only part of an event, keep the rest of it, or the resync would be joined onto it.
+    // Each event ends with a blank line, and its data is all on one line, so the first blank line ends it.
+    uint32_t keep = 0;
+    for(auto newlines = _newlines; newlines < 2 && keep < _used; keep++)
+        newlines = _queue[(_head + keep) % EVENT_STREAM_QUEUE_SIZE] == '\n' ? newlines + 1 : 0;
+    _used = keep;
+    if(!_started)
+        Queue(eventHeaders, sizeof(eventHeaders) - 1);
+    Queue(resyncEvent, sizeof(resyncEvent) - 1);
+}
+
+void EventStream::Client::Close()
+{
+    _owner = nullptr;
+    _closed = true;
+    Wake();
+}
+
+void EventStream::Client::WakeIfPending()
+{
+    if(_used)
+        Wake();
+}
@@ -0,0 +1,75 @@
+// Copyright (c) 2023 Mark Godwin.
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <stdint.h>
+#include <list>
+#include <memory>
+#include "webServer.h"
+#include "scheduler.h"
+
+// Most browsers that can listen at once. Each one holds a queue and a send buffer.
+#define EVENT_STREAM_MAX_CLIENTS 2
+// Bytes of events held for a client that isn't keeping up, before it is told to resync instead
+#define EVENT_STREAM_QUEUE_SIZE 1024
+// httpd closes a connection that hasn't sent anything for a while (see HTTPD_MAX_RETRIES), so send a comment at
+// least this often (ms)
+#define EVENT_STREAM_KEEPALIVE 2500
+
+/// @brief Server-Sent Events stream at /api/events, pushing blind and remote changes to the web interface as they happen
+/// @remarks Each client has a fixed size queue, so a slow client can't hold up the rest of the firmware. If the
+/// queue fills, it is emptied and the client is sent a resync event, to fetch the full lists again.
+class EventStream
+{
+    public:
+        EventStream(std::shared_ptr<WebServer> webServer);
+        ~EventStream();
+
+        /// @brief Send an event to every client
+        /// @param event Name of the event
+        /// @param data JSON data for the event, on one line
+        void Publish(const char *event, const char *data, uint32_t length);
+
+        bool HasClients() { return !_clients.empty(); }
+        /// @brief How many times a client fell behind and was told to resync
+        uint32_t GetResyncCount() { return _resyncCount; }
+
+    private:
+        class Client : public WebStream
+        {
+            public:
+                Client(EventStream *owner);
+                virtual ~Client();
+
+                virtual int Read(char *buffer, int count);
+
+                /// @brief Add to the queue
+                /// @return False if it didn't fit
+                bool Queue(const char *data, uint32_t length);
+                void Resync();
+                /// @brief Finish the response once everything queued has gone
+                void Close();
+                void WakeIfPending();
+
+            private:
+                Client(const Client &) = delete;
+
+                EventStream *_owner;
+                bool _closed;
+                bool _started;      // Some of the headers have been sent
+                uint8_t _newlines;  // Newlines at the end of what has been sent. Two means it ended on a whole event.
+                uint32_t _head;     // Next byte to send
+                uint32_t _used;
+                char _queue[EVENT_STREAM_QUEUE_SIZE];
+        };
+
+        WebStream *OpenClient();
+        uint32_t KeepAlive();
+
+        std::list<Client *> _clients;       // Owned by the web server, and removed when the connection closes
+        uint32_t _resyncCount;
+        StreamSubscription _subscription;
+        PendingWorker _wakeWorker;          // Sends outside of whatever published the event
+        ScheduledTimer _keepAliveTimer;
+};
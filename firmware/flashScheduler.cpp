@@ -0,0 +1,91 @@
+// Copyright (c) 2023 Mark Godwin.
+// SPDX-License-Identifier: MIT
+
+#include "picoSomfy.h"
+#include "pico/flash.h"
+
+#include "flashScheduler.h"
+#include "commandQueue.h"
+
+// How long to wait for the radio before erasing anyway. The longest command takes about 2 seconds.
+#define ERASE_WAIT_TIMEOUT 2500
+// How often to check for background work, and how quickly to continue if there's more to do
+#define IDLE_WORK_INTERVAL 10000
+#define IDLE_WORK_CONTINUE 500
+
+FlashScheduler::FlashScheduler(std::shared_ptr<RadioCommandQueue> commandQueue)
+:   _commandQueue(std::move(commandQueue)),
+    _idleTimer([this]() { return DoIdleWork(); }, IDLE_WORK_INTERVAL),
+    _deferredCount(0),
+    _stallCount(0),
+    _longestStall(0)
+{
+}
+
+int FlashScheduler::Program(void (*func)(void *), void *param)
+{
+    return Execute(func, param);
+}
+
+int FlashScheduler::Erase(void (*func)(void *), void *param)
+{
+    // Hold off any new transmissions, waiting for the current one to finish if we need to
+    auto held = _commandQueue->HoldTransmissions(0);
+    if(!held)
+    {
+        DBG_PUT("Erase deferred until the radio is idle");
+        _deferredCount++;
+        held = _commandQueue->HoldTransmissions(ERASE_WAIT_TIMEOUT);
+        if(!held)
+            DBG_PUT("Radio still busy. Erasing anyway");
+    }
+
+    auto result = Execute(func, param);
+
+    if(held)
+        _commandQueue->ReleaseTransmissions();
+    return result;
+}
+
+int FlashScheduler::Execute(void (*func)(void *), void *param)
+{
+    auto transmitting = _commandQueue->IsTransmitting();
+    auto start = get_absolute_time();
+
+    auto result = flash_safe_execute(func, param, 1000);
+
+    if(transmitting)
+    {
+        // The radio thread was paused mid-transmission for the whole operation
+        auto stall = (uint32_t)absolute_time_diff_us(start, get_absolute_time());
+        _stallCount++;
+        if(stall > _longestStall)
+            _longestStall = stall;
+    }
+    return result;
+}
+
+void FlashScheduler::SetIdleWork(std::function<bool()> &&work)
+{
+    _idleWork = std::move(work);
+}
+
+uint32_t FlashScheduler::DoIdleWork()
+{
+    if(!_idleWork)
+        return IDLE_WORK_INTERVAL;
+
+    // Don't start anything while commands are waiting to be sent
+    if(!_commandQueue->IsIdle())
+        return IDLE_WORK_CONTINUE;
+
+    if(_idleWork())
+        return IDLE_WORK_CONTINUE;
+
+    return IDLE_WORK_INTERVAL;
+}
+
+void FlashScheduler::PrintStats()
+{
+    printf("Flash scheduler statistics:\n    Deferred: %d\n    Stalls:   %d\n    Longest:  %dus\n\n", _deferredCount, _stallCount, _longestStall);
+}
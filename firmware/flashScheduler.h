@@ -0,0 +1,59 @@
+// Copyright (c) 2023 Mark Godwin.
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <memory>
+#include <functional>
+#include "scheduler.h"
+
+class RadioCommandQueue;
+
+/// @brief Runs flash operations so they don't disrupt radio transmissions
+/// @remarks Flash operations pause the radio thread on core 1. Programming a few pages is quick enough
+/// to slip between radio frames, but a sector erase isn't, so erases wait for a gap between transmissions.
+/// Erasing ahead of time is done from a timer, whenever the radio is idle.
+class FlashScheduler
+{
+    public:
+        FlashScheduler(std::shared_ptr<RadioCommandQueue> commandQueue);
+
+        /// @brief Program flash straight away
+        /// @param func Function to run with the other core paused
+        /// @param param Parameter for the function
+        /// @return PICO_OK on success
+        int Program(void (*func)(void *), void *param);
+
+        /// @brief Erase flash, once the radio has finished transmitting
+        /// @param func Function to run with the other core paused
+        /// @param param Parameter for the function
+        /// @return PICO_OK on success
+        int Erase(void (*func)(void *), void *param);
+
+        /// @brief Sets the background work to do when the radio is idle
+        /// @param work Does one step of work. Returns true if there is more to do
+        void SetIdleWork(std::function<bool()> &&work);
+
+        /// @brief Number of erases that had to wait for the radio
+        uint32_t GetDeferredCount() { return _deferredCount; }
+
+        /// @brief Number of flash operations that paused a radio transmission
+        uint32_t GetStallCount() { return _stallCount; }
+
+        /// @brief The longest time a radio transmission was paused by flash, in microseconds
+        uint32_t GetLongestStall() { return _longestStall; }
+
+        void PrintStats();
+
+    private:
+        int Execute(void (*func)(void *), void *param);
+        uint32_t DoIdleWork();
+
+        std::shared_ptr<RadioCommandQueue> _commandQueue;
+        std::function<bool()> _idleWork;
+        ScheduledTimer _idleTimer;
+
+        uint32_t _deferredCount;
+        uint32_t _stallCount;
+        uint32_t _longestStall;
+};
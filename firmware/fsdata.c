@@ -24,81 +24,6 @@
 #if FSDATA_FILE_ALIGNMENT==2
 #include "fsdata_alignment.h"
 #endif
-#if FSDATA_FILE_ALIGNMENT==1
-static const unsigned int dummy_align__api_blinds_add_json = 0;
-#endif
-static const unsigned char FSDATA_ALIGN_PRE data__api_blinds_add_json[] FSDATA_ALIGN_POST = {
-/* /api/blinds/add.json (21 chars) */
-0x2f,0x61,0x70,0x69,0x2f,0x62,0x6c,0x69,0x6e,0x64,0x73,0x2f,0x61,0x64,0x64,0x2e,
-0x6a,0x73,0x6f,0x6e,0x00,0x00,0x00,0x00,
-
-/* HTTP header */
-/* "HTTP/1.0 200 OK
-" (17 bytes) */
-0x48,0x54,0x54,0x50,0x2f,0x31,0x2e,0x30,0x20,0x32,0x30,0x30,0x20,0x4f,0x4b,0x0d,
-0x0a,
-/* "Server: picow
-" (15 bytes) */
-0x53,0x65,0x72,0x76,0x65,0x72,0x3a,0x20,0x70,0x69,0x63,0x6f,0x77,0x0d,0x0a,
-/* "Content-Type: application/json
-
-" (34 bytes) */
-0x43,0x6f,0x6e,0x74,0x65,0x6e,0x74,0x2d,0x54,0x79,0x70,0x65,0x3a,0x20,0x61,0x70,
-0x70,0x6c,0x69,0x63,0x61,0x74,0x69,0x6f,0x6e,0x2f,0x6a,0x73,0x6f,0x6e,0x0d,0x0a,
-0x0d,0x0a,
-/* raw file data (14 bytes) */
-0x3c,0x21,0x2d,0x2d,0x23,0x72,0x65,0x73,0x75,0x6c,0x74,0x2d,0x2d,0x3e,};
-
-#if FSDATA_FILE_ALIGNMENT==1
-static const unsigned int dummy_align__api_blinds_command_json = 1;
-#endif
-static const unsigned char FSDATA_ALIGN_PRE data__api_blinds_command_json[] FSDATA_ALIGN_POST = {
-/* /api/blinds/command.json (25 chars) */
-0x2f,0x61,0x70,0x69,0x2f,0x62,0x6c,0x69,0x6e,0x64,0x73,0x2f,0x63,0x6f,0x6d,0x6d,
-0x61,0x6e,0x64,0x2e,0x6a,0x73,0x6f,0x6e,0x00,0x00,0x00,0x00,
-
-/* HTTP header */
-/* "HTTP/1.0 200 OK
-" (17 bytes) */
-0x48,0x54,0x54,0x50,0x2f,0x31,0x2e,0x30,0x20,0x32,0x30,0x30,0x20,0x4f,0x4b,0x0d,
-0x0a,
-/* "Server: picow
-" (15 bytes) */
-0x53,0x65,0x72,0x76,0x65,0x72,0x3a,0x20,0x70,0x69,0x63,0x6f,0x77,0x0d,0x0a,
-/* "Content-Type: application/json
-
-" (34 bytes) */
-0x43,0x6f,0x6e,0x74,0x65,0x6e,0x74,0x2d,0x54,0x79,0x70,0x65,0x3a,0x20,0x61,0x70,
-0x70,0x6c,0x69,0x63,0x61,0x74,0x69,0x6f,0x6e,0x2f,0x6a,0x73,0x6f,0x6e,0x0d,0x0a,
-0x0d,0x0a,
-/* raw file data (14 bytes) */
-0x3c,0x21,0x2d,0x2d,0x23,0x72,0x65,0x73,0x75,0x6c,0x74,0x2d,0x2d,0x3e,};
-
-#if FSDATA_FILE_ALIGNMENT==1
-static const unsigned int dummy_align__api_blinds_delete_json = 2;
-#endif
-static const unsigned char FSDATA_ALIGN_PRE data__api_blinds_delete_json[] FSDATA_ALIGN_POST = {
-/* /api/blinds/delete.json (24 chars) */
-0x2f,0x61,0x70,0x69,0x2f,0x62,0x6c,0x69,0x6e,0x64,0x73,0x2f,0x64,0x65,0x6c,0x65,
-0x74,0x65,0x2e,0x6a,0x73,0x6f,0x6e,0x00,
-
-/* HTTP header */
-/* "HTTP/1.0 200 OK
-" (17 bytes) */
-0x48,0x54,0x54,0x50,0x2f,0x31,0x2e,0x30,0x20,0x32,0x30,0x30,0x20,0x4f,0x4b,0x0d,
-0x0a,
-/* "Server: picow
-" (15 bytes) */
-0x53,0x65,0x72,0x76,0x65,0x72,0x3a,0x20,0x70,0x69,0x63,0x6f,0x77,0x0d,0x0a,
-/* "Content-Type: application/json
-
-" (34 bytes) */
-0x43,0x6f,0x6e,0x74,0x65,0x6e,0x74,0x2d,0x54,0x79,0x70,0x65,0x3a,0x20,0x61,0x70,
-0x70,0x6c,0x69,0x63,0x61,0x74,0x69,0x6f,0x6e,0x2f,0x6a,0x73,0x6f,0x6e,0x0d,0x0a,
-0x0d,0x0a,
-/* raw file data (14 bytes) */
-0x3c,0x21,0x2d,0x2d,0x23,0x72,0x65,0x73,0x75,0x6c,0x74,0x2d,0x2d,0x3e,};
-
 #if FSDATA_FILE_ALIGNMENT==1
 static const unsigned int dummy_align__api_blinds_list_json = 3;
 #endif
@@ -108,9 +33,9 @@ static const unsigned char FSDATA_ALIGN_PRE data__api_blinds_list_json[] FSDATA_
 0x2e,0x6a,0x73,0x6f,0x6e,0x00,0x00,0x00,
 
 /* HTTP header */
-/* "HTTP/1.0 200 OK
+/* "HTTP/1.1 200 OK
 " (17 bytes) */
-0x48,0x54,0x54,0x50,0x2f,0x31,0x2e,0x30,0x20,0x32,0x30,0x30,0x20,0x4f,0x4b,0x0d,
+0x48,0x54,0x54,0x50,0x2f,0x31,0x2e,0x31,0x20,0x32,0x30,0x30,0x20,0x4f,0x4b,0x0d,
 0x0a,
 /* "Server: picow
 " (15 bytes) */
@@ -125,31 +50,6 @@ static const unsigned char FSDATA_ALIGN_PRE data__api_blinds_list_json[] FSDATA_
 0x5b,0x3c,0x21,0x2d,0x2d,0x23,0x62,0x6c,0x69,0x6e,0x64,0x73,0x2d,0x2d,0x3e,0x5d,
 };
 
-#if FSDATA_FILE_ALIGNMENT==1
-static const unsigned int dummy_align__api_blinds_update_json = 4;
-#endif
-static const unsigned char FSDATA_ALIGN_PRE data__api_blinds_update_json[] FSDATA_ALIGN_POST = {
-/* /api/blinds/update.json (24 chars) */
-0x2f,0x61,0x70,0x69,0x2f,0x62,0x6c,0x69,0x6e,0x64,0x73,0x2f,0x75,0x70,0x64,0x61,
-0x74,0x65,0x2e,0x6a,0x73,0x6f,0x6e,0x00,
-
-/* HTTP header */
-/* "HTTP/1.0 200 OK
-" (17 bytes) */
-0x48,0x54,0x54,0x50,0x2f,0x31,0x2e,0x30,0x20,0x32,0x30,0x30,0x20,0x4f,0x4b,0x0d,
-0x0a,
-/* "Server: picow
-" (15 bytes) */
-0x53,0x65,0x72,0x76,0x65,0x72,0x3a,0x20,0x70,0x69,0x63,0x6f,0x77,0x0d,0x0a,
-/* "Content-Type: application/json
-
-" (34 bytes) */
-0x43,0x6f,0x6e,0x74,0x65,0x6e,0x74,0x2d,0x54,0x79,0x70,0x65,0x3a,0x20,0x61,0x70,
-0x70,0x6c,0x69,0x63,0x61,0x74,0x69,0x6f,0x6e,0x2f,0x6a,0x73,0x6f,0x6e,0x0d,0x0a,
-0x0d,0x0a,
-/* raw file data (14 bytes) */
-0x3c,0x21,0x2d,0x2d,0x23,0x72,0x65,0x73,0x75,0x6c,0x74,0x2d,0x2d,0x3e,};
-
 #if FSDATA_FILE_ALIGNMENT==1
 static const unsigned int dummy_align__api_remotes_add_json = 5;
 #endif
@@ -159,9 +59,9 @@ static const unsigned char FSDATA_ALIGN_PRE data__api_remotes_add_json[] FSDATA_
 0x2e,0x6a,0x73,0x6f,0x6e,0x00,0x00,0x00,
 
 /* HTTP header */
-/* "HTTP/1.0 200 OK
+/* "HTTP/1.1 200 OK
 " (17 bytes) */
-0x48,0x54,0x54,0x50,0x2f,0x31,0x2e,0x30,0x20,0x32,0x30,0x30,0x20,0x4f,0x4b,0x0d,
+0x48,0x54,0x54,0x50,0x2f,0x31,0x2e,0x31,0x20,0x32,0x30,0x30,0x20,0x4f,0x4b,0x0d,
 0x0a,
 /* "Server: picow
 " (15 bytes) */
@@ -184,34 +84,9 @@ static const unsigned char FSDATA_ALIGN_PRE data__api_remotes_bindBlind_json[] F
 0x64,0x42,0x6c,0x69,0x6e,0x64,0x2e,0x6a,0x73,0x6f,0x6e,0x00,
 
 /* HTTP header */
-/* "HTTP/1.0 200 OK
-" (17 bytes) */
-0x48,0x54,0x54,0x50,0x2f,0x31,0x2e,0x30,0x20,0x32,0x30,0x30,0x20,0x4f,0x4b,0x0d,
-0x0a,
-/* "Server: picow
-" (15 bytes) */
-0x53,0x65,0x72,0x76,0x65,0x72,0x3a,0x20,0x70,0x69,0x63,0x6f,0x77,0x0d,0x0a,
-/* "Content-Type: application/json
-
-" (34 bytes) */
-0x43,0x6f,0x6e,0x74,0x65,0x6e,0x74,0x2d,0x54,0x79,0x70,0x65,0x3a,0x20,0x61,0x70,
-0x70,0x6c,0x69,0x63,0x61,0x74,0x69,0x6f,0x6e,0x2f,0x6a,0x73,0x6f,0x6e,0x0d,0x0a,
-0x0d,0x0a,
-/* raw file data (14 bytes) */
-0x3c,0x21,0x2d,0x2d,0x23,0x72,0x65,0x73,0x75,0x6c,0x74,0x2d,0x2d,0x3e,};
-
-#if FSDATA_FILE_ALIGNMENT==1
-static const unsigned int dummy_align__api_remotes_command_json = 7;
-#endif
-static const unsigned char FSDATA_ALIGN_PRE data__api_remotes_command_json[] FSDATA_ALIGN_POST = {
-/* /api/remotes/command.json (26 chars) */
-0x2f,0x61,0x70,0x69,0x2f,0x72,0x65,0x6d,0x6f,0x74,0x65,0x73,0x2f,0x63,0x6f,0x6d,
-0x6d,0x61,0x6e,0x64,0x2e,0x6a,0x73,0x6f,0x6e,0x00,0x00,0x00,
-
-/* HTTP header */
-/* "HTTP/1.0 200 OK
+/* "HTTP/1.1 200 OK
 " (17 bytes) */
-0x48,0x54,0x54,0x50,0x2f,0x31,0x2e,0x30,0x20,0x32,0x30,0x30,0x20,0x4f,0x4b,0x0d,
+0x48,0x54,0x54,0x50,0x2f,0x31,0x2e,0x31,0x20,0x32,0x30,0x30,0x20,0x4f,0x4b,0x0d,
 0x0a,
 /* "Server: picow
 " (15 bytes) */
@@ -234,9 +109,9 @@ static const unsigned char FSDATA_ALIGN_PRE data__api_remotes_delete_json[] FSDA
 0x65,0x74,0x65,0x2e,0x6a,0x73,0x6f,0x6e,0x00,0x00,0x00,0x00,
 
 /* HTTP header */
-/* "HTTP/1.0 200 OK
+/* "HTTP/1.1 200 OK
 " (17 bytes) */
-0x48,0x54,0x54,0x50,0x2f,0x31,0x2e,0x30,0x20,0x32,0x30,0x30,0x20,0x4f,0x4b,0x0d,
+0x48,0x54,0x54,0x50,0x2f,0x31,0x2e,0x31,0x20,0x32,0x30,0x30,0x20,0x4f,0x4b,0x0d,
 0x0a,
 /* "Server: picow
 " (15 bytes) */
@@ -259,9 +134,9 @@ static const unsigned char FSDATA_ALIGN_PRE data__api_remotes_discover_json[] FS
 0x63,0x6f,0x76,0x65,0x72,0x2e,0x6a,0x73,0x6f,0x6e,0x00,0x00,
 
 /* HTTP header */
-/* "HTTP/1.0 200 OK
+/* "HTTP/1.1 200 OK
 " (17 bytes) */
-0x48,0x54,0x54,0x50,0x2f,0x31,0x2e,0x30,0x20,0x32,0x30,0x30,0x20,0x4f,0x4b,0x0d,
+0x48,0x54,0x54,0x50,0x2f,0x31,0x2e,0x31,0x20,0x32,0x30,0x30,0x20,0x4f,0x4b,0x0d,
 0x0a,
 /* "Server: picow
 " (15 bytes) */
@@ -284,9 +159,9 @@ static const unsigned char FSDATA_ALIGN_PRE data__api_remotes_import_json[] FSDA
 0x6f,0x72,0x74,0x2e,0x6a,0x73,0x6f,0x6e,0x00,0x00,0x00,0x00,
 
 /* HTTP header */
-/* "HTTP/1.0 200 OK
+/* "HTTP/1.1 200 OK
 " (17 bytes) */
-0x48,0x54,0x54,0x50,0x2f,0x31,0x2e,0x30,0x20,0x32,0x30,0x30,0x20,0x4f,0x4b,0x0d,
+0x48,0x54,0x54,0x50,0x2f,0x31,0x2e,0x31,0x20,0x32,0x30,0x30,0x20,0x4f,0x4b,0x0d,
 0x0a,
 /* "Server: picow
 " (15 bytes) */
@@ -309,9 +184,9 @@ static const unsigned char FSDATA_ALIGN_PRE data__api_remotes_list_json[] FSDATA
 0x74,0x2e,0x6a,0x73,0x6f,0x6e,0x00,0x00,
 
 /* HTTP header */
-/* "HTTP/1.0 200 OK
+/* "HTTP/1.1 200 OK
 " (17 bytes) */
-0x48,0x54,0x54,0x50,0x2f,0x31,0x2e,0x30,0x20,0x32,0x30,0x30,0x20,0x4f,0x4b,0x0d,
+0x48,0x54,0x54,0x50,0x2f,0x31,0x2e,0x31,0x20,0x32,0x30,0x30,0x20,0x4f,0x4b,0x0d,
 0x0a,
 /* "Server: picow
 " (15 bytes) */
@@ -335,9 +210,9 @@ static const unsigned char FSDATA_ALIGN_PRE data__api_remotes_results_json[] FSD
 0x75,0x6c,0x74,0x73,0x2e,0x6a,0x73,0x6f,0x6e,0x00,0x00,0x00,
 
 /* HTTP header */
-/* "HTTP/1.0 200 OK
+/* "HTTP/1.1 200 OK
 " (17 bytes) */
-0x48,0x54,0x54,0x50,0x2f,0x31,0x2e,0x30,0x20,0x32,0x30,0x30,0x20,0x4f,0x4b,0x0d,
+0x48,0x54,0x54,0x50,0x2f,0x31,0x2e,0x31,0x20,0x32,0x30,0x30,0x20,0x4f,0x4b,0x0d,
 0x0a,
 /* "Server: picow
 " (15 bytes) */
@@ -361,9 +236,9 @@ static const unsigned char FSDATA_ALIGN_PRE data__api_remotes_unbindBlind_json[]
 0x69,0x6e,0x64,0x42,0x6c,0x69,0x6e,0x64,0x2e,0x6a,0x73,0x6f,0x6e,0x00,0x00,0x00,
 
 /* HTTP header */
-/* "HTTP/1.0 200 OK
+/* "HTTP/1.1 200 OK
 " (17 bytes) */
-0x48,0x54,0x54,0x50,0x2f,0x31,0x2e,0x30,0x20,0x32,0x30,0x30,0x20,0x4f,0x4b,0x0d,
+0x48,0x54,0x54,0x50,0x2f,0x31,0x2e,0x31,0x20,0x32,0x30,0x30,0x20,0x4f,0x4b,0x0d,
 0x0a,
 /* "Server: picow
 " (15 bytes) */
@@ -386,9 +261,9 @@ static const unsigned char FSDATA_ALIGN_PRE data__api_remotes_update_json[] FSDA
 0x61,0x74,0x65,0x2e,0x6a,0x73,0x6f,0x6e,0x00,0x00,0x00,0x00,
 
 /* HTTP header */
-/* "HTTP/1.0 200 OK
+/* "HTTP/1.1 200 OK
 " (17 bytes) */
-0x48,0x54,0x54,0x50,0x2f,0x31,0x2e,0x30,0x20,0x32,0x30,0x30,0x20,0x4f,0x4b,0x0d,
+0x48,0x54,0x54,0x50,0x2f,0x31,0x2e,0x31,0x20,0x32,0x30,0x30,0x20,0x4f,0x4b,0x0d,
 0x0a,
 /* "Server: picow
 " (15 bytes) */
@@ -411,9 +286,9 @@ static const unsigned char FSDATA_ALIGN_PRE data__api_configure_json[] FSDATA_AL
 0x73,0x6f,0x6e,0x00,
 
 /* HTTP header */
-/* "HTTP/1.0 200 OK
+/* "HTTP/1.1 200 OK
 " (17 bytes) */
-0x48,0x54,0x54,0x50,0x2f,0x31,0x2e,0x30,0x20,0x32,0x30,0x30,0x20,0x4f,0x4b,0x0d,
+0x48,0x54,0x54,0x50,0x2f,0x31,0x2e,0x31,0x20,0x32,0x30,0x30,0x20,0x4f,0x4b,0x0d,
 0x0a,
 /* "Server: picow
 " (15 bytes) */
@@ -435,9 +310,9 @@ static const unsigned char FSDATA_ALIGN_PRE data__api_mqtt_json[] FSDATA_ALIGN_P
 0x2f,0x61,0x70,0x69,0x2f,0x6d,0x71,0x74,0x74,0x2e,0x6a,0x73,0x6f,0x6e,0x00,0x00,
 
 /* HTTP header */
-/* "HTTP/1.0 200 OK
+/* "HTTP/1.1 200 OK
 " (17 bytes) */
-0x48,0x54,0x54,0x50,0x2f,0x31,0x2e,0x30,0x20,0x32,0x30,0x30,0x20,0x4f,0x4b,0x0d,
+0x48,0x54,0x54,0x50,0x2f,0x31,0x2e,0x31,0x20,0x32,0x30,0x30,0x20,0x4f,0x4b,0x0d,
 0x0a,
 /* "Server: picow
 " (15 bytes) */
@@ -448,7 +323,7 @@ static const unsigned char FSDATA_ALIGN_PRE data__api_mqtt_json[] FSDATA_ALIGN_P
 0x43,0x6f,0x6e,0x74,0x65,0x6e,0x74,0x2d,0x54,0x79,0x70,0x65,0x3a,0x20,0x61,0x70,
 0x70,0x6c,0x69,0x63,0x61,0x74,0x69,0x6f,0x6e,0x2f,0x6a,0x73,0x6f,0x6e,0x0d,0x0a,
 0x0d,0x0a,
-/* raw file data (165 bytes) */
+/* raw file data (235 bytes) */
 0x7b,0x0a,0x20,0x20,0x20,0x20,0x22,0x61,0x64,0x64,0x72,0x65,0x73,0x73,0x22,0x3a,
 0x20,0x22,0x3c,0x21,0x2d,0x2d,0x23,0x6d,0x71,0x74,0x74,0x41,0x64,0x64,0x72,0x2d,
 0x2d,0x3e,0x22,0x2c,0x0a,0x20,0x20,0x20,0x20,0x22,0x70,0x6f,0x72,0x74,0x22,0x3a,
@@ -459,7 +334,11 @@ static const unsigned char FSDATA_ALIGN_PRE data__api_mqtt_json[] FSDATA_ALIGN_P
 0x77,0x6f,0x72,0x64,0x22,0x3a,0x20,0x22,0x2a,0x2a,0x2a,0x2a,0x2a,0x2a,0x2a,0x2a,
 0x22,0x2c,0x0a,0x20,0x20,0x20,0x20,0x22,0x74,0x6f,0x70,0x69,0x63,0x22,0x3a,0x20,
 0x22,0x3c,0x21,0x2d,0x2d,0x23,0x6d,0x71,0x74,0x74,0x54,0x6f,0x70,0x69,0x2d,0x2d,
-0x3e,0x22,0x0a,0x7d,0x0a,};
+0x3e,0x22,0x2c,0x0a,0x20,0x20,0x20,0x20,0x22,0x6a,0x73,0x6f,0x6e,0x53,0x74,0x61,
+0x74,0x65,0x22,0x3a,0x20,0x3c,0x21,0x2d,0x2d,0x23,0x6d,0x71,0x74,0x74,0x4a,0x73,
+0x6f,0x6e,0x2d,0x2d,0x3e,0x2c,0x0a,0x20,0x20,0x20,0x20,0x22,0x66,0x61,0x69,0x6c,
+0x6f,0x76,0x65,0x72,0x22,0x3a,0x20,0x22,0x3c,0x21,0x2d,0x2d,0x23,0x6d,0x71,0x74,
+0x74,0x46,0x61,0x69,0x6c,0x2d,0x2d,0x3e,0x22,0x0a,0x7d,};
 
 #if FSDATA_FILE_ALIGNMENT==1
 static const unsigned int dummy_align__api_status_json = 17;
@@ -470,9 +349,9 @@ static const unsigned char FSDATA_ALIGN_PRE data__api_status_json[] FSDATA_ALIGN
 0x00,0x00,0x00,0x00,
 
 /* HTTP header */
-/* "HTTP/1.0 200 OK
+/* "HTTP/1.1 200 OK
 " (17 bytes) */
-0x48,0x54,0x54,0x50,0x2f,0x31,0x2e,0x30,0x20,0x32,0x30,0x30,0x20,0x4f,0x4b,0x0d,
+0x48,0x54,0x54,0x50,0x2f,0x31,0x2e,0x31,0x20,0x32,0x30,0x30,0x20,0x4f,0x4b,0x0d,
 0x0a,
 /* "Server: picow
 " (15 bytes) */
@@ -498,9 +377,9 @@ static const unsigned char FSDATA_ALIGN_PRE data__api_wifi_json[] FSDATA_ALIGN_P
 0x2f,0x61,0x70,0x69,0x2f,0x77,0x69,0x66,0x69,0x2e,0x6a,0x73,0x6f,0x6e,0x00,0x00,
 
 /* HTTP header */
-/* "HTTP/1.0 200 OK
+/* "HTTP/1.1 200 OK
 " (17 bytes) */
-0x48,0x54,0x54,0x50,0x2f,0x31,0x2e,0x30,0x20,0x32,0x30,0x30,0x20,0x4f,0x4b,0x0d,
+0x48,0x54,0x54,0x50,0x2f,0x31,0x2e,0x31,0x20,0x32,0x30,0x30,0x20,0x4f,0x4b,0x0d,
 0x0a,
 /* "Server: picow
 " (15 bytes) */
@@ -527,9 +406,9 @@ static const unsigned char FSDATA_ALIGN_PRE data__static_css_main_2a508ea2_css[]
 0x2e,0x32,0x61,0x35,0x30,0x38,0x65,0x61,0x32,0x2e,0x63,0x73,0x73,0x00,0x00,0x00,
 
 /* HTTP header */
-/* "HTTP/1.0 200 OK
+/* "HTTP/1.1 200 OK
 " (17 bytes) */
-0x48,0x54,0x54,0x50,0x2f,0x31,0x2e,0x30,0x20,0x32,0x30,0x30,0x20,0x4f,0x4b,0x0d,
+0x48,0x54,0x54,0x50,0x2f,0x31,0x2e,0x31,0x20,0x32,0x30,0x30,0x20,0x4f,0x4b,0x0d,
 0x0a,
 /* "Server: picow
 " (15 bytes) */
@@ -542,6 +421,20 @@ static const unsigned char FSDATA_ALIGN_PRE data__static_css_main_2a508ea2_css[]
 " (27 bytes) */
 0x43,0x6f,0x6e,0x74,0x65,0x6e,0x74,0x2d,0x45,0x6e,0x63,0x6f,0x64,0x69,0x6e,0x67,
 0x3a,0x20,0x64,0x65,0x66,0x6c,0x61,0x74,0x65,0x0d,0x0a,
+/* "ETag: "5194b22213a53cb0"
+" (26 bytes) */
+0x45,0x54,0x61,0x67,0x3a,0x20,0x22,0x35,0x31,0x39,0x34,0x62,0x32,0x32,0x32,0x31,
+0x33,0x61,0x35,0x33,0x63,0x62,0x30,0x22,0x0d,0x0a,
+/* "Cache-Control: public, max-age=31536000, immutable
+" (52 bytes) */
+0x43,0x61,0x63,0x68,0x65,0x2d,0x43,0x6f,0x6e,0x74,0x72,0x6f,0x6c,0x3a,0x20,0x70,
+0x75,0x62,0x6c,0x69,0x63,0x2c,0x20,0x6d,0x61,0x78,0x2d,0x61,0x67,0x65,0x3d,0x33,
+0x31,0x35,0x33,0x36,0x30,0x30,0x30,0x2c,0x20,0x69,0x6d,0x6d,0x75,0x74,0x61,0x62,
+0x6c,0x65,0x0d,0x0a,
+/* "Vary: Accept-Encoding
+" (23 bytes) */
+0x56,0x61,0x72,0x79,0x3a,0x20,0x41,0x63,0x63,0x65,0x70,0x74,0x2d,0x45,0x6e,0x63,
+0x6f,0x64,0x69,0x6e,0x67,0x0d,0x0a,
 /* "Content-Type: text/css
 
 " (26 bytes) */
@@ -2587,9 +2480,9 @@ static const unsigned char FSDATA_ALIGN_PRE data__static_js_main_f1c98554_js[] F
 0x66,0x31,0x63,0x39,0x38,0x35,0x35,0x34,0x2e,0x6a,0x73,0x00,
 
 /* HTTP header */
-/* "HTTP/1.0 200 OK
+/* "HTTP/1.1 200 OK
 " (17 bytes) */
-0x48,0x54,0x54,0x50,0x2f,0x31,0x2e,0x30,0x20,0x32,0x30,0x30,0x20,0x4f,0x4b,0x0d,
+0x48,0x54,0x54,0x50,0x2f,0x31,0x2e,0x31,0x20,0x32,0x30,0x30,0x20,0x4f,0x4b,0x0d,
 0x0a,
 /* "Server: picow
 " (15 bytes) */
@@ -2602,6 +2495,20 @@ static const unsigned char FSDATA_ALIGN_PRE data__static_js_main_f1c98554_js[] F
 " (27 bytes) */
 0x43,0x6f,0x6e,0x74,0x65,0x6e,0x74,0x2d,0x45,0x6e,0x63,0x6f,0x64,0x69,0x6e,0x67,
 0x3a,0x20,0x64,0x65,0x66,0x6c,0x61,0x74,0x65,0x0d,0x0a,
+/* "ETag: "95ac8f3b7591e52c"
+" (26 bytes) */
+0x45,0x54,0x61,0x67,0x3a,0x20,0x22,0x39,0x35,0x61,0x63,0x38,0x66,0x33,0x62,0x37,
+0x35,0x39,0x31,0x65,0x35,0x32,0x63,0x22,0x0d,0x0a,
+/* "Cache-Control: public, max-age=31536000, immutable
+" (52 bytes) */
+0x43,0x61,0x63,0x68,0x65,0x2d,0x43,0x6f,0x6e,0x74,0x72,0x6f,0x6c,0x3a,0x20,0x70,
+0x75,0x62,0x6c,0x69,0x63,0x2c,0x20,0x6d,0x61,0x78,0x2d,0x61,0x67,0x65,0x3d,0x33,
+0x31,0x35,0x33,0x36,0x30,0x30,0x30,0x2c,0x20,0x69,0x6d,0x6d,0x75,0x74,0x61,0x62,
+0x6c,0x65,0x0d,0x0a,
+/* "Vary: Accept-Encoding
+" (23 bytes) */
+0x56,0x61,0x72,0x79,0x3a,0x20,0x41,0x63,0x63,0x65,0x70,0x74,0x2d,0x45,0x6e,0x63,
+0x6f,0x64,0x69,0x6e,0x67,0x0d,0x0a,
 /* "Content-Type: application/javascript
 
 " (40 bytes) */
@@ -9266,9 +9173,9 @@ static const unsigned char FSDATA_ALIGN_PRE data__static_media_logo_7e0d9d9f898a
 0x64,0x36,0x35,0x2e,0x73,0x76,0x67,0x00,
 
 /* HTTP header */
-/* "HTTP/1.0 200 OK
+/* "HTTP/1.1 200 OK
 " (17 bytes) */
-0x48,0x54,0x54,0x50,0x2f,0x31,0x2e,0x30,0x20,0x32,0x30,0x30,0x20,0x4f,0x4b,0x0d,
+0x48,0x54,0x54,0x50,0x2f,0x31,0x2e,0x31,0x20,0x32,0x30,0x30,0x20,0x4f,0x4b,0x0d,
 0x0a,
 /* "Server: picow
 " (15 bytes) */
@@ -9281,6 +9188,20 @@ static const unsigned char FSDATA_ALIGN_PRE data__static_media_logo_7e0d9d9f898a
 " (27 bytes) */
 0x43,0x6f,0x6e,0x74,0x65,0x6e,0x74,0x2d,0x45,0x6e,0x63,0x6f,0x64,0x69,0x6e,0x67,
 0x3a,0x20,0x64,0x65,0x66,0x6c,0x61,0x74,0x65,0x0d,0x0a,
+/* "ETag: "9713d5fac17344f0"
+" (26 bytes) */
+0x45,0x54,0x61,0x67,0x3a,0x20,0x22,0x39,0x37,0x31,0x33,0x64,0x35,0x66,0x61,0x63,
+0x31,0x37,0x33,0x34,0x34,0x66,0x30,0x22,0x0d,0x0a,
+/* "Cache-Control: public, max-age=31536000, immutable
+" (52 bytes) */
+0x43,0x61,0x63,0x68,0x65,0x2d,0x43,0x6f,0x6e,0x74,0x72,0x6f,0x6c,0x3a,0x20,0x70,
+0x75,0x62,0x6c,0x69,0x63,0x2c,0x20,0x6d,0x61,0x78,0x2d,0x61,0x67,0x65,0x3d,0x33,
+0x31,0x35,0x33,0x36,0x30,0x30,0x30,0x2c,0x20,0x69,0x6d,0x6d,0x75,0x74,0x61,0x62,
+0x6c,0x65,0x0d,0x0a,
+/* "Vary: Accept-Encoding
+" (23 bytes) */
+0x56,0x61,0x72,0x79,0x3a,0x20,0x41,0x63,0x63,0x65,0x70,0x74,0x2d,0x45,0x6e,0x63,
+0x6f,0x64,0x69,0x6e,0x67,0x0d,0x0a,
 /* "Content-Type: image/svg+xml
 
 " (31 bytes) */
@@ -9441,9 +9362,9 @@ static const unsigned char FSDATA_ALIGN_PRE data__static_media_pico_3789cfb7157b
 0x36,0x34,0x64,0x2e,0x73,0x76,0x67,0x00,
 
 /* HTTP header */
-/* "HTTP/1.0 200 OK
+/* "HTTP/1.1 200 OK
 " (17 bytes) */
-0x48,0x54,0x54,0x50,0x2f,0x31,0x2e,0x30,0x20,0x32,0x30,0x30,0x20,0x4f,0x4b,0x0d,
+0x48,0x54,0x54,0x50,0x2f,0x31,0x2e,0x31,0x20,0x32,0x30,0x30,0x20,0x4f,0x4b,0x0d,
 0x0a,
 /* "Server: picow
 " (15 bytes) */
@@ -9456,6 +9377,20 @@ static const unsigned char FSDATA_ALIGN_PRE data__static_media_pico_3789cfb7157b
 " (27 bytes) */
 0x43,0x6f,0x6e,0x74,0x65,0x6e,0x74,0x2d,0x45,0x6e,0x63,0x6f,0x64,0x69,0x6e,0x67,
 0x3a,0x20,0x64,0x65,0x66,0x6c,0x61,0x74,0x65,0x0d,0x0a,
+/* "ETag: "85ded8c02245a7c8"
+" (26 bytes) */
+0x45,0x54,0x61,0x67,0x3a,0x20,0x22,0x38,0x35,0x64,0x65,0x64,0x38,0x63,0x30,0x32,
+0x32,0x34,0x35,0x61,0x37,0x63,0x38,0x22,0x0d,0x0a,
+/* "Cache-Control: public, max-age=31536000, immutable
+" (52 bytes) */
+0x43,0x61,0x63,0x68,0x65,0x2d,0x43,0x6f,0x6e,0x74,0x72,0x6f,0x6c,0x3a,0x20,0x70,
+0x75,0x62,0x6c,0x69,0x63,0x2c,0x20,0x6d,0x61,0x78,0x2d,0x61,0x67,0x65,0x3d,0x33,
+0x31,0x35,0x33,0x36,0x30,0x30,0x30,0x2c,0x20,0x69,0x6d,0x6d,0x75,0x74,0x61,0x62,
+0x6c,0x65,0x0d,0x0a,
+/* "Vary: Accept-Encoding
+" (23 bytes) */
+0x56,0x61,0x72,0x79,0x3a,0x20,0x41,0x63,0x63,0x65,0x70,0x74,0x2d,0x45,0x6e,0x63,
+0x6f,0x64,0x69,0x6e,0x67,0x0d,0x0a,
 /* "Content-Type: image/svg+xml
 
 " (31 bytes) */
@@ -9769,13 +9704,21 @@ static const unsigned char FSDATA_ALIGN_PRE data__asset_manifest_json[] FSDATA_A
 0x6a,0x73,0x6f,0x6e,0x00,0x00,0x00,0x00,
 
 /* HTTP header */
-/* "HTTP/1.0 200 OK
+/* "HTTP/1.1 200 OK
 " (17 bytes) */
-0x48,0x54,0x54,0x50,0x2f,0x31,0x2e,0x30,0x20,0x32,0x30,0x30,0x20,0x4f,0x4b,0x0d,
+0x48,0x54,0x54,0x50,0x2f,0x31,0x2e,0x31,0x20,0x32,0x30,0x30,0x20,0x4f,0x4b,0x0d,
 0x0a,
 /* "Server: picow
 " (15 bytes) */
 0x53,0x65,0x72,0x76,0x65,0x72,0x3a,0x20,0x70,0x69,0x63,0x6f,0x77,0x0d,0x0a,
+/* "ETag: "8cb59cb51111e941"
+" (26 bytes) */
+0x45,0x54,0x61,0x67,0x3a,0x20,0x22,0x38,0x63,0x62,0x35,0x39,0x63,0x62,0x35,0x31,
+0x31,0x31,0x31,0x65,0x39,0x34,0x31,0x22,0x0d,0x0a,
+/* "Cache-Control: no-cache
+" (25 bytes) */
+0x43,0x61,0x63,0x68,0x65,0x2d,0x43,0x6f,0x6e,0x74,0x72,0x6f,0x6c,0x3a,0x20,0x6e,
+0x6f,0x2d,0x63,0x61,0x63,0x68,0x65,0x0d,0x0a,
 /* "Content-Type: application/json
 
 " (34 bytes) */
@@ -9827,9 +9770,9 @@ static const unsigned char FSDATA_ALIGN_PRE data__favicon_ico[] FSDATA_ALIGN_POS
 0x2f,0x66,0x61,0x76,0x69,0x63,0x6f,0x6e,0x2e,0x69,0x63,0x6f,0x00,0x00,0x00,0x00,
 
 /* HTTP header */
-/* "HTTP/1.0 200 OK
+/* "HTTP/1.1 200 OK
 " (17 bytes) */
-0x48,0x54,0x54,0x50,0x2f,0x31,0x2e,0x30,0x20,0x32,0x30,0x30,0x20,0x4f,0x4b,0x0d,
+0x48,0x54,0x54,0x50,0x2f,0x31,0x2e,0x31,0x20,0x32,0x30,0x30,0x20,0x4f,0x4b,0x0d,
 0x0a,
 /* "Server: picow
 " (15 bytes) */
@@ -9842,6 +9785,18 @@ static const unsigned char FSDATA_ALIGN_PRE data__favicon_ico[] FSDATA_ALIGN_POS
 " (27 bytes) */
 0x43,0x6f,0x6e,0x74,0x65,0x6e,0x74,0x2d,0x45,0x6e,0x63,0x6f,0x64,0x69,0x6e,0x67,
 0x3a,0x20,0x64,0x65,0x66,0x6c,0x61,0x74,0x65,0x0d,0x0a,
+/* "ETag: "2168c53e4f770aba"
+" (26 bytes) */
+0x45,0x54,0x61,0x67,0x3a,0x20,0x22,0x32,0x31,0x36,0x38,0x63,0x35,0x33,0x65,0x34,
+0x66,0x37,0x37,0x30,0x61,0x62,0x61,0x22,0x0d,0x0a,
+/* "Cache-Control: no-cache
+" (25 bytes) */
+0x43,0x61,0x63,0x68,0x65,0x2d,0x43,0x6f,0x6e,0x74,0x72,0x6f,0x6c,0x3a,0x20,0x6e,
+0x6f,0x2d,0x63,0x61,0x63,0x68,0x65,0x0d,0x0a,
+/* "Vary: Accept-Encoding
+" (23 bytes) */
+0x56,0x61,0x72,0x79,0x3a,0x20,0x41,0x63,0x63,0x65,0x70,0x74,0x2d,0x45,0x6e,0x63,
+0x6f,0x64,0x69,0x6e,0x67,0x0d,0x0a,
 /* "Content-Type: image/x-icon
 
 " (30 bytes) */
@@ -10343,9 +10298,9 @@ static const unsigned char FSDATA_ALIGN_PRE data__index_html[] FSDATA_ALIGN_POST
 0x2f,0x69,0x6e,0x64,0x65,0x78,0x2e,0x68,0x74,0x6d,0x6c,0x00,
 
 /* HTTP header */
-/* "HTTP/1.0 200 OK
+/* "HTTP/1.1 200 OK
 " (17 bytes) */
-0x48,0x54,0x54,0x50,0x2f,0x31,0x2e,0x30,0x20,0x32,0x30,0x30,0x20,0x4f,0x4b,0x0d,
+0x48,0x54,0x54,0x50,0x2f,0x31,0x2e,0x31,0x20,0x32,0x30,0x30,0x20,0x4f,0x4b,0x0d,
 0x0a,
 /* "Server: picow
 " (15 bytes) */
@@ -10358,6 +10313,18 @@ static const unsigned char FSDATA_ALIGN_PRE data__index_html[] FSDATA_ALIGN_POST
 " (27 bytes) */
 0x43,0x6f,0x6e,0x74,0x65,0x6e,0x74,0x2d,0x45,0x6e,0x63,0x6f,0x64,0x69,0x6e,0x67,
 0x3a,0x20,0x64,0x65,0x66,0x6c,0x61,0x74,0x65,0x0d,0x0a,
+/* "ETag: "b7f56d0f916c07fa"
+" (26 bytes) */
+0x45,0x54,0x61,0x67,0x3a,0x20,0x22,0x62,0x37,0x66,0x35,0x36,0x64,0x30,0x66,0x39,
+0x31,0x36,0x63,0x30,0x37,0x66,0x61,0x22,0x0d,0x0a,
+/* "Cache-Control: no-cache
+" (25 bytes) */
+0x43,0x61,0x63,0x68,0x65,0x2d,0x43,0x6f,0x6e,0x74,0x72,0x6f,0x6c,0x3a,0x20,0x6e,
+0x6f,0x2d,0x63,0x61,0x63,0x68,0x65,0x0d,0x0a,
+/* "Vary: Accept-Encoding
+" (23 bytes) */
+0x56,0x61,0x72,0x79,0x3a,0x20,0x41,0x63,0x63,0x65,0x70,0x74,0x2d,0x45,0x6e,0x63,
+0x6f,0x64,0x69,0x6e,0x67,0x0d,0x0a,
 /* "Content-Type: text/html
 
 " (27 bytes) */
@@ -10396,9 +10363,9 @@ static const unsigned char FSDATA_ALIGN_PRE data__logo192_png[] FSDATA_ALIGN_POS
 0x2f,0x6c,0x6f,0x67,0x6f,0x31,0x39,0x32,0x2e,0x70,0x6e,0x67,0x00,0x00,0x00,0x00,
 
 /* HTTP header */
-/* "HTTP/1.0 200 OK
+/* "HTTP/1.1 200 OK
 " (17 bytes) */
-0x48,0x54,0x54,0x50,0x2f,0x31,0x2e,0x30,0x20,0x32,0x30,0x30,0x20,0x4f,0x4b,0x0d,
+0x48,0x54,0x54,0x50,0x2f,0x31,0x2e,0x31,0x20,0x32,0x30,0x30,0x20,0x4f,0x4b,0x0d,
 0x0a,
 /* "Server: picow
 " (15 bytes) */
@@ -10411,6 +10378,18 @@ static const unsigned char FSDATA_ALIGN_PRE data__logo192_png[] FSDATA_ALIGN_POS
 " (27 bytes) */
 0x43,0x6f,0x6e,0x74,0x65,0x6e,0x74,0x2d,0x45,0x6e,0x63,0x6f,0x64,0x69,0x6e,0x67,
 0x3a,0x20,0x64,0x65,0x66,0x6c,0x61,0x74,0x65,0x0d,0x0a,
+/* "ETag: "d05e55c69283071f"
+" (26 bytes) */
+0x45,0x54,0x61,0x67,0x3a,0x20,0x22,0x64,0x30,0x35,0x65,0x35,0x35,0x63,0x36,0x39,
+0x32,0x38,0x33,0x30,0x37,0x31,0x66,0x22,0x0d,0x0a,
+/* "Cache-Control: no-cache
+" (25 bytes) */
+0x43,0x61,0x63,0x68,0x65,0x2d,0x43,0x6f,0x6e,0x74,0x72,0x6f,0x6c,0x3a,0x20,0x6e,
+0x6f,0x2d,0x63,0x61,0x63,0x68,0x65,0x0d,0x0a,
+/* "Vary: Accept-Encoding
+" (23 bytes) */
+0x56,0x61,0x72,0x79,0x3a,0x20,0x41,0x63,0x63,0x65,0x70,0x74,0x2d,0x45,0x6e,0x63,
+0x6f,0x64,0x69,0x6e,0x67,0x0d,0x0a,
 /* "Content-Type: image/png
 
 " (27 bytes) */
@@ -10718,9 +10697,9 @@ static const unsigned char FSDATA_ALIGN_PRE data__logo512_png[] FSDATA_ALIGN_POS
 0x2f,0x6c,0x6f,0x67,0x6f,0x35,0x31,0x32,0x2e,0x70,0x6e,0x67,0x00,0x00,0x00,0x00,
 
 /* HTTP header */
-/* "HTTP/1.0 200 OK
+/* "HTTP/1.1 200 OK
 " (17 bytes) */
-0x48,0x54,0x54,0x50,0x2f,0x31,0x2e,0x30,0x20,0x32,0x30,0x30,0x20,0x4f,0x4b,0x0d,
+0x48,0x54,0x54,0x50,0x2f,0x31,0x2e,0x31,0x20,0x32,0x30,0x30,0x20,0x4f,0x4b,0x0d,
 0x0a,
 /* "Server: picow
 " (15 bytes) */
@@ -10733,6 +10712,18 @@ static const unsigned char FSDATA_ALIGN_PRE data__logo512_png[] FSDATA_ALIGN_POS
 " (27 bytes) */
 0x43,0x6f,0x6e,0x74,0x65,0x6e,0x74,0x2d,0x45,0x6e,0x63,0x6f,0x64,0x69,0x6e,0x67,
 0x3a,0x20,0x64,0x65,0x66,0x6c,0x61,0x74,0x65,0x0d,0x0a,
+/* "ETag: "8cd5a394f7ecc99c"
+" (26 bytes) */
+0x45,0x54,0x61,0x67,0x3a,0x20,0x22,0x38,0x63,0x64,0x35,0x61,0x33,0x39,0x34,0x66,
+0x37,0x65,0x63,0x63,0x39,0x39,0x63,0x22,0x0d,0x0a,
+/* "Cache-Control: no-cache
+" (25 bytes) */
+0x43,0x61,0x63,0x68,0x65,0x2d,0x43,0x6f,0x6e,0x74,0x72,0x6f,0x6c,0x3a,0x20,0x6e,
+0x6f,0x2d,0x63,0x61,0x63,0x68,0x65,0x0d,0x0a,
+/* "Vary: Accept-Encoding
+" (23 bytes) */
+0x56,0x61,0x72,0x79,0x3a,0x20,0x41,0x63,0x63,0x65,0x70,0x74,0x2d,0x45,0x6e,0x63,
+0x6f,0x64,0x69,0x6e,0x67,0x0d,0x0a,
 /* "Content-Type: image/png
 
 " (27 bytes) */
@@ -11544,13 +11535,21 @@ static const unsigned char FSDATA_ALIGN_PRE data__manifest_json[] FSDATA_ALIGN_P
 0x2f,0x6d,0x61,0x6e,0x69,0x66,0x65,0x73,0x74,0x2e,0x6a,0x73,0x6f,0x6e,0x00,0x00,
 
 /* HTTP header */
-/* "HTTP/1.0 200 OK
+/* "HTTP/1.1 200 OK
 " (17 bytes) */
-0x48,0x54,0x54,0x50,0x2f,0x31,0x2e,0x30,0x20,0x32,0x30,0x30,0x20,0x4f,0x4b,0x0d,
+0x48,0x54,0x54,0x50,0x2f,0x31,0x2e,0x31,0x20,0x32,0x30,0x30,0x20,0x4f,0x4b,0x0d,
 0x0a,
 /* "Server: picow
 " (15 bytes) */
 0x53,0x65,0x72,0x76,0x65,0x72,0x3a,0x20,0x70,0x69,0x63,0x6f,0x77,0x0d,0x0a,
+/* "ETag: "4e0afe7f81a71f41"
+" (26 bytes) */
+0x45,0x54,0x61,0x67,0x3a,0x20,0x22,0x34,0x65,0x30,0x61,0x66,0x65,0x37,0x66,0x38,
+0x31,0x61,0x37,0x31,0x66,0x34,0x31,0x22,0x0d,0x0a,
+/* "Cache-Control: no-cache
+" (25 bytes) */
+0x43,0x61,0x63,0x68,0x65,0x2d,0x43,0x6f,0x6e,0x74,0x72,0x6f,0x6c,0x3a,0x20,0x6e,
+0x6f,0x2d,0x63,0x61,0x63,0x68,0x65,0x0d,0x0a,
 /* "Content-Type: application/json
 
 " (34 bytes) */
@@ -11592,48 +11591,95 @@ static const unsigned char FSDATA_ALIGN_PRE data__manifest_json[] FSDATA_ALIGN_P
 
 
 
-const struct fsdata_file file__api_blinds_add_json[] = { {
-file_NULL,
-data__api_blinds_add_json,
-data__api_blinds_add_json + 24,
-sizeof(data__api_blinds_add_json) - 24,
-FS_FILE_FLAGS_HEADER_INCLUDED | FS_FILE_FLAGS_SSI,
-}};
+#if FSDATA_FILE_ALIGNMENT==1
+static const unsigned int dummy_align__api_snapshot_export_json = 29;
+#endif
+static const unsigned char FSDATA_ALIGN_PRE data__api_snapshot_export_json[] FSDATA_ALIGN_POST = {
+/* /api/snapshot/export.json (26 chars) */
+0x2f,0x61,0x70,0x69,0x2f,0x73,0x6e,0x61,0x70,0x73,0x68,0x6f,0x74,0x2f,0x65,0x78,
+0x70,0x6f,0x72,0x74,0x2e,0x6a,0x73,0x6f,0x6e,0x00,0x00,0x00,
 
-const struct fsdata_file file__api_blinds_command_json[] = { {
-file__api_blinds_add_json,
-data__api_blinds_command_json,
-data__api_blinds_command_json + 28,
-sizeof(data__api_blinds_command_json) - 28,
-FS_FILE_FLAGS_HEADER_INCLUDED | FS_FILE_FLAGS_SSI,
-}};
+/* HTTP header */
+/* "HTTP/1.1 200 OK
+" (17 bytes) */
+0x48,0x54,0x54,0x50,0x2f,0x31,0x2e,0x31,0x20,0x32,0x30,0x30,0x20,0x4f,0x4b,0x0d,
+0x0a,
+/* "Server: picow
+" (15 bytes) */
+0x53,0x65,0x72,0x76,0x65,0x72,0x3a,0x20,0x70,0x69,0x63,0x6f,0x77,0x0d,0x0a,
+/* "Content-Type: application/json
+
+" (34 bytes) */
+0x43,0x6f,0x6e,0x74,0x65,0x6e,0x74,0x2d,0x54,0x79,0x70,0x65,0x3a,0x20,0x61,0x70,
+0x70,0x6c,0x69,0x63,0x61,0x74,0x69,0x6f,0x6e,0x2f,0x6a,0x73,0x6f,0x6e,0x0d,0x0a,
+0x0d,0x0a,
+/* raw file data (18 bytes) */
+0x7b,0x3c,0x21,0x2d,0x2d,0x23,0x73,0x6e,0x61,0x70,0x73,0x68,0x6f,0x74,0x2d,0x2d,
+0x3e,0x7d,};
+
+
+#if FSDATA_FILE_ALIGNMENT==1
+static const unsigned int dummy_align__api_snapshot_import_json = 30;
+#endif
+static const unsigned char FSDATA_ALIGN_PRE data__api_snapshot_import_json[] FSDATA_ALIGN_POST = {
+/* /api/snapshot/import.json (26 chars) */
+0x2f,0x61,0x70,0x69,0x2f,0x73,0x6e,0x61,0x70,0x73,0x68,0x6f,0x74,0x2f,0x69,0x6d,
+0x70,0x6f,0x72,0x74,0x2e,0x6a,0x73,0x6f,0x6e,0x00,0x00,0x00,
+
+/* HTTP header */
+/* "HTTP/1.1 200 OK
+" (17 bytes) */
+0x48,0x54,0x54,0x50,0x2f,0x31,0x2e,0x31,0x20,0x32,0x30,0x30,0x20,0x4f,0x4b,0x0d,
+0x0a,
+/* "Server: picow
+" (15 bytes) */
+0x53,0x65,0x72,0x76,0x65,0x72,0x3a,0x20,0x70,0x69,0x63,0x6f,0x77,0x0d,0x0a,
+/* "Content-Type: application/json
+
+" (34 bytes) */
+0x43,0x6f,0x6e,0x74,0x65,0x6e,0x74,0x2d,0x54,0x79,0x70,0x65,0x3a,0x20,0x61,0x70,
+0x70,0x6c,0x69,0x63,0x61,0x74,0x69,0x6f,0x6e,0x2f,0x6a,0x73,0x6f,0x6e,0x0d,0x0a,
+0x0d,0x0a,
+/* raw file data (14 bytes) */
+0x3c,0x21,0x2d,0x2d,0x23,0x72,0x65,0x73,0x75,0x6c,0x74,0x2d,0x2d,0x3e,};
+
+
+#if FSDATA_FILE_ALIGNMENT==1
+static const unsigned int dummy_align__api_mqtt_rediscover_json = 31;
+#endif
+static const unsigned char FSDATA_ALIGN_PRE data__api_mqtt_rediscover_json[] FSDATA_ALIGN_POST = {
+/* /api/mqtt/rediscover.json (26 chars) */
+0x2f,0x61,0x70,0x69,0x2f,0x6d,0x71,0x74,0x74,0x2f,0x72,0x65,0x64,0x69,0x73,0x63,
+0x6f,0x76,0x65,0x72,0x2e,0x6a,0x73,0x6f,0x6e,0x00,0x00,0x00,
+
+/* HTTP header */
+/* "HTTP/1.1 200 OK
+" (17 bytes) */
+0x48,0x54,0x54,0x50,0x2f,0x31,0x2e,0x31,0x20,0x32,0x30,0x30,0x20,0x4f,0x4b,0x0d,
+0x0a,
+/* "Server: picow
+" (15 bytes) */
+0x53,0x65,0x72,0x76,0x65,0x72,0x3a,0x20,0x70,0x69,0x63,0x6f,0x77,0x0d,0x0a,
+/* "Content-Type: application/json
+
+" (34 bytes) */
+0x43,0x6f,0x6e,0x74,0x65,0x6e,0x74,0x2d,0x54,0x79,0x70,0x65,0x3a,0x20,0x61,0x70,
+0x70,0x6c,0x69,0x63,0x61,0x74,0x69,0x6f,0x6e,0x2f,0x6a,0x73,0x6f,0x6e,0x0d,0x0a,
+0x0d,0x0a,
+/* raw file data (14 bytes) */
+0x3c,0x21,0x2d,0x2d,0x23,0x72,0x65,0x73,0x75,0x6c,0x74,0x2d,0x2d,0x3e,};
 
-const struct fsdata_file file__api_blinds_delete_json[] = { {
-file__api_blinds_command_json,
-data__api_blinds_delete_json,
-data__api_blinds_delete_json + 24,
-sizeof(data__api_blinds_delete_json) - 24,
-FS_FILE_FLAGS_HEADER_INCLUDED | FS_FILE_FLAGS_SSI,
-}};
 
 const struct fsdata_file file__api_blinds_list_json[] = { {
-file__api_blinds_delete_json,
+file_NULL,
 data__api_blinds_list_json,
 data__api_blinds_list_json + 24,
 sizeof(data__api_blinds_list_json) - 24,
 FS_FILE_FLAGS_HEADER_INCLUDED | FS_FILE_FLAGS_SSI,
 }};
 
-const struct fsdata_file file__api_blinds_update_json[] = { {
-file__api_blinds_list_json,
-data__api_blinds_update_json,
-data__api_blinds_update_json + 24,
-sizeof(data__api_blinds_update_json) - 24,
-FS_FILE_FLAGS_HEADER_INCLUDED | FS_FILE_FLAGS_SSI,
-}};
-
 const struct fsdata_file file__api_remotes_add_json[] = { {
-file__api_blinds_update_json,
+file__api_blinds_list_json,
 data__api_remotes_add_json,
 data__api_remotes_add_json + 24,
 sizeof(data__api_remotes_add_json) - 24,
@@ -11648,16 +11694,8 @@ sizeof(data__api_remotes_bindBlind_json) - 28,
 FS_FILE_FLAGS_HEADER_INCLUDED | FS_FILE_FLAGS_SSI,
 }};
 
-const struct fsdata_file file__api_remotes_command_json[] = { {
-file__api_remotes_bindBlind_json,
-data__api_remotes_command_json,
-data__api_remotes_command_json + 28,
-sizeof(data__api_remotes_command_json) - 28,
-FS_FILE_FLAGS_HEADER_INCLUDED | FS_FILE_FLAGS_SSI,
-}};
-
 const struct fsdata_file file__api_remotes_delete_json[] = { {
-file__api_remotes_command_json,
+file__api_remotes_bindBlind_json,
 data__api_remotes_delete_json,
 data__api_remotes_delete_json + 28,
 sizeof(data__api_remotes_delete_json) - 28,
@@ -11824,6 +11862,30 @@ sizeof(data__manifest_json) - 16,
 FS_FILE_FLAGS_HEADER_INCLUDED | FS_FILE_FLAGS_SSI,
 }};
 
-#define FS_ROOT file__manifest_json
-#define FS_NUMFILES 29
+const struct fsdata_file file__api_snapshot_export_json[] = { {
+file__manifest_json,
+data__api_snapshot_export_json,
+data__api_snapshot_export_json + 28,
+sizeof(data__api_snapshot_export_json) - 28,
+FS_FILE_FLAGS_HEADER_INCLUDED | FS_FILE_FLAGS_SSI,
+}};
+
+const struct fsdata_file file__api_snapshot_import_json[] = { {
+file__api_snapshot_export_json,
+data__api_snapshot_import_json,
+data__api_snapshot_import_json + 28,
+sizeof(data__api_snapshot_import_json) - 28,
+FS_FILE_FLAGS_HEADER_INCLUDED | FS_FILE_FLAGS_SSI,
+}};
+
+const struct fsdata_file file__api_mqtt_rediscover_json[] = { {
+file__api_snapshot_import_json,
+data__api_mqtt_rediscover_json,
+data__api_mqtt_rediscover_json + 28,
+sizeof(data__api_mqtt_rediscover_json) - 28,
+FS_FILE_FLAGS_HEADER_INCLUDED | FS_FILE_FLAGS_SSI,
+}};
+
+#define FS_ROOT file__api_mqtt_rediscover_json
+#define FS_NUMFILES 27
 
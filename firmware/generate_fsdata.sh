@@ -21,5 +21,7 @@ rename -f -v 's/.template$//' ./fs/api/*.template
 rename -f -v 's/.template$//' ./fs/api/**/*.template
 
 echo Regenerating fsdata.c
-./makefsdata -defl:9 -svr:picow
+./makefsdata -defl:9 -svr:picow -11
+echo Adding cache headers
+python3 cache_headers.py fsdata.c
 echo Done
\ No newline at end of file
@@ -0,0 +1,71 @@
+// Copyright (c) 2023 Mark Godwin.
+// SPDX-License-Identifier: MIT
+
+#include "picoSomfy.h"
+#include <malloc.h>
+#include <reent.h>
+#include <new>
+
+#include "heapStats.h"
+
+// Allocations counted by each core. A core only adds to its own, as the M0+ has no atomic increment.
+static volatile uint32_t _allocationCount[2];
+
+// new, malloc, calloc and realloc all allocate with _malloc_r, which the link wraps to count them
+extern "C" void *__real__malloc_r(struct _reent *reent, size_t size);
+
+extern "C" void *__wrap__malloc_r(struct _reent *reent, size_t size)
+{
+    _allocationCount[get_core_num()]++;
+    return __real__malloc_r(reent, size);
+}
+
+// Replace the global new operators, to panic when out of memory.
+// Everything still ends up in malloc.
+static void *CheckedAlloc(size_t size)
+{
+    auto p = malloc(size);
+    if(p == nullptr)
+        panic("Out of memory allocating %d bytes", size);
+    return p;
+}
+
+void *operator new(size_t size)
+{
+    return CheckedAlloc(size);
+}
+
+void *operator new[](size_t size)
+{
+    return CheckedAlloc(size);
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void *p, size_t) noexcept
+{
+    free(p);
+}
+
+uint32_t GetHeapAllocationCount()
+{
+    return _allocationCount[0] + _allocationCount[1];
+}
+
+uint32_t GetHeapBytesInUse()
+{
+    return mallinfo().uordblks;
+}
@@ -0,0 +1,10 @@
+// Copyright (c) 2023 Mark Godwin.
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+/// @brief Number of heap allocations made with new, malloc, calloc or realloc, by either core, since startup
+uint32_t GetHeapAllocationCount();
+
+/// @brief Bytes of heap currently allocated
+uint32_t GetHeapBytesInUse();
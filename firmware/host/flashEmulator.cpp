@@ -0,0 +1,111 @@
+// Copyright (c) 2023 Mark Godwin.
+// SPDX-License-Identifier: MIT
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#include "pico/flash.h"
+#include "flashEmulator.h"
+
+// Typical times for a W25Q16JV
+#define PAGE_PROGRAM_US 400
+#define SECTOR_ERASE_US 45000
+
+uint8_t hostFlashMemory[PICO_FLASH_SIZE_BYTES];
+
+static uint64_t now;
+static uint32_t operations;
+static uint32_t powerCutAt = UINT32_MAX;
+static std::vector<uint32_t> eraseCounts(PICO_FLASH_SIZE_BYTES / FLASH_SECTOR_SIZE);
+
+absolute_time_t get_absolute_time()
+{
+    return now;
+}
+
+/// @brief Counts an operation, and reports whether the power goes before it finishes
+static bool StartOperation()
+{
+    return ++operations > powerCutAt;
+}
+
+void flash_range_erase(uint32_t flash_offs, size_t count)
+{
+    if(flash_offs % FLASH_SECTOR_SIZE || count % FLASH_SECTOR_SIZE || flash_offs + count > PICO_FLASH_SIZE_BYTES)
+    {
+        fprintf(stderr, "Bad erase of %zu bytes at 0x%08x\n", count, flash_offs);
+        abort();
+    }
+
+    for(auto offset = flash_offs; offset < flash_offs + count; offset += FLASH_SECTOR_SIZE)
+    {
+        if(StartOperation())
+            throw PowerCut();
+        memset(hostFlashMemory + offset, 0xFF, FLASH_SECTOR_SIZE);
+        eraseCounts[offset / FLASH_SECTOR_SIZE]++;
+        now += SECTOR_ERASE_US;
+    }
+}
+
+void flash_range_program(uint32_t flash_offs, const uint8_t *data, size_t count)
+{
+    if(flash_offs % FLASH_PAGE_SIZE || count % FLASH_PAGE_SIZE || flash_offs + count > PICO_FLASH_SIZE_BYTES)
+    {
+        fprintf(stderr, "Bad program of %zu bytes at 0x%08x\n", count, flash_offs);
+        abort();
+    }
+
+    for(size_t page = 0; page < count; page += FLASH_PAGE_SIZE)
+    {
+        // Programming can only clear bits
+        auto torn = StartOperation();
+        auto bytes = torn ? FLASH_PAGE_SIZE / 2 : FLASH_PAGE_SIZE;
+        for(size_t a = 0; a < bytes; a++)
+            hostFlashMemory[flash_offs + page + a] &= data[page + a];
+        now += PAGE_PROGRAM_US;
+        if(torn)
+            throw PowerCut();
+    }
+}
+
+int flash_safe_execute(void (*func)(void *), void *param, uint32_t)
+{
+    func(param);
+    return PICO_OK;
+}
+
+void FlashEmulator::Reset()
+{
+    memset(hostFlashMemory, 0xFF, sizeof(hostFlashMemory));
+    std::fill(eraseCounts.begin(), eraseCounts.end(), 0);
+    now = 0;
+    operations = 0;
+    powerCutAt = UINT32_MAX;
+}
+
+void FlashEmulator::AdvanceTime(uint64_t us)
+{
+    now += us;
+}
+
+void FlashEmulator::CutPowerAfter(uint32_t count)
+{
+    powerCutAt = operations + count;
+}
+
+void FlashEmulator::CancelPowerCut()
+{
+    powerCutAt = UINT32_MAX;
+}
+
+uint32_t FlashEmulator::GetOperationCount()
+{
+    return operations;
+}
+
+uint32_t FlashEmulator::GetEraseCount(uint32_t sector)
+{
+    return eraseCounts[sector];
+}
@@ -0,0 +1,38 @@
+// Copyright (c) 2023 Mark Godwin.
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+/// @brief Thrown out of a flash operation when the emulated power is cut
+struct PowerCut
+{
+};
+
+/// @brief Emulated NOR flash behind the SDK flash API, for running the storage code on a PC
+/// @remarks Erasing sets a whole sector to 0xFF and programming can only clear bits, as on the real chip.
+/// Operations take the typical times from the W25Q16JV datasheet, on an emulated clock.
+namespace FlashEmulator
+{
+    /// @brief Erase the whole flash and zero the counters and clock
+    void Reset();
+
+    /// @brief Moves the emulated clock on, e.g. to the next event of a workload
+    void AdvanceTime(uint64_t us);
+
+    /// @brief Cut the power partway through a later operation
+    /// @param operations Number of erases and page programs to let through first. The next one is torn: a program
+    /// only writes some of its bytes, and an erase doesn't happen at all. It then throws PowerCut.
+    void CutPowerAfter(uint32_t operations);
+
+    /// @brief Stop any power cut that hasn't happened yet
+    void CancelPowerCut();
+
+    /// @brief Erase and page program operations since the last Reset
+    uint32_t GetOperationCount();
+
+    /// @brief Times a sector has been erased since the last Reset
+    uint32_t GetEraseCount(uint32_t sector);
+}
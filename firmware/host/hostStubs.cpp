@@ -0,0 +1,79 @@
+// Copyright (c) 2023 Mark Godwin.
+// SPDX-License-Identifier: MIT
+
+// Stand-ins for the parts of the firmware the host builds use, which need the radio or the SDK's timers
+
+#include "pico/flash.h"
+#include "flashScheduler.h"
+#include "hostStubs.h"
+#include <map>
+#include <vector>
+
+static std::function<bool()> idleWork;
+
+// Timers can be made by other static objects, before this file's statics are
+static std::map<ScheduledTimer *, std::function<uint32_t()> *> &Timers()
+{
+    static std::map<ScheduledTimer *, std::function<uint32_t()> *> timers;
+    return timers;
+}
+
+ScheduledTimer::ScheduledTimer(std::function<uint32_t()> &&callback, uint32_t)
+:   _callback(std::move(callback))
+{
+    Timers()[this] = &_callback;
+}
+
+ScheduledTimer::~ScheduledTimer()
+{
+    Timers().erase(this);
+}
+
+void ScheduledTimer::ResetTimer(uint32_t)
+{
+}
+
+// There is no radio to wait for, so flash operations run straight away
+FlashScheduler::FlashScheduler(std::shared_ptr<RadioCommandQueue> commandQueue)
+:   _commandQueue(std::move(commandQueue)),
+    _idleTimer([]() { return 0; }, 0),
+    _deferredCount(0),
+    _stallCount(0),
+    _longestStall(0)
+{
+}
+
+int FlashScheduler::Program(void (*func)(void *), void *param)
+{
+    return flash_safe_execute(func, param, 1000);
+}
+
+int FlashScheduler::Erase(void (*func)(void *), void *param)
+{
+    return flash_safe_execute(func, param, 1000);
+}
+
+void FlashScheduler::SetIdleWork(std::function<bool()> &&work)
+{
+    idleWork = work;
+    _idleWork = std::move(work);
+}
+
+bool RunFlashIdleWork()
+{
+    return idleWork && idleWork();
+}
+
+void RunTimers()
+{
+    // A callback can delete timers, its own included
+    std::vector<ScheduledTimer *> due;
+    for(auto &timer : Timers())
+        due.push_back(timer.first);
+    for(auto timer : due)
+    {
+        auto callback = Timers().find(timer);
+        if(callback != Timers().end())
+            (*callback->second)();
+    }
+}
@@ -0,0 +1,11 @@
+// Copyright (c) 2023 Mark Godwin.
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+/// @brief Does a step of the background work, as FlashScheduler does whenever the radio is idle
+/// @return True if there is more to do
+bool RunFlashIdleWork();
+
+/// @brief Runs every timer's callback, as if they had all come due. Timers never fire by themselves on the host.
+void RunTimers();
@@ -0,0 +1,22 @@
+// Copyright (c) 2023 Mark Godwin.
+// SPDX-License-Identifier: MIT
+
+// Just enough of lwIP to build the MQTT client on a PC, against the stand-in brokers in mqttFailoverTest.cpp
+
+#pragma once
+
+#include <stdint.h>
+
+typedef uint8_t u8_t;
+typedef uint16_t u16_t;
+typedef uint32_t u32_t;
+typedef int8_t err_t;
+
+#define ERR_OK 0
+#define ERR_MEM -1
+#define ERR_TIMEOUT -3
+#define ERR_INPROGRESS -5
+#define ERR_VAL -6
+#define ERR_ISCONN -10
+#define ERR_CONN -11
+#define ERR_ARG -16
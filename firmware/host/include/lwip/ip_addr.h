@@ -0,0 +1,15 @@
+// Copyright (c) 2023 Mark Godwin.
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include "lwip/err.h"
+
+typedef struct ip_addr
+{
+    u32_t addr;
+} ip_addr_t;
+
+#define ip_addr_set_zero(ipaddr) ((ipaddr)->addr = 0)
+
+char *ipaddr_ntoa(const ip_addr_t *addr);
@@ -0,0 +1,15 @@
+// Copyright (c) 2023 Mark Godwin.
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+// Timers never fire on the host. Background work is run by calling it directly, and timers with RunTimers.
+typedef struct async_context async_context_t;
+typedef struct async_at_time_worker
+{
+    void *user_data;
+} async_at_time_worker_t;
+typedef struct async_when_pending_worker
+{
+    void *user_data;
+} async_when_pending_worker_t;
@@ -0,0 +1,7 @@
+// Copyright (c) 2023 Mark Godwin.
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+// The MQTT client only needs lwIP from here, which has stand-ins of its own
+#include "lwip/ip_addr.h"
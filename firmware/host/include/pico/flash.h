@@ -0,0 +1,10 @@
+// Copyright (c) 2023 Mark Godwin.
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include "pico/stdlib.h"
+
+void flash_range_erase(uint32_t flash_offs, size_t count);
+void flash_range_program(uint32_t flash_offs, const uint8_t *data, size_t count);
+int flash_safe_execute(void (*func)(void *), void *param, uint32_t enter_exit_timeout_ms);
@@ -0,0 +1,12 @@
+// Copyright (c) 2023 Mark Godwin.
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+
+static inline uint32_t get_rand_32()
+{
+    return (uint32_t)rand();
+}
@@ -0,0 +1,36 @@
+// Copyright (c) 2023 Mark Godwin.
+// SPDX-License-Identifier: MIT
+
+// Just enough of the Pico SDK to build the storage code on a PC, against the emulated flash in flashEmulator.cpp
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#define PICO_OK 0
+#define PICO_ERROR_TIMEOUT -1
+
+#define FLASH_PAGE_SIZE (1u << 8)
+#define FLASH_SECTOR_SIZE (1u << 12)
+#define PICO_FLASH_SIZE_BYTES (2 * 1024 * 1024)
+
+// Flash is read through memory, as it is through the XIP window on the device
+extern uint8_t hostFlashMemory[PICO_FLASH_SIZE_BYTES];
+#define XIP_BASE ((uintptr_t)hostFlashMemory)
+
+typedef uint64_t absolute_time_t;
+
+/// @brief Emulated time, in microseconds. Flash operations take as long as they would on the device.
+absolute_time_t get_absolute_time();
+
+static inline int64_t absolute_time_diff_us(absolute_time_t from, absolute_time_t to)
+{
+    return (int64_t)(to - from);
+}
+
+static inline uint32_t to_ms_since_boot(absolute_time_t t)
+{
+    return (uint32_t)(t / 1000);
+}
@@ -0,0 +1,150 @@
+// Copyright (c) 2023 Mark Godwin.
+// SPDX-License-Identifier: MIT
+
+// Checks the web server's Inflater against zlib. Text, random bytes and a mix of the two are compressed with each
+// compression level, window size and strategy, so there are stored, fixed and dynamic blocks, then read back in
+// buffers of different sizes. Then damaged data is thrown at it, which it must reject without reading or writing
+// out of bounds.
+//   inflater_test [damaged]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <random>
+#include <string>
+#include <vector>
+#include <zlib.h>
+#include "inflater.h"
+
+static std::mt19937 rng(1984);
+
+static std::vector<uint8_t> Compress(const std::string &text, int level, int windowBits, int strategy)
+{
+    z_stream stream = {};
+    deflateInit2(&stream, level, Z_DEFLATED, windowBits, 9, strategy);
+    // zlib's bound is a little short for the smallest windows
+    std::vector<uint8_t> out(deflateBound(&stream, text.size()) + 64);
+    stream.next_in = (Bytef *)text.data();
+    stream.avail_in = text.size();
+    stream.next_out = out.data();
+    stream.avail_out = out.size();
+    deflate(&stream, Z_FINISH);
+    out.resize(stream.total_out);
+    deflateEnd(&stream);
+    return out;
+}
+
+/// @return The data read in buffers of the given size, and whether it all read without error
+static bool Inflate(const std::vector<uint8_t> &data, int bufferSize, std::string &out)
+{
+    auto windowSize = Inflater::WindowSize(data.data(), data.size());
+    if(!windowSize)
+        return false;
+    std::vector<uint8_t> window(windowSize);
+    std::vector<uint8_t> buffer(bufferSize);
+    Inflater inflater(data.data(), data.size(), window.data(), window.size());
+    out.clear();
+    for(;;)
+    {
+        auto read = inflater.Read(buffer.data(), bufferSize);
+        if(read <= 0)
+            return read == 0;
+        out.append((const char *)buffer.data(), read);
+    }
+}
+
+static std::string Sample(uint32_t length, uint32_t kind)
+{
+    static const char *words[] = { "blind ", "remote ", "position ", "\"open\", ", "close\n", "{\"id\": 1}, " };
+    std::string text;
+    while(text.size() < length)
+    {
+        if(kind == 0 || (kind == 2 && rng() % 2))
+            text += words[rng() % 6];
+        else
+            text += (char)rng();
+    }
+    text.resize(length);
+    return text;
+}
+
+static bool TestRoundTrips()
+{
+    static const int strategies[] = { Z_DEFAULT_STRATEGY, Z_FIXED, Z_HUFFMAN_ONLY, Z_RLE };
+    static const int bufferSizes[] = { 1, 7, 512 };
+    auto tried = 0;
+    for(uint32_t kind = 0; kind < 3; kind++)
+    {
+        for(auto length : { 0u, 1u, 300u, 70000u })
+        {
+            auto text = Sample(length, kind);
+            for(auto level = 0; level <= 9; level += 3)
+            {
+                for(auto windowBits = 9; windowBits <= 15; windowBits += 3)
+                {
+                    for(auto strategy : strategies)
+                    {
+                        auto data = Compress(text, level, windowBits, strategy);
+                        for(auto bufferSize : bufferSizes)
+                        {
+                            std::string out;
+                            tried++;
+                            if(!Inflate(data, bufferSize, out) || out != text)
+                            {
+                                printf("Kind %d, %d bytes, level %d, window bits %d, strategy %d, buffer %d didn't "
+                                    "match\n", kind, length, level, windowBits, strategy, bufferSize);
+                                return false;
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+    printf("Read back %d compressed samples\n", tried);
+    return true;
+}
+
+/// @brief Flips bits, cuts the end off, or fills in random bytes after the header
+static bool TestDamaged(uint32_t iterations)
+{
+    auto text = Sample(5000, 2);
+    auto good = Compress(text, 9, 15, Z_DEFAULT_STRATEGY);
+    auto rejected = 0;
+    for(uint32_t a = 0; a < iterations; a++)
+    {
+        auto data = good;
+        switch(a % 3)
+        {
+            case 0:
+                data[2 + rng() % (data.size() - 2)] ^= 1 << (rng() % 8);
+                break;
+            case 1:
+                data.resize(2 + rng() % (data.size() - 2));
+                break;
+            case 2:
+                for(size_t b = 2; b < data.size(); b++)
+                    data[b] = rng();
+                break;
+        }
+        std::string out;
+        if(!Inflate(data, 512, out))
+            rejected++;
+    }
+    // A flipped bit can still give well formed data, but then the Adler-32 catches it
+    if(rejected != (int)iterations)
+    {
+        printf("Only %d of %d damaged samples were rejected\n", rejected, iterations);
+        return false;
+    }
+    printf("Rejected %d damaged samples\n", rejected);
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    auto damaged = argc > 1 ? atoi(argv[1]) : 3000;
+    auto ok = TestRoundTrips() &&
+        TestDamaged(damaged);
+    puts(ok ? "PASS" : "FAIL");
+    return ok ? 0 : 1;
+}
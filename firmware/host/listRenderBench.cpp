@@ -0,0 +1,144 @@
+// Copyright (c) 2023 Mark Godwin.
+// SPDX-License-Identifier: MIT
+
+// Times rendering the blind list for list.json over SSI tag parts, as httpd asks for them, with the items
+// Blinds::GetBlindsResponse writes. It is rendered three ways:
+//   cursor       one client, with ListCursor carrying on from where the last part finished
+//   rewalk       one client, walking the list from the start for every part, as before ListCursor
+//   two clients  two clients at once, taking turns. They share the cursor, so at least every other part walks from
+//                the start.
+// Each is checked against the list written in one go.
+//   list_render_bench [blinds] [renders]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <map>
+#include <string>
+#include "listCursor.h"
+
+// lwIP's default LWIP_HTTPD_MAX_TAG_INSERT_LEN, which lwipopts.h doesn't change
+#define TAG_INSERT_LEN 192
+#define LAST_TAG_PART 0xFFFF
+
+typedef std::chrono::steady_clock Clock;
+
+struct Item
+{
+    std::string name;
+    std::string group;
+    int position;
+    int openTime;
+    int closeTime;
+    uint32_t remoteId;
+};
+
+typedef std::map<uint32_t, Item> Items;
+
+static void WriteItem(JsonWriter &writer, Items::iterator pos)
+{
+    writer.BeginObject();
+    writer.Key("id");
+    writer.UInt(pos->first);
+    writer.Key("name");
+    writer.String(pos->second.name);
+    writer.Key("group");
+    writer.String(pos->second.group);
+    writer.Key("position");
+    writer.Int(pos->second.position);
+    writer.Key("openTime");
+    writer.Int(pos->second.openTime);
+    writer.Key("closeTime");
+    writer.Int(pos->second.closeTime);
+    writer.Key("remoteId");
+    writer.UInt(pos->second.remoteId);
+    writer.Key("state");
+    writer.String("stopped");
+    writer.EndObject();
+}
+
+/// @brief A client's response, built up a part at a time
+struct Response
+{
+    std::string text;
+    uint16_t part = 0;
+    uint32_t parts = 0;
+    bool done = false;
+};
+
+/// @brief Asks for the client's next part, as httpd does
+static void NextPart(ListCursor<Items> &cursor, Response &response, bool rewalk)
+{
+    char buffer[TAG_INSERT_LEN];
+    uint16_t nextPart = LAST_TAG_PART;
+    if(rewalk)
+        cursor.Reset();
+    auto length = cursor.Write(buffer, sizeof(buffer), response.part, &nextPart, WriteItem);
+    response.text.append(buffer, length);
+    response.parts++;
+    response.done = nextPart == LAST_TAG_PART;
+    response.part = nextPart;
+}
+
+/// @return Microseconds to render the list for each client
+static double Render(ListCursor<Items> &cursor, const std::string &expected, int clients, bool rewalk, uint32_t *parts)
+{
+    Response responses[2];
+    auto start = Clock::now();
+    for(auto finished = 0; finished < clients;)
+    {
+        finished = 0;
+        for(auto a = 0; a < clients; a++)
+        {
+            if(!responses[a].done)
+                NextPart(cursor, responses[a], rewalk);
+            finished += responses[a].done;
+        }
+    }
+    auto us = std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+
+    for(auto a = 0; a < clients; a++)
+    {
+        if(responses[a].text != expected)
+        {
+            puts("FAIL: A render doesn't match the list written in one go");
+            exit(1);
+        }
+    }
+    *parts = responses[0].parts;
+    return us / clients;
+}
+
+int main(int argc, char **argv)
+{
+    auto blinds = argc > 1 ? atoi(argv[1]) : 256;
+    auto renders = argc > 2 ? atoi(argv[2]) : 200;
+
+    Items items;
+    for(auto a = 1; a <= blinds; a++)
+        items[a] = { "Blind " + std::to_string(a), a % 3 ? "Living room" : "", a * 37 % 101, 20000, 19500, 0x100000u + a };
+
+    // The whole list in one go, to check the renders against
+    std::string expected(blinds * 256, 0);
+    JsonWriter writer(&expected[0], expected.size());
+    for(auto pos = items.begin(); pos != items.end(); pos++)
+        WriteItem(writer, pos);
+    expected.resize(writer.BytesWritten());
+
+    ListCursor<Items> cursor(items);
+    static const struct { const char *name; int clients; bool rewalk; } modes[] = {
+        { "cursor", 1, false },
+        { "rewalk", 1, true },
+        { "two clients", 2, false },
+    };
+    printf("%d blinds, %d bytes in %d byte parts\n", blinds, (int)expected.size(), TAG_INSERT_LEN);
+    for(auto &mode : modes)
+    {
+        double total = 0;
+        uint32_t parts = 0;
+        for(auto a = 0; a < renders; a++)
+            total += Render(cursor, expected, mode.clients, mode.rewalk, &parts);
+        printf("%-12s %9.1f us a response, %d parts\n", mode.name, total / renders, parts);
+    }
+    return 0;
+}
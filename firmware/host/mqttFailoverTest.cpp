@@ -0,0 +1,103 @@
+// Copyright (c) 2023 Mark Godwin.
+// SPDX-License-Identifier: MIT
+
+// Runs the MQTT client's broker failover against two stand-in brokers. It should only give up on a broker after
+// MQTT_FAILOVER_ATTEMPTS failed attempts, not count an attempt that is still in progress or the loss of a session
+// that was up, and come back to the main broker once the failover broker fails in turn.
+
+#include <stdio.h>
+#include <string.h>
+#include <memory>
+#include <string>
+#include "pico/stdlib.h"
+#include "deviceConfig.h"
+#include "flashScheduler.h"
+#include "flashEmulator.h"
+#include "hostStubs.h"
+#include "mqttClient.h"
+#include "mqttStandIn.h"
+#include "statusLed.h"
+
+#define STORAGE_SIZE (32 * FLASH_SECTOR_SIZE)
+#define LEGACY_BLOCK_SIZE 252
+
+static StandInBroker brokers[] = { { "10.0.0.1", true, 0 }, { "10.0.0.2", true, 0 } };
+
+static bool Expect(bool ok, const char *what)
+{
+    if(!ok)
+        printf("Expected %s\n", what);
+    return ok;
+}
+
+/// @brief Fails attempts to connect to the current broker, checking it only moves on after the last one
+/// @param from Broker to fail, which should be tried MQTT_FAILOVER_ATTEMPTS times
+static bool FailBroker(MqttClient &mqtt, uint32_t from)
+{
+    auto attempts = brokers[from].attempts;
+    for(auto a = 0; a < MQTT_FAILOVER_ATTEMPTS; a++)
+    {
+        if(!Expect(mqtt.GetBrokerIndex() == from, "to stay on the broker until its attempts are used up"))
+            return false;
+        RunTimers();
+        // The watchdog comes round again before the broker answers. That attempt is still going, so isn't counted.
+        RunTimers();
+        MqttStandIn::Answer();
+    }
+    return Expect(brokers[from].attempts - attempts == MQTT_FAILOVER_ATTEMPTS, "an attempt per watchdog run") &&
+        Expect(mqtt.GetBrokerIndex() != from, "to move on to another broker");
+}
+
+/// @brief Connects to the current broker, which should be the one given, for the first time in a while
+static bool ConnectBroker(MqttClient &mqtt, uint32_t to)
+{
+    RunTimers();
+    MqttStandIn::Answer();
+    return Expect(mqtt.IsConnected(), "to connect") &&
+        Expect(mqtt.GetBrokerIndex() == to, "to connect to the next broker") &&
+        Expect(mqtt.TakeBrokerChanged(), "to see the broker has changed") &&
+        Expect(!mqtt.TakeBrokerChanged(), "to see the change only once");
+}
+
+static bool TestFailover()
+{
+    FlashEmulator::Reset();
+    MqttStandIn::SetBrokers(brokers, 2);
+    auto config = std::make_shared<DeviceConfig>(std::make_shared<FlashScheduler>(nullptr), STORAGE_SIZE,
+        LEGACY_BLOCK_SIZE);
+    MqttConfig mqttConfig;
+    memset(&mqttConfig, 0, sizeof(mqttConfig));
+    strcpy(mqttConfig.brokerAddress, brokers[0].address);
+    mqttConfig.port = 1883;
+    strcpy(mqttConfig.failoverAddress[0], brokers[1].address);
+    config->SaveMqttConfig(&mqttConfig);
+
+    StatusLed led(0);
+    MqttClient mqtt(config, std::make_shared<StandInWifi>(), "pico_somfy/status", "online", "offline", &led);
+    mqtt.Start();
+
+    // The main broker is down, so move on to the failover broker
+    brokers[0].up = false;
+    if(!FailBroker(mqtt, 0) || !ConnectBroker(mqtt, 1))
+        return false;
+
+    // Losing a session that was up isn't a failed attempt. Then the failover broker goes down, and the main broker
+    // is back. The unused second failover broker is skipped.
+    MqttStandIn::Drop();
+    brokers[0].up = true;
+    brokers[1].up = false;
+    if(!FailBroker(mqtt, 1) || !ConnectBroker(mqtt, 0))
+        return false;
+
+    if(!Expect(mqtt.GetFailoverCount() == 2, "two failovers"))
+        return false;
+    puts("Failed over to the second broker, and back");
+    return true;
+}
+
+int main()
+{
+    auto ok = TestFailover();
+    puts(ok ? "PASS" : "FAIL");
+    return ok ? 0 : 1;
+}
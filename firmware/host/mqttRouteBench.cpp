@@ -0,0 +1,156 @@
+// Copyright (c) 2023 Mark Godwin.
+// SPDX-License-Identifier: MIT
+
+// Times how the MQTT client routes incoming device topics, through its hash table of parsed topics, against the
+// std::map of whole topic strings it replaced. Every blind has a cmd and a pos route, and there is a remote for every
+// other blind. The messages are spread at random over the routes.
+//   mqtt_route_bench [blinds] [messages]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#include "pico/stdlib.h"
+#include "deviceConfig.h"
+#include "flashScheduler.h"
+#include "flashEmulator.h"
+#include "hostStubs.h"
+#include "mqttClient.h"
+#include "mqttStandIn.h"
+#include "statusLed.h"
+
+#define STORAGE_SIZE (32 * FLASH_SECTOR_SIZE)
+#define LEGACY_BLOCK_SIZE 252
+
+typedef std::chrono::steady_clock Clock;
+
+static std::mt19937 rng(1984);
+static StandInBroker broker = { "10.0.0.1", true, 0 };
+
+/// @brief Routing as it was, by whole topic string
+class MapRouter
+{
+    public:
+        void Add(const std::string &topic, SubscribeFunc &&callback)
+        {
+            _routes.insert({ topic, std::move(callback) });
+        }
+
+        // What IncomingPublishCallback and IncomingPayloadCallback did between them
+        void Deliver(const char *topic, const uint8_t *payload, uint16_t length)
+        {
+            auto route = _routes.find(topic);
+            if(route == _routes.end())
+                return;
+            memcpy(_payload, payload, length);
+            route->second(_payload, length);
+        }
+
+    private:
+        // Transparent comparison, so looking up a topic doesn't need to allocate a string
+        std::map<std::string, SubscribeFunc, std::less<>> _routes;
+        uint8_t _payload[MQTT_MAX_PAYLOAD];
+};
+
+struct Route
+{
+    MqttTopicKind kind;
+    uint32_t id;
+    MqttTopicVerb verb;
+    std::string topic;
+};
+
+static double Microseconds(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+}
+
+int main(int argc, char **argv)
+{
+    auto blinds = argc > 1 ? atoi(argv[1]) : 256;
+    auto messages = argc > 2 ? atoi(argv[2]) : 1000000;
+
+    std::vector<Route> routes;
+    for(auto a = 1; a <= blinds; a++)
+    {
+        routes.push_back({ MqttTopicKind::Blind, (uint32_t)a, MqttTopicVerb::Command, string_format("pico_somfy/blinds/%08x/cmd", a) });
+        routes.push_back({ MqttTopicKind::Blind, (uint32_t)a, MqttTopicVerb::Position, string_format("pico_somfy/blinds/%08x/pos", a) });
+        if(a % 2 == 0)
+        {
+            auto remoteId = 0x100000 + a;
+            routes.push_back({ MqttTopicKind::Remote, (uint32_t)remoteId, MqttTopicVerb::Command, string_format("pico_somfy/remotes/%08x/cmd", remoteId) });
+        }
+    }
+    std::vector<uint32_t> order(messages);
+    for(auto &route : order)
+        route = rng() % routes.size();
+    static const uint8_t payload[] = "50";
+
+    // Counts the messages each route gets, so the two can be checked against each other
+    std::vector<uint32_t> tableCounts(routes.size()), mapCounts(routes.size());
+
+    FlashEmulator::Reset();
+    MqttStandIn::SetBrokers(&broker, 1);
+    auto config = std::make_shared<DeviceConfig>(std::make_shared<FlashScheduler>(nullptr), STORAGE_SIZE,
+        LEGACY_BLOCK_SIZE);
+    MqttConfig mqttConfig;
+    memset(&mqttConfig, 0, sizeof(mqttConfig));
+    strcpy(mqttConfig.brokerAddress, broker.address);
+    mqttConfig.port = 1883;
+    config->SaveMqttConfig(&mqttConfig);
+
+    StatusLed led(0);
+    auto mqtt = std::make_shared<MqttClient>(config, std::make_shared<StandInWifi>(), "pico_somfy/status", "online",
+        "offline", &led);
+    mqtt->Start();
+    mqtt->SubscribeTopic("pico_somfy/blinds/+/cmd");
+    mqtt->SubscribeTopic("pico_somfy/blinds/+/pos");
+    mqtt->SubscribeTopic("pico_somfy/remotes/+/cmd");
+    RunTimers();
+    MqttStandIn::Answer();
+    if(!mqtt->IsConnected())
+    {
+        puts("Couldn't connect to the stand-in broker");
+        return 1;
+    }
+
+    auto start = Clock::now();
+    std::vector<MqttSubscription> subscriptions;
+    subscriptions.reserve(routes.size());
+    for(size_t a = 0; a < routes.size(); a++)
+    {
+        auto &route = routes[a];
+        subscriptions.emplace_back(mqtt, route.kind, route.id, route.verb,
+            [&tableCounts, a](const uint8_t *, uint32_t) { tableCounts[a]++; });
+    }
+    auto tableAddUs = Microseconds(start);
+
+    start = Clock::now();
+    MapRouter map;
+    for(size_t a = 0; a < routes.size(); a++)
+        map.Add(routes[a].topic, [&mapCounts, a](const uint8_t *, uint32_t) { mapCounts[a]++; });
+    auto mapAddUs = Microseconds(start);
+
+    start = Clock::now();
+    for(auto route : order)
+        MqttStandIn::Deliver(routes[route].topic.c_str(), payload, 2);
+    auto tableUs = Microseconds(start);
+
+    start = Clock::now();
+    for(auto route : order)
+        map.Deliver(routes[route].topic.c_str(), payload, 2);
+    auto mapUs = Microseconds(start);
+
+    printf("%d routes, %d messages\n", (int)routes.size(), messages);
+    printf("Hash table: %7.1f ns a message, %8.1f us to add the routes\n", tableUs * 1000 / messages, tableAddUs);
+    printf("std::map:   %7.1f ns a message, %8.1f us to add the routes\n", mapUs * 1000 / messages, mapAddUs);
+
+    auto ok = tableCounts == mapCounts && mqtt->GetDroppedCount() == 0;
+    puts(ok ? "Both delivered every message to the same route" : "FAIL: The routes got different messages");
+    return ok ? 0 : 1;
+}
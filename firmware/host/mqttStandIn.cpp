@@ -0,0 +1,145 @@
+// Copyright (c) 2023 Mark Godwin.
+// SPDX-License-Identifier: MIT
+
+// Stand-ins for lwIP's MQTT client and DNS, and for the parts of the firmware the MQTT client uses that need the
+// hardware
+
+#include <stdio.h>
+#include <string.h>
+#include "lwip/apps/mqtt.h"
+#include "lwip/dns.h"
+#include "heapStats.h"
+#include "statusLed.h"
+#include "mqttStandIn.h"
+
+enum ClientState
+{
+    Disconnected,
+    Connecting,
+    Connected
+};
+
+// The client lwIP would have, connecting to one of the stand-ins
+struct mqtt_client_s
+{
+    ClientState state;
+    StandInBroker *broker;
+    mqtt_connection_cb_t callback;
+    void *arg;
+    mqtt_incoming_publish_cb_t publishCallback;
+    mqtt_incoming_data_cb_t dataCallback;
+    void *inpubArg;
+};
+
+static mqtt_client_s client;
+static StandInBroker *brokers;
+static size_t brokerCount;
+
+void MqttStandIn::SetBrokers(StandInBroker *newBrokers, size_t count)
+{
+    brokers = newBrokers;
+    brokerCount = count;
+}
+
+void MqttStandIn::Answer()
+{
+    if(client.state != Connecting)
+        return;
+    // A broker that is down never gets as far as refusing. The connection just drops.
+    client.state = client.broker->up ? Connected : Disconnected;
+    client.callback(&client, client.arg, client.broker->up ? MQTT_CONNECT_ACCEPTED : MQTT_CONNECT_DISCONNECTED);
+}
+
+void MqttStandIn::Drop()
+{
+    client.state = Disconnected;
+    client.callback(&client, client.arg, MQTT_CONNECT_DISCONNECTED);
+}
+
+void MqttStandIn::Deliver(const char *topic, const uint8_t *payload, uint16_t length)
+{
+    client.publishCallback(client.inpubArg, topic, length);
+    client.dataCallback(client.inpubArg, payload, length, MQTT_DATA_FLAG_LAST);
+}
+
+mqtt_client_t *mqtt_client_new(void)
+{
+    memset(&client, 0, sizeof(client));
+    return &client;
+}
+
+err_t mqtt_client_connect(mqtt_client_t *client, const ip_addr_t *ipaddr, u16_t, mqtt_connection_cb_t cb, void *arg,
+    const struct mqtt_connect_client_info_t *)
+{
+    // As lwIP does, until the last attempt has finished
+    if(client->state != Disconnected)
+        return ERR_ISCONN;
+
+    for(size_t a = 0; a < brokerCount; a++)
+    {
+        if(!strcmp(brokers[a].address, ipaddr_ntoa(ipaddr)))
+        {
+            brokers[a].attempts++;
+            client->state = Connecting;
+            client->broker = &brokers[a];
+            client->callback = cb;
+            client->arg = arg;
+            return ERR_OK;
+        }
+    }
+    return ERR_CONN;
+}
+
+u8_t mqtt_client_is_connected(mqtt_client_t *client)
+{
+    return client->state == Connected;
+}
+
+void mqtt_set_inpub_callback(mqtt_client_t *client, mqtt_incoming_publish_cb_t pub_cb, mqtt_incoming_data_cb_t data_cb,
+    void *arg)
+{
+    client->publishCallback = pub_cb;
+    client->dataCallback = data_cb;
+    client->inpubArg = arg;
+}
+
+err_t mqtt_sub_unsub(mqtt_client_t *client, const char *, u8_t, mqtt_request_cb_t, void *, u8_t)
+{
+    return client->state == Connected ? ERR_OK : ERR_CONN;
+}
+
+err_t mqtt_publish(mqtt_client_t *client, const char *, const void *, u16_t, u8_t, u8_t, mqtt_request_cb_t, void *)
+{
+    return client->state == Connected ? ERR_OK : ERR_CONN;
+}
+
+err_t dns_gethostbyname(const char *hostname, ip_addr_t *addr, dns_found_callback, void *)
+{
+    uint32_t a, b, c, d;
+    if(sscanf(hostname, "%u.%u.%u.%u", &a, &b, &c, &d) != 4)
+        return ERR_ARG;
+    addr->addr = a | (b << 8) | (c << 16) | (d << 24);
+    return ERR_OK;
+}
+
+char *ipaddr_ntoa(const ip_addr_t *addr)
+{
+    static char text[16];
+    snprintf(text, sizeof(text), "%u.%u.%u.%u", addr->addr & 0xFF, (addr->addr >> 8) & 0xFF,
+        (addr->addr >> 16) & 0xFF, addr->addr >> 24);
+    return text;
+}
+
+// No LED on a PC
+StatusLed::StatusLed(int)
+:   _pulseTimer([]() { return 0; }, 0)
+{
+}
+
+void StatusLed::TurnOn() {}
+void StatusLed::TurnOff() {}
+void StatusLed::SetLevel(uint16_t) {}
+void StatusLed::Pulse(int, int, int) {}
+
+uint32_t GetHeapAllocationCount() { return 0; }
+uint32_t GetHeapBytesInUse() { return 0; }
@@ -0,0 +1,43 @@
+// Copyright (c) 2023 Mark Godwin.
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <functional>
+#include "iwifiConnection.h"
+
+/// @brief A broker the stand-in for lwIP's MQTT client can connect to
+struct StandInBroker
+{
+    const char *address;    // Dotted quad
+    bool up;
+    uint32_t attempts;      // Connections started
+};
+
+/// @brief Stand-in for lwIP's MQTT client and DNS, so the firmware's MqttClient can run on a PC. There is no network.
+/// Connections wait until the test says how the broker answers, and messages arrive when the test delivers them.
+namespace MqttStandIn
+{
+    /// @brief Set the brokers that can be connected to. They must stay put while in use.
+    void SetBrokers(StandInBroker *brokers, size_t count);
+
+    /// @brief The broker answers the connection in progress, accepting it if it is up
+    void Answer();
+
+    /// @brief The broker goes away while connected
+    void Drop();
+
+    /// @brief The broker sends a message, all in one piece
+    void Deliver(const char *topic, const uint8_t *payload, uint16_t length);
+}
+
+/// @brief WiFi that is always connected
+class StandInWifi : public IWifiConnection
+{
+    public:
+        virtual bool IsConnected() { return true; }
+        virtual bool IsAccessPointMode() { return false; }
+        virtual void SetLinkUpHandler(std::function<void()> &&) {}
+};
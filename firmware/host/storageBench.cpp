@@ -0,0 +1,157 @@
+// Copyright (c) 2023 Mark Godwin.
+// SPDX-License-Identifier: MIT
+
+// Replays a busy household against DeviceConfig on the emulated flash, to see how the storage wears and performs.
+//   storage_bench [blinds] [days] [blinds in use]
+// Each blind has its own remote, and the ones in use are moved a few times a day. The rolling codes and positions
+// are saved every SAVE_DELAY, as the firmware does, and a blind is renamed once a day.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <random>
+#include <vector>
+#include "pico/flash.h"
+#include "deviceConfig.h"
+#include "flashScheduler.h"
+#include "flashEmulator.h"
+#include "hostStubs.h"
+
+// As picoSomfy.cpp
+#define STORAGE_SECTORS 32
+#define STORAGE_LEGACY_BLOCK_SIZE 252
+#define BASE_REMOTE_ID 0x100000
+
+#define COMMANDS_PER_BLIND_PER_DAY 6
+#define TICKS_PER_DAY (24 * 60 * 60 * 1000 / SAVE_DELAY)
+// Rated endurance of each sector
+#define FLASH_ENDURANCE 100000
+
+static std::mt19937 rng(1984);
+
+static std::unique_ptr<DeviceConfig> Mount(std::shared_ptr<FlashScheduler> flash)
+{
+    auto start = std::chrono::steady_clock::now();
+    auto config = std::make_unique<DeviceConfig>(flash, STORAGE_SECTORS * FLASH_SECTOR_SIZE, STORAGE_LEGACY_BLOCK_SIZE);
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+    // The emulated clock only counts flash operations, not reading through the records
+    printf("Mounted in %dus on this machine\n\n", (int)elapsed.count());
+    return config;
+}
+
+int main(int argc, char **argv)
+{
+    auto blindCount = argc > 1 ? atoi(argv[1]) : 200;
+    auto days = argc > 2 ? atoi(argv[2]) : 90;
+    auto activeCount = argc > 3 ? std::min(atoi(argv[3]), blindCount) : blindCount;
+    printf("%d blinds, %d of them in use, for %d days\n\n", blindCount, activeCount, days);
+
+    FlashEmulator::Reset();
+    auto flash = std::make_shared<FlashScheduler>(nullptr);
+    auto config = Mount(flash);
+
+    WifiConfig wifiConfig = { "ssid", "password" };
+    config->SaveWifiConfig(&wifiConfig);
+    MqttConfig mqttConfig;
+    memset(&mqttConfig, 0, sizeof(mqttConfig));
+    strcpy(mqttConfig.brokerAddress, "broker");
+    mqttConfig.port = 1883;
+    config->SaveMqttConfig(&mqttConfig);
+
+    std::vector<BlindConfig> blinds(blindCount);
+    std::vector<RemoteConfig> remotes(blindCount);
+    std::vector<uint16_t> blindIds;
+    std::vector<uint16_t> remoteIds;
+    for(auto a = 0; a < blindCount; a++)
+    {
+        auto &blind = blinds[a];
+        memset(&blind, 0, sizeof(blind));
+        snprintf(blind.blindName, sizeof(blind.blindName), "Blind %d", a + 1);
+        blind.openTime = 20000;
+        blind.closeTime = 18000;
+        blind.remoteId = BASE_REMOTE_ID + a + 1;
+        config->SaveBlindConfig(a + 1, &blind);
+        blindIds.push_back(a + 1);
+        config->SaveBlindDiscoveryHash(a + 1, rng());
+
+        auto &remote = remotes[a];
+        memset(&remote, 0, sizeof(remote));
+        snprintf(remote.remoteName, sizeof(remote.remoteName), "Remote %d", a + 1);
+        remote.remoteId = blind.remoteId;
+        remote.blindCount = 1;
+        remote.blinds[0] = a + 1;
+        config->SaveRemoteConfig(remote.remoteId, &remote);
+        remoteIds.push_back(remote.remoteId & 0xFFFF);
+        config->SaveRemoteDiscoveryHash(remote.remoteId, rng());
+    }
+    config->SaveBlindIds(blindIds.data(), blindIds.size());
+    config->SaveRemoteIds(remoteIds.data(), remoteIds.size());
+
+    puts("After setting up:");
+    config->PrintStorageStats();
+
+    std::vector<uint32_t> startErases;
+    for(uint32_t sector = 0; sector < PICO_FLASH_SIZE_BYTES / FLASH_SECTOR_SIZE; sector++)
+        startErases.push_back(FlashEmulator::GetEraseCount(sector));
+
+    config = Mount(flash);
+    std::vector<bool> dirty(blindCount);
+    for(auto day = 0; day < days; day++)
+    {
+        auto renameAt = rng() % TICKS_PER_DAY;
+        for(uint32_t tick = 0; tick < TICKS_PER_DAY; tick++)
+        {
+            for(auto a = 0; a < activeCount; a++)
+            {
+                if(rng() % TICKS_PER_DAY >= COMMANDS_PER_BLIND_PER_DAY)
+                    continue;
+                remotes[a].rollingCode++;
+                blinds[a].currentPosition = blinds[a].currentPosition ? 0 : 100;
+                dirty[a] = true;
+            }
+            if(tick == renameAt)
+            {
+                auto a = rng() % blindCount;
+                snprintf(blinds[a].blindName, sizeof(blinds[a].blindName), "Blind %d (day %d)", (int)a + 1, day);
+                dirty[a] = true;
+            }
+
+            // The save timer
+            for(auto a = 0; a < blindCount; a++)
+            {
+                if(!dirty[a])
+                    continue;
+                config->SaveRemoteConfig(remotes[a].remoteId, &remotes[a]);
+                config->SaveBlindConfig(a + 1, &blinds[a]);
+                dirty[a] = false;
+            }
+
+            // The radio is idle for most of the time between saves
+            while(RunFlashIdleWork())
+                ;
+            FlashEmulator::AdvanceTime(SAVE_DELAY * 1000ull);
+        }
+    }
+
+    printf("After %d days:\n", days);
+    config->PrintStorageStats();
+
+    uint32_t minErases = UINT32_MAX;
+    uint32_t maxErases = 0;
+    for(uint32_t sector = 0; sector < STORAGE_SECTORS; sector++)
+    {
+        auto erases = FlashEmulator::GetEraseCount(PICO_FLASH_SIZE_BYTES / FLASH_SECTOR_SIZE - STORAGE_SECTORS + sector) -
+            startErases[PICO_FLASH_SIZE_BYTES / FLASH_SECTOR_SIZE - STORAGE_SECTORS + sector];
+        minErases = std::min(minErases, erases);
+        maxErases = std::max(maxErases, erases);
+    }
+    auto maxPerDay = (double)maxErases / days;
+    printf("Sector erases during the workload: %d-%d. The most erased sector reaches %d erases in %.0f years\n\n",
+        minErases, maxErases, FLASH_ENDURANCE, maxPerDay ? FLASH_ENDURANCE / maxPerDay / 365 : 0.0);
+
+    config = Mount(flash);
+    return 0;
+}
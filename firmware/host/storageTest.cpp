@@ -0,0 +1,291 @@
+// Copyright (c) 2023 Mark Godwin.
+// SPDX-License-Identifier: MIT
+
+// Cuts the power at every point of a legacy migration, and at random points of a save workload, then checks
+// that remounting the storage finds everything that was saved.
+
+#include <stdio.h>
+#include <string.h>
+#include <map>
+#include <memory>
+#include <random>
+#include <vector>
+#include "pico/flash.h"
+#include "blockStorage.h"
+#include "deviceConfig.h"
+#include "flashScheduler.h"
+#include "flashEmulator.h"
+
+#define STORAGE_SECTORS 32
+#define STORAGE_SIZE (STORAGE_SECTORS * FLASH_SECTOR_SIZE)
+#define STORAGE_BASE (PICO_FLASH_SIZE_BYTES - STORAGE_SIZE)
+#define LEGACY_BLOCK_SIZE 252
+#define LEGACY_SLOT_SIZE 256
+
+typedef std::map<uint32_t, std::vector<uint8_t>> Blocks;
+
+static std::mt19937 rng(1984);
+static auto flash = std::make_shared<FlashScheduler>(nullptr);
+
+static std::vector<uint8_t> RandomBlock(size_t maxSize)
+{
+    std::vector<uint8_t> block(1 + rng() % maxSize);
+    for(auto &b : block)
+        b = rng();
+    // Legacy blocks can't be told apart from their padding, so end on something that isn't
+    block.back() |= 1;
+    return block;
+}
+
+/// @brief Mounts the storage, restarting it if the power is cut while mounting
+static std::unique_ptr<BlockStorage> Mount()
+{
+    try
+    {
+        return std::make_unique<BlockStorage>(flash, STORAGE_BASE, STORAGE_SIZE, LEGACY_BLOCK_SIZE);
+    }
+    catch(PowerCut &)
+    {
+        FlashEmulator::CancelPowerCut();
+        return std::make_unique<BlockStorage>(flash, STORAGE_BASE, STORAGE_SIZE, LEGACY_BLOCK_SIZE);
+    }
+}
+
+/// @brief Checks every block is stored exactly once, with the expected data
+/// @param pending A block that was being saved (or cleared, if it has no data) when the power was cut.
+/// It can have either its old or its new data.
+static bool Check(BlockStorage &storage, const Blocks &expected, const Blocks::value_type *pending = nullptr)
+{
+    Blocks found;
+    uint32_t cursor = 0;
+    uint32_t blockId;
+    size_t size;
+    const uint8_t *data;
+    while((data = storage.NextBlock(&cursor, &blockId, &size)) != nullptr)
+    {
+        if(found.count(blockId))
+        {
+            printf("Block %08x is stored more than once\n", blockId);
+            return false;
+        }
+        found[blockId].assign(data, data + size);
+
+        auto block = storage.GetBlock(blockId, &size);
+        if(block != data)
+        {
+            printf("Block %08x is found in a different place to where it is enumerated\n", blockId);
+            return false;
+        }
+    }
+
+    for(auto &block : expected)
+    {
+        if(pending && block.first == pending->first)
+            continue;
+        auto stored = found.find(block.first);
+        if(stored == found.end() || stored->second != block.second)
+        {
+            printf("Block %08x was %s\n", block.first, stored == found.end() ? "lost" : "changed");
+            return false;
+        }
+    }
+
+    if(pending)
+    {
+        auto stored = found.find(pending->first);
+        auto old = expected.find(pending->first);
+        auto isOld = old == expected.end() ? stored == found.end() : stored != found.end() && stored->second == old->second;
+        auto isNew = pending->second.empty() ? stored == found.end() : stored != found.end() && stored->second == pending->second;
+        if(!isOld && !isNew)
+        {
+            printf("Block %08x being saved is neither its old or new data\n", pending->first);
+            return false;
+        }
+    }
+
+    if(found.size() > expected.size() + (pending ? 1 : 0))
+    {
+        printf("%zu blocks found, when %zu were saved\n", found.size(), expected.size());
+        return false;
+    }
+    return true;
+}
+
+/// @brief Writes blocks in the original fixed-slot format, packed from the start of the storage
+static void WriteLegacyStorage(const std::vector<std::pair<uint32_t, std::vector<uint8_t>>> &slots)
+{
+    auto slot = hostFlashMemory + STORAGE_BASE;
+    for(auto &block : slots)
+    {
+        // Deleted slots have their ID zeroed
+        memset(slot, 0, LEGACY_SLOT_SIZE);
+        memcpy(slot, &block.first, sizeof(block.first));
+        memcpy(slot + sizeof(uint32_t), block.second.data(), block.second.size());
+        slot += LEGACY_SLOT_SIZE;
+    }
+}
+
+/// @param usedSlots Slots written, from the start of the storage
+/// @param cutPower Whether to cut the power at each step. When every sector has something in it, the first sector
+/// migrated has nowhere to copy its blocks to, so that can't survive a power cut.
+static bool TestMigration(uint32_t usedSlots, bool cutPower)
+{
+    // The first sector is full. After that, some of the slots are deleted, as they would be after blinds and
+    // remotes are removed.
+    std::vector<std::pair<uint32_t, std::vector<uint8_t>>> slots;
+    Blocks expected;
+    for(uint32_t a = 0; a < usedSlots; a++)
+    {
+        auto blockId = a >= FLASH_SECTOR_SIZE / LEGACY_SLOT_SIZE && a % 5 == 3 ? 0 : 0x19850000 + a;
+        slots.emplace_back(blockId, RandomBlock(LEGACY_BLOCK_SIZE));
+        // They come back zero padded to a whole word
+        auto padded = slots.back().second;
+        padded.resize((padded.size() + sizeof(uint32_t) - 1) & ~(sizeof(uint32_t) - 1));
+        if(blockId)
+            expected[blockId] = padded;
+    }
+
+    // How many flash operations it takes without interruption
+    FlashEmulator::Reset();
+    WriteLegacyStorage(slots);
+    auto storage = Mount();
+    auto operations = FlashEmulator::GetOperationCount();
+    if(!Check(*storage, expected))
+        return false;
+
+    // Then cut the power at each of them in turn
+    for(uint32_t cut = 0; cutPower && cut < operations; cut++)
+    {
+        FlashEmulator::Reset();
+        WriteLegacyStorage(slots);
+        FlashEmulator::CutPowerAfter(cut);
+        storage = Mount();
+        if(!Check(*storage, expected))
+        {
+            printf("Migrating %d slots, with the power cut after %d of %d flash operations\n", usedSlots, cut, operations);
+            return false;
+        }
+    }
+    printf("Migrated %d slots with %d power cuts\n", usedSlots, cutPower ? operations : 0);
+    return true;
+}
+
+static bool TestSaves(uint32_t iterations)
+{
+    FlashEmulator::Reset();
+    auto storage = Mount();
+    Blocks expected;
+    uint32_t cuts = 0;
+    for(uint32_t a = 0; a < iterations; a++)
+    {
+        // Mostly small records, like rolling codes, with the occasional large ID list
+        Blocks::value_type pending(0x19870000 + rng() % 150, std::vector<uint8_t>());
+        if(rng() % 10)
+            pending.second = RandomBlock(rng() % 20 ? 128 : 2048);
+
+        auto cut = rng() % 8 == 0;
+        if(cut)
+            FlashEmulator::CutPowerAfter(rng() % 20);
+        try
+        {
+            if(pending.second.empty())
+                storage->ClearBlock(pending.first);
+            else if(!storage->SaveBlock(pending.first, pending.second.data(), pending.second.size()))
+            {
+                printf("Storage full after %d saves\n", a);
+                return false;
+            }
+            while(rng() % 4 == 0 && storage->DoMaintenance())
+                ;
+            FlashEmulator::CancelPowerCut();
+        }
+        catch(PowerCut &)
+        {
+            cuts++;
+            storage = Mount();
+            if(!Check(*storage, expected, &pending))
+            {
+                printf("After %d saves, with the power cut\n", a);
+                return false;
+            }
+
+            // Carry on with whichever version survived
+            size_t size;
+            auto block = storage->GetBlock(pending.first, &size);
+            if(block == nullptr)
+                pending.second.clear();
+            else
+                pending.second.assign(block, block + size);
+        }
+
+        if(pending.second.empty())
+            expected.erase(pending.first);
+        else
+            expected[pending.first] = pending.second;
+        if(!Check(*storage, expected))
+        {
+            printf("After %d saves\n", a);
+            return false;
+        }
+    }
+
+    storage = Mount();
+    if(!Check(*storage, expected))
+        return false;
+    printf("Saved %d blocks with %d power cuts\n", iterations, cuts);
+    return true;
+}
+
+/// @brief Opens config saved by older firmware, and checks it is all upgraded up front, so reading it never writes
+static bool TestConfigUpgrade()
+{
+    FlashEmulator::Reset();
+    BlindConfig oldBlind;
+    memset(&oldBlind, 0, sizeof(oldBlind));
+    strcpy(oldBlind.blindName, "Kitchen");
+    oldBlind.openTime = 20000;
+    oldBlind.remoteId = 0x100005;
+    {
+        auto storage = Mount();
+        // An unversioned blind, from before the group name was added
+        storage->SaveBlock(0x19850005, (const uint8_t *)&oldBlind, offsetof(BlindConfig, groupName));
+        // A version 1 blind, which had no group name either
+        uint8_t record[sizeof(ConfigHeader) + offsetof(BlindConfig, groupName)];
+        ConfigHeader header = { 1, offsetof(BlindConfig, groupName) };
+        memcpy(record, &header, sizeof(header));
+        memcpy(record + sizeof(header), &oldBlind, offsetof(BlindConfig, groupName));
+        storage->SaveBlock(0x19870006, record, sizeof(record));
+    }
+
+    DeviceConfig config(flash, STORAGE_SIZE, LEGACY_BLOCK_SIZE);
+    auto operations = FlashEmulator::GetOperationCount();
+    for(auto blindId : { 5, 6 })
+    {
+        auto blind = config.GetBlindConfig(blindId);
+        if(blind == nullptr || strcmp(blind->blindName, "Kitchen") || blind->openTime != 20000 ||
+            blind->remoteId != 0x100005 || blind->groupName[0])
+        {
+            printf("Blind %d wasn't upgraded\n", blindId);
+            return false;
+        }
+    }
+    if(FlashEmulator::GetOperationCount() != operations)
+    {
+        puts("Reading the config wrote to the flash");
+        return false;
+    }
+    puts("Upgraded old config records");
+    return true;
+}
+
+int main()
+{
+    auto ok = TestConfigUpgrade() &&
+        TestMigration(0, true) &&
+        TestMigration(16, true) &&
+        TestMigration(16 * 5 + 3, true) &&
+        TestMigration(STORAGE_SIZE / LEGACY_SLOT_SIZE, false) &&
+        TestSaves(20000);
+    puts(ok ? "PASS" : "FAIL");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,338 @@
+// Copyright (c) 2023 Mark Godwin.
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <stdint.h>
+
+/// @brief Decompresses zlib data (HTTP's deflate encoding) that is all in memory, a buffer at a time
+/// @remarks As the whole input is there, decoding only stops when the output buffer is full, part way through a
+/// match or a stored block at worst, so that is all there is to carry on with. Matches reach back into what has
+/// already been written, so the caller gives it a window as big as the data's header asks for (WindowSize).
+class Inflater
+{
+    public:
+        /// @return The window the data needs, or 0 if it isn't zlib data
+        static uint32_t WindowSize(const uint8_t *data, uint32_t length)
+        {
+            // Deflate, a header that checks out, and no preset dictionary
+            if(length < 6 || (data[0] & 0x0F) != 8 || (data[0] >> 4) > 7 || ((data[0] << 8) | data[1]) % 31 ||
+                (data[1] & 0x20))
+                return 0;
+            return 1 << ((data[0] >> 4) + 8);
+        }
+
+        /// @param window At least WindowSize bytes
+        Inflater(const uint8_t *data, uint32_t length, uint8_t *window, uint32_t windowSize)
+        :   _in(data + 2),
+            _end(data + length),
+            _bits(0),
+            _bitCount(0),
+            _window(window),
+            _windowSize(windowSize),
+            _written(0),
+            _adlerA(1),
+            _adlerB(0),
+            _state(State::BlockHeader),
+            _lastBlock(false),
+            _storedLength(0),
+            _copyLength(0),
+            _copyDistance(0)
+        {
+        }
+
+        /// @brief Decompress the next part
+        /// @return Bytes written, 0 once it is all written, or -1 if the data is bad
+        int Read(uint8_t *buffer, int count)
+        {
+            auto read = 0;
+            while(read < count)
+            {
+                if(_copyLength)
+                {
+                    Put(buffer[read++] = _window[(_written - _copyDistance) % _windowSize]);
+                    _copyLength--;
+                    continue;
+                }
+
+                switch(_state)
+                {
+                    case State::BlockHeader:
+                        if(_lastBlock)
+                            _state = CheckAdler() ? State::Done : State::Failed;
+                        else
+                            _state = ReadBlockHeader() ? _state : State::Failed;
+                        break;
+
+                    case State::Stored:
+                        if(!_storedLength)
+                            _state = State::BlockHeader;
+                        else if(_in == _end)
+                            _state = State::Failed;
+                        else
+                        {
+                            Put(buffer[read++] = *_in++);
+                            _storedLength--;
+                        }
+                        break;
+
+                    case State::Huffman:
+                    {
+                        auto symbol = Decode(_literals);
+                        if(symbol < 256)
+                            Put(buffer[read++] = symbol);
+                        else if(symbol == 256)
+                            _state = State::BlockHeader;
+                        else if(!ReadMatch(symbol))
+                            _state = State::Failed;
+                        break;
+                    }
+
+                    case State::Done:
+                        return read;
+
+                    case State::Failed:
+                        return -1;
+                }
+                if(_in > _end)
+                    _state = State::Failed;
+            }
+            return read;
+        }
+
+    private:
+        enum class State : uint8_t
+        {
+            BlockHeader,
+            Stored,
+            Huffman,
+            Done,
+            Failed
+        };
+
+        // Canonical Huffman code, as the count of codes of each length and the symbols in code order
+        struct Tree
+        {
+            uint16_t counts[16];
+            uint16_t symbols[288];
+        };
+
+        void Put(uint8_t byte)
+        {
+            _window[_written++ % _windowSize] = byte;
+            _adlerA = (_adlerA + byte) % 65521;
+            _adlerB = (_adlerB + _adlerA) % 65521;
+        }
+
+        /// @brief Take bits, least significant first. Reading past the end leaves _in past _end, to be caught later.
+        uint32_t Bits(uint32_t count)
+        {
+            while(_bitCount < count)
+            {
+                _bits |= (uint32_t)(_in < _end ? *_in : 0) << _bitCount;
+                _in++;
+                _bitCount += 8;
+            }
+            auto value = _bits & ((1u << count) - 1);
+            _bits >>= count;
+            _bitCount -= count;
+            return value;
+        }
+
+        /// @brief Drop what is left of the current byte
+        void AlignToByte()
+        {
+            _bits = 0;
+            _bitCount = 0;
+        }
+
+        static bool Build(Tree &tree, const uint8_t *lengths, uint32_t count)
+        {
+            uint16_t offsets[16];
+            for(auto &c : tree.counts)
+                c = 0;
+            for(uint32_t a = 0; a < count; a++)
+                tree.counts[lengths[a]]++;
+            tree.counts[0] = 0;
+
+            // More codes than the lengths have room for can't be decoded. Fewer is allowed.
+            int32_t left = 1;
+            offsets[1] = 0;
+            for(auto length = 1; length < 16; length++)
+            {
+                left = (left << 1) - tree.counts[length];
+                if(left < 0)
+                    return false;
+                if(length < 15)
+                    offsets[length + 1] = offsets[length] + tree.counts[length];
+            }
+            for(uint32_t a = 0; a < count; a++)
+            {
+                if(lengths[a])
+                    tree.symbols[offsets[lengths[a]]++] = a;
+            }
+            return true;
+        }
+
+        /// @return The next symbol, or 0xFFFF if there is no such code
+        uint32_t Decode(const Tree &tree)
+        {
+            int32_t code = 0, first = 0, index = 0;
+            for(auto length = 1; length < 16; length++)
+            {
+                code |= Bits(1);
+                auto count = tree.counts[length];
+                if(code - first < count)
+                    return tree.symbols[index + code - first];
+                index += count;
+                first = (first + count) << 1;
+                code <<= 1;
+            }
+            return 0xFFFF;
+        }
+
+        bool ReadBlockHeader()
+        {
+            _lastBlock = Bits(1);
+            switch(Bits(2))
+            {
+                case 0:
+                {
+                    AlignToByte();
+                    if(_end - _in < 4)
+                        return false;
+                    _storedLength = _in[0] | (_in[1] << 8);
+                    auto check = _in[2] | (_in[3] << 8);
+                    _in += 4;
+                    _state = State::Stored;
+                    return (_storedLength ^ check) == 0xFFFF;
+                }
+
+                case 1:
+                {
+                    uint8_t lengths[288 + 30];
+                    for(auto a = 0; a < 288; a++)
+                        lengths[a] = a < 144 ? 8 : a < 256 ? 9 : a < 280 ? 7 : 8;
+                    for(auto a = 0; a < 30; a++)
+                        lengths[288 + a] = 5;
+                    _state = State::Huffman;
+                    return Build(_literals, lengths, 288) && Build(_distances, lengths + 288, 30);
+                }
+
+                case 2:
+                    _state = State::Huffman;
+                    return ReadDynamicTrees();
+
+                default:
+                    return false;
+            }
+        }
+
+        bool ReadDynamicTrees()
+        {
+            static const uint8_t order[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+            uint8_t lengths[288 + 32];
+            auto literalCount = Bits(5) + 257;
+            auto distanceCount = Bits(5) + 1;
+            auto lengthCount = Bits(4) + 4;
+            if(literalCount > 286 || distanceCount > 30)
+                return false;
+
+            // The lengths are themselves Huffman coded, by a tree that comes first
+            for(uint32_t a = 0; a < 19; a++)
+                lengths[order[a]] = a < lengthCount ? Bits(3) : 0;
+            if(!Build(_literals, lengths, 19))
+                return false;
+
+            uint32_t total = literalCount + distanceCount;
+            for(uint32_t a = 0; a < total; )
+            {
+                auto symbol = Decode(_literals);
+                if(symbol < 16)
+                {
+                    lengths[a++] = symbol;
+                    continue;
+                }
+
+                uint8_t repeat = 0;
+                uint32_t times;
+                if(symbol == 16)
+                {
+                    if(!a)
+                        return false;
+                    repeat = lengths[a - 1];
+                    times = 3 + Bits(2);
+                }
+                else if(symbol == 17)
+                    times = 3 + Bits(3);
+                else if(symbol == 18)
+                    times = 11 + Bits(7);
+                else
+                    return false;
+                if(a + times > total)
+                    return false;
+                while(times--)
+                    lengths[a++] = repeat;
+            }
+
+            // There must be an end of block code
+            return _in <= _end && lengths[256] && Build(_literals, lengths, literalCount) &&
+                Build(_distances, lengths + literalCount, distanceCount);
+        }
+
+        bool ReadMatch(uint32_t symbol)
+        {
+            static const uint16_t lengthBase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35,
+                43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+            static const uint8_t lengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4,
+                4, 4, 4, 5, 5, 5, 5, 0 };
+            static const uint16_t distanceBase[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+                257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+            static const uint8_t distanceExtra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8,
+                9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+            symbol -= 257;
+            if(symbol >= 29)
+                return false;
+            auto length = lengthBase[symbol] + Bits(lengthExtra[symbol]);
+
+            auto distanceSymbol = Decode(_distances);
+            if(distanceSymbol >= 30)
+                return false;
+            auto distance = distanceBase[distanceSymbol] + Bits(distanceExtra[distanceSymbol]);
+            if(distance > _written || distance > _windowSize)
+                return false;
+
+            _copyLength = length;
+            _copyDistance = distance;
+            return true;
+        }
+
+        /// @brief Check the Adler-32 of everything written against the one after the last block
+        bool CheckAdler()
+        {
+            AlignToByte();
+            if(_end - _in < 4)
+                return false;
+            auto adler = ((uint32_t)_in[0] << 24) | (_in[1] << 16) | (_in[2] << 8) | _in[3];
+            _in += 4;
+            return adler == ((_adlerB << 16) | _adlerA);
+        }
+
+        const uint8_t *_in;
+        const uint8_t *_end;
+        uint32_t _bits;
+        uint32_t _bitCount;
+        uint8_t *_window;
+        uint32_t _windowSize;
+        uint32_t _written;          // Bytes written so far, which wraps round the window
+        uint32_t _adlerA;
+        uint32_t _adlerB;
+        State _state;
+        bool _lastBlock;
+        uint32_t _storedLength;     // Left to copy from a stored block
+        uint32_t _copyLength;       // Left to copy from a match
+        uint32_t _copyDistance;
+        Tree _literals;             // Also the code lengths' tree, while reading a dynamic block's header
+        Tree _distances;
+};
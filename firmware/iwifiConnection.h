@@ -3,9 +3,14 @@
 
 #pragma once
 
+#include <functional>
+
 class IWifiConnection
 {
     public:
         virtual bool IsConnected() = 0;
         virtual bool IsAccessPointMode() = 0;
+
+        /// @brief Set a function to call when the link comes up, and has an IP address
+        virtual void SetLinkUpHandler(std::function<void()> &&handler) = 0;
 };
@@ -0,0 +1,392 @@
+// Copyright (c) 2023 Mark Godwin.
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+// Deepest nesting of objects and arrays a document can have
+#define JSON_MAX_DEPTH 8
+
+/// @brief Read only view of a JSON value held in someone else's buffer, for picking values out of request bodies.
+/// @remarks Nothing is allocated or copied. Parse checks the whole document once, then members and array items are
+/// found by scanning the text again, which is fine for the small bodies the web API takes.
+class JsonValue
+{
+    public:
+        JsonValue()
+        :   _begin(nullptr),
+            _end(nullptr)
+        {
+        }
+
+        /// @brief Check a whole document is well formed
+        /// @return Its value, or an invalid value if it isn't JSON
+        static JsonValue Parse(const char *text, uint32_t length)
+        {
+            auto end = text + length;
+            auto begin = SkipSpace(text, end);
+            auto valueEnd = SkipValue(begin, end, 0);
+            if(!valueEnd || SkipSpace(valueEnd, end) != end)
+                return JsonValue();
+            return JsonValue(begin, valueEnd);
+        }
+
+        bool IsValid() const { return _begin != nullptr; }
+        bool IsObject() const { return IsValid() && *_begin == '{'; }
+        bool IsArray() const { return IsValid() && *_begin == '['; }
+        bool IsString() const { return IsValid() && *_begin == '\"'; }
+        bool IsNumber() const { return IsValid() && (*_begin == '-' || IsDigit(*_begin)); }
+
+        /// @brief Member of an object
+        /// @return The value, or an invalid value if there is no such member
+        /// @remarks Keys are compared as written, so a key with escapes in it won't be found
+        JsonValue operator[](const char *key) const
+        {
+            if(!IsObject())
+                return JsonValue();
+
+            auto p = SkipSpace(_begin + 1, _end);
+            while(p < _end && *p == '\"')
+            {
+                auto keyEnd = SkipString(p, _end);
+                auto matches = KeyEquals(p + 1, keyEnd - 1, key);
+                // Past the colon
+                p = SkipSpace(SkipSpace(keyEnd, _end) + 1, _end);
+                auto valueEnd = SkipValue(p, _end, 0);
+                if(matches)
+                    return JsonValue(p, valueEnd);
+                p = NextItem(valueEnd);
+            }
+            return JsonValue();
+        }
+
+        /// @brief Call callback(JsonValue) for each item of an array
+        template<typename TCallback>
+        void ForEach(TCallback &&callback) const
+        {
+            if(!IsArray())
+                return;
+
+            auto p = SkipSpace(_begin + 1, _end);
+            while(p < _end && *p != ']')
+            {
+                auto valueEnd = SkipValue(p, _end, 0);
+                callback(JsonValue(p, valueEnd));
+                p = NextItem(valueEnd);
+            }
+        }
+
+        /// @brief Number of items in an array
+        uint32_t Count() const
+        {
+            uint32_t count = 0;
+            ForEach([&count](JsonValue) { count++; });
+            return count;
+        }
+
+        /// @brief Read a number, rounded to the nearest integer
+        /// @return False if it isn't a number, or is out of range
+        bool GetInt(int32_t &value) const
+        {
+            if(!IsNumber())
+                return false;
+            return ParseInt(_begin, _end, value);
+        }
+
+        /// @brief Read a number that must fit in a smaller type, like a blind id
+        /// @return False if it isn't a number, or is outside 0 to max
+        template<typename T>
+        bool GetUInt(T &value, uint32_t max) const
+        {
+            int32_t result;
+            if(!GetInt(result) || result < 0 || (uint32_t)result > max)
+                return false;
+            value = result;
+            return true;
+        }
+
+        bool GetBool(bool &value) const
+        {
+            if(_end - _begin == 4 && *_begin == 't')
+                value = true;
+            else if(_end - _begin == 5 && *_begin == 'f')
+                value = false;
+            else
+                return false;
+            return true;
+        }
+
+        /// @brief Copy out a string, with its escapes decoded. A number is copied as it was written.
+        /// @return False if it isn't a string or number, or doesn't fit in the buffer with its terminator
+        bool GetString(char *buffer, uint32_t size) const
+        {
+            if(IsNumber())
+            {
+                if(_end - _begin >= size)
+                    return false;
+                auto length = _end - _begin;
+                for(auto a = 0; a < length; a++)
+                    buffer[a] = _begin[a];
+                buffer[length] = 0;
+                return true;
+            }
+            if(!IsString() || !size)
+                return false;
+
+            auto out = buffer;
+            auto outEnd = buffer + size - 1;
+            auto p = _begin + 1;
+            while(p < _end - 1)
+            {
+                uint32_t c = (uint8_t)*p++;
+                if(c == '\\')
+                {
+                    c = *p++;
+                    switch(c)
+                    {
+                        case 'b': c = '\b'; break;
+                        case 'f': c = '\f'; break;
+                        case 'n': c = '\n'; break;
+                        case 'r': c = '\r'; break;
+                        case 't': c = '\t'; break;
+                        case 'u':
+                            c = (HexValue(p[0]) << 12) | (HexValue(p[1]) << 8) | (HexValue(p[2]) << 4) | HexValue(p[3]);
+                            p += 4;
+                            break;
+                    }
+                }
+
+                // Characters from \u escapes go out as UTF-8. Surrogate pairs aren't put back together.
+                auto count = c < 0x80 ? 1 : c < 0x800 ? 2 : 3;
+                if(outEnd - out < count)
+                    return false;
+                if(count == 1)
+                    *out++ = c;
+                else if(count == 2)
+                {
+                    *out++ = 0xC0 | (c >> 6);
+                    *out++ = 0x80 | (c & 0x3F);
+                }
+                else
+                {
+                    *out++ = 0xE0 | (c >> 12);
+                    *out++ = 0x80 | ((c >> 6) & 0x3F);
+                    *out++ = 0x80 | (c & 0x3F);
+                }
+            }
+            *out = 0;
+            return true;
+        }
+
+        /// @brief Read a decimal number from text, rounded to the nearest integer
+        /// @return False if the text isn't a number, or it is out of range
+        static bool ParseInt(const char *p, const char *end, int32_t &value)
+        {
+            auto negative = p < end && *p == '-';
+            if(negative)
+                p++;
+            if(p == end || !IsDigit(*p))
+                return false;
+
+            int64_t result = 0;
+            for(; p < end && IsDigit(*p); p++)
+            {
+                result = result * 10 + (*p - '0');
+                if(result > INT32_MAX)
+                    return false;
+            }
+            if(p < end && *p == '.')
+            {
+                p++;
+                if(p == end || !IsDigit(*p))
+                    return false;
+                if(*p >= '5')
+                    result++;
+                while(p < end && IsDigit(*p))
+                    p++;
+            }
+            if(p != end)
+                return false;
+
+            value = negative ? -result : result;
+            return true;
+        }
+
+    private:
+        JsonValue(const char *begin, const char *end)
+        :   _begin(begin),
+            _end(end)
+        {
+        }
+
+        static bool IsDigit(char c) { return c >= '0' && c <= '9'; }
+        static bool IsSpace(char c) { return c == ' ' || c == '\t' || c == '\n' || c == '\r'; }
+
+        static int HexValue(char c)
+        {
+            if(c >= '0' && c <= '9')
+                return c - '0';
+            if(c >= 'a' && c <= 'f')
+                return c + 10 - 'a';
+            if(c >= 'A' && c <= 'F')
+                return c + 10 - 'A';
+            return -1;
+        }
+
+        static const char *SkipSpace(const char *p, const char *end)
+        {
+            while(p < end && IsSpace(*p))
+                p++;
+            return p;
+        }
+
+        // After an item of an object or array, to the start of the next one or the closing bracket
+        const char *NextItem(const char *p) const
+        {
+            p = SkipSpace(p, _end);
+            if(p < _end && *p == ',')
+                p = SkipSpace(p + 1, _end);
+            return p;
+        }
+
+        static bool KeyEquals(const char *begin, const char *end, const char *key)
+        {
+            while(begin < end && *key && *begin == *key)
+            {
+                begin++;
+                key++;
+            }
+            return begin == end && !*key;
+        }
+
+        // These return the end of what they skip, or null if it isn't well formed
+
+        static const char *SkipString(const char *p, const char *end)
+        {
+            for(p++; p < end; p++)
+            {
+                if(*p == '\"')
+                    return p + 1;
+                if((uint8_t)*p < 0x20)
+                    return nullptr;
+                if(*p == '\\')
+                {
+                    if(++p == end)
+                        return nullptr;
+                    if(*p == 'u')
+                    {
+                        if(end - p < 5)
+                            return nullptr;
+                        for(auto a = 1; a <= 4; a++)
+                        {
+                            if(HexValue(p[a]) < 0)
+                                return nullptr;
+                        }
+                        p += 4;
+                    }
+                    else if(!strchr("\"\\/bfnrt", *p))
+                        return nullptr;
+                }
+            }
+            return nullptr;
+        }
+
+        static const char *SkipDigits(const char *p, const char *end)
+        {
+            if(p == end || !IsDigit(*p))
+                return nullptr;
+            while(p < end && IsDigit(*p))
+                p++;
+            return p;
+        }
+
+        static const char *SkipNumber(const char *p, const char *end)
+        {
+            if(*p == '-')
+                p++;
+            p = SkipDigits(p, end);
+            if(p && p < end && *p == '.')
+                p = SkipDigits(p + 1, end);
+            if(p && p < end && (*p == 'e' || *p == 'E'))
+            {
+                p++;
+                if(p < end && (*p == '+' || *p == '-'))
+                    p++;
+                p = SkipDigits(p, end);
+            }
+            return p;
+        }
+
+        static const char *SkipLiteral(const char *p, const char *end, const char *literal)
+        {
+            for(; *literal; literal++, p++)
+            {
+                if(p == end || *p != *literal)
+                    return nullptr;
+            }
+            return p;
+        }
+
+        static const char *SkipValue(const char *p, const char *end, uint32_t depth)
+        {
+            if(p == nullptr || p >= end)
+                return nullptr;
+
+            switch(*p)
+            {
+                case '\"':
+                    return SkipString(p, end);
+                case 't':
+                    return SkipLiteral(p, end, "true");
+                case 'f':
+                    return SkipLiteral(p, end, "false");
+                case 'n':
+                    return SkipLiteral(p, end, "null");
+                case '{':
+                case '[':
+                {
+                    if(depth >= JSON_MAX_DEPTH)
+                        return nullptr;
+                    auto isObject = *p == '{';
+                    auto close = isObject ? '}' : ']';
+                    p = SkipSpace(p + 1, end);
+                    if(p < end && *p == close)
+                        return p + 1;
+                    while(p < end)
+                    {
+                        if(isObject)
+                        {
+                            if(*p != '\"')
+                                return nullptr;
+                            p = SkipString(p, end);
+                            if(p == nullptr)
+                                return nullptr;
+                            p = SkipSpace(p, end);
+                            if(p == end || *p != ':')
+                                return nullptr;
+                            p = SkipSpace(p + 1, end);
+                        }
+                        p = SkipValue(p, end, depth + 1);
+                        if(p == nullptr)
+                            return nullptr;
+                        p = SkipSpace(p, end);
+                        if(p < end && *p == close)
+                            return p + 1;
+                        if(p == end || *p != ',')
+                            return nullptr;
+                        p = SkipSpace(p + 1, end);
+                    }
+                    return nullptr;
+                }
+                default:
+                    if(*p == '-' || IsDigit(*p))
+                        return SkipNumber(p, end);
+                    return nullptr;
+            }
+        }
+
+        const char *_begin;
+        const char *_end;
+};
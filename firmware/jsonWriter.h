@@ -0,0 +1,186 @@
+// Copyright (c) 2023 Mark Godwin.
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+
+// Longest a character of a string can be once escaped, as \u00XX
+#define JSON_ESCAPE_MAX 6
+
+/// @brief Streaming JSON encoder for SSI tag buffers.
+/// @remarks Writes a window of the output: the first skip bytes are thrown away, and anything past the end of the
+/// buffer is counted but not stored. Writing the same document again with a larger skip carries on where the
+/// buffer filled up, even part way through a value, so long output can be split over several SSI tag parts.
+class JsonWriter
+{
+    public:
+        JsonWriter(char *buffer, int length, uint32_t skip = 0)
+        :   _buffer(buffer),
+            _length(length),
+            _skip(skip),
+            _written(0),
+            _position(0),
+            _overflow(false),
+            _depth(0),
+            _needComma(0)
+        {
+        }
+
+        /// @brief Bytes stored in the buffer
+        uint16_t BytesWritten() { return _written; }
+
+        /// @brief Bytes of output so far, including any skipped or that didn't fit
+        uint32_t Position() { return _position; }
+
+        /// @brief True if some output didn't fit in the buffer
+        bool IsFull() { return _overflow; }
+
+        void BeginObject() { Separate(); Put('{'); Push(); }
+        void EndObject() { Pop(); Put('}'); }
+        void BeginArray() { Separate(); Put('['); Push(); }
+        void EndArray() { Pop(); Put(']'); }
+
+        /// @brief Start a member of an object. Follow it with the value
+        void Key(const char *key)
+        {
+            Separate();
+            PutString(key);
+            Put(':');
+            // The value follows the key without a comma
+            _needComma &= ~(1u << _depth);
+        }
+
+        /// @brief Escape one character of a string, as String does
+        /// @param out Room for JSON_ESCAPE_MAX characters
+        /// @return Characters written
+        static uint32_t EscapeChar(char c, char *out)
+        {
+            static const char hex[] = "0123456789abcdef";
+            auto u = (uint8_t)c;
+            switch(u)
+            {
+                case '\"': out[0] = '\\'; out[1] = '\"'; return 2;
+                case '\\': out[0] = '\\'; out[1] = '\\'; return 2;
+                case '\n': out[0] = '\\'; out[1] = 'n'; return 2;
+                case '\r': out[0] = '\\'; out[1] = 'r'; return 2;
+                case '\t': out[0] = '\\'; out[1] = 't'; return 2;
+                default:
+                    if(u >= 0x20)
+                    {
+                        out[0] = c;
+                        return 1;
+                    }
+                    // Other control characters as \u00XX
+                    out[0] = '\\';
+                    out[1] = 'u';
+                    out[2] = '0';
+                    out[3] = '0';
+                    out[4] = hex[u >> 4];
+                    out[5] = hex[u & 0xF];
+                    return 6;
+            }
+        }
+
+        void String(const char *value) { Separate(); PutString(value); }
+        void String(const std::string &value) { String(value.c_str()); }
+        void Bool(bool value) { Separate(); PutRaw(value ? "true" : "false"); }
+        void Null() { Separate(); PutRaw("null"); }
+
+        void Int(int32_t value)
+        {
+            Separate();
+            if(value < 0)
+            {
+                Put('-');
+                PutDigits(-(int64_t)value);
+            }
+            else
+                PutDigits(value);
+        }
+
+        void UInt(uint32_t value) { Separate(); PutDigits(value); }
+
+        /// @brief Carry on a list of values begun by another writer, so the next value is preceded by a comma
+        void ContinueList() { _needComma |= 1; }
+
+    private:
+        void Put(char c)
+        {
+            _position++;
+            if(_skip)
+                _skip--;
+            else if(_length > 0)
+            {
+                *_buffer++ = c;
+                _length--;
+                _written++;
+            }
+            else
+                _overflow = true;
+        }
+
+        void PutRaw(const char *str)
+        {
+            while(*str)
+                Put(*str++);
+        }
+
+        void PutDigits(uint64_t value)
+        {
+            char digits[20];
+            auto count = 0;
+            do
+            {
+                digits[count++] = '0' + value % 10;
+                value /= 10;
+            }
+            while(value);
+            while(count)
+                Put(digits[--count]);
+        }
+
+        void PutString(const char *str)
+        {
+            Put('\"');
+            for(; *str; str++)
+            {
+                char escaped[JSON_ESCAPE_MAX];
+                auto length = EscapeChar(*str, escaped);
+                for(uint32_t a = 0; a < length; a++)
+                    Put(escaped[a]);
+            }
+            Put('\"');
+        }
+
+        // Commas go before every value but the first at each level
+        void Separate()
+        {
+            auto bit = 1u << _depth;
+            if(_needComma & bit)
+                Put(',');
+            _needComma |= bit;
+        }
+
+        void Push()
+        {
+            _depth++;
+            _needComma &= ~(1u << _depth);
+        }
+
+        void Pop()
+        {
+            if(_depth)
+                _depth--;
+        }
+
+        char *_buffer;
+        int _length;
+        uint32_t _skip;
+        uint16_t _written;
+        uint32_t _position;
+        bool _overflow;
+        uint32_t _depth;
+        uint32_t _needComma;    // One bit per level
+};
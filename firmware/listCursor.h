@@ -0,0 +1,78 @@
+// Copyright (c) 2023 Mark Godwin.
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <stdint.h>
+#include "jsonWriter.h"
+
+/// @brief Writes a map as a comma separated list of JSON values over as many SSI tag parts as it needs,
+/// remembering where each part got to so the next one carries on from there instead of starting again.
+/// @remarks Every part but the last fills the buffer, so part n always starts n buffers into the list, and an item
+/// can be split between parts. Call Reset whenever an entry is added to or removed from the map.
+/// There is one cursor per list, not per connection, as SSI handlers aren't told which connection they're writing
+/// for. A part that doesn't follow on from the last one written falls back to walking the list from the start.
+/// The output is still right, but while two clients fetch the list at once their parts interleave, so at least half
+/// of them take the slow path: O(n) per part rather than O(1). list_render_bench in the host build measures this.
+template<typename TMap>
+class ListCursor
+{
+    public:
+        ListCursor(TMap &map)
+        :   _map(map),
+            _pos(map.end()),
+            _itemStart(0),
+            _part(-1)
+        {
+        }
+
+        /// @brief Write one SSI tag part of the list
+        /// @param writeItem Called as writeItem(JsonWriter &, iterator) to write each item
+        /// @return Bytes written to the buffer
+        template<typename TWriteItem>
+        uint16_t Write(char *buffer, int length, uint16_t tagPart, uint16_t *nextPart, TWriteItem &&writeItem)
+        {
+            uint32_t start = tagPart * length;
+            if(_part < 0 || tagPart != _part + 1 || start < _itemStart)
+            {
+                // Start again from the top
+                _pos = _map.begin();
+                _itemStart = 0;
+            }
+            _part = tagPart;
+
+            // Write from the start of the item the last part finished in, skipping what was sent already
+            JsonWriter writer(buffer, length, start - _itemStart);
+            if(_pos != _map.begin())
+                writer.ContinueList();
+            for(; _pos != _map.end(); _pos++)
+            {
+                auto itemStart = writer.Position();
+                writeItem(writer, _pos);
+
+                if(writer.IsFull())
+                {
+                    // Finish this item in the next part
+                    _itemStart += itemStart;
+                    *nextPart = tagPart + 1;
+                    return writer.BytesWritten();
+                }
+            }
+
+            // All done
+            _part = -1;
+            return writer.BytesWritten();
+        }
+
+        void Reset()
+        {
+            _pos = _map.end();
+            _part = -1;
+        }
+
+    private:
+        TMap &_map;
+        typename TMap::iterator _pos;   // Item the last part finished in
+        uint32_t _itemStart;            // Where that item starts in the list
+        int32_t _part;
+};
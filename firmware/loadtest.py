@@ -0,0 +1,109 @@
+#!/usr/bin/env python3
+# Copyright (c) 2023 Mark Godwin.
+# SPDX-License-Identifier: MIT
+"""Measure how quickly a pico_somfy device serves its web interface, with and without keep-alive.
+
+    loadtest.py <device> [requests] [clients] [path...]
+
+Several clients fetch the paths over and over, as browsers loading the page would, until they have made the
+requests between them (default 600 from 3 clients). It is done twice:
+    close       a new connection for every request, which is all HTTP/1.0 firmware can do
+    keep-alive  each client reuses its connection for as long as the device keeps it open
+Requests per second, latency percentiles and connections opened are printed for each.
+With no paths, index.html and the files it links to are fetched.
+"""
+
+import http.client
+import re
+import sys
+import threading
+import time
+
+LINK = re.compile(r'(?:href|src)="(/[^"]+)"')
+
+
+class CountingConnection(http.client.HTTPConnection):
+    """Counts the connections it opens, as http.client quietly reopens them"""
+    opened = 0
+    lock = threading.Lock()
+
+    def connect(self):
+        super().connect()
+        with CountingConnection.lock:
+            CountingConnection.opened += 1
+
+
+def page_paths(device):
+    connection = http.client.HTTPConnection(device, timeout=10)
+    connection.request("GET", "/index.html")
+    html = connection.getresponse().read().decode("utf-8", "replace")
+    connection.close()
+    return ["/index.html"] + sorted(set(LINK.findall(html)))
+
+
+def fetch(connection, path, keep_alive):
+    headers = {} if keep_alive else {"Connection": "close"}
+    for attempt in range(2):
+        try:
+            connection.request("GET", path, headers=headers)
+            response = connection.getresponse()
+            response.read()
+            return response.status
+        except (http.client.RemoteDisconnected, ConnectionResetError, BrokenPipeError):
+            # The device closed an idle connection as we reused it. A browser would just try again.
+            connection.close()
+            if attempt:
+                raise
+
+
+def client(device, paths, count, keep_alive, latencies, errors):
+    connection = CountingConnection(device, timeout=10)
+    for a in range(count):
+        if not keep_alive:
+            connection = CountingConnection(device, timeout=10)
+        start = time.perf_counter()
+        try:
+            status = fetch(connection, paths[a % len(paths)], keep_alive)
+        except (OSError, http.client.HTTPException):
+            status = None
+            connection.close()
+        latencies.append(time.perf_counter() - start)
+        if status != 200:
+            errors.append(status)
+        if not keep_alive:
+            connection.close()
+    connection.close()
+
+
+def run(device, paths, requests, clients, keep_alive):
+    CountingConnection.opened = 0
+    latencies = []
+    errors = []
+    threads = [threading.Thread(target=client, args=(device, paths, requests // clients, keep_alive, latencies, errors))
+               for a in range(clients)]
+    start = time.perf_counter()
+    for thread in threads:
+        thread.start()
+    for thread in threads:
+        thread.join()
+    elapsed = time.perf_counter() - start
+
+    latencies.sort()
+    percentile = lambda p: latencies[min(len(latencies) - 1, int(len(latencies) * p))] * 1000
+    print("%-10s  %7.1f req/s  p50 %6.1f ms  p99 %6.1f ms  max %6.1f ms  %4d connections  %d errors" % (
+        "keep-alive" if keep_alive else "close", len(latencies) / elapsed, percentile(0.5), percentile(0.99),
+        latencies[-1] * 1000, CountingConnection.opened, len(errors)))
+
+
+def main(device, requests="600", clients="3", *paths):
+    paths = list(paths) or page_paths(device)
+    print("%s requests from %s clients, cycling through %s" % (requests, clients, " ".join(paths)))
+    for keep_alive in (False, True):
+        run(device, paths, int(requests), int(clients), keep_alive)
+
+
+if __name__ == "__main__":
+    if len(sys.argv) < 2:
+        print(__doc__)
+        sys.exit(1)
+    main(*sys.argv[1:])
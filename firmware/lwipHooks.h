@@ -0,0 +1,23 @@
+// Copyright (c) 2023 Mark Godwin.
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include "lwip/err.h"
+
+struct tcp_pcb;
+struct pbuf;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// @brief Sees each TCP segment just before lwIP hands it on, so the web server can read the request headers
+/// httpd doesn't pass on, like If-None-Match.
+err_t web_server_tcp_input_hook(struct tcp_pcb *pcb, struct pbuf *p);
+
+#ifdef __cplusplus
+}
+#endif
+
+#define LWIP_HOOK_TCP_INPACKET_PCB(pcb, hdr, optlen, opt1len, opt2, p) web_server_tcp_input_hook(pcb, p)
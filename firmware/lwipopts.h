@@ -11,6 +11,8 @@
 #define MEM_ALIGNMENT               4
 #define MEM_SIZE                    (10 * 1024)
 #define MEMP_NUM_TCP_SEG            32
+// One for each web connection, plus MQTT and one to spare for a connection being closed
+#define MEMP_NUM_TCP_PCB            (MEMP_NUM_PARALLEL_HTTPD_CONNS + 2)
 #define MEMP_NUM_ARP_QUEUE          10
 #define PBUF_POOL_SIZE              24
 #define LWIP_ARP                    1
@@ -90,6 +92,27 @@
 // CGI handler with SSI integration for returning results
 #define LWIP_HTTPD_CGI_SSI              1
 #define LWIP_HTTPD_FILE_STATE           1
+// Streams, like the event stream, are custom files that send data as it becomes available
+#define LWIP_HTTPD_CUSTOM_FILES         1
+#define LWIP_HTTPD_DYNAMIC_FILE_READ    1
+#define LWIP_HTTPD_FS_ASYNC_READ        1
+// Routes take JSON bodies
+#define LWIP_HTTPD_SUPPORT_POST         1
+// Lets the web server see request headers that httpd doesn't pass on
+#define LWIP_HOOK_FILENAME              "lwipHooks.h"
+// Keep connections open between requests, so each fetch from the web interface doesn't need a new handshake.
+// Files and routes with a Content-Length are persistent, SSI files still close when they are done.
+#define LWIP_HTTPD_SUPPORT_11_KEEPALIVE 1
+// Connection state comes from fixed pools rather than the heap. When they are full, the oldest connection
+// (usually one left idle by keep-alive) is closed to make room for the new one.
+#define HTTPD_USE_MEM_POOL              1
+#define MEMP_NUM_PARALLEL_HTTPD_CONNS   6
+#define MEMP_NUM_PARALLEL_HTTPD_SSI_CONNS 3
+#define LWIP_HTTPD_KILL_OLD_ON_CONNECTIONS_EXCEEDED 1
+// Poll every second, and close a connection that hasn't made progress for 5 polls. This is what ends idle
+// keep-alive connections, so they don't hold pcbs and pbufs.
+#define HTTPD_POLL_INTERVAL             2
+#define HTTPD_MAX_RETRIES               5
 
 #define MQTT_DEBUG LWIP_DBG_OFF
 #define MQTT_OUTPUT_RINGBUF_SIZE        (4 * 1024)
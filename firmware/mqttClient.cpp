@@ -4,22 +4,60 @@
 #include "picoSomfy.h"
 #include "pico/cyw43_arch.h"
 #include "pico/flash.h"
+#include "pico/rand.h"
+#include "lwip/dns.h"
 
 #include "mqttClient.h"
 #include "deviceConfig.h"
 #include "iwifiConnection.h"
 #include "statusLed.h"
+#include "heapStats.h"
+#include "bufferOutput.h"
 
 MqttClient::MqttClient(std::shared_ptr<DeviceConfig> config, std::shared_ptr<IWifiConnection> wifi, const char *statusTopic, const char *onlinePayload, const char *offlinePayload, StatusLed *statusLed)
-: _config(std::move(config)),
+: _statusLed(statusLed),
   _wifi(std::move(wifi)),
+  _config(std::move(config)),
+  _client(nullptr),
   _statusTopic(statusTopic),
   _onlinePayload(onlinePayload),
   _offlinePayload(offlinePayload),
-  _statusLed(statusLed),
-  _payload(nullptr),
-  _client(nullptr)
+  _currentCallback(nullptr),
+  _payloadLength(0),
+  _payloadReceived(0),
+  _queueUsed(0),
+  _queueDepth(0),
+  _queueHighWater(0),
+  _coalescedCount(0),
+  _publishDroppedCount(0),
+  _inFlight(0),
+  _resendCount(0),
+  _nextSequence(1),
+  _nextDoneId(1),
+  _receivedCount(0),
+  _zeroCopyCount(0),
+  _droppedCount(0),
+  _lastAllocationCount(0),
+  _hasBrokerAddress(false),
+  _resolving(false),
+  _wasConnected(false),
+  _retryDelay(MQTT_RETRY_MIN),
+  _connectAttempts(0),
+  _connectCount(0),
+  _lastConnectAttempts(0),
+  _lastDowntime(0),
+  _brokerIndex(0),
+  _brokerAttempts(0),
+  _connectedBroker(0),
+  _failoverCount(0),
+  _brokerChanged(false)
 {
+    memset(_routes, 0, sizeof(_routes));
+    memset(_brokerHealth, 0, sizeof(_brokerHealth));
+    for(auto &slot : _inFlightSlots)
+        slot = { this, 0 };
+    ip_addr_set_zero(&_brokerAddress);
+    _disconnectedAt = get_absolute_time();
 }
 
 void MqttClient::Start()
@@ -34,8 +72,9 @@ void MqttClient::Start()
 
     _client = mqtt_client_new();
 
-    // Start the connection attemps after a few seconds...
+    // Start the connection attemps after a few seconds, or as soon as WiFi is up
     _watchdogTimer = std::make_unique<ScheduledTimer>([this]() { return MqttWatchdog(); }, 5000);
+    _wifi->SetLinkUpHandler([this]() { OnLinkUp(); });
 
 }
 
@@ -47,9 +86,70 @@ void MqttClient::DoConnect()
         return;
     }
 
+    if(_resolving)
+        // Still waiting for DNS
+        return;
+
+    _connectAttempts++;
+    auto address = BrokerAddress(_brokerIndex);
+    ip_addr_t brokerAddress;
+    // Dotted-quad addresses, and names lwIP has cached, come straight back
+    auto err = dns_gethostbyname(address, &brokerAddress, DnsFoundCallbackEntry, this);
+    if(err == ERR_OK)
+    {
+        _brokerAddress = brokerAddress;
+        _hasBrokerAddress = true;
+        Connect(&_brokerAddress);
+    }
+    else if(err == ERR_INPROGRESS)
+    {
+        DBG_PRINT("Looking up MQTT broker %s\n", address);
+        _resolving = true;
+    }
+    else
+    {
+        DBG_PRINT("Unable to look up MQTT broker %s (%d)\n", address, err);
+        ConnectLastKnown();
+    }
+}
+
+void MqttClient::DnsFoundCallback(const char *name, const ip_addr_t *address)
+{
+    _resolving = false;
+    if(strcmp(name, BrokerAddress(_brokerIndex)))
+        // We've moved on to another broker since asking
+        return;
 
+    if(address == nullptr)
+    {
+        DBG_PRINT("MQTT broker %s not found\n", name);
+        ConnectLastKnown();
+        return;
+    }
+
+    _brokerAddress = *address;
+    _hasBrokerAddress = true;
+    if(!IsConnected())
+        Connect(&_brokerAddress);
+}
+
+void MqttClient::ConnectLastKnown()
+{
+    // DNS may be down when the broker isn't, so try where it was last time
+    if(_hasBrokerAddress)
+    {
+        DBG_PUT("Using the last known MQTT broker address");
+        Connect(&_brokerAddress);
+    }
+    else
+        BrokerFailed();
+}
+
+void MqttClient::Connect(const ip_addr_t *brokerAddress)
+{
     auto mqttConfig = _config->GetMqttConfig();
-    DBG_PRINT("Connecting to MQTT server at %s:%d\n", mqttConfig->brokerAddress, mqttConfig->port);
+    auto port = BrokerPort(_brokerIndex);
+    DBG_PRINT("Connecting to MQTT server at %s:%d\n", ipaddr_ntoa(brokerAddress), port);
     mqtt_connect_client_info_t ci;
     memset(&ci, 0, sizeof(ci));
     err_t err;
@@ -64,15 +164,14 @@ void MqttClient::DoConnect()
     ci.will_topic = _statusTopic;
     ci.keep_alive = 40;
 
-    ip_addr_t brokerAddress;
-    ipaddr_aton(mqttConfig->brokerAddress, &brokerAddress);
-
-    DBG_PRINT("Addr: %08x\n", brokerAddress.addr);
+    err = mqtt_client_connect(_client, brokerAddress, port, ConnectionCallbackEntry, this, &ci);
     
-    err = mqtt_client_connect(_client, &brokerAddress, mqttConfig->port, ConnectionCallbackEntry, this, &ci);
-    
-    if(err != ERR_OK) {
+    if(err == ERR_ISCONN)
+        // Still waiting to hear how the last attempt went
+        DBG_PUT("Mqtt connection already in progress");
+    else if(err != ERR_OK) {
         DBG_PRINT("Mqtt connection failure: %d\n", err);
+        BrokerFailed();
     }    
     else
     {
@@ -86,28 +185,142 @@ uint32_t MqttClient::MqttWatchdog()
     if(!IsConnected())
     {
         DoConnect();
+        // Try again soon, backing off if the broker stays away
+        return NextRetryDelay();
     }
     else
     {
         DBG_PRINT_NA("-");
+        // In case lwIP freed up some room without telling us
+        DrainPublishQueue();
+    }
+
+    if(_queueDepth || _publishDroppedCount || _resendCount)
+        DBG_PRINT("Publish queue: %d waiting (most %d), %d in flight, %d coalesced, %d dropped, %d resent\n", _queueDepth, _queueHighWater, _inFlight, _coalescedCount, _publishDroppedCount, _resendCount);
+
+    // The steady state shouldn't need to allocate anything
+    auto allocations = GetHeapAllocationCount();
+    if(allocations != _lastAllocationCount)
+    {
+        DBG_PRINT("Heap: %d allocations in the last minute. %d bytes in use\n", allocations - _lastAllocationCount, GetHeapBytesInUse());
+        _lastAllocationCount = allocations;
     }
 
     // Restart timer
     return 60000;
 }
 
+const char *MqttClient::BrokerAddress(uint32_t index)
+{
+    auto mqttConfig = _config->GetMqttConfig();
+    return index == 0 ? mqttConfig->brokerAddress : mqttConfig->failoverAddress[index - 1];
+}
+
+uint16_t MqttClient::BrokerPort(uint32_t index)
+{
+    auto mqttConfig = _config->GetMqttConfig();
+    auto port = index == 0 ? 0 : mqttConfig->failoverPort[index - 1];
+    // Failover brokers use the main port, unless they say otherwise
+    return port ? port : mqttConfig->port;
+}
+
+void MqttClient::NextBroker()
+{
+    // Round robin over the brokers that are set up, coming back to the main one after the last
+    auto next = _brokerIndex;
+    do
+        next = (next + 1) % (1 + MQTT_FAILOVER_BROKERS);
+    while(next != 0 && !*BrokerAddress(next));
+
+    _brokerAttempts = 0;
+    if(next == _brokerIndex)
+        // Nowhere else to go
+        return;
+
+    DBG_PRINT("Giving up on MQTT broker %s, trying %s\n", BrokerAddress(_brokerIndex), BrokerAddress(next));
+    _brokerIndex = next;
+    _failoverCount++;
+    _hasBrokerAddress = false;
+    _retryDelay = MQTT_RETRY_MIN;
+}
+
+void MqttClient::BrokerFailed()
+{
+    // Move on if this broker keeps failing
+    _brokerHealth[_brokerIndex].failures++;
+    if(++_brokerAttempts >= MQTT_FAILOVER_ATTEMPTS)
+        NextBroker();
+}
+
+bool MqttClient::TakeBrokerChanged()
+{
+    auto changed = _brokerChanged;
+    _brokerChanged = false;
+    return changed;
+}
+
+uint32_t MqttClient::NextRetryDelay()
+{
+    auto delay = _retryDelay;
+    _retryDelay = std::min(_retryDelay * 2, (uint32_t)MQTT_RETRY_MAX);
+    // Add some jitter, so everything that lost the broker doesn't come back at once
+    return delay + get_rand_32() % (delay / 4 + 1);
+}
+
+void MqttClient::OnLinkUp()
+{
+    // No point waiting for the next retry now we're back on the network
+    if(!IsConnected())
+    {
+        DBG_PUT("WiFi is up. Connecting to MQTT");
+        _retryDelay = MQTT_RETRY_MIN;
+        _brokerAttempts = 0;
+        _watchdogTimer->ResetTimer(1);
+    }
+}
+
+void MqttClient::PublishConnectionStats()
+{
+    char topic[64];
+    snprintf(topic, sizeof(topic), "%s/connection", _statusTopic);
+
+    char buff[192];
+    BufferOutput payload(buff, sizeof(buff));
+    payload.Append("{\"connects\": ");
+    payload.Append((int)_connectCount);
+    payload.Append(", \"attempts\": ");
+    payload.Append((int)_lastConnectAttempts);
+    payload.Append(", \"downtime_ms\": ");
+    payload.Append((int)_lastDowntime);
+    payload.Append(", \"broker\": \"");
+    payload.Append(ipaddr_ntoa(&_brokerAddress));
+    payload.Append("\", \"broker_index\": ");
+    payload.Append((int)_brokerIndex);
+    payload.Append(", \"failovers\": ");
+    payload.Append((int)_failoverCount);
+    payload.Append(", \"broker_failures\": [");
+    for(auto a = 0; a <= MQTT_FAILOVER_BROKERS; a++)
+    {
+        if(a)
+            payload.Append(',');
+        payload.Append((int)_brokerHealth[a].failures);
+    }
+    payload.Append("]}");
+    Publish(topic, (const uint8_t *)buff, payload.BytesWritten());
+}
+
 bool MqttClient::IsConnected()
 {
     return _client && mqtt_client_is_connected(_client);
 }
 
-void MqttClient::SubscribeTopic(const char *topic)
+void MqttClient::SubscribeTopic(const char *topic, uint8_t qos)
 {
     if(!_client)
         return;
-    if(_subscribedTopics.insert(topic).second && IsConnected())
+    if(_subscribedTopics.emplace(topic, qos).second && IsConnected())
     {
-        mqtt_subscribe(_client, topic, 0, SubscriptionRequestCallbackEntry, this);
+        mqtt_subscribe(_client, topic, qos, SubscriptionRequestCallbackEntry, this);
     }
 }
 
@@ -122,34 +335,351 @@ void MqttClient::UnsubscribeTopic(const char *topic)
     }
 }
 
-void MqttClient::AddTopicCallback(const char *topic, SubscribeFunc &&callback)
+void MqttClient::AddRoute(MqttRoute *route)
 {
     if(!_client)
         return;
-    _topicCallbacks.insert({topic, callback});
+    auto &bucket = _routes[RouteBucket(route->kind, route->id, route->verb)];
+    route->next = bucket;
+    bucket = route;
 }
 
-
-void MqttClient::RemoveTopicCallback(const char *topic)
+void MqttClient::RemoveRoute(MqttRoute *route)
 {
     if(!_client)
         return;
-    _topicCallbacks.erase(topic);
+    if(&route->callback == _currentCallback)
+        _currentCallback = nullptr;
+
+    auto entry = &_routes[RouteBucket(route->kind, route->id, route->verb)];
+    while(*entry)
+    {
+        if(*entry == route)
+        {
+            *entry = route->next;
+            return;
+        }
+        entry = &(*entry)->next;
+    }
 }
 
-bool MqttClient::Publish(const char *topic, const uint8_t *payload, uint32_t length, bool retain)
+uint32_t MqttClient::RouteBucket(MqttTopicKind kind, uint32_t id, MqttTopicVerb verb)
 {
-    if(!IsConnected())
+    return (id * 8 + (uint32_t)kind * 2 + (uint32_t)verb) & (MQTT_ROUTE_BUCKETS - 1);
+}
+
+uint32_t MqttClient::GroupId(const char *name, size_t length)
+{
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    while(length--)
+        hash = (hash ^ (uint8_t)*name++) * 16777619u;
+    return hash;
+}
+
+bool MqttClient::ParseTopic(const char *topic, MqttTopicKind *kind, uint32_t *id, MqttTopicVerb *verb)
+{
+    // pico_somfy/{blinds|remotes}/{8 hex digits}/{cmd|pos}, pico_somfy/groups/{name}/{cmd|pos} or pico_somfy/all/{cmd|pos}
+    static const char root[] = "pico_somfy/";
+    if(strncmp(topic, root, sizeof(root) - 1))
+        return false;
+    topic += sizeof(root) - 1;
+
+    if(!strncmp(topic, "groups/", 7))
     {
-        DBG_PUT("Can't publish - not connected to broker");
+        // Groups are routed by a hash of their name
+        topic += 7;
+        auto end = strchr(topic, '/');
+        if(end == nullptr || end == topic)
+            return false;
+        *kind = MqttTopicKind::Group;
+        *id = GroupId(topic, end - topic);
+        topic = end;
+    }
+    else if(!strncmp(topic, "all/", 4))
+    {
+        *kind = MqttTopicKind::All;
+        *id = 0;
+        topic += 3;
+    }
+    else
+    {
+        if(!strncmp(topic, "blinds/", 7))
+        {
+            *kind = MqttTopicKind::Blind;
+            topic += 7;
+        }
+        else if(!strncmp(topic, "remotes/", 8))
+        {
+            *kind = MqttTopicKind::Remote;
+            topic += 8;
+        }
+        else
+            return false;
+
+        uint32_t value = 0;
+        for(auto a = 0; a < 8; a++)
+        {
+            auto c = *topic++;
+            if(c >= '0' && c <= '9')
+                value = (value << 4) | (c - '0');
+            else if(c >= 'a' && c <= 'f')
+                value = (value << 4) | (c - 'a' + 10);
+            else
+                return false;
+        }
+        *id = value;
+    }
+
+    if(!strcmp(topic, "/cmd"))
+        *verb = MqttTopicVerb::Command;
+    else if(!strcmp(topic, "/pos"))
+        *verb = MqttTopicVerb::Position;
+    else
         return false;
+    return true;
+}
+
+MqttRoute *MqttClient::FindRoute(const char *topic)
+{
+    MqttTopicKind kind;
+    uint32_t id;
+    MqttTopicVerb verb;
+    if(!ParseTopic(topic, &kind, &id, &verb))
+        return nullptr;
+
+    for(auto route = _routes[RouteBucket(kind, id, verb)]; route; route = route->next)
+    {
+        if(route->id == id && route->kind == kind && route->verb == verb)
+            return route;
     }
-    auto result = mqtt_publish(_client, topic, payload, length, 0, retain, PublishCallbackEntry, this);
-    if(result)
-        DBG_PRINT("Publish failed (%d)\n", result);
-    return result == ERR_OK;
+    return nullptr;
 }
 
+bool MqttClient::Publish(const char *topic, const uint8_t *payload, uint32_t length, bool retain, uint8_t qos)
+{
+    if(!_client)
+        return false;
+
+    // Send straight away if nothing is waiting ahead of us. QoS 1 messages are always queued,
+    // as they stay there until the broker acknowledges them.
+    if(_queueUsed == 0 && qos == 0 && IsConnected())
+    {
+        auto result = mqtt_publish(_client, topic, payload, length, 0, retain, PublishCallbackEntry, this);
+        if(result == ERR_OK)
+            return true;
+        if(result != ERR_MEM)
+        {
+            DBG_PRINT("Publish failed (%d)\n", result);
+            return false;
+        }
+    }
+
+    // lwIP is busy, or we're not connected. Wait for it to catch up.
+    if(!QueuePublish(topic, payload, length, retain, qos))
+    {
+        DBG_PRINT("Publish queue full. Dropped message to %s\n", topic);
+        _publishDroppedCount++;
+        return false;
+    }
+    DrainPublishQueue();
+    return true;
+}
+
+bool MqttClient::Publish(const char *topic, uint32_t length, const PayloadWriter &writer, bool retain, uint8_t qos,
+    PublishDoneFunc &&done)
+{
+    if(!_client)
+        return false;
+
+    auto doneId = done && qos ? _nextDoneId++ : 0;
+    if(!_nextDoneId)
+        _nextDoneId = 1;
+    auto payload = ReservePublish(topic, length, retain, qos, doneId);
+    if(payload == nullptr)
+    {
+        DBG_PRINT("Publish queue full. Dropped message to %s\n", topic);
+        _publishDroppedCount++;
+        return false;
+    }
+    if(doneId)
+        _publishDone.emplace(doneId, std::move(done));
+    writer(payload);
+    DrainPublishQueue();
+    return true;
+}
+
+bool MqttClient::QueuePublish(const char *topic, const uint8_t *payload, uint32_t length, bool retain, uint8_t qos)
+{
+    auto queued = ReservePublish(topic, length, retain, qos);
+    if(queued == nullptr)
+        return false;
+    memcpy(queued, payload, length);
+    return true;
+}
+
+uint8_t *MqttClient::ReservePublish(const char *topic, uint32_t length, bool retain, uint8_t qos, uint32_t doneId)
+{
+    auto topicLength = strlen(topic);
+    auto entrySize = sizeof(QueuedMessage) + topicLength + 1 + length;
+
+    // Only the latest message to a topic matters, so it replaces any that are waiting
+    auto existing = FindQueued(topic);
+    auto available = sizeof(_queue) - _queueUsed;
+    if(existing >= 0)
+        available += QueuedSize(existing);
+    if(entrySize > available || length > UINT16_MAX)
+        return nullptr;
+
+    if(existing >= 0)
+    {
+        RemoveQueued(existing);
+        _coalescedCount++;
+    }
+
+    QueuedMessage header { (uint16_t)topicLength, (uint16_t)length, retain, qos, false, 0, doneId };
+    auto entry = _queue + _queueUsed;
+    memcpy(entry, &header, sizeof(header));
+    memcpy(entry + sizeof(header), topic, topicLength + 1);
+    _queueUsed += entrySize;
+
+    _queueDepth++;
+    if(_queueDepth > _queueHighWater)
+        _queueHighWater = _queueDepth;
+
+    // The caller fills in the payload
+    return entry + sizeof(header) + topicLength + 1;
+}
+
+uint32_t MqttClient::QueuedSize(uint32_t offset)
+{
+    QueuedMessage header;
+    memcpy(&header, _queue + offset, sizeof(header));
+    return sizeof(header) + header.topicLength + 1 + header.payloadLength;
+}
+
+int MqttClient::FindQueued(const char *topic)
+{
+    for(uint32_t offset = 0; offset < _queueUsed; offset += QueuedSize(offset))
+    {
+        QueuedMessage header;
+        memcpy(&header, _queue + offset, sizeof(header));
+        // A message the broker hasn't acknowledged yet can't be replaced
+        if(!header.inFlight && !strcmp((const char *)_queue + offset + sizeof(header), topic))
+            return offset;
+    }
+    return -1;
+}
+
+int MqttClient::FindInFlight(uint32_t sequence)
+{
+    for(uint32_t offset = 0; offset < _queueUsed; offset += QueuedSize(offset))
+    {
+        QueuedMessage header;
+        memcpy(&header, _queue + offset, sizeof(header));
+        if(header.inFlight && header.sequence == sequence)
+            return offset;
+    }
+    return -1;
+}
+
+MqttClient::InFlightSlot *MqttClient::FreeInFlightSlot()
+{
+    for(auto &slot : _inFlightSlots)
+    {
+        if(!slot.sequence)
+            return &slot;
+    }
+    return nullptr;
+}
+
+void MqttClient::RemoveQueued(uint32_t offset)
+{
+    QueuedMessage header;
+    memcpy(&header, _queue + offset, sizeof(header));
+    if(header.doneId)
+        // Replaced or dropped, so it won't ever be done
+        _publishDone.erase(header.doneId);
+
+    auto entrySize = QueuedSize(offset);
+
+    // The queue is small, so shuffling the rest down is cheap enough
+    memmove(_queue + offset, _queue + offset + entrySize, _queueUsed - offset - entrySize);
+    _queueUsed -= entrySize;
+    _queueDepth--;
+}
+
+void MqttClient::DrainPublishQueue()
+{
+    uint32_t offset = 0;
+    while(offset < _queueUsed && IsConnected())
+    {
+        QueuedMessage header;
+        memcpy(&header, _queue + offset, sizeof(header));
+        if(header.inFlight)
+        {
+            offset += QueuedSize(offset);
+            continue;
+        }
+        auto slot = header.qos ? FreeInFlightSlot() : nullptr;
+        if(header.qos && (_inFlight >= MQTT_MAX_IN_FLIGHT || slot == nullptr))
+            // Wait for an acknowledgement. Later messages wait too, to keep things in order.
+            return;
+
+        auto topic = (const char *)_queue + offset + sizeof(header);
+        auto payload = _queue + offset + sizeof(header) + header.topicLength + 1;
+
+        // lwIP copies the message into its own buffer
+        if(slot)
+        {
+            slot->sequence = _nextSequence++;
+            if(!_nextSequence)
+                _nextSequence = 1;
+        }
+        auto result = header.qos ?
+            mqtt_publish(_client, topic, payload, header.payloadLength, 1, header.retain, AcknowledgedCallbackEntry, slot) :
+            mqtt_publish(_client, topic, payload, header.payloadLength, 0, header.retain, PublishCallbackEntry, this);
+        if(slot && result != ERR_OK)
+            slot->sequence = 0;
+        if(result == ERR_MEM)
+            // Wait for lwIP to send something, and call us back
+            return;
+
+        if(result == ERR_OK && header.qos)
+        {
+            // Keep it until the broker acknowledges it, in case we have to send it again
+            header.inFlight = true;
+            header.sequence = slot->sequence;
+            memcpy(_queue + offset, &header, sizeof(header));
+            offset += QueuedSize(offset);
+            _inFlight++;
+            continue;
+        }
+
+        if(result != ERR_OK)
+        {
+            DBG_PRINT("Queued publish to %s failed (%d)\n", topic, result);
+            _publishDroppedCount++;
+        }
+        RemoveQueued(offset);
+    }
+}
+
+void MqttClient::ResendInFlight()
+{
+    // lwIP forgets its requests when the connection drops, so send anything unacknowledged again
+    for(uint32_t offset = 0; offset < _queueUsed; offset += QueuedSize(offset))
+    {
+        QueuedMessage header;
+        memcpy(&header, _queue + offset, sizeof(header));
+        header.inFlight = false;
+        memcpy(_queue + offset, &header, sizeof(header));
+    }
+    _inFlight = 0;
+    // lwIP drops the requests without calling back, so the slots are all free again
+    for(auto &slot : _inFlightSlots)
+        slot.sequence = 0;
+}
 
 void MqttClient::ConnectionCallback(mqtt_connection_status_t status)
 {
@@ -157,8 +687,28 @@ void MqttClient::ConnectionCallback(mqtt_connection_status_t status)
     {
         case MQTT_CONNECT_ACCEPTED:
             DBG_PUT("Mqtt client is connected");
-            Publish(_statusTopic, (const uint8_t *)_onlinePayload, strlen(_onlinePayload));
+            _wasConnected = true;
+            _connectCount++;
+            _lastConnectAttempts = _connectAttempts;
+            _lastDowntime = absolute_time_diff_us(_disconnectedAt, get_absolute_time()) / 1000;
+            _connectAttempts = 0;
+            _retryDelay = MQTT_RETRY_MIN;
+            _brokerAttempts = 0;
+            _brokerHealth[_brokerIndex].connects++;
+            if(_brokerIndex != _connectedBroker)
+            {
+                // Subscriptions are made again below, but retained messages need to be sent to the new broker
+                DBG_PRINT("Failed over to MQTT broker %s\n", BrokerAddress(_brokerIndex));
+                _connectedBroker = _brokerIndex;
+                _brokerChanged = true;
+            }
+            _watchdogTimer->ResetTimer(60000);
+            // Say we're online before sending anything that queued up while we were away
+            if(mqtt_publish(_client, _statusTopic, _onlinePayload, strlen(_onlinePayload), 0, true, PublishCallbackEntry, this) != ERR_OK)
+                QueuePublish(_statusTopic, (const uint8_t *)_onlinePayload, strlen(_onlinePayload), true, 0);
+            DrainPublishQueue();
             DoSubscribe();
+            PublishConnectionStats();
             _statusLed->Pulse(0, 512, 64);
             // Cheat: The main loop will do a republish of anything that needs it
             return;
@@ -177,7 +727,20 @@ void MqttClient::ConnectionCallback(mqtt_connection_status_t status)
 
     }
 
+    ResendInFlight();
     _statusLed->TurnOff();
+
+    if(!_wasConnected)
+        // The attempt to connect failed, rather than an established session dropping
+        BrokerFailed();
+
+    if(_wasConnected)
+    {
+        // Lost the broker. Start retrying straight away.
+        _wasConnected = false;
+        _disconnectedAt = get_absolute_time();
+        _watchdogTimer->ResetTimer(NextRetryDelay());
+    }
 }
 
 void MqttClient::DoSubscribe()
@@ -186,10 +749,8 @@ void MqttClient::DoSubscribe()
     {
         mqtt_set_inpub_callback(_client, IncomingPublishCallbackEntry, IncomingPayloadCallbackEntry, this);
 
-        auto topic = sub.c_str();
-        mqtt_request_cb_t cb;
-        
-        mqtt_subscribe(_client, topic, 0, SubscriptionRequestCallbackEntry, this);
+        auto topic = sub.first.c_str();
+        mqtt_subscribe(_client, topic, sub.second, SubscriptionRequestCallbackEntry, this);
     }
 }
 
@@ -203,56 +764,98 @@ void MqttClient::PublishCallback(err_t result)
     _statusLed->SetLevel(2048);
     if(result)
         DBG_PRINT("Publish Error: %d\n", result);
+
+    // lwIP has sent something, so it may have room for more
+    DrainPublishQueue();
+}
+
+void MqttClient::AcknowledgedCallback(InFlightSlot *slot, err_t result)
+{
+    auto sequence = slot->sequence;
+    slot->sequence = 0;
+    // Nothing to do if the message has been sent again since
+    auto offset = sequence ? FindInFlight(sequence) : -1;
+    if(offset < 0)
+        return;
+    _inFlight--;
+
+    if(result == ERR_OK)
+    {
+        QueuedMessage header;
+        memcpy(&header, _queue + offset, sizeof(header));
+        auto done = _publishDone.find(header.doneId);
+        PublishDoneFunc callback;
+        if(done != _publishDone.end())
+            callback = std::move(done->second);
+        RemoveQueued(offset);
+        // Once it's out of the queue, in case the callback publishes something itself
+        if(callback)
+            callback();
+    }
+    else
+    {
+        DBG_PRINT("Publish was not acknowledged (%d). Sending it again\n", result);
+        QueuedMessage header;
+        memcpy(&header, _queue + offset, sizeof(header));
+        header.inFlight = false;
+        memcpy(_queue + offset, &header, sizeof(header));
+        _resendCount++;
+    }
+    DrainPublishQueue();
 }
 
 void MqttClient::IncomingPublishCallback(const char *topic, u32_t tot_len)
 {
-    auto sub = _topicCallbacks.find(topic);
-    if(sub == _topicCallbacks.end())
+    _currentCallback = nullptr;
+    _payloadLength = tot_len;
+    _payloadReceived = 0;
+    _receivedCount++;
+
+    auto route = FindRoute(topic);
+    if(route == nullptr)
     {
         DBG_PRINT("Recieved a message for %s with no subscription\n", topic);
-        if(_payload)
-        {
-            delete [] _payload;
-            _payload = nullptr;
-        }
+        _droppedCount++;
         return;
     }
 
     _statusLed->SetLevel(2048);
-    if(tot_len > 2048)
+    if(tot_len > sizeof(_payload))
     {
         DBG_PRINT("Recieved a message of %d bytes, greater than maximum buffer size\n", tot_len);
+        _droppedCount++;
         return;
     }
 
-    if(_payload)
-    {
-        DBG_PUT("Unexpected: Overwriting previous payload buffer\n");
-        delete [] _payload;
-        _payload = nullptr;
-    }
-
-    _currentTopic = sub->first;
-    _payload = new uint8_t[tot_len];
-    _payloadLength = tot_len;
-    _payloadReceived = 0;
+    _currentCallback = &route->callback;
 }
 
 void MqttClient::IncomingPayloadCallback(const u8_t *data, u16_t len, u8_t flags)
 {
-    if(_payload == nullptr)
+    if(_currentCallback == nullptr)
     {
         DBG_PRINT("Ignoring %d bytes of unexpected payload\n", len);
+        return;
     }
 
     _statusLed->SetLevel(2048);
+
+    // If the whole message arrived in one go, pass it straight to the subscriber
+    if(_payloadReceived == 0 && len == _payloadLength && (flags & MQTT_DATA_FLAG_LAST))
+    {
+        _zeroCopyCount++;
+        auto callback = _currentCallback;
+        _currentCallback = nullptr;
+        (*callback)(data, len);
+        return;
+    }
+
     auto remaining = _payloadLength - _payloadReceived;
     if(len > remaining)
     {
         DBG_PUT("Got more payload than we expected");
-        delete [] _payload;
-        _payload = nullptr;
+        _droppedCount++;
+        _currentCallback = nullptr;
         return;
     }
 
@@ -262,14 +865,14 @@ void MqttClient::IncomingPayloadCallback(const u8_t *data, u16_t len, u8_t flags
     if(flags & MQTT_DATA_FLAG_LAST)
     {
         // Call the subscriber...
-        _topicCallbacks[_currentTopic](_payload, _payloadLength);
-        delete [] _payload;
-        _payload = nullptr;
+        auto callback = _currentCallback;
+        _currentCallback = nullptr;
+        (*callback)(_payload, _payloadReceived);
     }
 }
 
 
-void MqttClient::ConnectionCallbackEntry(mqtt_client_t *client, void *arg, mqtt_connection_status_t status)
+void MqttClient::ConnectionCallbackEntry(mqtt_client_t *, void *arg, mqtt_connection_status_t status)
 {
     auto pThis = (MqttClient *)arg;
     pThis->ConnectionCallback(status);
@@ -294,8 +897,20 @@ void MqttClient::IncomingPayloadCallbackEntry(void *arg, const u8_t *data, u16_t
     pthis->IncomingPayloadCallback(data, len, flags);
 }
 
+void MqttClient::DnsFoundCallbackEntry(const char *name, const ip_addr_t *address, void *arg)
+{
+    auto pthis = (MqttClient *)arg;
+    pthis->DnsFoundCallback(name, address);
+}
+
 void MqttClient::PublishCallbackEntry(void *arg, err_t result)
 {
     auto pthis = (MqttClient *)arg;
     pthis->PublishCallback(result);
+}
+
+void MqttClient::AcknowledgedCallbackEntry(void *arg, err_t result)
+{
+    auto slot = (InFlightSlot *)arg;
+    slot->owner->AcknowledgedCallback(slot, result);
 }
\ No newline at end of file
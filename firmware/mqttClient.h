@@ -8,15 +8,68 @@
 #include <map>
 #include <set>
 #include <memory>
+#include <string>
+#include <stdio.h>
 #include "scheduler.h"
+#include "deviceConfig.h"
 
-class DeviceConfig;
 class IWifiConnection;
 struct async_context;
 class StatusLed;
 
 typedef std::function<void(const uint8_t *, uint32_t)> SubscribeFunc;
 
+/// @brief Fills in a message payload, in place
+typedef std::function<void(uint8_t *)> PayloadWriter;
+
+/// @brief Called once the broker has acknowledged a QoS 1 message
+typedef std::function<void()> PublishDoneFunc;
+
+// Largest incoming message we can handle
+#define MQTT_MAX_PAYLOAD 2048
+
+// Bytes held for messages waiting to be published, when lwIP's output buffer is full
+#define MQTT_PUBLISH_QUEUE_SIZE 4096
+
+// Most QoS 1 messages we'll have waiting for the broker to acknowledge
+#define MQTT_MAX_IN_FLIGHT 8
+
+// Connection retries start quickly, and back off to this
+#define MQTT_RETRY_MIN 1000
+#define MQTT_RETRY_MAX 60000
+
+// Failed connection attempts before moving on to the next broker
+#define MQTT_FAILOVER_ATTEMPTS 3
+
+// Routes are hashed into this many buckets. Must be a power of 2
+#define MQTT_ROUTE_BUCKETS 64
+
+/// @brief The kinds of device that have command topics: pico_somfy/{kind}/{id}/{verb}
+enum class MqttTopicKind : uint8_t
+{
+    Blind,      // blinds
+    Remote,     // remotes
+    Group,      // groups, with a name in place of the ID: pico_somfy/groups/{name}/{verb}
+    All         // all, with no ID: pico_somfy/all/{verb}
+};
+
+/// @brief The commands a device topic can take
+enum class MqttTopicVerb : uint8_t
+{
+    Command,    // cmd
+    Position    // pos
+};
+
+/// @brief Where to send messages for one device topic. Kept in the subscription that owns it, so routing doesn't allocate.
+struct MqttRoute
+{
+    MqttTopicKind kind;
+    MqttTopicVerb verb;
+    uint32_t id;
+    SubscribeFunc callback;
+    MqttRoute *next;
+};
+
 /// @brief Mqtt client that does its best to stay connected
 class MqttClient
 {
@@ -34,22 +87,94 @@ class MqttClient
 
         /// @brief Add a subscription to the client. Can be used with wildcards
         /// @param topic Topic to subscribe to, with wildcards if needed
-        void SubscribeTopic(const char *topic);
+        /// @param qos Usually 0. lwIP always connects with a clean session, so the broker doesn't keep messages for us
+        /// while we're disconnected, whatever the QoS.
+        void SubscribeTopic(const char *topic, uint8_t qos = 0);
         void UnsubscribeTopic(const char *topic);
 
-        /// @brief Add a callback when a given topic is matched. The topic (or a matching wildcard) must have been subscribed already
-        /// @param topic Topic to match (no wildcards!)
-        /// @param callback Callback to call
-        void AddTopicCallback(const char *topic, SubscribeFunc &&callback);
-        void RemoveTopicCallback(const char *topic);
+        /// @brief Add a route for messages on a device topic. The topic (or a matching wildcard) must have been subscribed already
+        /// @param route Route to add. It must stay put until removed
+        void AddRoute(MqttRoute *route);
+        void RemoveRoute(MqttRoute *route);
+
+        /// @brief The route ID for a named group
+        static uint32_t GroupId(const char *name, size_t length);
+
+        /// @brief Publish a message, or queue it until lwIP has room to send it. Queued messages survive a reconnect.
+        /// A queued message is replaced by any later one to the same topic.
+        /// With QoS 1, the message stays queued until the broker acknowledges it, and is sent again after a reconnect.
+        /// @return False if MQTT is not enabled, or the queue is full
+        bool Publish(const char *topic, const uint8_t *payload, uint32_t length, bool retain = true, uint8_t qos = 0);
+
+        /// @brief Publish a message, written straight into the publish queue, so it needs no buffer of its own
+        /// @param length Exact length of the payload
+        /// @param writer Called to fill in the payload, before this returns
+        /// @param done With QoS 1, called once the broker has the message. Not called if the message is replaced by a
+        /// later one to the same topic, or dropped.
+        bool Publish(const char *topic, uint32_t length, const PayloadWriter &writer, bool retain = true, uint8_t qos = 0,
+            PublishDoneFunc &&done = nullptr);
+
+        /// @brief Number of messages waiting to be published
+        uint32_t GetPublishQueueDepth() { return _queueDepth; }
+
+        /// @brief Most messages that have been waiting to be published at once
+        uint32_t GetPublishQueueHighWater() { return _queueHighWater; }
+
+        /// @brief Number of queued messages replaced by a later message to the same topic
+        uint32_t GetCoalescedCount() { return _coalescedCount; }
+
+        /// @brief Number of messages that could not be queued, or that lwIP rejected
+        uint32_t GetPublishDroppedCount() { return _publishDroppedCount; }
+
+        /// @brief Number of QoS 1 messages waiting for the broker to acknowledge them
+        uint32_t GetInFlightCount() { return _inFlight; }
+
+        /// @brief Number of QoS 1 messages sent again because they were not acknowledged
+        uint32_t GetResendCount() { return _resendCount; }
+
+        /// @brief Number of times we've connected to the broker
+        uint32_t GetConnectCount() { return _connectCount; }
+
+        /// @brief How long, in ms, it took to get back to the broker last time
+        uint32_t GetLastDowntime() { return _lastDowntime; }
 
-        bool Publish(const char *topic, const uint8_t *payload, uint32_t length, bool retain = true);
+        /// @brief Number of messages received
+        uint32_t GetReceivedCount() { return _receivedCount; }
+
+        /// @brief Number of messages passed straight to subscribers, without copying
+        uint32_t GetZeroCopyCount() { return _zeroCopyCount; }
+
+        /// @brief Number of messages dropped because they were too large or unexpected
+        uint32_t GetDroppedCount() { return _droppedCount; }
+
+        /// @brief Which broker we're using. 0 for the main broker, or a failover broker from 1
+        uint32_t GetBrokerIndex() { return _brokerIndex; }
+
+        /// @brief Number of times we've moved on to another broker
+        uint32_t GetFailoverCount() { return _failoverCount; }
+
+        /// @brief True once, after connecting to a different broker from last time.
+        /// The new broker won't have our retained messages, so they need publishing again.
+        bool TakeBrokerChanged();
 
     private:
         static void ConnectionCallbackEntry(mqtt_client_t *client, void *arg, mqtt_connection_status_t status);
         void ConnectionCallback(mqtt_connection_status_t status);
 
         void DoConnect();
+        void Connect(const ip_addr_t *brokerAddress);
+        void ConnectLastKnown();
+        uint32_t NextRetryDelay();
+        void OnLinkUp();
+        void PublishConnectionStats();
+
+        const char *BrokerAddress(uint32_t index);
+        uint16_t BrokerPort(uint32_t index);
+        void NextBroker();
+        void BrokerFailed();
+
+        static void DnsFoundCallbackEntry(const char *name, const ip_addr_t *address, void *arg);
+        void DnsFoundCallback(const char *name, const ip_addr_t *address);
         void DoSubscribe();
 
         uint32_t MqttWatchdog();
@@ -66,6 +191,25 @@ class MqttClient
         static void PublishCallbackEntry(void *arg, err_t result);
         void PublishCallback(err_t result);
 
+        struct InFlightSlot;
+        static void AcknowledgedCallbackEntry(void *arg, err_t result);
+        void AcknowledgedCallback(InFlightSlot *slot, err_t result);
+
+        bool QueuePublish(const char *topic, const uint8_t *payload, uint32_t length, bool retain, uint8_t qos);
+        uint8_t *ReservePublish(const char *topic, uint32_t length, bool retain, uint8_t qos, uint32_t doneId = 0);
+        uint32_t QueuedSize(uint32_t offset);
+        int FindQueued(const char *topic);
+        int FindInFlight(uint32_t sequence);
+        InFlightSlot *FreeInFlightSlot();
+        void RemoveQueued(uint32_t offset);
+        void DrainPublishQueue();
+        void ResendInFlight();
+
+
+        static bool ParseTopic(const char *topic, MqttTopicKind *kind, uint32_t *id, MqttTopicVerb *verb);
+        static uint32_t RouteBucket(MqttTopicKind kind, uint32_t id, MqttTopicVerb verb);
+        MqttRoute *FindRoute(const char *topic);
+
         StatusLed *_statusLed;
         std::unique_ptr<ScheduledTimer> _watchdogTimer;
         std::shared_ptr<IWifiConnection> _wifi;
@@ -76,13 +220,79 @@ class MqttClient
         const char *_onlinePayload;
         const char *_offlinePayload;
 
-        std::set<std::string> _subscribedTopics;
-        std::map<std::string, SubscribeFunc> _topicCallbacks;
-        std::string _currentTopic;
-        uint8_t *_payload;
+        std::map<std::string, uint8_t> _subscribedTopics;    // Topic and QoS
+        MqttRoute *_routes[MQTT_ROUTE_BUCKETS];
+
+        // Messages arrive one at a time, so one buffer is enough to reassemble them when they're fragmented
+        SubscribeFunc *_currentCallback;
         uint32_t _payloadLength;
         uint32_t _payloadReceived;
+        uint8_t _payload[MQTT_MAX_PAYLOAD];
+
+        // Messages waiting for lwIP to have room, packed in order as a QueuedMessage header, topic and payload
+        struct QueuedMessage
+        {
+            uint16_t topicLength;
+            uint16_t payloadLength;
+            bool retain;
+            uint8_t qos;
+            bool inFlight;      // Sent with QoS 1, and not acknowledged yet
+            uint32_t sequence;  // Given each time it is sent with QoS 1
+            uint32_t doneId;    // Key of its entry in _publishDone, or 0 if it has none
+        };
+        uint8_t _queue[MQTT_PUBLISH_QUEUE_SIZE];
+        uint32_t _queueUsed;
+        uint32_t _queueDepth;
+        uint32_t _queueHighWater;
+        uint32_t _coalescedCount;
+        uint32_t _publishDroppedCount;
+        uint32_t _inFlight;
+        uint32_t _resendCount;
 
+        // lwIP hands one of these back with each acknowledgement, to say which message it was for.
+        // After a timeout the message is sent again with a new sequence, so a late reply to the old one is ignored.
+        struct InFlightSlot
+        {
+            MqttClient *owner;
+            uint32_t sequence;      // Of the message waiting for this acknowledgement, or 0 if the slot is free
+        };
+        InFlightSlot _inFlightSlots[MQTT_MAX_IN_FLIGHT];
+        uint32_t _nextSequence;
+
+        // Completion callbacks of queued messages. Only the odd discovery message has one, so they're kept aside.
+        std::map<uint32_t, PublishDoneFunc> _publishDone;
+        uint32_t _nextDoneId;
+
+
+        uint32_t _receivedCount;
+        uint32_t _zeroCopyCount;
+        uint32_t _droppedCount;
+        uint32_t _lastAllocationCount;
+
+        // Connection state
+        ip_addr_t _brokerAddress;   // Where the broker was last found
+        bool _hasBrokerAddress;
+        bool _resolving;
+        bool _wasConnected;
+        uint32_t _retryDelay;
+        uint32_t _connectAttempts;
+        absolute_time_t _disconnectedAt;
+        uint32_t _connectCount;
+        uint32_t _lastConnectAttempts;
+        uint32_t _lastDowntime;
+
+        // Failover
+        struct BrokerHealth
+        {
+            uint32_t failures;          // Failed connection attempts
+            uint32_t connects;
+        };
+        BrokerHealth _brokerHealth[1 + MQTT_FAILOVER_BROKERS];
+        uint32_t _brokerIndex;
+        uint32_t _brokerAttempts;       // Failed attempts since last connected to the current broker
+        uint32_t _connectedBroker;      // The broker we were last connected to
+        uint32_t _failoverCount;
+        bool _brokerChanged;
 
 };
 
@@ -98,43 +308,39 @@ std::string string_format( const std::string& format, Args ... args )
     return std::string( buf.get(), buf.get() + size - 1 ); // We don't want the '\0' inside
 }
 
-/// @brief Helper class for managing a subscription lifetime
+/// @brief Helper class for managing the lifetime of a route for a device topic
 class MqttSubscription
 {
     public:
-        MqttSubscription(std::shared_ptr<MqttClient> client, std::string topic, SubscribeFunc &&callback, bool doSubscribe = false)
-        :   _client(client),
-             _topic(std::move(topic)),
-             _subscribed(doSubscribe)
+        MqttSubscription(std::shared_ptr<MqttClient> client, MqttTopicKind kind, uint32_t id, MqttTopicVerb verb, SubscribeFunc &&callback)
+        :   _client(std::move(client)),
+            _route({ kind, verb, id, std::forward<SubscribeFunc>(callback), nullptr })
         {
-            _client->AddTopicCallback(_topic.c_str(), std::forward<SubscribeFunc>(callback));
-            // Normally, we expect the topic would have been subscribed by wildcard
-            if(_subscribed)
-                client->SubscribeTopic(topic.c_str());
-            
+            // We expect the topic to have been subscribed by wildcard
+            _client->AddRoute(&_route);
         }
 
         MqttSubscription(MqttSubscription &&other)
         :   _client(std::move(other._client)),
-            _topic(std::move(other._topic)),
-            _subscribed(other._subscribed)
+            _route({ other._route.kind, other._route.verb, other._route.id, std::move(other._route.callback), nullptr })
         {
+            // The route is linked in by address, so it has to move too
+            if(_client)
+            {
+                _client->RemoveRoute(&other._route);
+                _client->AddRoute(&_route);
+            }
         }
 
-
         ~MqttSubscription()
         {
             if(_client)
-            {
-                if(_subscribed)
-                    _client->UnsubscribeTopic(_topic.c_str());
-                _client->RemoveTopicCallback(_topic.c_str());
-            }
+                _client->RemoveRoute(&_route);
         }
        
     private:
         MqttSubscription(const MqttSubscription &) = delete;
         std::shared_ptr<MqttClient> _client;
-        std::string _topic;
-        bool _subscribed;
+        MqttRoute _route;
 };
+
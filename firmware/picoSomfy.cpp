@@ -22,11 +22,14 @@
 #include "mqttClient.h"
 #include "blockStorage.h"
 #include "configService.h"
+#include "configSnapshot.h"
 #include "deviceConfig.h"
 #include "serviceStatus.h"
 #include "serviceControl.h"
 #include "statusLed.h"
 #include "commandQueue.h"
+#include "flashScheduler.h"
+#include "eventStream.h"
 
 // SPI Defines
 // We are going to use SPI 0, and allocate it to the following GPIO pins
@@ -46,9 +49,15 @@
 #define PIN_LED_G 12
 #define PIN_LED_B 13
 
-// How much flash memory to use to store blind/remote/wifi config. Beware changing these as it will corrupt the block storage
+// How much flash memory to use to store blind/remote/wifi config. Beware changing this as it will corrupt the block storage
 #define STORAGE_SECTORS 32
-#define STORAGE_BLOCK_SIZE 252
+// Block size used by the original fixed-block storage format. Only needed to migrate old config.
+#define STORAGE_LEGACY_BLOCK_SIZE 252
+
+// Discovery republishing carries on this soon while the MQTT queue takes messages, and backs off to the
+// longer delay while it is full
+#define REPUBLISH_INTERVAL 10
+#define REPUBLISH_QUEUE_FULL_DELAY 500
 
 // Radio hardware reset
 #define PIN_RESET_RADIO 15
@@ -155,10 +164,12 @@ int main()
     commandQueue->Start();
 
     // Store flash settings at the very top of Flash memory
-    // ALL STORED DATA WILL BE LOST IF THESE ARE CHANGED
+    // ALL STORED DATA WILL BE LOST IF THIS IS CHANGED
     const uint32_t StorageSize = STORAGE_SECTORS * FLASH_SECTOR_SIZE;
 
-    auto config = std::make_shared<DeviceConfig>(StorageSize, STORAGE_BLOCK_SIZE);
+    // Flash operations are coordinated with the radio thread, so they don't disrupt transmissions
+    auto flashScheduler = std::make_shared<FlashScheduler>(commandQueue);
+    auto config = std::make_shared<DeviceConfig>(flashScheduler, StorageSize, STORAGE_LEGACY_BLOCK_SIZE);
     auto wifiConfig = checkConfig(config, &redLed);
     if(wifiConfig == nullptr)
     {
@@ -194,6 +205,7 @@ int main()
     auto webServer = std::make_shared<WebServer>(config, wifiConnection, wifiLed);
     webServer->Start();
     auto configService = std::make_shared<ConfigService>(config, webServer, wifiScanner, service);
+    auto configSnapshot = std::make_shared<ConfigSnapshot>(config, webServer, service);
 
     if(apMode)
     {
@@ -279,26 +291,73 @@ void runServiceMode(
     mqttClient->SubscribeTopic("pico_somfy/blinds/+/cmd");
     mqttClient->SubscribeTopic("pico_somfy/blinds/+/pos");
     mqttClient->SubscribeTopic("pico_somfy/remotes/+/cmd");
-
-    auto blinds = std::make_shared<Blinds>(config, mqttClient, webServer);
-    auto remotes = std::make_shared<SomfyRemotes>(config, blinds, webServer, commandQueue, mqttClient);
+    mqttClient->SubscribeTopic("pico_somfy/groups/+/cmd");
+    mqttClient->SubscribeTopic("pico_somfy/groups/+/pos");
+    mqttClient->SubscribeTopic("pico_somfy/all/cmd");
+    mqttClient->SubscribeTopic("pico_somfy/all/pos");
+
+    auto events = std::make_shared<EventStream>(webServer);
+    auto blinds = std::make_shared<Blinds>(config, mqttClient, webServer, commandQueue, events);
+    auto remotes = std::make_shared<SomfyRemotes>(config, blinds, webServer, commandQueue, mqttClient, events);
     blinds->Initialize(remotes);
 
     ServiceStatus statusApi(webServer, mqttClient, false);
 
-    ScheduledTimer republishTimer([&blinds, &remotes] () {
-        // Try to republish discovery information for one device
+    ScheduledTimer republishTimer([&blinds, &remotes, &mqttClient] () {
+        // The main loop starts us again when MQTT reconnects
+        if(!mqttClient->IsConnected())
+            return 0;
+
+        // Republish discovery information for every device that needs it, until the MQTT publish queue is full.
         // It should be safe to access the collections from this callback.
+        auto queued = mqttClient->GetPublishQueueDepth() + mqttClient->GetCoalescedCount();
         if(remotes->TryRepublish()||
             blinds->TryRepublish())
-            // Do another later, if there is more work to be done
-            // We can't publish everything at once, as lwip needs a chance to run to clear the queues
-            return 100;
+        {
+            // Try the rest shortly, once lwIP has sent some of the queue. If nothing more went in, the queue is full,
+            // so give the broker time to acknowledge what's in flight first.
+            auto progress = mqttClient->GetPublishQueueDepth() + mqttClient->GetCoalescedCount() != queued;
+            return progress ? REPUBLISH_INTERVAL : REPUBLISH_QUEUE_FULL_DELAY;
+        }
 
         // Everything that needed to be published has been
         return 0;
     }, 0);
 
+    // Discovery is only published when it changes. This sends it all again, e.g. if the broker has lost it.
+    CgiSubscription rediscover(webServer, "/api/mqtt/rediscover.json", [&blinds, &remotes, &mqttClient, &republishTimer](const CgiParams &params) {
+        if(!mqttClient->IsEnabled())
+            return false;
+        remotes->Rediscover();
+        blinds->Rediscover();
+        if(mqttClient->IsConnected())
+            republishTimer.ResetTimer(REPUBLISH_INTERVAL);
+        return true;
+    });
+
+    // How each source of radio commands is getting on with its limits
+    RouteSubscription radioStats(webServer, "/api/radio.json", HttpGet, [&commandQueue](const WebRequest &request, WebResponse &response) {
+        static const char *const sourceNames[COMMAND_SOURCE_COUNT] = { "none", "mqtt", "web", "remote", "schedule" };
+        auto &json = response.Json();
+        json.BeginObject();
+        for(auto a = 0; a < COMMAND_SOURCE_COUNT; a++)
+        {
+            auto &stats = commandQueue->GetSourceStats((CommandSource)a);
+            json.Key(sourceNames[a]);
+            json.BeginObject();
+            json.Key("sent");
+            json.UInt(stats.sent);
+            json.Key("limited");
+            json.UInt(stats.limited);
+            json.Key("dropped");
+            json.UInt(stats.dropped);
+            json.Key("waiting");
+            json.UInt(commandQueue->GetWaitingCount((CommandSource)a));
+            json.EndObject();
+        }
+        json.EndObject();
+    });
+
     auto mqttConnected = false;
 
     auto asyncContext = cyw43_arch_async_context();
@@ -315,6 +374,12 @@ void runServiceMode(
             if(mqttClient->IsConnected())
             {
                 mqttConnected = true;
+                if(mqttClient->TakeBrokerChanged())
+                {
+                    // A failover broker won't have our retained messages
+                    blinds->Rediscover();
+                    remotes->Rediscover();
+                }
                 republishTimer.ResetTimer(250);
             }
         }
@@ -1,9 +1,11 @@
 #include "pico/stdlib.h"
 
 #ifdef NDEBUG
-#define DBG_PRINT(fmt, ...)
-#define DBG_PRINT_NA(fmt)
-#define DBG_PUT(str)
+// Compiled out, but still a statement that uses its arguments, so an if with only a debug print in it isn't left
+// empty, and values kept only to print aren't unused
+#define DBG_PRINT(fmt, ...) do { if(0) printf(fmt, __VA_ARGS__); } while(0)
+#define DBG_PRINT_NA(fmt) do { if(0) printf(fmt); } while(0)
+#define DBG_PUT(str) do { if(0) puts(str); } while(0)
 #else
 #define DBG_PRINT(fmt, ...) printf(fmt, __VA_ARGS__)
 #define DBG_PRINT_NA(fmt) printf(fmt)
@@ -222,6 +222,12 @@ uint8_t RFM69Radio::GetVersion()
     return ReadRegister(RADIO_RegVersion);
 }
 
+int RFM69Radio::GetRssi()
+{
+    // Register holds -RSSI in half dB steps
+    return -(int)ReadRegister(RADIO_RegRssiValue) / 2;
+}
+
 inline void RFM69Radio::SetMode(uint8_t mode, bool listen)
 {
     if(mode == _mode && listen == _listen)
@@ -20,6 +20,8 @@ public:
     void SetFrequency(double frequency);
     double GetFrequency();
     uint8_t GetVersion();
+    // Signal strength of the last reception in dBm
+    int GetRssi();
 
     void Reset();
     void Initialize();
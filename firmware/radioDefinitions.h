@@ -23,6 +23,7 @@
 #define RADIO_RegOokAvg  0x1c
 #define RADIO_RegOokFix  0x1d
 
+#define RADIO_RegRssiValue 0x24
 #define RADIO_RegDioMapping 0x25
 #define RADIO_RegIrqFlags 0x27
 #define RADIO_RegRssiThreshold 0x29
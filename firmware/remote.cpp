@@ -14,7 +14,17 @@
 #include "deviceConfig.h"
 #include "commandQueue.h"
 #include "blinds.h"
-#include "bufferOutput.h"
+#include "discoveryTemplate.h"
+
+// Home Assistant discovery for each button on a remote
+#define BUTTON_DISCOVERY(cmd, name) \
+    "{ \"name\": \"" name "\", \"avty_t\": \"pico_somfy/status\", \"pl_avail\": \"online\", \"pl_not_avail\": \"offline\", " \
+    "\"cmd_t\": \"pico_somfy/remotes/" DISCOVERY_ID "/cmd\", \"pl_prs\": \"" cmd "\", \"uniq_id\": \"psrem_" DISCOVERY_ID cmd "\", " \
+    "\"device\": { \"name\": \"" DISCOVERY_NAME "\", \"mdl\": \"Pico-Somfy Remote\", \"mf\": \"Bagpuss\", \"ids\": [\"psr_" DISCOVERY_ID "\"] } }"
+
+static constexpr DiscoveryTemplate upButtonDiscovery(BUTTON_DISCOVERY("up", "Up Button"));
+static constexpr DiscoveryTemplate downButtonDiscovery(BUTTON_DISCOVERY("down", "Down Button"));
+static constexpr DiscoveryTemplate stopButtonDiscovery(BUTTON_DISCOVERY("stop", "Stop Button"));
 
 SomfyRemote::SomfyRemote(
     std::shared_ptr<RadioCommandQueue> commandQueue,
@@ -37,7 +47,8 @@ SomfyRemote::SomfyRemote(
       _isDirty(false),
       _isExternal(isExternal),
       _needsPublish(false),
-      _cmdSubscription(mqttClient, string_format("pico_somfy/remotes/%08x/cmd", remoteId), [this](const uint8_t *payload, uint32_t length)
+      _forcePublish(false),
+      _cmdSubscription(mqttClient, MqttTopicKind::Remote, remoteId, MqttTopicVerb::Command, [this](const uint8_t *payload, uint32_t length)
                        { OnCommand(payload, length); }),
       _discoveryWorker([this]()
                        { PublishDiscovery(); })
@@ -69,20 +80,26 @@ void SomfyRemote::SaveConfig(bool force)
     _isDirty = false;
 }
 
-void SomfyRemote::PressButtons(SomfyButton buttons, uint16_t repeat)
+bool SomfyRemote::PressButtons(SomfyButton buttons, uint16_t repeat, CommandSource source)
 {
+    if(!_commandQueue->QueueCommand(SomfyCommand { .remoteId = _remoteId, .rollingCode = _rollingCode, .repeat = repeat, .button = buttons }, source))
+    {
+        // The blinds won't move, so leave them be
+        DBG_PRINT("Command for remote %08x wasn't sent\n", _remoteId);
+        return false;
+    }
+    _rollingCode++;
     _isDirty = true;
-    
-    _commandQueue->QueueCommand(SomfyCommand { .remoteId = _remoteId, .rollingCode = _rollingCode++, .repeat = repeat, .button = buttons });
 
     // Now tell all our connected blinds that we've sent a command
     for (auto blindId : _associatedBlinds)
     {
-        _blinds->GetBlind(blindId)->ButtonsPressed(buttons, repeat > ShortPress);
+        _blinds->GetBlind(blindId)->ButtonsPressed(buttons, repeat > ShortPress, source);
     }
+    return true;
 }
 
-void SomfyRemote::ExternalButtonPress(SomfyButton buttons, uint16_t repeat, uint16_t rollingCode)
+void SomfyRemote::ExternalButtonPress(SomfyButton buttons, uint16_t repeat, uint16_t rollingCode, int rssi)
 {
     _isDirty = true;
     _rollingCode = rollingCode + 1;
@@ -90,7 +107,7 @@ void SomfyRemote::ExternalButtonPress(SomfyButton buttons, uint16_t repeat, uint
     // Tell all connected blinds that a button on the external remote was pressed
     for (auto blindId : _associatedBlinds)
     {
-        _blinds->GetBlind(blindId)->ButtonsPressed(buttons, repeat > 7);
+        _blinds->GetBlind(blindId)->ButtonsPressed(buttons, repeat > 7, CommandSource::Remote, rssi);
     }
 }
 
@@ -116,18 +133,18 @@ void SomfyRemote::DisassociateBlind(uint16_t blindId)
 void SomfyRemote::OnCommand(const uint8_t *payload, uint32_t length)
 {
     if (length == 2 && !memcmp(payload, "up", 2))
-        PressButtons(SomfyButton::Up, ShortPress);
+        PressButtons(SomfyButton::Up, ShortPress, CommandSource::Mqtt);
     else if (length == 4 && !memcmp(payload, "down", 4))
-        PressButtons(SomfyButton::Down, ShortPress);
+        PressButtons(SomfyButton::Down, ShortPress, CommandSource::Mqtt);
     else if (length == 4 && !memcmp(payload, "stop", 4))
-        PressButtons(SomfyButton::My, ShortPress);
+        PressButtons(SomfyButton::My, ShortPress, CommandSource::Mqtt);
 }
 
-void SomfyRemote::PublishDiscovery()
+bool SomfyRemote::PublishDiscovery()
 {
     if(!_mqttClient->IsConnected())
         // We'll be called again when MQTT connects
-        return;
+        return false;
 
     DBG_PRINT("Discovery publish for remote %d (%s)\n", _remoteId, _remoteName.c_str());
     auto mqttConfig = _config->GetMqttConfig();
@@ -135,52 +152,58 @@ void SomfyRemote::PublishDiscovery()
     {
         DBG_PUT("Discovery topic not configured\n");
         _needsPublish = false;
-        return;
+        return true;
     }
     // No discovery for the primary remote for any blind
     if (_blinds->IsAPrimaryRemote(_remoteId))
     {
         DBG_PUT("Primary remote for blind not published\n");
         _needsPublish = false;
-        return;
+        return true;
+    }
+    // The messages are retained, so don't send them again if the broker already has them
+    auto name = _remoteName.c_str();
+    auto hash = upButtonDiscovery.Hash(DISCOVERY_HASH_SEED, mqttConfig->topic, _remoteId, name);
+    hash = downButtonDiscovery.Hash(hash, mqttConfig->topic, _remoteId, name);
+    hash = stopButtonDiscovery.Hash(hash, mqttConfig->topic, _remoteId, name);
+    if(!_forcePublish && hash == _config->GetRemoteDiscoveryHash(_remoteId))
+    {
+        _needsPublish = false;
+        return true;
     }
+
     DBG_PRINT("Discovery topic: %s\n", mqttConfig->topic);
 
-    if( PublishDiscovery("up", "Up Button", mqttConfig->topic) &&
-        PublishDiscovery("down", "Down Button", mqttConfig->topic) &&
-        PublishDiscovery("stop", "Stop Button", mqttConfig->topic))
+    // The hash is saved once the broker has all three, unless the remote was deleted while we waited
+    auto waiting = std::make_shared<int>(3);
+    auto done = [config = _config, remoteId = _remoteId, hash, waiting]()
     {
-        _needsPublish = false;
+        if(!--*waiting && config->GetRemoteConfig(remoteId))
+            config->SaveRemoteDiscoveryHash(remoteId, hash);
+    };
+    if( !PublishDiscovery("up", upButtonDiscovery, mqttConfig->topic, done) ||
+        !PublishDiscovery("down", downButtonDiscovery, mqttConfig->topic, done) ||
+        !PublishDiscovery("stop", stopButtonDiscovery, mqttConfig->topic, done))
+    {
+        return false;
     }
+
+    _needsPublish = false;
+    _forcePublish = false;
+    return true;
 }
 
-bool SomfyRemote::PublishDiscovery(const char *cmd, const char *name, const char *baseTopic)
+bool SomfyRemote::PublishDiscovery(const char *cmd, const DiscoveryTemplate &discovery, const char *baseTopic, PublishDoneFunc done)
 {
-
-    char payload[512];
-    BufferOutput payloadWriter(payload, sizeof(payload));
-
-    payloadWriter.Append("{ \"name\": \"");
-    payloadWriter.Append(name);
-    payloadWriter.Append(
-        "\", \"avty_t\": \"pico_somfy/status\", \"pl_avail\": \"online\", \"pl_not_avail\": \"offline\", \"cmd_t\": \"pico_somfy/remotes/");
-    payloadWriter.AppendHex(_remoteId);
-    payloadWriter.Append("/cmd\", \"pl_prs\": \"");
-    payloadWriter.Append(cmd);
-    payloadWriter.Append("\", \"uniq_id\": \"psrem_");
-    payloadWriter.AppendHex(_remoteId);
-    payloadWriter.Append(cmd);
-    payloadWriter.Append("\", \"device\": { \"name\": \"");
-
-    payloadWriter.AppendEscaped(this->_remoteName.c_str());
-    payloadWriter.Append("\", \"mdl\": \"Pico-Somfy Remote\", \"mf\": \"Bagpuss\", \"ids\": [\"psr_");
-    payloadWriter.AppendHex(_remoteId);
-    payloadWriter.Append("\"] } }");
-
     char topic[68];
     snprintf(topic, sizeof(topic), "%s/button/pico_somfy/%08x_%s/config", baseTopic, _remoteId, cmd);
     topic[67] = 0;
-    DBG_PRINT("Publishing %d bytes to %s\n", payloadWriter.BytesWritten(), topic);
 
-    return _mqttClient->Publish(topic, (uint8_t *)payload, payloadWriter.BytesWritten());
-}
\ No newline at end of file
+    auto name = _remoteName.c_str();
+    auto length = discovery.Length(name);
+    DBG_PRINT("Publishing %d bytes to %s\n", length, topic);
+
+    // QoS 1, so it is sent again after a reconnect until the broker has it
+    return _mqttClient->Publish(topic, length, [this, &discovery, name](uint8_t *payload) { discovery.Write(payload, _remoteId, name); }, true, 1,
+        std::move(done));
+}
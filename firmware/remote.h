@@ -19,12 +19,23 @@ enum SomfyButton : int
     SunDetectorOff = Up | Prog
 };
 
+/// @brief Where the last command to move a blind came from
+enum class CommandSource : uint8_t
+{
+    None,
+    Mqtt,       // An MQTT command topic
+    Web,        // The web interface or HTTP API
+    Remote,     // A physical remote, picked up by the radio
+    Schedule    // The firmware itself, e.g. stopping a blind at the position it was sent to
+};
+
 const int ShortPress = 3;
 const int LongPress = 12;
 
 class Blinds;
 class RemoteConfig;
 class DeviceConfig;
+class DiscoveryTemplate;
 
 class SomfyRemote
 {
@@ -57,15 +68,24 @@ public:
     void SaveConfig(bool force = false);
 
     // Press buttons on the controller. Note that buttons can be chorded.
-    void PressButtons(SomfyButton buttons, uint16_t repeat);
-    void ExternalButtonPress(SomfyButton buttons, uint16_t repeat, uint16_t rollingCode);
+    // Returns false if the command couldn't be queued, e.g. the source is sending too many.
+    bool PressButtons(SomfyButton buttons, uint16_t repeat, CommandSource source);
+    void ExternalButtonPress(SomfyButton buttons, uint16_t repeat, uint16_t rollingCode, int rssi);
 
     bool IsExternal() { return _isExternal; }
     bool NeedsPublish() { return _needsPublish; }
-    void TriggerPublishDiscovery() {
+
+    /// @brief Publish the Home Assistant discovery messages for the buttons
+    /// @return False if they couldn't all be sent, and need trying again
+    bool PublishDiscovery();
+
+    /// @brief Publish discovery info soon, if it has changed since it was last published
+    /// @param force Publish it even if it hasn't changed
+    void TriggerPublishDiscovery(bool force = false) {
         if(_mqttClient->IsEnabled() && !_isExternal)
         {
             _needsPublish = true;
+            _forcePublish |= force;
             _discoveryWorker.ScheduleWork();
         }
     }
@@ -73,8 +93,7 @@ public:
 
 private:
     void OnCommand(const uint8_t *payload, uint32_t length);
-    void PublishDiscovery();
-    bool PublishDiscovery(const char *cmd, const char *name, const char *baseTopic);
+    bool PublishDiscovery(const char *cmd, const DiscoveryTemplate &discovery, const char *baseTopic, PublishDoneFunc done);
 
     std::shared_ptr<RadioCommandQueue> _commandQueue;
     std::shared_ptr<Blinds> _blinds;
@@ -86,6 +105,7 @@ private:
     bool _isDirty;      // Does need save?
     bool _isExternal;   // Is this a clone of a real remote?
     bool _needsPublish;
+    bool _forcePublish; // Publish discovery even if it hasn't changed
     std::vector<uint16_t> _associatedBlinds;
 
     MqttSubscription _cmdSubscription;
@@ -6,7 +6,8 @@
 #include "remotes.h"
 #include "deviceConfig.h"
 #include "blinds.h"
-#include "bufferOutput.h"
+#include "eventStream.h"
+#include "jsonWriter.h"
 
 const uint32_t BaseRemoteId = 0x270000;
 
@@ -15,23 +16,25 @@ SomfyRemotes::SomfyRemotes(
     std::shared_ptr<Blinds> blinds,
     std::shared_ptr<WebServer> webServer,
     std::shared_ptr<RadioCommandQueue> commandQueue,
-    std::shared_ptr<MqttClient> mqttClient)
+    std::shared_ptr<MqttClient> mqttClient,
+    std::shared_ptr<EventStream> events)
 :   _config(std::move(config)),
     _blinds(std::move(blinds)),
     _commandQueue(std::move(commandQueue)),
     _mqttClient(mqttClient),
+    _events(std::move(events)),
+    _listCursor(_remotes),
     _saveTimer([this]() { SaveRemoteState(); return SAVE_DELAY; }, SAVE_DELAY)    // Potentially save every two minutes, to avoid writing rolling code changes too often when lots of presses happen
 {
 
-    uint32_t count;
-    const uint16_t *remoteIds = _config->GetRemoteIds(&count);
+    auto remoteIds = _config->GetRemoteIds();
 
-    DBG_PRINT("There are %d remotes registered\n", count);
+    DBG_PRINT("There are %d remotes registered\n", remoteIds.size());
 
     _nextId = BaseRemoteId + 1;
-    for(auto a = 0; a < count; a++)
+    for(auto remoteId : remoteIds)
     {
-        auto id = remoteIds[a] | BaseRemoteId;
+        auto id = remoteId | BaseRemoteId;
         if(id >= _nextId)
             _nextId = id + 1;
         auto cfg = _config->GetRemoteConfig(id);
@@ -47,11 +50,10 @@ SomfyRemotes::SomfyRemotes(
         }
     }
 
-    const uint32_t *externalRemtoeIds = _config->GetExternalRemoteIds(&count);
-    DBG_PRINT("There are %d external remotes registered\n", count);
-    for(auto a = 0; a < count; a++)
+    auto externalRemoteIds = _config->GetExternalRemoteIds();
+    DBG_PRINT("There are %d external remotes registered\n", externalRemoteIds.size());
+    for(auto id : externalRemoteIds)
     {
-        auto id = externalRemtoeIds[a];
         auto cfg = _config->GetRemoteConfig(id);
         if(cfg)
         {
@@ -72,7 +74,7 @@ SomfyRemotes::SomfyRemotes(
     _webApi.push_back(CgiSubscription(webServer, "/api/remotes/delete.json", [this](const CgiParams &params) { return DoDeleteRemote(GetRemoteParam(params), params); }));
     _webApi.push_back(CgiSubscription(webServer, "/api/remotes/bindBlind.json", [this](const CgiParams &params) { return DoAddOrRemoveBlindToRemote(GetRemoteParam(params), params, &SomfyRemote::AssociateBlind); }));
     _webApi.push_back(CgiSubscription(webServer, "/api/remotes/unbindBlind.json", [this](const CgiParams &params) { return DoAddOrRemoveBlindToRemote(GetRemoteParam(params), params, &SomfyRemote::DisassociateBlind); }));
-    _webApi.push_back(CgiSubscription(webServer, "/api/remotes/command.json", [this](const CgiParams &params) { return DoButtonPress(GetRemoteParam(params), params); }));
+    _webRoutes.push_back(RouteSubscription(webServer, "/api/remotes/command.json", HttpGet | HttpPost, [this](const WebRequest &request, WebResponse &response) { DoButtonPress(request, response); }));
     _webApi.push_back(CgiSubscription(webServer, "/api/remotes/discover.json", [this](const CgiParams &params) { return StartDiscovery(); }));
 
     _webData.push_back(SsiSubscription(webServer, "remotes", [this](char *buffer, int len, uint16_t tagPart, uint16_t *nextPart) { return GetRemotesResponse(buffer, len, tagPart, nextPart); }));
@@ -94,6 +96,7 @@ std::shared_ptr<SomfyRemote> SomfyRemotes::CreateRemote(std::string remoteName)
     auto id = _nextId++;
     auto newRemote = std::make_shared<SomfyRemote>(_commandQueue, _blinds, _config, _mqttClient, remoteName, id, 1, std::vector<uint16_t>(), false);
     _remotes.insert({id, newRemote});
+    _listCursor.Reset();
     newRemote->SaveConfig(true);
 
     SaveRemoteList();
@@ -102,6 +105,7 @@ std::shared_ptr<SomfyRemote> SomfyRemotes::CreateRemote(std::string remoteName)
 
 void SomfyRemotes::DeleteRemote(uint32_t remoteId)
 {
+    _listCursor.Reset();
     _remotes.erase(remoteId);
     _config->DeleteRemoteConfig(remoteId);
     SaveRemoteList();
@@ -111,17 +115,23 @@ bool SomfyRemotes::TryRepublish()
 {
     for(auto iter = _remotes.begin(); iter != _remotes.end(); iter++)
     {
-        if(iter->second->NeedsPublish())
-        {
-            iter->second->TriggerPublishDiscovery();
+        // Publish as many as the MQTT queue will take
+        if(iter->second->NeedsPublish() && !iter->second->PublishDiscovery())
             return true;
-        }
     }
 
     // No remotes needed publishing
     return false;
 }
 
+void SomfyRemotes::Rediscover()
+{
+    for(auto iter = _remotes.begin(); iter != _remotes.end(); iter++)
+    {
+        iter->second->TriggerPublishDiscovery(true);
+    }
+}
+
 void SomfyRemotes::SaveRemoteState()
 {
     for(auto iter = _remotes.begin(); iter != _remotes.end(); iter++)
@@ -142,7 +152,22 @@ void SomfyRemotes::ExternalButtonPress(SomfyCommand command)
     }
     else
     {
-        entry->second->ExternalButtonPress(command.button, command.repeat, command.rollingCode);
+        entry->second->ExternalButtonPress(command.button, command.repeat, command.rollingCode, command.rssi);
+    }
+
+    if(_events->HasClients())
+    {
+        char buff[64];
+        JsonWriter event(buff, sizeof(buff));
+        event.BeginObject();
+        event.Key("id");
+        event.UInt(command.remoteId);
+        event.Key("buttons");
+        event.UInt(command.button);
+        event.Key("known");
+        event.Bool(entry != _remotes.end());
+        event.EndObject();
+        _events->Publish("remote", buff, event.BytesWritten());
     }
 
 }
@@ -150,34 +175,30 @@ void SomfyRemotes::ExternalButtonPress(SomfyCommand command)
 void SomfyRemotes::SaveRemoteList()
 {
     {
-        uint16_t ids[128];
-        uint16_t *idoff = ids;
+        std::vector<uint16_t> ids;
         for(auto iter = _remotes.begin(); iter != _remotes.end(); iter++)
         {
             if(!iter->second->IsExternal())
-                *idoff++ = iter->first & 0xFFFF;
+                ids.push_back(iter->first & 0xFFFF);
         }
-        _config->SaveRemoteIds(ids, idoff - ids);
+        _config->SaveRemoteIds(ids.data(), ids.size());
     }
 
     {
-        uint32_t ids[64];
-        uint32_t *idoff = ids;
+        std::vector<uint32_t> ids;
         for(auto iter = _remotes.begin(); iter != _remotes.end(); iter++)
         {
             if(iter->second->IsExternal())
-                *idoff++ = iter->first;
+                ids.push_back(iter->first);
         }
-        _config->SaveExternalRemoteIds(ids, idoff - ids);
+        _config->SaveExternalRemoteIds(ids.data(), ids.size());
     }
 }
 
 std::shared_ptr<SomfyRemote> SomfyRemotes::GetRemoteParam(const CgiParams &params)
 {
-    auto idparam = params.find("id");
     uint32_t id;
-    if(idparam == params.end() ||
-        !sscanf(idparam->second.c_str(), "%u", &id))
+    if(!params.GetUInt("id", id))
     {
         DBG_PUT("Invalid command: Bad id parameter\n");
         return nullptr;
@@ -192,38 +213,37 @@ std::shared_ptr<SomfyRemote> SomfyRemotes::GetRemoteParam(const CgiParams &param
     return entry->second;
 }
 
-bool SomfyRemotes::DoAddRemote(const CgiParams &params)
+// Names are written into JSON and saved in a fixed size config field
+static bool GetNameParam(const CgiParams &params, char *name)
 {
-    auto nameparam = params.find("name");
-    if(nameparam == params.end() ||
-        !nameparam->second.length() ||
-        nameparam->second.length() + 1 > sizeof(RemoteConfig::remoteName) ||
-        nameparam->second.find('\"') != std::string::npos)
+    if(!params.GetString("name", name, sizeof(RemoteConfig::remoteName)) ||
+        !*name ||
+        strchr(name, '\"'))
     {
         DBG_PUT("Bad name parameter\n");
         return false;
     }
+    return true;
+}
 
-    CreateRemote(nameparam->second);
+bool SomfyRemotes::DoAddRemote(const CgiParams &params)
+{
+    char name[sizeof(RemoteConfig::remoteName)];
+    if(!GetNameParam(params, name))
+        return false;
+
+    CreateRemote(name);
     return true;
 }
 
 bool SomfyRemotes::DoImportRemote(const CgiParams &params)
 {
-    auto nameparam = params.find("name");
-    if(nameparam == params.end() ||
-        !nameparam->second.length() ||
-        nameparam->second.length() + 1 > sizeof(RemoteConfig::remoteName) ||
-        nameparam->second.find('\"') != std::string::npos)
-    {
-        DBG_PUT("Bad name parameter\n");
+    char name[sizeof(RemoteConfig::remoteName)];
+    if(!GetNameParam(params, name))
         return false;
-    }
 
-    auto idparam = params.find("id");
     uint32_t id;
-    if(idparam == params.end() ||
-        !sscanf(idparam->second.c_str(), "%u", &id))
+    if(!params.GetUInt("id", id))
     {
         DBG_PUT("Invalid command: Bad id parameter\n");
         return false;
@@ -236,8 +256,9 @@ bool SomfyRemotes::DoImportRemote(const CgiParams &params)
     }
 
     DBG_PRINT("Importing new remote with id %08x\n", _nextId);
-    auto newRemote = std::make_shared<SomfyRemote>(_commandQueue, _blinds, _config, _mqttClient, nameparam->second, id, 1, std::vector<uint16_t>(), true);
+    auto newRemote = std::make_shared<SomfyRemote>(_commandQueue, _blinds, _config, _mqttClient, name, id, 1, std::vector<uint16_t>(), true);
     _remotes.insert({id, newRemote});
+    _listCursor.Reset();
     newRemote->SaveConfig(true);
     SaveRemoteList();
     return true;
@@ -248,22 +269,19 @@ bool SomfyRemotes::DoUpdateRemote(std::shared_ptr<SomfyRemote> remote, const Cgi
     if(!remote)
         return false;
 
-    auto nameparam = params.find("name");
-    if(nameparam == params.end() ||
-        !nameparam->second.length() ||
-        nameparam->second.length() + 1 > sizeof(RemoteConfig::remoteName) ||
-        nameparam->second.find('\"') != std::string::npos)
-    {
-        DBG_PUT("Bad name parameter\n");
+    char name[sizeof(RemoteConfig::remoteName)];
+    if(!GetNameParam(params, name))
         return false;
-    }
 
-    remote->SetName( nameparam->second);
+    remote->SetName(name);
     return true;
 }
 
 bool SomfyRemotes::DoDeleteRemote(std::shared_ptr<SomfyRemote> remote, const CgiParams &params)
 {
+    if(!remote)
+        return false;
+
     // Can't remove the primary remote for any blind - we should remove the blind instead
     auto remoteId = remote->GetRemoteId();
     if(_blinds->IsAPrimaryRemote(remoteId))
@@ -279,10 +297,8 @@ bool SomfyRemotes::DoAddOrRemoveBlindToRemote(std::shared_ptr<SomfyRemote> remot
     if(!remote)
         return false;
 
-    auto idparam = params.find("blindId");
     uint16_t id;
-    if(idparam == params.end() ||
-        !sscanf(idparam->second.c_str(), "%hu", &id))
+    if(!params.GetUInt("blindId", id, UINT16_MAX))
     {
         DBG_PUT("Invalid command: Bad blindId parameter\n");
         return false;
@@ -298,23 +314,39 @@ bool SomfyRemotes::DoAddOrRemoveBlindToRemote(std::shared_ptr<SomfyRemote> remot
     return true;
 }
 
-bool SomfyRemotes::DoButtonPress(std::shared_ptr<SomfyRemote> remote, const CgiParams &params)
+void SomfyRemotes::DoButtonPress(const WebRequest &request, WebResponse &response)
 {
-    if(!remote)
-        return false;
+    int32_t id;
+    int32_t buttons;
+    if(!request.GetInt("id", id) || !request.GetInt("buttons", buttons))
+    {
+        response.Error(400, "Needs id and buttons");
+        return;
+    }
+    // Optional, a short press if it isn't there
+    auto longPress = false;
+    if(request.Has("long") && !request.GetBool("long", longPress))
+    {
+        response.Error(400, "long must be true or false");
+        return;
+    }
 
-    auto buttonParam = params.find("buttons");
-    SomfyButton buttons;
-    if(buttonParam == params.end() ||
-        !sscanf(buttonParam->second.c_str(), "%d", &buttons))
+    auto remote = _remotes.find(id);
+    if(remote == _remotes.end())
     {
-        DBG_PUT("Invalid command: Bad buttons parameter\n");
+        response.Error(404, "No such remote");
+        return;
     }
-    auto longParam = params.find("long");
-    auto longPress = (longParam != params.end() && longParam->second == "true");
 
-    remote->PressButtons(buttons, longPress ? LongPress : ShortPress);
-    return true;
+    uint32_t retryAfterMs;
+    if(!_commandQueue->CanQueue(CommandSource::Web, 1, &retryAfterMs))
+    {
+        response.Busy(retryAfterMs);
+        return;
+    }
+
+    if(!remote->second->PressButtons((SomfyButton)buttons, longPress ? LongPress : ShortPress, CommandSource::Web))
+        response.Error(503, "The radio queue is full");
 }
 
 bool SomfyRemotes::StartDiscovery()
@@ -325,58 +357,30 @@ bool SomfyRemotes::StartDiscovery()
 
 uint16_t SomfyRemotes::GetRemotesResponse(char *pcInsert, int iInsertLen, uint16_t tagPart, uint16_t *nextPart)
 {
-    // This data structure is a poor choice for this API
-    auto pos = _remotes.begin();
-    for(auto a = 0; a < tagPart; a++)
+    // Carry on from the last part, rather than walking the map again
+    return _listCursor.Write(pcInsert, iInsertLen, tagPart, nextPart, [](JsonWriter &writer, decltype(_remotes)::iterator pos)
     {
-        pos++;
-    }
-
-    if(pos == _remotes.end())
-        return 0;
-
-    BufferOutput outputter(pcInsert, iInsertLen);
-    outputter.Append("{ \"id\": ");
-    outputter.Append((int)pos->first);
-    outputter.Append(", \"name\": \"");
-    outputter.Append(pos->second->GetName());
-    outputter.Append("\", \"blinds\": [");
-
-    bool first = true;
-    for(auto blindId :pos->second->GetAssociatedBlinds())
-    {
-        if(first)
-            first = false;
-        else
-            outputter.Append(',');
-        outputter.Append(blindId);
-    }
-    outputter.Append("],\"external\":");
-    outputter.Append(pos->second->IsExternal()?"true":"false");
-
-    pos++;
-    if(pos != _remotes.end())
-    {
-        outputter.Append(" },");
-        *nextPart = tagPart + 1;
-    }
-    else
-        outputter.Append(" }");
-    
-    return outputter.BytesWritten();
+        writer.BeginObject();
+        writer.Key("id");
+        writer.UInt(pos->first);
+        writer.Key("name");
+        writer.String(pos->second->GetName());
+        writer.Key("blinds");
+        writer.BeginArray();
+        for(auto blindId : pos->second->GetAssociatedBlinds())
+            writer.UInt(blindId);
+        writer.EndArray();
+        writer.Key("external");
+        writer.Bool(pos->second->IsExternal());
+        writer.EndObject();
+    });
 }
 
 uint16_t SomfyRemotes::GetDiscoveryResponse(char *pcInsert, int iInsertLen, uint16_t tagPart, uint16_t *nextPart)
 {
-    BufferOutput outputter(pcInsert, iInsertLen);
-    bool first = true;
+    // Only a few remotes are remembered, so they always fit
+    JsonWriter writer(pcInsert, iInsertLen);
     for(auto iter = _detectedRemotes.begin(); iter != _detectedRemotes.end(); iter++)
-    {
-        if(first)
-            first = false;
-        else
-            outputter.Append(',');
-        outputter.Append((int)(*iter));
-    }
-    return outputter.BytesWritten();
+        writer.UInt(*iter);
+    return writer.BytesWritten();
 }
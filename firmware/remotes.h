@@ -7,6 +7,7 @@
 #include <list>
 #include <memory>
 #include <map>
+#include "listCursor.h"
 #include "webServer.h"
 #include "scheduler.h"
 #include "commandQueue.h"
@@ -15,6 +16,7 @@ class DeviceConfig;
 class RadioCommandQueue;
 class Blinds;
 class MqttClient;
+class EventStream;
 
 class SomfyRemotes
 {
@@ -24,7 +26,8 @@ class SomfyRemotes
             std::shared_ptr<Blinds> blinds,
             std::shared_ptr<WebServer> webServer,
             std::shared_ptr<RadioCommandQueue> commandQueue,
-            std::shared_ptr<MqttClient> mqttClient);
+            std::shared_ptr<MqttClient> mqttClient,
+            std::shared_ptr<EventStream> events);
 
         std::shared_ptr<SomfyRemote> GetRemote(uint32_t remoteId);
         std::shared_ptr<SomfyRemote> CreateRemote(std::string remoteName);
@@ -33,6 +36,9 @@ class SomfyRemotes
         /// @brief Publish discovery info for any devices that need to, now that Mqtt is connected
         /// @return True if there is more work to be done
         bool TryRepublish();
+
+        /// @brief Publish discovery info for every device, whether or not it has changed
+        void Rediscover();
         void SaveRemoteState();
 
         void ExternalButtonPress(SomfyCommand command);
@@ -48,7 +54,7 @@ class SomfyRemotes
         bool DoUpdateRemote(std::shared_ptr<SomfyRemote> remote, const CgiParams &params);
         bool DoDeleteRemote(std::shared_ptr<SomfyRemote> remote, const CgiParams &params);
         bool DoAddOrRemoveBlindToRemote(std::shared_ptr<SomfyRemote> remote, const CgiParams &params, blindAssocFunc assocFunc);
-        bool DoButtonPress(std::shared_ptr<SomfyRemote> remote, const CgiParams &params);
+        void DoButtonPress(const WebRequest &request, WebResponse &response);
         bool StartDiscovery();
 
         uint16_t GetRemotesResponse(char *pcInsert, int iInsertLen, uint16_t tagPart, uint16_t *nextPart);
@@ -58,12 +64,15 @@ class SomfyRemotes
         std::shared_ptr<Blinds> _blinds;
         std::shared_ptr<RadioCommandQueue> _commandQueue;
         std::shared_ptr<MqttClient> _mqttClient;
+        std::shared_ptr<EventStream> _events;
         std::map<uint32_t, std::shared_ptr<SomfyRemote>> _remotes;
+        ListCursor<std::map<uint32_t, std::shared_ptr<SomfyRemote>>> _listCursor;     // For GetRemotesResponse. Shared by every connection.
         std::list<uint32_t> _detectedRemotes;
 
         uint32_t _nextId;
 
         std::list<CgiSubscription> _webApi;
+        std::list<RouteSubscription> _webRoutes;
         std::list<SsiSubscription> _webData;
         ScheduledTimer _saveTimer;
 };
@@ -0,0 +1,129 @@
+#!/usr/bin/env python3
+# Copyright (c) 2023 Mark Godwin.
+# SPDX-License-Identifier: MIT
+"""Save, restore, decode and compare config snapshots from a pico_somfy device.
+
+    snapshot.py export <device> <file> [secrets]
+                                            Save the device config to a file. The WiFi and MQTT passwords are
+                                            left blank, unless "secrets" is given.
+    snapshot.py import <device> <file>      Replace the device config from a file. The device restarts.
+    snapshot.py decode <file>               List the records in a snapshot
+    snapshot.py diff <file1> <file2>        Show the records that differ between two snapshots
+"""
+
+import json
+import struct
+import sys
+import urllib.request
+import zlib
+
+# Record IDs, as used by deviceConfig.cpp
+RECORD_TYPES = [
+    (0xFFFFFFFF, 0x19841986, "blind list"),
+    (0xFFFFFFFF, 0x19841987, "remote list"),
+    (0xFFFFFFFF, 0x19841990, "external remote list"),
+    (0xFFFFFFFF, 0x19841991, "wifi"),
+    (0xFFFFFFFF, 0x19841992, "mqtt"),
+    (0xFFFF0000, 0x19870000, "blind"),
+    (0xFFFF0000, 0x19880000, "remote"),
+    (0xFFFF0000, 0x19890000, "blind discovery hash"),
+    (0xFFFF0000, 0x198A0000, "remote discovery hash"),
+    (0xFFFFFFFF, 0x19841984, "wifi (unversioned)"),
+    (0xFFFFFFFF, 0x19841985, "mqtt (unversioned)"),
+    (0xFFFF0000, 0x19850000, "blind (unversioned)"),
+    (0xFFFF0000, 0x19860000, "remote (unversioned)"),
+]
+
+CHUNK_SIZE = 128
+
+
+def record_name(record_id):
+    for mask, magic, name in RECORD_TYPES:
+        if record_id & mask == magic:
+            if mask != 0xFFFFFFFF:
+                return "%s %d" % (name, record_id & ~mask)
+            return name
+    return "unknown"
+
+
+def parse(snapshot):
+    """Returns the records in a snapshot as a dict of ID to data, checking it is intact"""
+    stream = bytearray()
+    records = {}
+    for entry in snapshot["records"]:
+        entry = bytes.fromhex(entry)
+        record_id, length = struct.unpack_from("<IH", entry)
+        data = entry[6:6 + length]
+        (crc,) = struct.unpack_from("<I", entry, 6 + length)
+        if len(entry) != 10 + length or crc != zlib.crc32(entry[:6 + length]):
+            raise ValueError("Record %08x is corrupt" % record_id)
+        records[record_id] = data
+        stream += entry
+    if len(records) != snapshot["count"] or zlib.crc32(stream) != int(snapshot["crc"], 16):
+        raise ValueError("Snapshot is incomplete")
+    return records
+
+
+def load(path):
+    with open(path) as f:
+        return json.load(f)
+
+
+def request(device, path):
+    with urllib.request.urlopen("http://%s%s" % (device, path)) as response:
+        return json.loads(response.read())
+
+
+def export_snapshot(device, path, secrets=None):
+    if secrets not in (None, "secrets"):
+        raise ValueError("Expected \"secrets\", not \"%s\"" % secrets)
+    snapshot = request(device, "/api/snapshot/export.json" + ("?secrets=1" if secrets else ""))
+    parse(snapshot)
+    with open(path, "w") as f:
+        json.dump(snapshot, f, indent=1)
+    print("Saved %d records%s" % (snapshot["count"], "" if secrets else ", without the WiFi and MQTT passwords"))
+
+
+def import_snapshot(device, path):
+    snapshot = load(path)
+    parse(snapshot)
+    stream = "".join(snapshot["records"])
+    if not request(device, "/api/snapshot/import.json?op=begin"):
+        raise RuntimeError("Device refused to start the import")
+    for offset in range(0, len(stream), CHUNK_SIZE * 2):
+        chunk = stream[offset:offset + CHUNK_SIZE * 2]
+        if not request(device, "/api/snapshot/import.json?op=data&offset=%d&data=%s" % (offset // 2, chunk)):
+            raise RuntimeError("Device rejected the data at offset %d" % (offset // 2))
+    if not request(device, "/api/snapshot/import.json?op=commit&count=%d&crc=%s" % (snapshot["count"], snapshot["crc"])):
+        raise RuntimeError("Device failed to commit the import")
+    print("Imported %d records. The device is restarting." % snapshot["count"])
+
+
+def decode(path):
+    for record_id, data in sorted(parse(load(path)).items()):
+        print("%08x  %-24s %4d bytes  %s" % (record_id, record_name(record_id), len(data), data.hex()))
+
+
+def diff(path1, path2):
+    left = parse(load(path1))
+    right = parse(load(path2))
+    for record_id in sorted(set(left) | set(right)):
+        name = record_name(record_id)
+        if record_id not in right:
+            print("- %08x  %s" % (record_id, name))
+        elif record_id not in left:
+            print("+ %08x  %s" % (record_id, name))
+        elif left[record_id] != right[record_id]:
+            print("~ %08x  %s" % (record_id, name))
+            a, b = left[record_id], right[record_id]
+            for offset in range(0, max(len(a), len(b)), 16):
+                if a[offset:offset + 16] != b[offset:offset + 16]:
+                    print("    %04x  %-32s  %s" % (offset, a[offset:offset + 16].hex(), b[offset:offset + 16].hex()))
+
+
+if __name__ == "__main__":
+    commands = {"export": export_snapshot, "import": import_snapshot, "decode": decode, "diff": diff}
+    if len(sys.argv) < 2 or sys.argv[1] not in commands:
+        print(__doc__)
+        sys.exit(1)
+    commands[sys.argv[1]](*sys.argv[2:])
@@ -0,0 +1,136 @@
+// Copyright (c) 2023 Mark Godwin.
+// SPDX-License-Identifier: MIT
+
+#include "picoSomfy.h"
+#include "webMetrics.h"
+#include "webServer.h"
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+
+static const char metricsHeaders[] =
+    "HTTP/1.0 200 OK\r\n"
+    "Content-Type: text/plain\r\n"
+    "Cache-Control: no-store\r\n"
+    "\r\n";
+static const char metricsColumns[] =
+    "# url requests errors ssiBytes ssiChunks"
+    " handlerUs:100,1000,10000,100000,1000000,more"
+    " renderUs:100,1000,10000,100000,1000000,more"
+    " chunks:1,4,16,64,256,more\n";
+
+static void AddToHistogram(uint32_t *histogram, uint32_t value, uint32_t firstBound, uint32_t scale)
+{
+    auto bucket = 0;
+    for(auto bound = firstBound; bucket < WEB_METRICS_BUCKETS - 1 && value > bound; bound *= scale)
+        bucket++;
+    histogram[bucket]++;
+}
+
+void WebMetrics::Entry::RecordHandler(uint32_t us, bool failed)
+{
+    AddToHistogram(handlerTime, us, 100, 10);
+    if(failed)
+        errors++;
+}
+
+void WebMetrics::Entry::RecordResponse(uint32_t ssiBytes, uint32_t ssiChunks, uint32_t renderUs)
+{
+    requests++;
+    if(!ssiChunks)
+        return;
+    this->ssiBytes += ssiBytes;
+    this->ssiChunks += ssiChunks;
+    AddToHistogram(renderTime, renderUs, 100, 10);
+    AddToHistogram(chunksPerResponse, ssiChunks, 1, 4);
+}
+
+/// @brief Writes the entries out a line at a time, as httpd asks for them
+class WebMetrics::Stream : public WebStream
+{
+    public:
+        Stream(WebMetrics *owner)
+        :   _owner(owner),
+            _pos(owner->_entries.begin()),
+            _headersSent(false),
+            _lineLength(0),
+            _lineSent(0)
+        {
+        }
+
+        virtual int Read(char *buffer, int count)
+        {
+            auto read = 0;
+            while(read < count)
+            {
+                if(_lineSent == _lineLength && !NextLine())
+                    break;
+                auto chunk = std::min<int>(count - read, _lineLength - _lineSent);
+                memcpy(buffer + read, _line + _lineSent, chunk);
+                read += chunk;
+                _lineSent += chunk;
+            }
+            return read ? read : -1;
+        }
+
+    private:
+        bool NextLine()
+        {
+            _lineSent = 0;
+            if(!_headersSent)
+            {
+                _headersSent = true;
+                _lineLength = snprintf(_line, sizeof(_line), "%s# uptimeMs %u\n%s",
+                    metricsHeaders, to_ms_since_boot(get_absolute_time()), metricsColumns);
+            }
+            else if(_pos != _owner->_entries.end())
+            {
+                // Entries are never removed, so the iterator stays good while more are added
+                auto &entry = _pos->second;
+                _lineLength = snprintf(_line, sizeof(_line), "%.63s %u %u %u %u", _pos->first.c_str(),
+                    entry.requests, entry.errors, entry.ssiBytes, entry.ssiChunks);
+                for(auto histogram : { entry.handlerTime, entry.renderTime, entry.chunksPerResponse })
+                {
+                    for(auto a = 0; a < WEB_METRICS_BUCKETS; a++)
+                        _lineLength += snprintf(_line + _lineLength, sizeof(_line) - _lineLength, " %u", histogram[a]);
+                }
+                _lineLength += snprintf(_line + _lineLength, sizeof(_line) - _lineLength, "\n");
+                _pos++;
+            }
+            else
+                _lineLength = 0;
+
+            if(_lineLength >= (int)sizeof(_line))
+                _lineLength = sizeof(_line) - 1;
+            return _lineLength > 0;
+        }
+
+        WebMetrics *_owner;
+        std::map<std::string, Entry, std::less<>>::iterator _pos;
+        bool _headersSent;
+        char _line[320];
+        int _lineLength;
+        int _lineSent;
+};
+
+WebMetrics::WebMetrics()
+:   _other(&_entries["*"])
+{
+}
+
+WebMetrics::Entry *WebMetrics::Find(const char *url)
+{
+    auto entry = _entries.find(url);
+    if(entry != _entries.end())
+        return &entry->second;
+    if(_entries.size() >= WEB_METRICS_MAX_URLS)
+        return _other;
+
+    // Starts at zero
+    return &_entries[url];
+}
+
+WebStream *WebMetrics::OpenStream()
+{
+    return new Stream(this);
+}
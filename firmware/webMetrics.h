@@ -0,0 +1,52 @@
+// Copyright (c) 2023 Mark Godwin.
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <stdint.h>
+#include <map>
+#include <string>
+
+class WebStream;
+
+// Buckets in each histogram. Times are bucketed by powers of 10 from 100us, chunk counts by powers of 4 from 1.
+// The last bucket has no upper bound.
+#define WEB_METRICS_BUCKETS 6
+// Most urls counted separately. Any more are counted together under "*".
+#define WEB_METRICS_MAX_URLS 40
+
+/// @brief Counts requests to each url of the web server, and how long their handlers and SSI tags took.
+/// @remarks Recording is a few adds into a fixed entry per url, found once as the request starts, so it costs
+/// next to nothing. The counts are read as text from /api/metrics.
+class WebMetrics
+{
+    public:
+        struct Entry
+        {
+            uint32_t requests;
+            uint32_t errors;            // CGI handlers that failed, or routes that answered with an error status
+            uint32_t ssiBytes;          // Written by SSI tag handlers
+            uint32_t ssiChunks;         // SSI tag handler calls
+            uint32_t handlerTime[WEB_METRICS_BUCKETS];      // CGI handler or route, in us
+            uint32_t renderTime[WEB_METRICS_BUCKETS];       // All the SSI tag handlers of one response, in us
+            uint32_t chunksPerResponse[WEB_METRICS_BUCKETS];
+
+            void RecordHandler(uint32_t us, bool failed);
+            /// @brief Count a finished request, with what its SSI tags wrote if it has any
+            void RecordResponse(uint32_t ssiBytes, uint32_t ssiChunks, uint32_t renderUs);
+        };
+
+        WebMetrics();
+
+        /// @brief Entry for a url, added if it hasn't been seen before
+        Entry *Find(const char *url);
+
+        /// @brief Text response with all the counts, one line per url
+        WebStream *OpenStream();
+
+    private:
+        class Stream;
+
+        std::map<std::string, Entry, std::less<>> _entries;
+        Entry *_other;
+};
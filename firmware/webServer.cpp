@@ -5,10 +5,16 @@
 #include "pico/cyw43_arch.h"
 #include "pico/flash.h"
 #include "lwip/apps/httpd.h"
+#include "lwip/apps/fs.h"
+#include "lwip/pbuf.h"
+#include "lwip/tcp.h"
 #include <map>
+#include <stdarg.h>
 #include <string>
+#include <strings.h>
 
 #include "webServer.h"
+#include "inflater.h"
 #include "deviceConfig.h"
 #include "serviceControl.h"
 #include "statusLed.h"
@@ -17,17 +23,318 @@
 // HTTPD callbacks aren't conducive to multiple instances
 WebServer *_globalInstance;
 
+// httpd sends the answer to a POST by opening a file, so the waiting response is opened by this name
+static const char postResponseUri[] = "/api/_response";
+static const char metricsUri[] = "/api/metrics";
+
 WebServer::WebServer(std::shared_ptr<DeviceConfig> config, std::shared_ptr<IWifiConnection> wifiConnection, StatusLed *statusLed)
 :   _config(std::move(config)),
     _wifiConnection(std::move(wifiConnection)),
-    _statusLed(statusLed)
+    _statusLed(statusLed),
+    _postResponse(nullptr),
+    _checkingFile(false)
 {
     _globalInstance = this;
+    for(auto &post : _posts)
+        post.connection = nullptr;
+}
+
+// Longest ETag or Accept-Encoding value kept from a request
+#define WEB_HEADER_VALUE_SIZE 64
+
+// Headers of the GET request httpd is about to handle, which it doesn't pass on itself
+static struct
+{
+    bool seen;
+    bool acceptsDeflate;
+    char ifNoneMatch[WEB_HEADER_VALUE_SIZE];
+} _requestHeaders;
+
+// True if the request header at offset has this name. Header names are matched in any case.
+static bool HeaderNameIs(struct pbuf *p, uint16_t offset, const char *name, uint16_t length)
+{
+    for(uint16_t a = 0; a < length; a++)
+    {
+        if(tolower(pbuf_get_at(p, offset + a)) != tolower(name[a]))
+            return false;
+    }
+    return pbuf_get_at(p, offset + length) == ':';
+}
+
+// Copy out the value of a header, if it is before the end of the headers
+static bool FindHeader(struct pbuf *p, uint16_t headerEnd, const char *name, char *value)
+{
+    auto length = strlen(name);
+    // Each line after the request line, up to the blank line at the end
+    for(auto line = pbuf_memfind(p, "\r\n", 2, 0); line < headerEnd; line = pbuf_memfind(p, "\r\n", 2, line + 2))
+    {
+        uint16_t at = line + 2;
+        if(!HeaderNameIs(p, at, name, length))
+            continue;
+
+        // Past the colon and any space before the value
+        at += length + 1;
+        while(pbuf_get_at(p, at) == ' ' || pbuf_get_at(p, at) == '\t')
+            at++;
+        auto end = pbuf_memfind(p, "\r\n", 2, at);
+        auto count = std::min<uint16_t>(end - at, WEB_HEADER_VALUE_SIZE - 1);
+        pbuf_copy_partial(p, value, count, at);
+        while(count && (value[count - 1] == ' ' || value[count - 1] == '\t'))
+            count--;
+        value[count] = 0;
+        return true;
+    }
+    return false;
 }
 
+// True if an Accept-Encoding list takes a coding, either by name or as *, without q=0 turning it down
+static bool AcceptsCoding(const char *list, const char *coding)
+{
+    auto codingLength = strlen(coding);
+    for(auto item = list; *item; )
+    {
+        item += strspn(item, " \t,");
+        auto length = strcspn(item, " \t,;");
+        auto matches = (length == codingLength && !strncasecmp(item, coding, length)) || (length == 1 && *item == '*');
+
+        // Any parameters, of which only q matters
+        auto end = item + strcspn(item, ",");
+        auto q = (const char *)memchr(item, ';', end - item);
+        auto refused = false;
+        if(q)
+        {
+            q += 1 + strspn(q + 1, " \t");
+            refused = (*q == 'q' || *q == 'Q') && q[1] == '=' && strtod(q + 2, nullptr) == 0;
+        }
+        if(matches)
+            return !refused;
+        item = end;
+    }
+    return false;
+}
+
+// True if an If-None-Match list has the file's tag in it. GET compares tags weakly, so a W/ on either is ignored.
+static bool MatchesETag(const char *list, const char *etag, uint32_t etagLength)
+{
+    if(etagLength > 2 && !memcmp(etag, "W/", 2))
+    {
+        etag += 2;
+        etagLength -= 2;
+    }
+
+    for(auto item = list; *item; )
+    {
+        item += strspn(item, " \t,");
+        if(*item == '*')
+            return true;
+        if(!strncmp(item, "W/", 2))
+            item += 2;
+        // Each tag is quoted, and can't have a quote in it
+        auto end = *item == '\"' ? strchr(item + 1, '\"') : nullptr;
+        if(!end)
+            return false;
+        end++;
+        if((uint32_t)(end - item) == etagLength && !memcmp(item, etag, etagLength))
+            return true;
+        item = end;
+    }
+    return false;
+}
+
+extern "C" err_t web_server_tcp_input_hook(struct tcp_pcb *pcb, struct pbuf *p)
+{
+    if(pcb->local_port != HTTPD_SERVER_PORT || !p->tot_len)
+        return ERR_OK;
+
+    // httpd reads the request as part of handling this segment, straight after this. A request that takes more
+    // than one segment isn't looked at, and is just sent the file.
+    _requestHeaders.seen = false;
+    if(p->tot_len < 4 || pbuf_memcmp(p, 0, "GET ", 4))
+        return ERR_OK;
+    auto headerEnd = pbuf_memfind(p, "\r\n\r\n", 4, 0);
+    if(headerEnd == 0xFFFF)
+        return ERR_OK;
+
+    char accept[WEB_HEADER_VALUE_SIZE];
+    _requestHeaders.seen = true;
+    _requestHeaders.acceptsDeflate = FindHeader(p, headerEnd, "Accept-Encoding", accept) &&
+        AcceptsCoding(accept, "deflate");
+    if(!FindHeader(p, headerEnd, "If-None-Match", _requestHeaders.ifNoneMatch))
+        *_requestHeaders.ifNoneMatch = 0;
+    return ERR_OK;
+}
+
+// Find a header in a file's headers, and give the length of its value
+static const char *FileHeader(const char *headers, uint32_t length, const char *name, uint32_t *valueLength)
+{
+    auto nameLength = strlen(name);
+    for(auto line = headers; line < headers + length; )
+    {
+        auto end = (const char *)memchr(line, '\r', headers + length - line);
+        if(!end || end == line)
+            break;
+        if(end - line > nameLength && !memcmp(line, name, nameLength))
+        {
+            *valueLength = end - line - nameLength;
+            return line + nameLength;
+        }
+        line = end + 2;
+    }
+    return nullptr;
+}
+
+/// @brief 304 answer to a conditional request
+class WebServer::NotModified : public WebStream
+{
+    public:
+        NotModified(const char *etag, uint32_t etagLength, const char *cacheControl, uint32_t cacheControlLength)
+        :   _sent(0)
+        {
+            _length = snprintf(_header, sizeof(_header), "HTTP/1.1 304 Not Modified\r\nETag: %.*s\r\nCache-Control: %.*s\r\n\r\n",
+                (int)etagLength, etag, (int)cacheControlLength, cacheControl);
+            if(_length >= sizeof(_header))
+                _length = sizeof(_header) - 1;
+        }
+
+        virtual int Read(char *buffer, int count)
+        {
+            if(_sent == _length)
+                return -1;
+            auto chunk = std::min<int>(count, _length - _sent);
+            memcpy(buffer, _header + _sent, chunk);
+            _sent += chunk;
+            return chunk;
+        }
+
+        // A 304 never has a body
+        virtual bool IsPersistent() const { return true; }
+
+    private:
+        char _header[160];
+        int _length;
+        int _sent;
+};
+
+/// @brief A deflate encoded file, decompressed as it is sent, for a client that doesn't accept deflate
+/// @remarks Files are only held compressed. The window can be up to 32KB, so only one is sent at a time.
+class WebServer::InflatedFile : public WebStream
+{
+    public:
+        static bool IsBusy() { return _open; }
+
+        /// @param headerLength To the end of the last header line
+        InflatedFile(const char *headers, uint32_t headerLength, const char *body, uint32_t bodyLength, uint32_t windowSize)
+        :   _window(new uint8_t[windowSize]),
+            _inflater((const uint8_t *)body, bodyLength, _window, windowSize),
+            _headerLength(0),
+            _sent(0)
+        {
+            _open = true;
+
+            // The file's headers, less the encoding and length that were for the compressed bytes. The ETag is
+            // weakened, as these aren't the same bytes. The response then ends when the connection closes.
+            for(auto line = headers; line < headers + headerLength; )
+            {
+                auto end = (const char *)memchr(line, '\r', headers + headerLength - line) + 2;
+                if(!strncmp(line, "ETag: ", 6))
+                    Append("ETag: W/%.*s", (int)(end - line - 6), line + 6);
+                else if(strncmp(line, "Content-Encoding: ", 18) && strncmp(line, "Content-Length: ", 16))
+                    Append("%.*s", (int)(end - line), line);
+                line = end;
+            }
+            Append("Connection: close\r\n\r\n");
+        }
+
+        virtual ~InflatedFile()
+        {
+            delete[] _window;
+            _open = false;
+        }
+
+        virtual int Read(char *buffer, int count)
+        {
+            if(_sent < _headerLength)
+            {
+                auto chunk = std::min<int>(count, _headerLength - _sent);
+                memcpy(buffer, _header + _sent, chunk);
+                _sent += chunk;
+                return chunk;
+            }
+
+            // The whole file is there, so there is always more to send until it ends
+            auto read = _inflater.Read((uint8_t *)buffer, count);
+            if(read < 0)
+                DBG_PUT("Couldn't decompress a file");
+            return read > 0 ? read : -1;
+        }
+
+    private:
+        void Append(const char *format, ...)
+        {
+            va_list args;
+            va_start(args, format);
+            auto length = vsnprintf(_header + _headerLength, sizeof(_header) - _headerLength, format, args);
+            va_end(args);
+            _headerLength = std::min<int>(_headerLength + length, sizeof(_header) - 1);
+        }
+
+        static bool _open;
+
+        uint8_t *_window;
+        Inflater _inflater;
+        char _header[256];
+        int _headerLength;
+        int _sent;
+};
+
+bool WebServer::InflatedFile::_open = false;
+
+/// @brief GET request for a route, called once httpd has the query string
+class WebServer::RouteCall : public WebResponse
+{
+    public:
+        RouteCall(WebServer *server, const Route &route)
+        :   _server(server),
+            _route(route),
+            _called(false)
+        {
+        }
+
+        virtual void SetParameters(int count, char **names, char **values)
+        {
+            for(auto a = 0; a < count; a++)
+                CgiParams::UrlDecode(values[a]);
+            Call(count, names, values);
+        }
+
+        virtual int Read(char *buffer, int count)
+        {
+            // No query string
+            if(!_called)
+                Call(0, nullptr, nullptr);
+            return WebResponse::Read(buffer, count);
+        }
+
+    private:
+        void Call(int count, char **names, char **values)
+        {
+            _called = true;
+            WebRequest request(HttpGet, CgiParams(count, names, values), JsonValue());
+            _server->CallRoute(_route, request, *this);
+        }
+
+        WebServer *_server;
+        const Route &_route;
+        bool _called;
+};
+
 struct CgiContext {
     WebServer *pThis;
     bool result;
+    WebMetrics::Entry *metrics;
+    uint32_t ssiBytes;
+    uint32_t ssiChunks;
+    uint32_t renderUs;
 };
 
 extern "C" {
@@ -36,7 +343,16 @@ extern "C" {
                                 char **pcParam, char **pcValue, void *connectionState)
     {
         CgiContext *ctx = (CgiContext *)connectionState;
+        if(ctx == nullptr)
+        {
+            // Streams and routes don't get a context
+            ((WebStream *)file->pextension)->SetParameters(iNumParams, pcParam, pcValue);
+            return;
+        }
+        auto start = get_absolute_time();
         ctx->result = ctx->pThis->HandleRequest(file, uri, iNumParams, pcParam, pcValue);
+        if(ctx->metrics)
+            ctx->metrics->RecordHandler(absolute_time_diff_us(start, get_absolute_time()), !ctx->result);
     }
 
     // Called by httpd when a file is opened
@@ -46,21 +362,302 @@ extern "C" {
         auto ctx = new CgiContext;
         ctx->pThis = _globalInstance;
         ctx->result = false;
+        ctx->metrics = _globalInstance->GetFileMetrics(name);
+        ctx->ssiBytes = 0;
+        ctx->ssiChunks = 0;
+        ctx->renderUs = 0;
         return ctx;
     }
 
     // Called by httpd when a file is closed
     void fs_state_free(struct fs_file *file, void *state)
     {
-        delete (CgiContext *)state;
+        auto ctx = (CgiContext *)state;
+        if(ctx && ctx->metrics)
+            ctx->metrics->RecordResponse(ctx->ssiBytes, ctx->ssiChunks, ctx->renderUs);
+        delete ctx;
+    }
+
+    // Called as a POST request arrives, to see if it will be accepted
+    err_t httpd_post_begin(void *connection, const char *uri, const char *http_request, u16_t http_request_len, int content_len,
+                            char *response_uri, u16_t response_uri_len, u8_t *post_auto_wnd)
+    {
+        return _globalInstance->BeginPost(connection, uri, content_len, response_uri, response_uri_len) ? ERR_OK : ERR_ARG;
+    }
+
+    err_t httpd_post_receive_data(void *connection, struct pbuf *p)
+    {
+        _globalInstance->ReceivePost(connection, p);
+        pbuf_free(p);
+        return ERR_OK;
+    }
+
+    void httpd_post_finished(void *connection, char *response_uri, u16_t response_uri_len)
+    {
+        _globalInstance->FinishPost(connection, response_uri, response_uri_len);
+    }
+
+    // Called before looking for a file, to see if it's a stream or route instead
+    int fs_open_custom(struct fs_file *file, const char *name)
+    {
+        auto stream = _globalInstance->OpenStream(name);
+        if(stream == nullptr)
+            return 0;
+
+        // httpd sizes its send buffer from what's left of the file, and stops at the end. So the stream is
+        // always WEB_STREAM_READ_SIZE from the end, and finishes by returning FS_READ_EOF instead.
+        file->data = nullptr;
+        file->len = WEB_STREAM_READ_SIZE;
+        file->index = 0;
+        file->pextension = stream;
+        file->flags = FS_FILE_FLAGS_HEADER_INCLUDED;
+        if(stream->IsPersistent())
+            file->flags |= FS_FILE_FLAGS_HEADER_PERSISTENT;
+        return 1;
+    }
+
+    void fs_close_custom(struct fs_file *file)
+    {
+        delete (WebStream *)file->pextension;
+    }
+
+    u8_t fs_canread_custom(struct fs_file *file)
+    {
+        // Reads can be delayed instead
+        return 1;
+    }
+
+    u8_t fs_wait_read_custom(struct fs_file *file, fs_wait_cb callback_fn, void *callback_arg)
+    {
+        return 1;
+    }
+
+    int fs_read_async_custom(struct fs_file *file, char *buffer, int count, fs_wait_cb callback_fn, void *callback_arg)
+    {
+        return WebServer::ReadStream((WebStream *)file->pextension, buffer, count, callback_fn, callback_arg);
+    }
+}
+
+WebStream *WebServer::OpenStream(const char *url)
+{
+    // Request headers are only for the first file the request opens, not error pages or files opened to check them
+    auto checkFile = _requestHeaders.seen && !_checkingFile;
+    if(!_checkingFile)
+        _requestHeaders.seen = false;
+
+    if(_postResponse && !strcmp(url, postResponseUri))
+    {
+        auto response = _postResponse;
+        _postResponse = nullptr;
+        return response;
+    }
+
+    if(!strcmp(url, metricsUri))
+        return _metrics.OpenStream();
+
+    auto subscription = _streamSubscriptions.find(url);
+    if(subscription != _streamSubscriptions.end())
+    {
+        DBG_PRINT("Opening stream %s\n", url);
+        return subscription->second();
+    }
+
+    auto route = _routes.find(url);
+    if(route != _routes.end())
+    {
+        if(route->second.methods & HttpGet)
+            return new RouteCall(this, route->second);
+        auto response = new WebResponse();
+        response->Error(405, "Use POST");
+        return response;
+    }
+    return checkFile ? CheckFileRequest(url) : nullptr;
+}
+
+WebStream *WebServer::CheckFileRequest(const char *url)
+{
+    fs_file file;
+    _checkingFile = true;
+    auto err = fs_open(&file, url);
+    _checkingFile = false;
+    if(err != ERR_OK)
+        return nullptr;
+
+    WebStream *response = nullptr;
+    auto headerEnd = (const char *)memmem(file.data, file.len, "\r\n\r\n", 4);
+    if(headerEnd)
+    {
+        auto headerLength = headerEnd - file.data + 2;
+        uint32_t etagLength, cacheControlLength, encodingLength;
+        auto etag = FileHeader(file.data, headerLength, "ETag: ", &etagLength);
+        auto cacheControl = FileHeader(file.data, headerLength, "Cache-Control: ", &cacheControlLength);
+        auto encoding = FileHeader(file.data, headerLength, "Content-Encoding: ", &encodingLength);
+
+        // The browser already has it
+        if(etag && cacheControl && MatchesETag(_requestHeaders.ifNoneMatch, etag, etagLength))
+        {
+            response = new NotModified(etag, etagLength, cacheControl, cacheControlLength);
+        }
+        else if(encoding && !_requestHeaders.acceptsDeflate)
+        {
+            // Files are only held compressed, so decompress it as it is sent
+            auto body = headerEnd + 4;
+            auto bodyLength = file.data + file.len - body;
+            auto windowSize = Inflater::WindowSize((const uint8_t *)body, bodyLength);
+            if(!windowSize)
+            {
+                auto error = new WebResponse();
+                error->Error(406, "This needs a browser that accepts deflate encoding");
+                response = error;
+            }
+            else if(InflatedFile::IsBusy())
+            {
+                auto error = new WebResponse();
+                error->Error(503, "Already decompressing a file for another browser, try again");
+                response = error;
+            }
+            else
+                response = new InflatedFile(file.data, headerLength, body, bodyLength, windowSize);
+        }
+    }
+    fs_close(&file);
+
+    // Answered without opening the file, so it is counted here instead
+    if(response)
+        _metrics.Find(url)->RecordResponse(0, 0, 0);
+    return response;
+}
+
+bool WebServer::BeginPost(void *connection, const char *uri, int contentLength, char *responseUri, uint16_t responseUriLength)
+{
+    // The query string is still on the end of the uri, and isn't used
+    std::string_view path(uri, strcspn(uri, "?"));
+    DBG_PRINT("POST %.*s, %d bytes\n", (int)path.length(), path.data(), contentLength);
+
+    auto reject = [this, responseUri, responseUriLength](uint16_t status, const char *message)
+    {
+        auto response = new WebResponse();
+        response->Error(status, message);
+        SetPostResponse(response, responseUri, responseUriLength);
+        return false;
+    };
+
+    auto route = _routes.find(path);
+    if(route == _routes.end())
+        return reject(404, "No such API");
+    if(!(route->second.methods & HttpPost))
+        return reject(405, "Use GET");
+    if(contentLength < 0 || contentLength > WEB_POST_BODY_SIZE)
+        return reject(413, "Request body too long");
+
+    for(auto &post : _posts)
+    {
+        if(!post.connection)
+        {
+            post.connection = connection;
+            post.route = &route->second;
+            post.length = contentLength;
+            post.received = 0;
+            return true;
+        }
+    }
+    return reject(503, "Too many requests at once");
+}
+
+void WebServer::ReceivePost(void *connection, struct pbuf *p)
+{
+    for(auto &post : _posts)
+    {
+        if(post.connection == connection)
+        {
+            // Straight from the pbufs into the body
+            auto space = post.length - post.received;
+            post.received += pbuf_copy_partial(p, post.body + post.received, std::min<uint32_t>(p->tot_len, space), 0);
+            return;
+        }
+    }
+}
+
+void WebServer::FinishPost(void *connection, char *responseUri, uint16_t responseUriLength)
+{
+    for(auto &post : _posts)
+    {
+        if(post.connection != connection)
+            continue;
+
+        post.connection = nullptr;
+        // httpd also calls this if the connection closes part way through the body, and there's nobody to answer
+        if(post.received < post.length)
+            return;
+
+        auto response = new WebResponse();
+        auto body = JsonValue::Parse(post.body, post.received);
+        if(post.received && !body.IsValid())
+            response->Error(400, "Body isn't valid JSON");
+        else
+        {
+            WebRequest request(HttpPost, CgiParams(0, nullptr, nullptr), body);
+            CallRoute(*post.route, request, *response);
+        }
+        SetPostResponse(response, responseUri, responseUriLength);
+        return;
+    }
+}
+
+void WebServer::SetPostResponse(WebResponse *response, char *responseUri, uint16_t responseUriLength)
+{
+    // httpd opens it straight away, so there's only ever one waiting
+    delete _postResponse;
+    _postResponse = response;
+    strlcpy(responseUri, postResponseUri, responseUriLength);
+}
+
+void WebServer::CallRoute(const Route &route, const WebRequest &request, WebResponse &response)
+{
+    _statusLed->SetLevel(2048);
+    auto start = get_absolute_time();
+    route.handler(request, response);
+    if(response.Json().IsFull())
+        response.Error(500, "Response too long");
+    else if(!response.Json().BytesWritten())
+        // Nothing else to say
+        response.Json().Bool(true);
+
+    route.metrics->RecordHandler(absolute_time_diff_us(start, get_absolute_time()), response.GetStatus() >= 400);
+    route.metrics->RecordResponse(0, 0, 0);
+}
+
+WebMetrics::Entry *WebServer::GetFileMetrics(const char *name)
+{
+    // Files opened to check their headers are part of another request
+    return _checkingFile ? nullptr : _metrics.Find(name);
+}
+
+int WebServer::ReadStream(WebStream *stream, char *buffer, int count, void (*wakeCallback)(void *), void *wakeArg)
+{
+    auto read = stream->Read(buffer, count);
+    if(read < 0)
+        return FS_READ_EOF;
+    if(read == 0)
+    {
+        // httpd will wait until the stream wakes it up
+        stream->_wakeCallback = wakeCallback;
+        stream->_wakeArg = wakeArg;
+        return FS_READ_DELAYED;
     }
+    return read;
 }
 
 
  uint16_t WebServer::HandleResponseEntry(const char *tag, char *pcInsert, int iInsertLen, uint16_t tagPart, uint16_t *nextPart, void *connectionState)
  {
     auto ctx = (CgiContext *)connectionState;
-    return ctx->pThis->HandleResponse(tag, pcInsert, iInsertLen, tagPart, nextPart, ctx->result);
+    auto start = get_absolute_time();
+    auto written = ctx->pThis->HandleResponse(tag, pcInsert, iInsertLen, tagPart, nextPart, ctx->result);
+    ctx->renderUs += absolute_time_diff_us(start, get_absolute_time());
+    ctx->ssiBytes += written;
+    ctx->ssiChunks++;
+    return written;
  }
 
  uint16_t WebServer::HandleResponse(const char *tag, char *pcInsert, int iInsertLen, uint16_t tagPart, uint16_t *nextPart, bool cgiResult)
@@ -98,70 +695,18 @@ void WebServer::Start()
 
 }
 
-char hexToInt(char x)
-{
-    if(x >= '0' && x <= '9')
-        return x - '0';
-    if(x >= 'a' && x <= 'f')
-        return x + 10 - 'a';
-    if(x >= 'A' && x <= 'F')
-        return x + 10 - 'A';
-    return -1;
-}
-
-// World's worst urlDecode:
-std::string urlDecode(const char *value)
-{
-    auto len = 0;
-    auto decode = false;
-    auto off = value;
-    while(auto chr = *off++)
-    {
-        decode |= chr == '+' || chr == '%';
-        len++;
-    }
-    if(!decode)
-        return value;
-
-    std::string result;
-    result.resize(len);
-    auto buf = result.data();
-    auto outLen = 0;
-    while(auto chr = *value++)
-    {
-        if(chr == '+')
-            *buf++ = ' ';
-        else if(chr == '%')
-        {
-            auto n1 = *value++;
-            if(!n1)
-                break;
-            auto n2 = *value++;
-            if(!n2)
-                break;
-            *buf++ = (hexToInt(n1) << 4) | hexToInt(n2);
-        }
-        else
-            *buf++ = chr;
-
-        outLen++;
-    }
-    result.resize(outLen);
-    return result;
-}
-
 bool WebServer::HandleRequest(fs_file *file, const char *uri, int iNumParams, char **pcParam, char **pcValue)
 {
     _statusLed->SetLevel(2048);
     DBG_PRINT("CGI executed: %s\n", uri);
 
-    std::map<std::string, std::string> params;
+    // httpd has already split the query string up in its own buffer, so the values are decoded there too
     for(auto a = 0; a < iNumParams; a++)
     {
-        auto val = urlDecode(pcValue[a]);
-        DBG_PRINT("    %s = %s\n", pcParam[a], val.c_str());
-        params[pcParam[a]] = val;
+        CgiParams::UrlDecode(pcValue[a]);
+        DBG_PRINT("    %s = %s\n", pcParam[a], pcValue[a]);
     }
+    CgiParams params(iNumParams, pcParam, pcValue);
 
     auto kvp = _requestSubscriptions.find(uri);
     if(kvp != _requestSubscriptions.end())
@@ -195,3 +740,122 @@ void WebServer::RemoveResponseHandler(std::string tag)
 {
     _responseSubscriptions.erase(tag);
 }
+
+void WebServer::AddRoute(std::string url, uint8_t methods, RouteFunc &&callback)
+{
+    auto metrics = _metrics.Find(url.c_str());
+    _routes.insert({ url, Route { methods, callback, metrics }});
+}
+
+void WebServer::RemoveRoute(std::string url)
+{
+    _routes.erase(url);
+}
+
+void WebServer::AddStreamHandler(std::string url, StreamOpenFunc &&callback)
+{
+    _streamSubscriptions.insert({ url, callback});
+}
+
+void WebServer::RemoveStreamHandler(std::string url)
+{
+    _streamSubscriptions.erase(url);
+}
+
+static const char *StatusText(uint16_t status)
+{
+    switch(status)
+    {
+        case 200: return "OK";
+        case 201: return "Created";
+        case 304: return "Not Modified";
+        case 400: return "Bad Request";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 406: return "Not Acceptable";
+        case 409: return "Conflict";
+        case 413: return "Payload Too Large";
+        case 429: return "Too Many Requests";
+        case 503: return "Service Unavailable";
+        default: return status < 400 ? "OK" : "Error";
+    }
+}
+
+bool WebRequest::GetString(const char *name, char *buffer, uint32_t size) const
+{
+    auto param = _params.Get(name);
+    if(param)
+        return strlcpy(buffer, param, size) < size;
+    return _body[name].GetString(buffer, size);
+}
+
+bool WebRequest::GetInt(const char *name, int32_t &value) const
+{
+    auto param = _params.Get(name);
+    if(param)
+        return JsonValue::ParseInt(param, param + strlen(param), value);
+    return _body[name].GetInt(value);
+}
+
+bool WebRequest::GetBool(const char *name, bool &value) const
+{
+    if(_params.Has(name))
+        return _params.GetBool(name, value);
+    return _body[name].GetBool(value);
+}
+
+void WebResponse::Error(uint16_t status, const char *message)
+{
+    DBG_PRINT("Web request failed, %d: %s\n", status, message);
+    _status = status;
+    _json = JsonWriter(_body, sizeof(_body));
+    _json.BeginObject();
+    _json.Key("error");
+    _json.String(message);
+    _json.EndObject();
+}
+
+void WebResponse::Busy(uint32_t retryAfterMs)
+{
+    DBG_PRINT("Web request turned away, try again in %dms\n", retryAfterMs);
+    _status = 429;
+    // The header is in whole seconds
+    _retryAfter = (retryAfterMs + 999) / 1000;
+    _json = JsonWriter(_body, sizeof(_body));
+    _json.BeginObject();
+    _json.Key("error");
+    _json.String("Too many commands, try again later");
+    _json.Key("retryAfterMs");
+    _json.UInt(retryAfterMs);
+    _json.EndObject();
+}
+
+int WebResponse::Read(char *buffer, int count)
+{
+    if(!_headerLength)
+    {
+        char retryAfter[32] = "";
+        if(_retryAfter)
+            snprintf(retryAfter, sizeof(retryAfter), "Retry-After: %u\r\n", _retryAfter);
+        _headerLength = snprintf(_header, sizeof(_header),
+            "HTTP/1.1 %d %s\r\nContent-Type: application/json\r\nContent-Length: %d\r\nCache-Control: no-store\r\n%s\r\n",
+            _status, StatusText(_status), _json.BytesWritten(), retryAfter);
+    }
+
+    // The headers, then the body
+    uint32_t total = _headerLength + _json.BytesWritten();
+    if(_sent >= total)
+        return -1;
+
+    int read = 0;
+    while(read < count && _sent < total)
+    {
+        auto from = _sent < _headerLength ? _header + _sent : _body + _sent - _headerLength;
+        auto left = _sent < _headerLength ? _headerLength - _sent : total - _sent;
+        auto chunk = std::min<uint32_t>(left, count - read);
+        memcpy(buffer + read, from, chunk);
+        read += chunk;
+        _sent += chunk;
+    }
+    return read;
+}
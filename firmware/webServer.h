@@ -9,17 +9,149 @@
 #include <functional>
 #include <map>
 #include <string.h>
+#include <string_view>
+#include "cgiParams.h"
+#include "jsonReader.h"
+#include "jsonWriter.h"
+#include "webMetrics.h"
 
 class DeviceConfig;
 class ServiceControl;
 class IWifiConnection;
 class StatusLed;
 
-typedef std::map<std::string, std::string> CgiParams;
 typedef std::function<bool(const CgiParams &)> CgiSubscribeFunc;
 
 typedef std::function<uint16_t(char *buffer, int len, uint16_t tagPart, uint16_t *nextPart)> SsiSubscribeFunc;
 
+class WebStream;
+typedef std::function<WebStream *()> StreamOpenFunc;
+
+// Most a stream is asked for at once, which is also the size of the send buffer httpd allocates for it
+#define WEB_STREAM_READ_SIZE 512
+
+/// @brief A response written as it goes, rather than served from a file, for long lived responses like event streams.
+/// @remarks The output must start with the HTTP headers. The web server deletes the stream when the connection closes.
+class WebStream
+{
+    public:
+        virtual ~WebStream() {}
+
+        /// @brief Copy out whatever is ready to send
+        /// @return Bytes copied, 0 if nothing is ready yet, or -1 once the response is finished
+        virtual int Read(char *buffer, int count) = 0;
+
+        /// @brief Called with the query string parameters, if there are any, before the first Read
+        virtual void SetParameters(int count, char **names, char **values) {}
+
+        /// @brief True if the headers say where the response ends (Content-Length, or no body), so the connection
+        /// can be kept open for the client's next request. Otherwise it is closed once the stream finishes.
+        virtual bool IsPersistent() const { return false; }
+
+    protected:
+        /// @brief Tell the web server there is more to send, after Read returned 0
+        void Wake()
+        {
+            auto callback = _wakeCallback;
+            _wakeCallback = nullptr;
+            if(callback)
+                callback(_wakeArg);
+        }
+
+    private:
+        friend class WebServer;
+        void (*_wakeCallback)(void *) = nullptr;
+        void *_wakeArg = nullptr;
+};
+
+enum HttpMethod : uint8_t
+{
+    HttpGet = 1,
+    HttpPost = 2
+};
+
+// Largest POST body a route takes, and how many can be arriving at once
+#define WEB_POST_BODY_SIZE 1024
+#define WEB_MAX_POSTS 2
+// Largest response body a route can write
+#define WEB_RESPONSE_SIZE 512
+
+/// @brief Request passed to a route. Parameters come from the query string, or the members of a JSON object body.
+/// @remarks Everything points into httpd's buffers, so is only valid for the call to the route.
+class WebRequest
+{
+    public:
+        WebRequest(HttpMethod method, const CgiParams &params, JsonValue body)
+        :   _method(method),
+            _params(params),
+            _body(body)
+        {
+        }
+
+        HttpMethod GetMethod() const { return _method; }
+        const CgiParams &GetParams() const { return _params; }
+        const JsonValue &GetBody() const { return _body; }
+
+        bool Has(const char *name) const { return _params.Has(name) || _body[name].IsValid(); }
+
+        /// @brief Copy a parameter into a buffer
+        /// @return False if it is missing, or doesn't fit
+        bool GetString(const char *name, char *buffer, uint32_t size) const;
+        /// @brief Read a whole number parameter
+        /// @return False if it is missing, or isn't a number
+        bool GetInt(const char *name, int32_t &value) const;
+        /// @brief Read a true/false parameter
+        /// @return False if it is missing, or isn't either
+        bool GetBool(const char *name, bool &value) const;
+
+    private:
+        HttpMethod _method;
+        CgiParams _params;
+        JsonValue _body;
+};
+
+/// @brief Response written by a route. It is sent with the status code and headers once the route returns.
+class WebResponse : public WebStream
+{
+    public:
+        WebResponse()
+        :   _status(200),
+            _json(_body, sizeof(_body)),
+            _retryAfter(0),
+            _headerLength(0),
+            _sent(0)
+        {
+        }
+
+        void SetStatus(uint16_t status) { _status = status; }
+        uint16_t GetStatus() { return _status; }
+
+        /// @brief Writer for the JSON body
+        JsonWriter &Json() { return _json; }
+
+        /// @brief Respond with an error status, and a JSON body with a message saying why
+        void Error(uint16_t status, const char *message);
+
+        /// @brief Respond with 429, telling the client when to try again
+        void Busy(uint32_t retryAfterMs);
+
+        virtual int Read(char *buffer, int count);
+
+        // Always sent with a Content-Length
+        virtual bool IsPersistent() const { return true; }
+
+    private:
+        uint16_t _status;
+        char _body[WEB_RESPONSE_SIZE];
+        JsonWriter _json;
+        uint32_t _retryAfter;       // Seconds, or 0 for none
+        char _header[160];
+        uint16_t _headerLength;
+        uint32_t _sent;
+};
+
+typedef std::function<void(const WebRequest &request, WebResponse &response)> RouteFunc;
+
 
 /// @brief Rather bizarre and very stunted web-server
 /// @remarks This isn't how a sane person would handle web requests in a microcontroller
@@ -38,7 +170,58 @@ class WebServer
         void AddResponseHandler(std::string tag, SsiSubscribeFunc &&callback);
         void RemoveResponseHandler(std::string tag);
 
+        void AddStreamHandler(std::string url, StreamOpenFunc &&callback);
+        void RemoveStreamHandler(std::string url);
+
+        /// @brief Start a stream for a url, if it has a handler
+        /// @return The stream, or null to look for a file instead
+        WebStream *OpenStream(const char *url);
+        static int ReadStream(WebStream *stream, char *buffer, int count, void (*wakeCallback)(void *), void *wakeArg);
+
+        /// @brief Handle a url with a route, instead of CGI and a template file
+        /// @param methods HttpGet and/or HttpPost. POST requests take a JSON body.
+        /// @remarks A route that doesn't write a body answers true.
+        void AddRoute(std::string url, uint8_t methods, RouteFunc &&callback);
+        void RemoveRoute(std::string url);
+
+        // Called by httpd as POST requests arrive
+        bool BeginPost(void *connection, const char *uri, int contentLength, char *responseUri, uint16_t responseUriLength);
+        void ReceivePost(void *connection, struct pbuf *p);
+        void FinishPost(void *connection, char *responseUri, uint16_t responseUriLength);
+
+        /// @brief Metrics for a file as httpd opens it
+        /// @return The entry to record the request in, or null if it isn't a request
+        WebMetrics::Entry *GetFileMetrics(const char *name);
+
     private:
+        struct Route
+        {
+            uint8_t methods;
+            RouteFunc handler;
+            WebMetrics::Entry *metrics;
+        };
+
+        // POST body being received
+        struct PendingPost
+        {
+            void *connection;       // Null if free
+            const Route *route;
+            uint32_t length;
+            uint32_t received;
+            char body[WEB_POST_BODY_SIZE];
+        };
+
+        class RouteCall;
+        class NotModified;
+        class InflatedFile;
+
+        /// @brief Answer a request for a file from its headers and the request's, if it doesn't need sending
+        /// @return A response, or null to send the file
+        WebStream *CheckFileRequest(const char *url);
+
+        void CallRoute(const Route &route, const WebRequest &request, WebResponse &response);
+        /// @brief Have httpd serve a response for a POST, instead of a file
+        void SetPostResponse(WebResponse *response, char *responseUri, uint16_t responseUriLength);
 
         static uint16_t HandleResponseEntry(const char *tag, char *pcInsert, int iInsertLen, uint16_t tagPart, uint16_t *nextPart, void *connectionState);
         uint16_t HandleResponse(const char *tag, char *pcInsert, int iInsertLen, uint16_t tagPart, uint16_t *nextPart, bool cgiResult);
@@ -47,8 +230,15 @@ class WebServer
         std::shared_ptr<IWifiConnection> _wifiConnection;
         StatusLed *_statusLed;
 
-        std::map<std::string, CgiSubscribeFunc> _requestSubscriptions;
+        std::map<std::string, CgiSubscribeFunc, std::less<>> _requestSubscriptions;
         std::map<std::string, SsiSubscribeFunc> _responseSubscriptions;
+        std::map<std::string, StreamOpenFunc, std::less<>> _streamSubscriptions;     // Looked up by const char *, without a copy
+        std::map<std::string, Route, std::less<>> _routes;
+
+        WebMetrics _metrics;
+        PendingPost _posts[WEB_MAX_POSTS];
+        WebResponse *_postResponse;     // Waiting for httpd to open it
+        bool _checkingFile;             // Opening a file for CheckFileRequest
 
 };
 
@@ -113,3 +303,60 @@ class SsiSubscription
 
 };
 
+/// @brief Subscription to open a stream when a url is requested, in place of a file
+class StreamSubscription
+{
+    public:
+        StreamSubscription(std::shared_ptr<WebServer> webInterface, std::string url, StreamOpenFunc &&callback)
+        :   _webInterface(webInterface),
+             _url(std::move(url))
+        {
+            _webInterface->AddStreamHandler(_url, std::forward<StreamOpenFunc>(callback));
+        }
+
+        StreamSubscription(StreamSubscription &&other)
+        :   _webInterface(std::move(other._webInterface)),
+            _url(std::move(other._url))
+        {
+        }
+
+        ~StreamSubscription()
+        {
+            if(_webInterface)
+                _webInterface->RemoveStreamHandler(_url);
+        }
+
+    private:
+        StreamSubscription(const StreamSubscription &) = delete;
+        std::shared_ptr<WebServer> _webInterface;
+        std::string _url;
+};
+
+/// @brief Subscription to handle a url with a route
+class RouteSubscription
+{
+    public:
+        RouteSubscription(std::shared_ptr<WebServer> webInterface, std::string url, uint8_t methods, RouteFunc &&callback)
+        :   _webInterface(webInterface),
+             _url(std::move(url))
+        {
+            _webInterface->AddRoute(_url, methods, std::forward<RouteFunc>(callback));
+        }
+
+        RouteSubscription(RouteSubscription &&other)
+        :   _webInterface(std::move(other._webInterface)),
+            _url(std::move(other._url))
+        {
+        }
+
+        ~RouteSubscription()
+        {
+            if(_webInterface)
+                _webInterface->RemoveRoute(_url);
+        }
+
+    private:
+        RouteSubscription(const RouteSubscription &) = delete;
+        std::shared_ptr<WebServer> _webInterface;
+        std::string _url;
+};
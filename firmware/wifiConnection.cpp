@@ -92,8 +92,12 @@ uint32_t WifiConnection::WifiWatchdog()
     else if(state == CYW43_LINK_UP)
     {
         if(!_wasConnected)
+        {
             _statusLed->Pulse(0, 1024, 128);
-        _wasConnected = true;
+            _wasConnected = true;
+            if(_linkUpHandler)
+                _linkUpHandler();
+        }
         DBG_PRINT_NA(".");
         return 60000;
     }
@@ -102,7 +106,8 @@ uint32_t WifiConnection::WifiWatchdog()
         _wasConnected = false;
         _statusLed->Pulse(0, 2048, 512);
         DBG_PRINT("Wifi: No IP assigned (%d)\n", state);
-        return 10000;
+        // Check again soon, so we notice as soon as the link is up
+        return 1000;
     }
 }
 
@@ -21,6 +21,7 @@ class WifiConnection : public IWifiConnection
 
         virtual bool IsConnected();
         virtual bool IsAccessPointMode() { return _apMode; }
+        virtual void SetLinkUpHandler(std::function<void()> &&handler) { _linkUpHandler = std::move(handler); }
 
     private:    
         uint32_t WifiWatchdog();
@@ -30,6 +31,7 @@ class WifiConnection : public IWifiConnection
         StatusLed *_statusLed;
         bool _apMode;
         bool _wasConnected;
+        std::function<void()> _linkUpHandler;
         // For AP mode        
         dhcp_server_t _dhcp_server;
         dns_server_t _dns_server;
@@ -2,11 +2,12 @@ import { Accordion, Button } from "react-bootstrap";
 import { BlindForm, BlindValues } from "./BlindForm";
 import { useState } from "react";
 import { useToaster } from "./toaster";
+import { callBlindApi } from "./blindApi";
 
 
 export function AddBlind(props: { onSaved: () => void } ) : JSX.Element {
 
-    const [values, setValues] = useState<BlindValues>({ name: "", openTime: 20, closeTime: 30});
+    const [values, setValues] = useState<BlindValues>({ name: "", group: "", openTime: 20, closeTime: 30});
     const toaster = useToaster();
     const [addIndex, setAddIndex] = useState(1);
 
@@ -17,14 +18,13 @@ export function AddBlind(props: { onSaved: () => void } ) : JSX.Element {
             return;
         }
 
-        const params = new URLSearchParams();
-        params.set("name", values.name);
-        params.set("openTime", values.openTime.toString());
-        params.set("closeTime", values.closeTime.toString());
-        let response = await fetch("/api/blinds/add.json?" + params.toString());
-
-        let body: boolean =  await response.json();
-        if(!body)
+        const added = await callBlindApi("add", {
+            name: values.name,
+            group: values.group,
+            openTime: values.openTime,
+            closeTime: values.closeTime
+        });
+        if(!added)
         {
             toaster.open("Unable to add blind", "For some reason, the blind could not be added.");
         }
@@ -10,6 +10,7 @@ import {useToaster} from './toaster';
 import './Blind.css';
 import { BlindForm, BlindValues } from './BlindForm';
 import { SomfyButton, pressButtons } from './remoteApi';
+import { callBlindApi } from './blindApi';
 
 let dragTimeout : number | undefined;
 export function Blind(props: {config: BlindConfig, remote: RemoteConfig, onSaved: () => void }) {
@@ -24,13 +25,8 @@ export function Blind(props: {config: BlindConfig, remote: RemoteConfig, onSaved
         if(dragTimeout)
             window.clearTimeout(dragTimeout);
         dragTimeout = window.setTimeout(async () => {
-            const params = new URLSearchParams();
-            params.set("id", props.config.id.toString());
-            params.set("command", "pos");
-            params.set("payload", pos.toString());
-            let response = await fetch("/api/blinds/command.json?" + params.toString());
-            let body: boolean =  await response.json();
-            if(!body)
+            const accepted = await callBlindApi("command", { id: props.config.id, command: "pos", payload: pos });
+            if(!accepted)
                 toaster.open("Command Rejected", "Something went wrong with the command");
             else
                 props.onSaved();
@@ -39,13 +35,8 @@ export function Blind(props: {config: BlindConfig, remote: RemoteConfig, onSaved
 
     async function sendBlindCommand(cmd: string)
     {
-        const params = new URLSearchParams();
-        params.set("id", props.config.id.toString());
-        params.set("command", "cmd");
-        params.set("payload", cmd);
-        let response = await fetch("/api/blinds/command.json?" + params.toString());
-        let body: boolean =  await response.json();
-        if(!body)
+        const accepted = await callBlindApi("command", { id: props.config.id, command: "cmd", payload: cmd });
+        if(!accepted)
             toaster.open("Command Rejected", "Something went wrong with the command");
         else
             props.onSaved();
@@ -70,15 +61,14 @@ export function Blind(props: {config: BlindConfig, remote: RemoteConfig, onSaved
     const handleEditCancel = () => setEdit(false);
     const handleSave = async () => {
 
-        const params = new URLSearchParams();
-        params.set("id", props.config.id.toString());
-        params.set("name", newValues!.name);
-        params.set("openTime", newValues!.openTime.toString());
-        params.set("closeTime", newValues!.closeTime.toString());
-        let response = await fetch("/api/blinds/update.json?" + params.toString());
-
-        let body: boolean =  await response.json();
-        if(!body)
+        const saved = await callBlindApi("update", {
+            id: props.config.id,
+            name: newValues!.name,
+            group: newValues!.group,
+            openTime: newValues!.openTime,
+            closeTime: newValues!.closeTime
+        });
+        if(!saved)
             toaster.open("Save Failed", "For some reason, the controller didn't save the changes.");
         else
             props.onSaved();
@@ -100,12 +90,8 @@ export function Blind(props: {config: BlindConfig, remote: RemoteConfig, onSaved
         if(!dereg)
             toaster.open("Remote not deregistered", "We tried to de-register the remote with the blind, but the commands weren't accepted. Deleting the blind anyway...")
 
-        const params = new URLSearchParams();
-        params.set("id", props.config.id.toString());
-        let response = await fetch("/api/blinds/delete.json?" + params.toString());
-
-        let body: boolean =  await response.json();
-        if(!body)
+        const deleted = await callBlindApi("delete", { id: props.config.id });
+        if(!deleted)
             toaster.open("Delete Failed", "For some reason, the controller didn't delete the blind.");
         else
             props.onSaved();
@@ -5,6 +5,7 @@ import { useState } from "react";
 
 export interface BlindValues {
     name: string;
+    group: string;
     openTime: number;
     closeTime: number;
   };
@@ -32,6 +33,18 @@ return (
                 Between 1 and 47 characters, and no quotation marks!
             </Form.Text>
         </Form.Group>
+        <Form.Group className="mb-3">
+            <Form.Label htmlFor="blindGroup">Group</Form.Label>
+            <Form.Control
+                type="text"
+                id="blindGroup"
+                aria-describedby="groupHelpBlock"
+                value={values.group}
+                onChange={e => doSetValues( { ...values, group: e.target.value })} />
+            <Form.Text id="groupHelpBlock" muted>
+                [Optional] Up to 23 characters. Blinds in the same group can be moved together on pico_somfy/groups/&lt;group&gt;/cmd.
+            </Form.Text>
+        </Form.Group>
         <Form.Group className="mb-3">
             <Form.Label htmlFor="openTime">Open time</Form.Label>
             <Form.Control type="int" id="openTime" aria-describedby="openTimeHelpBlock" 
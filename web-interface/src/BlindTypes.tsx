@@ -2,6 +2,7 @@
 export interface BlindConfig {
     id: number;
     name: string;
+    group: string;
     position: number;
     openTime: number;
     closeTime: number;
@@ -17,6 +17,7 @@ export function ControlPage(): JSX.Element {
     const [reload, setReload] = useState(0);
     const [blinds, setBlinds] = useState<BlindConfig[]>([]);
     const [remotes, setRemotes] = useState<RemoteConfig[]>([]);
+    const [live, setLive] = useState(false);
 
     const toaster = useToaster();
 
@@ -34,7 +35,8 @@ export function ControlPage(): JSX.Element {
                     setRemotes(response);
                     setBlinds(blindResponse);
 
-                    if (blindResponse.findIndex(b => b.state !== "stopped") !== -1) {
+                    // Without the event stream, keep polling while anything moves
+                    if (!live && blindResponse.findIndex(b => b.state !== "stopped") !== -1) {
                         timeout = setTimeout(() => setReload(reload+1), 1000);
                     }
                 }
@@ -53,7 +55,23 @@ export function ControlPage(): JSX.Element {
             cancelled = true;
             clearTimeout(timeout);
         };
-    }, [reload, toaster]);
+    }, [reload, live, toaster]);
+
+    // Blind changes pushed by the device as they happen
+    useEffect(() => {
+        const events = new EventSource("/api/events");
+
+        events.onopen = () => setLive(true);
+        events.onerror = () => setLive(false);
+        events.addEventListener("blind", (e: MessageEvent) => {
+            const update: { id: number, position: number, state: string } = JSON.parse(e.data);
+            setBlinds(current => current.map(b => b.id === update.id ? { ...b, position: update.position, state: update.state } : b));
+        });
+        // Sent if we fell behind and missed some changes
+        events.addEventListener("resync", () => setReload(r => r + 1));
+
+        return () => events.close();
+    }, []);
 
 
     // Blinds and their associated remotes
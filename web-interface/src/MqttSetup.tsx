@@ -8,7 +8,9 @@ interface MqttCfg {
   port: number,
   username: string,
   password: string,
-  topic: string
+  topic: string,
+  jsonState: boolean,
+  failover: string
 };
 
 export function MqttSetup() : JSX.Element {
@@ -44,9 +46,15 @@ export function MqttSetup() : JSX.Element {
 
     if(!mqttCfg)
       return;
-    if(!mqttCfg.address.match(/^(?:[0-9]{1,3}\.){3}[0-9]{1,3}$/))
+    if(!mqttCfg.address.match(/^[A-Za-z0-9]([A-Za-z0-9.-]{0,61}[A-Za-z0-9])?$/))
     {
-      toaster.open('IP address invalid', 'You need to enter the broker in IPv4 dotted format.');
+      toaster.open('Broker address invalid', 'You need to enter the broker as a host name, or an IPv4 address in dotted format.');
+      return;
+    }
+    const failover = (mqttCfg.failover ?? "").split(",").map(f => f.trim()).filter(f => f.length > 0);
+    if(failover.length > 2 || !failover.every(f => f.match(/^[A-Za-z0-9]([A-Za-z0-9.-]{0,61}[A-Za-z0-9])?(:[0-9]{1,5})?$/)))
+    {
+      toaster.open('Failover brokers invalid', 'You can enter up to two failover brokers, separated by commas, as a host name or IPv4 address with an optional port.');
       return;
     }
     if(mqttCfg.port < 1 || mqttCfg.port > 65535)
@@ -64,6 +72,8 @@ export function MqttSetup() : JSX.Element {
     params.set("username", mqttCfg.username);
     params.set("password", mqttCfg.password);
     params.set("topic", mqttCfg.topic);
+    params.set("json", mqttCfg.jsonState ? "true" : "false");
+    params.set("failover", failover.join(","));
     let response = await fetch("/api/configure.json?" + params.toString());
     let body: boolean =  await response.json();
     setLoading(false);
@@ -83,7 +93,7 @@ export function MqttSetup() : JSX.Element {
         <form method="get" className="mt-3"  >
           <fieldset disabled={loading}>
             <div className="mb-3">
-              <label htmlFor="mqttBroker" className="form-label">MQTT Broker IP Address and Port number</label>
+              <label htmlFor="mqttBroker" className="form-label">MQTT Broker Address and Port number</label>
               <div className="row">
                 <div className="col-9">
                   <input id="mqttAddress" type="input" className="form-control col-9" aria-describedby="mqttUserHelp" value={mqttCfg?.address} onChange={e => { setMqttCfg( { ...mqttCfg!, address: e.target.value }); }} />
@@ -93,7 +103,15 @@ export function MqttSetup() : JSX.Element {
                 </div>
               </div>
               <span id="mqttAddress" className="form-text">
-                Enter the IP Address and port number of the MQTT Broker to connect to. Host Names are not supported!
+                Enter the host name or IP Address, and port number of the MQTT Broker to connect to.
+              </span>
+            </div>
+
+            <div className="mb-3">
+              <label htmlFor="mqttFailover" className="form-label">Failover Brokers</label>
+              <input id="mqttFailover" type="input" className="form-control" aria-describedby="mqttFailoverHelp" value={mqttCfg?.failover} onChange={e => { setMqttCfg( { ...mqttCfg!, failover: e.target.value }); }} />
+              <span id="mqttFailoverHelp" className="form-text">
+                [Optional] Up to two more brokers to try, in order, when the main broker can't be reached. Separate them with commas, and add :port if it differs from the main broker. They use the same user and password.
               </span>
             </div>
 
@@ -121,6 +139,14 @@ export function MqttSetup() : JSX.Element {
               </span>
             </div>
 
+            <div className="mb-3 form-check">
+              <input id="mqttJson" type="checkbox" className="form-check-input" aria-describedby="mqttJsonHelp" checked={mqttCfg?.jsonState ?? false} onChange={e => { setMqttCfg( { ...mqttCfg!, jsonState: e.target.checked }); }} />
+              <label htmlFor="mqttJson" className="form-check-label">Publish blind state as JSON</label>
+              <div id="mqttJsonHelp" className="form-text">
+                [Optional] Publish each blind's position, target, direction, last command source and remote signal strength as one message on pico_somfy/blinds/&lt;id&gt;/json, instead of the separate position and state topics.
+              </div>
+            </div>
+
             <div className="mb-3">
               <button type="submit" className="btn btn-primary" onClick={doSave}>Save and Reboot</button>
               <Spinner loading={loading} />
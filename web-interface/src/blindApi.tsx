@@ -0,0 +1,16 @@
+
+/// Call one of the blind APIs, with its parameters as a JSON body
+/// Returns true if the device accepted it
+export async function callBlindApi(action: string, body: object) {
+    try {
+        const response = await fetch("/api/blinds/" + action + ".json", {
+            method: "POST",
+            headers: { "Content-Type": "application/json" },
+            body: JSON.stringify(body)
+        });
+        return response.ok;
+    }
+    catch {
+        return false;
+    }
+}